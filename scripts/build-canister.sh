@@ -82,6 +82,14 @@ if [ ! -f "$REFC_SRC/runtime.c" ]; then
     done
 fi
 
+# Bignum backend: mini-gmp (default) or fast (support/bignum/fast)
+BIGNUM="${BIGNUM:-mini-gmp}"
+case "$BIGNUM" in
+    mini-gmp) BIGNUM_FLAGS="" ;;
+    fast) BIGNUM_FLAGS="$PROJECT_DIR/support/bignum/fast/fastbn.c -I$PROJECT_DIR/support/bignum/fast" ;;
+    *) echo "Unknown BIGNUM backend: $BIGNUM (expected mini-gmp or fast)"; exit 1 ;;
+esac
+
 # Minimal RefC files for canister (no file I/O to avoid WASI)
 REFC_C_FILES="$REFC_SRC/runtime.c $REFC_SRC/memoryManagement.c $REFC_SRC/stringOps.c $REFC_SRC/mathFunctions.c $REFC_SRC/casts.c $REFC_SRC/prim.c $REFC_SRC/refc_util.c"
 
@@ -91,7 +99,7 @@ echo ">>> Step 3: Compile to standalone WASM (Emscripten)"
 # STANDALONE_WASM produces a .wasm file that can run without JS glue
 # PURE_WASI=0 and FILESYSTEM=0 to avoid WASI imports that IC doesn't support
 # First build to JS/WASM bundle (avoids WASI completely)
-emcc "$C_FILE" $REFC_C_FILES "$MINI_GMP/mini-gmp.c" "$IC0_SUPPORT/canister_entry.c" \
+emcc "$C_FILE" $REFC_C_FILES "$MINI_GMP/mini-gmp.c" $BIGNUM_FLAGS "$IC0_SUPPORT/canister_entry.c" \
     -I"$REFC_SUPPORT" \
     -I"$C_SUPPORT" \
     -I"$MINI_GMP" \
@@ -75,9 +75,17 @@ if [ ! -f "$REFC_SRC/runtime.c" ]; then
     done
 fi
 
+# Bignum backend: mini-gmp (default) or fast (support/bignum/fast)
+BIGNUM="${BIGNUM:-mini-gmp}"
+case "$BIGNUM" in
+    mini-gmp) BIGNUM_FLAGS="" ;;
+    fast) BIGNUM_FLAGS="$PROJECT_DIR/support/bignum/fast/fastbn.c -I$PROJECT_DIR/support/bignum/fast" ;;
+    *) echo "Unknown BIGNUM backend: $BIGNUM (expected mini-gmp or fast)"; exit 1 ;;
+esac
+
 REFC_C_FILES="$REFC_SRC/runtime.c $REFC_SRC/memoryManagement.c $REFC_SRC/stringOps.c $REFC_SRC/mathFunctions.c $REFC_SRC/casts.c $REFC_SRC/prim.c $REFC_SRC/idris_support.c $REFC_SRC/idris_file.c $REFC_SRC/refc_util.c $REFC_SRC/idris_util.c"
 
-emcc "$C_FILE" $REFC_C_FILES "$MINI_GMP/mini-gmp.c" \
+emcc "$C_FILE" $REFC_C_FILES "$MINI_GMP/mini-gmp.c" $BIGNUM_FLAGS \
     -I"$REFC_SUPPORT" \
     -I"$C_SUPPORT" \
     -I"$MINI_GMP" \
@@ -0,0 +1,476 @@
+/*
+ * fastbn - arithmetic for the "fast" bignum backend (see fastbn.h)
+ *
+ * mini-gmp multiplies limbs through half-limb products and allocates a
+ * temporary for every aliased operand. Here a limb product is a single
+ * double-width multiply (i64.mul on wasm32), operands up to
+ * FASTBN_FIXED_BITS are handled in stack buffers, and long products switch
+ * to Karatsuba. Results are written through the public mpz_limbs_* API, so
+ * values stay ordinary mini-gmp mpz_t's.
+ */
+#include "fastbn.h"
+
+#include <limits.h>
+#include <stdint.h>
+#include <string.h>
+
+#if ULONG_MAX == 0xffffffffUL
+typedef uint64_t dlimb;
+#define LIMB_BITS 32
+#elif defined(__SIZEOF_INT128__)
+typedef unsigned __int128 dlimb;
+#define LIMB_BITS 64
+#else
+#error "fastbn: no double-width type for mp_limb_t"
+#endif
+
+_Static_assert(sizeof(mp_limb_t) * CHAR_BIT == LIMB_BITS,
+               "fastbn: mp_limb_t is expected to be unsigned long");
+
+#define FIXED_LIMBS (FASTBN_FIXED_BITS / LIMB_BITS)
+
+/* Scratch space beyond the fixed-size buffers comes from the same allocator
+ * as mini-gmp's limbs (which dies on allocation failure). */
+static mp_limb_t *scratchAlloc(size_t limbs) {
+  void *(*alloc)(size_t);
+  mp_get_memory_functions(&alloc, NULL, NULL);
+  return alloc(limbs * sizeof(mp_limb_t));
+}
+
+static void scratchFree(mp_limb_t *p, size_t limbs) {
+  void (*release)(void *, size_t);
+  mp_get_memory_functions(NULL, NULL, &release);
+  release(p, limbs * sizeof(mp_limb_t));
+}
+
+/* ---------------------------------------------------------------------------
+ * Limb vectors
+ *
+ * Results may alias an operand when both start at the same limb.
+ * ------------------------------------------------------------------------- */
+
+static mp_size_t normalized(const mp_limb_t *a, mp_size_t n) {
+  while (n > 0 && a[n - 1] == 0)
+    n--;
+  return n;
+}
+
+static int cmpN(const mp_limb_t *a, const mp_limb_t *b, mp_size_t n) {
+  while (n-- > 0)
+    if (a[n] != b[n])
+      return a[n] > b[n] ? 1 : -1;
+  return 0;
+}
+
+// r = a + b over n limbs, returns the carry
+static mp_limb_t addN(mp_limb_t *r, const mp_limb_t *a, const mp_limb_t *b,
+                      mp_size_t n) {
+  mp_limb_t c = 0;
+  for (mp_size_t i = 0; i < n; i++) {
+    mp_limb_t s = a[i] + c;
+    c = s < c;
+    mp_limb_t t = s + b[i];
+    c += t < s;
+    r[i] = t;
+  }
+  return c;
+}
+
+// r = a + b with an >= bn, returns the carry
+static mp_limb_t addMN(mp_limb_t *r, const mp_limb_t *a, mp_size_t an,
+                       const mp_limb_t *b, mp_size_t bn) {
+  mp_limb_t c = addN(r, a, b, bn);
+  for (mp_size_t i = bn; i < an; i++) {
+    mp_limb_t t = a[i] + c;
+    c = t < c;
+    r[i] = t;
+  }
+  return c;
+}
+
+// r = a - b with an >= bn and a >= b
+static void subMN(mp_limb_t *r, const mp_limb_t *a, mp_size_t an,
+                  const mp_limb_t *b, mp_size_t bn) {
+  mp_limb_t borrow = 0;
+  for (mp_size_t i = 0; i < bn; i++) {
+    mp_limb_t t = a[i] - b[i];
+    mp_limb_t b1 = a[i] < b[i];
+    r[i] = t - borrow;
+    borrow = b1 | (t < borrow);
+  }
+  for (mp_size_t i = bn; i < an; i++) {
+    mp_limb_t t = a[i];
+    r[i] = t - borrow;
+    borrow = t < borrow;
+  }
+}
+
+// r = a * b over n limbs, returns the high limb
+static mp_limb_t mul1(mp_limb_t *r, const mp_limb_t *a, mp_size_t n,
+                      mp_limb_t b) {
+  mp_limb_t c = 0;
+  for (mp_size_t i = 0; i < n; i++) {
+    dlimb p = (dlimb)a[i] * b + c;
+    r[i] = (mp_limb_t)p;
+    c = (mp_limb_t)(p >> LIMB_BITS);
+  }
+  return c;
+}
+
+// r += a * b over n limbs, returns the high limb
+static mp_limb_t addmul1(mp_limb_t *r, const mp_limb_t *a, mp_size_t n,
+                         mp_limb_t b) {
+  mp_limb_t c = 0;
+  for (mp_size_t i = 0; i < n; i++) {
+    dlimb p = (dlimb)a[i] * b + r[i] + c;
+    r[i] = (mp_limb_t)p;
+    c = (mp_limb_t)(p >> LIMB_BITS);
+  }
+  return c;
+}
+
+// r[0 .. an+bn) = a * b; r must not overlap a or b
+static void mulBasecase(mp_limb_t *r, const mp_limb_t *a, mp_size_t an,
+                        const mp_limb_t *b, mp_size_t bn) {
+  r[an] = mul1(r, a, an, b[0]);
+  for (mp_size_t j = 1; j < bn; j++)
+    r[an + j] = addmul1(r + j, a, an, b[j]);
+}
+
+/* ---------------------------------------------------------------------------
+ * Karatsuba
+ *
+ * With h = ceil(n/2), a = a1*B^h + a0 and b = b1*B^h + b0:
+ *   a*b = z2*B^2h + ((a0+a1)(b0+b1) - z0 - z2)*B^h + z0
+ * The half sums keep their carry limb, so the middle product is
+ * (h+1) x (h+1).
+ * ------------------------------------------------------------------------- */
+
+static size_t karatsubaScratch(mp_size_t n) {
+  if (n < FASTBN_KARATSUBA_LIMBS)
+    return 0;
+  mp_size_t h = (n + 1) / 2;
+  return 4 * (size_t)(h + 1) + karatsubaScratch(h + 1);
+}
+
+// r[0 .. 2n) = a * b for two n-limb operands
+static void karatsuba(mp_limb_t *r, const mp_limb_t *a, const mp_limb_t *b,
+                      mp_size_t n, mp_limb_t *tmp) {
+  if (n < FASTBN_KARATSUBA_LIMBS) {
+    mulBasecase(r, a, n, b, n);
+    return;
+  }
+  mp_size_t h = (n + 1) / 2;
+  mp_size_t l = n - h;
+  mp_limb_t *sa = tmp;
+  mp_limb_t *sb = sa + (h + 1);
+  mp_limb_t *z1 = sb + (h + 1);
+  mp_limb_t *next = z1 + 2 * (h + 1);
+
+  sa[h] = addMN(sa, a, h, a + h, l);
+  sb[h] = addMN(sb, b, h, b + h, l);
+  karatsuba(z1, sa, sb, h + 1, next);
+  karatsuba(r, a, b, h, next);                 // z0
+  karatsuba(r + 2 * h, a + h, b + h, l, next); // z2
+
+  subMN(z1, z1, 2 * (h + 1), r, 2 * h);
+  subMN(z1, z1, 2 * (h + 1), r + 2 * h, 2 * l);
+  // z1 = a0*b1 + a1*b0 < B^(h+l+1), which fits above B^h
+  mp_size_t zn = normalized(z1, 2 * (h + 1));
+  addMN(r + h, r + h, 2 * n - h, z1, zn);
+}
+
+// r[0 .. an+bn) = a * b with an >= bn >= 1; r must not overlap a or b
+static void mulAny(mp_limb_t *r, const mp_limb_t *a, mp_size_t an,
+                   const mp_limb_t *b, mp_size_t bn) {
+  if (bn < FASTBN_KARATSUBA_LIMBS) {
+    mulBasecase(r, a, an, b, bn);
+    return;
+  }
+  size_t scratch = karatsubaScratch(bn);
+  if (an == bn) {
+    mp_limb_t *tmp = scratchAlloc(scratch);
+    karatsuba(r, a, b, bn, tmp);
+    scratchFree(tmp, scratch);
+    return;
+  }
+  // Unbalanced: multiply b by bn-limb slices of a and accumulate
+  mp_limb_t *tmp = scratchAlloc(scratch + 2 * (size_t)bn);
+  mp_limb_t *prod = tmp + scratch;
+  memset(r, 0, (size_t)(an + bn) * sizeof(mp_limb_t));
+  for (mp_size_t i = 0; i < an; i += bn) {
+    mp_size_t c = an - i < bn ? an - i : bn;
+    if (c == bn)
+      karatsuba(prod, a + i, b, bn, tmp);
+    else
+      mulAny(prod, b, bn, a + i, c);
+    addMN(r + i, r + i, an + bn - i, prod, c + bn);
+  }
+  scratchFree(tmp, scratch + 2 * (size_t)bn);
+}
+
+/* ---------------------------------------------------------------------------
+ * Division (Knuth, TAOCP vol. 2, 4.3.1, algorithm D)
+ * ------------------------------------------------------------------------- */
+
+// q[0 .. nn-dn] = n / d and r[0 .. dn) = n % d, for nn >= dn >= 1,
+// nn <= 2 * FIXED_LIMBS, dn <= FIXED_LIMBS and d[dn-1] != 0
+static void divremN(mp_limb_t *q, mp_limb_t *r, const mp_limb_t *n,
+                    mp_size_t nn, const mp_limb_t *d, mp_size_t dn) {
+  if (dn == 1) {
+    dlimb rem = 0;
+    for (mp_size_t i = nn; i-- > 0;) {
+      dlimb cur = (rem << LIMB_BITS) | n[i];
+      q[i] = (mp_limb_t)(cur / d[0]);
+      rem = cur % d[0];
+    }
+    r[0] = (mp_limb_t)rem;
+    return;
+  }
+
+  // Normalize so the divisor's top bit is set
+  mp_limb_t un[2 * FIXED_LIMBS + 1], vn[FIXED_LIMBS];
+  int s = __builtin_clzl(d[dn - 1]);
+  if (s == 0) {
+    memcpy(vn, d, (size_t)dn * sizeof(mp_limb_t));
+    memcpy(un, n, (size_t)nn * sizeof(mp_limb_t));
+    un[nn] = 0;
+  } else {
+    for (mp_size_t i = dn - 1; i > 0; i--)
+      vn[i] = (d[i] << s) | (d[i - 1] >> (LIMB_BITS - s));
+    vn[0] = d[0] << s;
+    un[nn] = n[nn - 1] >> (LIMB_BITS - s);
+    for (mp_size_t i = nn - 1; i > 0; i--)
+      un[i] = (n[i] << s) | (n[i - 1] >> (LIMB_BITS - s));
+    un[0] = n[0] << s;
+  }
+
+  const dlimb base = (dlimb)1 << LIMB_BITS;
+  for (mp_size_t j = nn - dn; j >= 0; j--) {
+    // Estimate the quotient digit from the top two limbs, then correct it
+    dlimb num = ((dlimb)un[j + dn] << LIMB_BITS) | un[j + dn - 1];
+    dlimb qhat = num / vn[dn - 1];
+    dlimb rhat = num % vn[dn - 1];
+    while (qhat >= base ||
+           qhat * vn[dn - 2] > ((rhat << LIMB_BITS) | un[j + dn - 2])) {
+      qhat--;
+      rhat += vn[dn - 1];
+      if (rhat >= base)
+        break;
+    }
+
+    // un[j .. j+dn] -= qhat * vn
+    mp_limb_t carry = 0, borrow = 0;
+    for (mp_size_t i = 0; i < dn; i++) {
+      dlimb p = qhat * vn[i] + carry;
+      carry = (mp_limb_t)(p >> LIMB_BITS);
+      mp_limb_t lo = (mp_limb_t)p;
+      mp_limb_t t = un[i + j] - lo;
+      mp_limb_t b1 = un[i + j] < lo;
+      un[i + j] = t - borrow;
+      borrow = b1 | (t < borrow);
+    }
+    mp_limb_t t = un[j + dn] - carry;
+    mp_limb_t b1 = un[j + dn] < carry;
+    un[j + dn] = t - borrow;
+    borrow = b1 | (t < borrow);
+
+    if (borrow) {
+      // qhat was one too large: add the divisor back
+      qhat--;
+      un[j + dn] += addN(un + j, un + j, vn, dn);
+    }
+    q[j] = (mp_limb_t)qhat;
+  }
+
+  if (s == 0) {
+    memcpy(r, un, (size_t)dn * sizeof(mp_limb_t));
+  } else {
+    for (mp_size_t i = 0; i < dn; i++)
+      r[i] = (un[i] >> s) | (un[i + 1] << (LIMB_BITS - s));
+  }
+}
+
+enum { DIV_TRUNC, DIV_FLOOR, DIV_EUCLID };
+
+// Writes the quotient / remainder of n by d to q / r (either may be NULL)
+// rounded per mode. Returns 0, touching nothing, when d is zero or the
+// operands are larger than the fixed-size buffers; the caller then uses
+// mini-gmp. DIV_EUCLID only defines the (non-negative) remainder.
+static int divFixed(mpz_ptr q, mpz_ptr r, mpz_srcptr n, mpz_srcptr d,
+                    int mode) {
+  mp_size_t nn = (mp_size_t)mpz_size(n), dn = (mp_size_t)mpz_size(d);
+  if (dn == 0 || dn > FIXED_LIMBS || nn > 2 * FIXED_LIMBS)
+    return 0;
+  int nneg = mpz_sgn(n) < 0, dneg = mpz_sgn(d) < 0;
+
+  mp_limb_t qp[2 * FIXED_LIMBS + 1], rp[FIXED_LIMBS], dp[FIXED_LIMBS];
+  mp_size_t qn, rn;
+  memcpy(dp, mpz_limbs_read(d), (size_t)dn * sizeof(mp_limb_t));
+  if (nn < dn) {
+    qn = 0;
+    rn = nn;
+    if (nn > 0)
+      memcpy(rp, mpz_limbs_read(n), (size_t)nn * sizeof(mp_limb_t));
+  } else {
+    divremN(qp, rp, mpz_limbs_read(n), nn, dp, dn);
+    qn = normalized(qp, nn - dn + 1);
+    rn = normalized(rp, dn);
+  }
+
+  int qneg = nneg != dneg, rneg = nneg;
+  if (rn > 0 && ((mode == DIV_FLOOR && nneg != dneg) ||
+                 (mode == DIV_EUCLID && nneg))) {
+    // Round towards -inf (or make the remainder positive): r = |d| - r
+    subMN(rp, dp, dn, rp, rn);
+    rn = normalized(rp, dn);
+    rneg = mode == DIV_FLOOR ? dneg : 0;
+    if (mode == DIV_FLOOR) {
+      mp_limb_t one = 1;
+      qp[qn] = 0;
+      addMN(qp, qp, qn + 1, &one, 1);
+      qn = normalized(qp, qn + 1);
+    }
+  }
+
+  if (q) {
+    mp_limb_t *out = mpz_limbs_write(q, qn > 0 ? qn : 1);
+    memcpy(out, qp, (size_t)qn * sizeof(mp_limb_t));
+    mpz_limbs_finish(q, qneg ? -qn : qn);
+  }
+  if (r) {
+    mp_limb_t *out = mpz_limbs_write(r, rn > 0 ? rn : 1);
+    memcpy(out, rp, (size_t)rn * sizeof(mp_limb_t));
+    mpz_limbs_finish(r, rneg ? -rn : rn);
+  }
+  return 1;
+}
+
+/* ---------------------------------------------------------------------------
+ * mpz entry points
+ * ------------------------------------------------------------------------- */
+
+static void addSigned(mpz_ptr r, mpz_srcptr a, mpz_srcptr b, int negateB) {
+  int aneg = mpz_sgn(a) < 0, bneg = (mpz_sgn(b) < 0) != negateB;
+  mp_size_t an = (mp_size_t)mpz_size(a), bn = (mp_size_t)mpz_size(b);
+  // x is the operand with the larger magnitude
+  if (an < bn ||
+      (an == bn && cmpN(mpz_limbs_read(a), mpz_limbs_read(b), an) < 0)) {
+    mpz_srcptr ts = a;
+    a = b;
+    b = ts;
+    mp_size_t tn = an;
+    an = bn;
+    bn = tn;
+    int tneg = aneg;
+    aneg = bneg;
+    bneg = tneg;
+  }
+
+  // Growing r first keeps aliased operands valid (they move along with it)
+  mp_limb_t *rp = mpz_limbs_modify(r, an + 1);
+  const mp_limb_t *ap = mpz_limbs_read(a), *bp = mpz_limbs_read(b);
+  mp_size_t rn;
+  if (aneg == bneg) {
+    rp[an] = addMN(rp, ap, an, bp, bn);
+    rn = an + 1;
+  } else {
+    subMN(rp, ap, an, bp, bn);
+    rn = an;
+  }
+  mpz_limbs_finish(r, aneg ? -rn : rn);
+}
+
+void fastbn_mpz_add(mpz_t r, const mpz_t a, const mpz_t b) {
+  addSigned(r, a, b, 0);
+}
+
+void fastbn_mpz_sub(mpz_t r, const mpz_t a, const mpz_t b) {
+  addSigned(r, a, b, 1);
+}
+
+void fastbn_mpz_mul(mpz_t r, const mpz_t a, const mpz_t b) {
+  mp_size_t an = (mp_size_t)mpz_size(a), bn = (mp_size_t)mpz_size(b);
+  if (an == 0 || bn == 0) {
+    mpz_set_ui(r, 0);
+    return;
+  }
+  int neg = (mpz_sgn(a) < 0) != (mpz_sgn(b) < 0);
+  if (an < bn) {
+    mpz_srcptr t = a;
+    a = b;
+    b = t;
+    mp_size_t tn = an;
+    an = bn;
+    bn = tn;
+  }
+  mp_size_t rn = an + bn;
+  const mp_limb_t *ap = mpz_limbs_read(a), *bp = mpz_limbs_read(b);
+
+  if (r == a || r == b) {
+    mp_limb_t fixed[2 * FIXED_LIMBS];
+    mp_limb_t *tp = rn <= 2 * FIXED_LIMBS ? fixed : scratchAlloc((size_t)rn);
+    mulAny(tp, ap, an, bp, bn);
+    memcpy(mpz_limbs_write(r, rn), tp, (size_t)rn * sizeof(mp_limb_t));
+    if (tp != fixed)
+      scratchFree(tp, (size_t)rn);
+  } else {
+    mulAny(mpz_limbs_write(r, rn), ap, an, bp, bn);
+  }
+  mpz_limbs_finish(r, neg ? -rn : rn);
+}
+
+void fastbn_mpz_tdiv_qr(mpz_t q, mpz_t r, const mpz_t n, const mpz_t d) {
+  if (!divFixed(q, r, n, d, DIV_TRUNC))
+    mpz_tdiv_qr(q, r, n, d);
+}
+
+void fastbn_mpz_tdiv_q(mpz_t q, const mpz_t n, const mpz_t d) {
+  if (!divFixed(q, NULL, n, d, DIV_TRUNC))
+    mpz_tdiv_q(q, n, d);
+}
+
+void fastbn_mpz_tdiv_r(mpz_t r, const mpz_t n, const mpz_t d) {
+  if (!divFixed(NULL, r, n, d, DIV_TRUNC))
+    mpz_tdiv_r(r, n, d);
+}
+
+void fastbn_mpz_fdiv_qr(mpz_t q, mpz_t r, const mpz_t n, const mpz_t d) {
+  if (!divFixed(q, r, n, d, DIV_FLOOR))
+    mpz_fdiv_qr(q, r, n, d);
+}
+
+void fastbn_mpz_fdiv_q(mpz_t q, const mpz_t n, const mpz_t d) {
+  if (!divFixed(q, NULL, n, d, DIV_FLOOR))
+    mpz_fdiv_q(q, n, d);
+}
+
+void fastbn_mpz_fdiv_r(mpz_t r, const mpz_t n, const mpz_t d) {
+  if (!divFixed(NULL, r, n, d, DIV_FLOOR))
+    mpz_fdiv_r(r, n, d);
+}
+
+void fastbn_mpz_mod(mpz_t r, const mpz_t n, const mpz_t d) {
+  if (!divFixed(NULL, r, n, d, DIV_EUCLID))
+    mpz_mod(r, n, d);
+}
+
+void fastbn_mpz_divexact(mpz_t q, const mpz_t n, const mpz_t d) {
+  if (!divFixed(q, NULL, n, d, DIV_TRUNC))
+    mpz_divexact(q, n, d);
+}
+
+void fastbn_mpz_pow_ui(mpz_t r, const mpz_t b, unsigned long e) {
+  mpz_t acc, sq;
+  mpz_init_set_ui(acc, 1);
+  mpz_init_set(sq, b);
+  for (; e; e >>= 1) {
+    if (e & 1)
+      fastbn_mpz_mul(acc, acc, sq);
+    if (e > 1)
+      fastbn_mpz_mul(sq, sq, sq);
+  }
+  mpz_swap(r, acc);
+  mpz_clear(acc);
+  mpz_clear(sq);
+}
@@ -0,0 +1,38 @@
+/*
+ * fastbn - arithmetic for the "fast" bignum backend
+ *
+ * Drop-in replacements for the mpz entry points the RefC runtime spends its
+ * Integer time in. They run on mini-gmp's mpz_t (same struct, same memory
+ * functions) but use double-limb products, fixed-size stack buffers for
+ * operands up to FASTBN_FIXED_BITS and Karatsuba above
+ * FASTBN_KARATSUBA_LIMBS. Operands outside the tuned range fall through to
+ * mini-gmp. Selected with `idris2-wasm build --bignum=fast`, whose gmp.h
+ * maps mpz_add etc. onto these names.
+ */
+#ifndef FASTBN_H
+#define FASTBN_H
+
+#include "mini-gmp.h"
+
+// Operand size the fixed-limb paths are tuned for (Nat128/256 and cycles
+// amounts); division of larger operands is left to mini-gmp.
+#define FASTBN_FIXED_BITS 512
+// Multiplications of at least this many limbs per operand use Karatsuba.
+#define FASTBN_KARATSUBA_LIMBS 24
+
+void fastbn_mpz_add(mpz_t r, const mpz_t a, const mpz_t b);
+void fastbn_mpz_sub(mpz_t r, const mpz_t a, const mpz_t b);
+void fastbn_mpz_mul(mpz_t r, const mpz_t a, const mpz_t b);
+
+void fastbn_mpz_tdiv_qr(mpz_t q, mpz_t r, const mpz_t n, const mpz_t d);
+void fastbn_mpz_tdiv_q(mpz_t q, const mpz_t n, const mpz_t d);
+void fastbn_mpz_tdiv_r(mpz_t r, const mpz_t n, const mpz_t d);
+void fastbn_mpz_fdiv_qr(mpz_t q, mpz_t r, const mpz_t n, const mpz_t d);
+void fastbn_mpz_fdiv_q(mpz_t q, const mpz_t n, const mpz_t d);
+void fastbn_mpz_fdiv_r(mpz_t r, const mpz_t n, const mpz_t d);
+void fastbn_mpz_mod(mpz_t r, const mpz_t n, const mpz_t d);
+void fastbn_mpz_divexact(mpz_t q, const mpz_t n, const mpz_t d);
+
+void fastbn_mpz_pow_ui(mpz_t r, const mpz_t b, unsigned long e);
+
+#endif
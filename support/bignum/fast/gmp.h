@@ -0,0 +1,37 @@
+/*
+ * gmp.h for `idris2-wasm build --bignum=fast`
+ *
+ * Same wrapper as the default mini-gmp one (mpz_inits / mpz_clears), plus
+ * the arithmetic entry points routed to fastbn.c. This directory goes on the
+ * include path ahead of mini-gmp's, so the runtime picks it up unchanged.
+ */
+#ifndef GMP_WRAPPER_H
+#define GMP_WRAPPER_H
+#include "mini-gmp.h"
+#include <stdarg.h>
+static inline void mpz_inits(mpz_t x, ...) {
+    va_list ap; va_start(ap, x); mpz_init(x);
+    while ((x = va_arg(ap, mpz_ptr)) != NULL) mpz_init(x);
+    va_end(ap);
+}
+static inline void mpz_clears(mpz_t x, ...) {
+    va_list ap; va_start(ap, x); mpz_clear(x);
+    while ((x = va_arg(ap, mpz_ptr)) != NULL) mpz_clear(x);
+    va_end(ap);
+}
+
+#include "fastbn.h"
+
+#define mpz_add fastbn_mpz_add
+#define mpz_sub fastbn_mpz_sub
+#define mpz_mul fastbn_mpz_mul
+#define mpz_tdiv_qr fastbn_mpz_tdiv_qr
+#define mpz_tdiv_q fastbn_mpz_tdiv_q
+#define mpz_tdiv_r fastbn_mpz_tdiv_r
+#define mpz_fdiv_qr fastbn_mpz_fdiv_qr
+#define mpz_fdiv_q fastbn_mpz_fdiv_q
+#define mpz_fdiv_r fastbn_mpz_fdiv_r
+#define mpz_mod fastbn_mpz_mod
+#define mpz_divexact fastbn_mpz_divexact
+#define mpz_pow_ui fastbn_mpz_pow_ui
+#endif
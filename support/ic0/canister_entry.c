@@ -19,6 +19,12 @@ extern void ic0_msg_arg_data_copy(int32_t dst, int32_t offset, int32_t size);
 extern void ic0_debug_print(int32_t src, int32_t size);
 extern void ic0_trap(int32_t src, int32_t size);
 
+/* Stable memory page cache (ic_stable.c) */
+extern void ic_stable_flush(void);
+
+/* Stable KV store batch log recovery (ic_stkv.c) */
+extern int64_t stkv_recover(void);
+
 /* =============================================================================
  * Idris2 RefC Runtime Interface
  * ============================================================================= */
@@ -70,18 +76,24 @@ __attribute__((export_name("canister_init")))
 void canister_init(void) {
     debug_log("Idris2 canister: init");
     ensure_idris2_init();
+    ic_stable_flush();
 }
 
 __attribute__((export_name("canister_post_upgrade")))
 void canister_post_upgrade(void) {
     debug_log("Idris2 canister: post_upgrade");
+    /* Finish or trim a stkv batch before Idris code reads the store */
+    stkv_recover();
     ensure_idris2_init();
+    ic_stable_flush();
 }
 
 __attribute__((export_name("canister_pre_upgrade")))
 void canister_pre_upgrade(void) {
     debug_log("Idris2 canister: pre_upgrade");
     /* Save state to stable memory here */
+    /* Dirty stable pages live in the heap, which the upgrade drops */
+    ic_stable_flush();
 }
 
 /* =============================================================================
@@ -91,6 +103,7 @@ void canister_pre_upgrade(void) {
  * 1. Parse arguments via ic0_msg_arg_data_copy if needed
  * 2. Call Idris2 functions via RefC interface
  * 3. Reply with Candid-encoded result
+ * 4. (updates) ic_stable_flush() so stable memory is current between messages
  * ============================================================================= */
 
 __attribute__((export_name("canister_query greet")))
@@ -103,4 +116,5 @@ __attribute__((export_name("canister_update ping")))
 void canister_update_ping(void) {
     debug_log("ping called");
     reply_text("pong");
+    ic_stable_flush();
 }
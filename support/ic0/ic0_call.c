@@ -4,6 +4,7 @@
  * Buffer management for ic0_call_* API
  */
 #include "ic0_call.h"
+#include "ic_bytes.h"
 #include <string.h>
 
 /* =============================================================================
@@ -16,11 +17,10 @@ static int32_t g_callee_len = 0;
 static uint8_t g_method_buffer[IC_CALL_METHOD_SIZE];
 static int32_t g_method_len = 0;
 
-static uint8_t g_payload_buffer[IC_CALL_PAYLOAD_SIZE];
-static int32_t g_payload_len = 0;
-
-static uint8_t g_response_buffer[IC_CALL_RESPONSE_SIZE];
-static int32_t g_response_len = 0;
+/* The response outlives the message that made the call (it is filled in
+ * the callback), so neither growable buffer is released between calls */
+static ic_bytes g_payload = {0};
+static ic_bytes g_response = {0};
 
 static int32_t g_call_status = 0;  /* 0=idle, 1=pending, 2=success, -1=error */
 
@@ -41,9 +41,7 @@ void ic_call_write_byte(int32_t buffer_id, int32_t index, int32_t byte) {
             }
             break;
         case IC_CALL_BUFFER_PAYLOAD:
-            if (index >= 0 && index < IC_CALL_PAYLOAD_SIZE) {
-                g_payload_buffer[index] = (uint8_t)byte;
-            }
+            ic_bytes_put(&g_payload, index, (uint8_t)byte);
             break;
     }
 }
@@ -55,7 +53,7 @@ int32_t ic_call_get_ptr(int32_t buffer_id) {
         case IC_CALL_BUFFER_METHOD:
             return (int32_t)(uintptr_t)g_method_buffer;
         case IC_CALL_BUFFER_PAYLOAD:
-            return (int32_t)(uintptr_t)g_payload_buffer;
+            return (int32_t)(uintptr_t)g_payload.data;
         default:
             return 0;
     }
@@ -70,7 +68,9 @@ void ic_call_set_len(int32_t buffer_id, int32_t len) {
             g_method_len = (len >= 0 && len <= IC_CALL_METHOD_SIZE) ? len : 0;
             break;
         case IC_CALL_BUFFER_PAYLOAD:
-            g_payload_len = (len >= 0 && len <= IC_CALL_PAYLOAD_SIZE) ? len : 0;
+            if (ic_bytes_set_len(&g_payload, len) != 0) {
+                g_payload.len = 0;
+            }
             break;
     }
 }
@@ -80,28 +80,28 @@ void ic_call_set_len(int32_t buffer_id, int32_t len) {
  * ============================================================================= */
 
 int32_t ic_call_response_ptr(void) {
-    return (int32_t)(uintptr_t)g_response_buffer;
+    return (int32_t)(uintptr_t)g_response.data;
 }
 
 int32_t ic_call_response_len(void) {
-    return g_response_len;
+    return (int32_t)g_response.len;
 }
 
 int32_t ic_call_response_byte(int32_t index) {
-    if (index >= 0 && index < g_response_len) {
-        return (int32_t)g_response_buffer[index];
+    if (index >= 0 && (uint32_t)index < g_response.len) {
+        return (int32_t)g_response.data[index];
     }
     return 0;
 }
 
 void ic_call_response_write(int32_t index, int32_t byte) {
-    if (index >= 0 && index < IC_CALL_RESPONSE_SIZE) {
-        g_response_buffer[index] = (uint8_t)byte;
-    }
+    ic_bytes_put(&g_response, index, (uint8_t)byte);
 }
 
 void ic_call_response_set_len(int32_t len) {
-    g_response_len = (len >= 0 && len <= IC_CALL_RESPONSE_SIZE) ? len : 0;
+    if (ic_bytes_set_len(&g_response, len) != 0) {
+        g_response.len = 0;
+    }
 }
 
 /* =============================================================================
@@ -116,6 +116,15 @@ void ic_call_set_status(int32_t status) {
     g_call_status = status;
 }
 
+void ic_call_clear(void) {
+    ic_bytes_clear(&g_payload);
+    ic_bytes_clear(&g_response);
+}
+
+int32_t ic_call_overflow(void) {
+    return (int32_t)(g_payload.overflow | g_response.overflow);
+}
+
 /* =============================================================================
  * IC0 Callback Handlers (called by IC runtime)
  * ============================================================================= */
@@ -127,9 +136,10 @@ extern void ic0_msg_arg_data_copy(int32_t dst, int32_t offset, int32_t size);
 /* Default reply callback - copies response to buffer */
 void ic_call_default_reply(void) {
     int32_t size = ic0_msg_arg_data_size();
-    if (size > 0 && size <= IC_CALL_RESPONSE_SIZE) {
-        ic0_msg_arg_data_copy((int32_t)(uintptr_t)g_response_buffer, 0, size);
-        g_response_len = size;
+    ic_bytes_clear(&g_response);
+    if (size > 0 && ic_bytes_reserve(&g_response, size) == 0) {
+        ic0_msg_arg_data_copy((int32_t)(uintptr_t)g_response.data, 0, size);
+        g_response.len = (uint32_t)size;
         g_call_status = 2;  /* Success */
     } else {
         g_call_status = -1; /* Error */
@@ -139,5 +149,5 @@ void ic_call_default_reply(void) {
 /* Default reject callback */
 void ic_call_default_reject(void) {
     g_call_status = -1;  /* Error */
-    g_response_len = 0;
+    ic_bytes_clear(&g_response);
 }
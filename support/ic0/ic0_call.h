@@ -13,11 +13,9 @@
 #define IC_CALL_BUFFER_METHOD  1
 #define IC_CALL_BUFFER_PAYLOAD 2
 
-/* Buffer sizes */
+/* Buffer sizes; payload and response grow up to IC_BYTES_MAX (ic_bytes.h) */
 #define IC_CALL_CALLEE_SIZE  32   /* Principal max size */
 #define IC_CALL_METHOD_SIZE  64   /* Method name max size */
-#define IC_CALL_PAYLOAD_SIZE 4096 /* Request payload max size */
-#define IC_CALL_RESPONSE_SIZE 8192 /* Response max size */
 
 /* Buffer management */
 void ic_call_write_byte(int32_t buffer_id, int32_t index, int32_t byte);
@@ -35,6 +33,12 @@ void ic_call_response_set_len(int32_t len);
 int32_t ic_call_status(void);
 void ic_call_set_status(int32_t status);
 
+/* Start a new call: empty payload and response, overflow cleared */
+void ic_call_clear(void);
+
+/* Nonzero if a payload write or response passed IC_BYTES_MAX */
+int32_t ic_call_overflow(void);
+
 /* Callback registration */
 typedef void (*ic_callback_fn)(void);
 void ic_call_set_reply_callback(ic_callback_fn fn);
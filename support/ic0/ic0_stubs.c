@@ -10,6 +10,36 @@
  * These stubs provide the C functions that wrap the WASM imports.
  */
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ic_bytes.h"
+#include "ic_stable.h"
+
+/* Runtime byte kernels (SIMD128 when built with --simd). Optional so the
+ * stubs still build against an upstream RefC runtime. */
+#if defined(__has_include)
+#if __has_include("simdOps.h")
+#include "simdOps.h"
+#define IC_HAVE_RUNTIME_KERNELS 1
+/* The vendored buffer.c: growable buffers and external views */
+#include "buffer.h"
+#define IC_HAVE_BUFFER_VIEWS 1
+/* printf-free number formatting from the vendored casts.c */
+extern size_t idris2_formatInt64(char* buf, int64_t v);
+extern size_t idris2_formatDouble(char* buf, double x);
+/* Whichever bignum backend the build selected (--bignum) */
+#if __has_include("gmp.h")
+#include "gmp.h"
+#define IC_HAVE_BIGNUM 1
+#endif
+#endif
+/* Bits128 / Bits256 values from the vendored wideInts.c */
+#if __has_include("wideInts.h")
+#include "wideInts.h"
+#define IC_HAVE_WIDE_INTS 1
+#endif
+#endif
 
 /* =============================================================================
  * WASM Imports from IC Runtime
@@ -137,6 +167,73 @@ void ic0_msg_arg_data_copy(int32_t dst, int32_t offset, int32_t size) {
     ic0_msg_arg_data_copy_impl((uint32_t)dst, (uint32_t)offset, (uint32_t)size);
 }
 
+#ifdef IC_HAVE_BUFFER_VIEWS
+/* Message data as RefC Buffers (WasmBuilder.IC0.Message). The argument is
+ * copied once, straight into the Buffer's storage, and replies are appended
+ * from a Buffer's storage in place - no intermediate C buffers. */
+static void ic_trap_msg(const char* msg) {
+    ic0_trap_impl((uint32_t)(uintptr_t)msg, (uint32_t)strlen(msg));
+}
+
+void* ic_msg_arg_buffer(void) {
+    uint32_t size = ic0_msg_arg_data_size_impl();
+    Buffer* b = newBufferWithCapacity((int)size);
+    if (b == NULL) {
+        ic_trap_msg("ic_msg_arg_buffer: out of memory");
+    }
+    ic0_msg_arg_data_copy_impl((uint32_t)(uintptr_t)b->data, 0, size);
+    b->size = (int)size;
+    return b;
+}
+
+void ic_msg_reply_append_buffer(void* buffer, int32_t loc, int32_t len) {
+    Buffer* b = buffer;
+    if (loc < 0 || len < 0 || loc > b->size - len) {
+        ic_trap_msg("ic_msg_reply_append_buffer: range outside buffer");
+    }
+    ic0_msg_reply_data_append_impl((uint32_t)(uintptr_t)(b->data + loc), (uint32_t)len);
+}
+
+/* Append the whole buffer and send the reply */
+void ic_msg_reply_buffer(void* buffer) {
+    ic_msg_reply_append_buffer(buffer, 0, ((Buffer*)buffer)->size);
+    ic0_msg_reply_impl();
+}
+
+/* Buffers over the ic_ffi_bridge state. Writes through the Candid view
+ * land in the reply buffer; finish with ic_candid_set_len. The Candid
+ * storage is pinned once viewed, so the view never dangles. */
+extern uint8_t* ic_candid_c_expose(int64_t size);
+extern int32_t ic_candid_c_get_capacity(void);
+extern const char* ic_json_c_get_buf(void);
+extern int64_t ic_json_get_len(void);
+
+void* ic_candid_buffer_view(int64_t size) {
+    uint8_t* data = ic_candid_c_expose(size);
+    if (data == NULL) {
+        ic_trap_msg("ic_candid_buffer_view: reply larger than the IC message limit");
+    }
+    Buffer* b = newBufferView(data, ic_candid_c_get_capacity());
+    if (b == NULL) {
+        ic_trap_msg("ic_candid_buffer_view: out of memory");
+    }
+    return b;
+}
+
+/* The JSON input is read-only, so it is handed out as a copy the caller
+ * owns rather than as a view */
+void* ic_json_buffer(void) {
+    int len = (int)ic_json_get_len();
+    Buffer* b = newBufferWithCapacity(len);
+    if (b == NULL) {
+        ic_trap_msg("ic_json_buffer: out of memory");
+    }
+    memcpy(b->data, ic_json_c_get_buf(), (size_t)len);
+    b->size = len;
+    return b;
+}
+#endif
+
 /* Caller information */
 int32_t ic0_msg_caller_size(void) { return (int32_t)ic0_msg_caller_size_impl(); }
 void ic0_msg_caller_copy(int32_t dst, int32_t offset, int32_t size) {
@@ -166,24 +263,34 @@ int32_t ic0_canister_status(void) { return (int32_t)ic0_canister_status_impl();
 /* Time */
 uint64_t ic0_time(void) { return ic0_time_impl(); }
 
-/* Stable memory */
+/* Stable memory: uncached, but coherent with the page cache (ic_stable.c) */
 int32_t ic0_stable_size(void) { return (int32_t)ic0_stable_size_impl(); }
 int32_t ic0_stable_grow(int32_t new_pages) {
-    return (int32_t)ic0_stable_grow_impl((uint32_t)new_pages);
+    uint32_t old = ic0_stable_grow_impl((uint32_t)new_pages);
+    if (old != UINT32_MAX) ic_stable_resized((uint64_t)old + (uint32_t)new_pages);
+    return (int32_t)old;
 }
 void ic0_stable_read(int32_t dst, int32_t offset, int32_t size) {
+    ic_stable_sync((uint32_t)offset, (uint32_t)size);
     ic0_stable_read_impl((uint32_t)dst, (uint32_t)offset, (uint32_t)size);
 }
 void ic0_stable_write(int32_t offset, int32_t src, int32_t size) {
     ic0_stable_write_impl((uint32_t)offset, (uint32_t)src, (uint32_t)size);
+    ic_stable_patch((uint32_t)offset, (const void*)(uintptr_t)(uint32_t)src, (uint32_t)size);
 }
 uint64_t ic0_stable64_size(void) { return ic0_stable64_size_impl(); }
-uint64_t ic0_stable64_grow(uint64_t new_pages) { return ic0_stable64_grow_impl(new_pages); }
+uint64_t ic0_stable64_grow(uint64_t new_pages) {
+    uint64_t old = ic0_stable64_grow_impl(new_pages);
+    if (old != UINT64_MAX) ic_stable_resized(old + new_pages);
+    return old;
+}
 void ic0_stable64_read(uint64_t dst, uint64_t offset, uint64_t size) {
+    ic_stable_sync(offset, size);
     ic0_stable64_read_impl(dst, offset, size);
 }
 void ic0_stable64_write(uint64_t offset, uint64_t src, uint64_t size) {
     ic0_stable64_write_impl(offset, src, size);
+    ic_stable_patch(offset, (const void*)(uintptr_t)src, size);
 }
 
 /* Certified data */
@@ -224,6 +331,37 @@ void ic0_msg_cycles_refunded128(int32_t dst) {
     ic0_msg_cycles_refunded128_impl((uint32_t)dst);
 }
 
+#ifdef IC_HAVE_WIDE_INTS
+/* Cycles as Bits128 values (WasmBuilder.IC0.Cycles): the 16-byte ic0
+ * buffers are decoded straight into the value, no Integer involved. */
+Value* ic_cycles_balance128(void) {
+    uint8_t buf[16];
+    ic0_canister_cycle_balance128_impl((uint32_t)(uintptr_t)buf);
+    return idris2_load_Bits128(buf);
+}
+Value* ic_cycles_available128(void) {
+    uint8_t buf[16];
+    ic0_msg_cycles_available128_impl((uint32_t)(uintptr_t)buf);
+    return idris2_load_Bits128(buf);
+}
+Value* ic_cycles_refunded128(void) {
+    uint8_t buf[16];
+    ic0_msg_cycles_refunded128_impl((uint32_t)(uintptr_t)buf);
+    return idris2_load_Bits128(buf);
+}
+Value* ic_cycles_accept128(Value* max) {
+    uint8_t buf[16];
+    ic0_msg_cycles_accept128_impl(idris2_word_Bits128(max, 1),
+                                  idris2_word_Bits128(max, 0),
+                                  (uint32_t)(uintptr_t)buf);
+    return idris2_load_Bits128(buf);
+}
+void ic_cycles_add128(Value* amount) {
+    ic0_call_cycles_add128_impl(idris2_word_Bits128(amount, 1),
+                                idris2_word_Bits128(amount, 0));
+}
+#endif
+
 /* Debugging */
 void ic0_debug_print(int32_t src, int32_t size) {
     ic0_debug_print_impl((uint32_t)src, (uint32_t)size);
@@ -240,6 +378,122 @@ uint64_t ic0_global_timer_set(uint64_t timestamp) {
     return ic0_global_timer_set_impl(timestamp);
 }
 uint64_t ic0_instruction_counter(void) { return ic0_instruction_counter_impl(); }
+
+#ifdef IC_HAVE_RUNTIME_KERNELS
+/*
+ * Benchmark one runtime byte kernel over `len` bytes of ASCII data.
+ * Returns the instructions spent (performance counter 0), so the caller can
+ * report bytes per instruction for scalar vs. --simd builds.
+ * kernel: 0=memeq 1=strcmp 2=reverse 3=utf8_valid 4=memchr 5=fill 6=copy
+ *         7=format `len` Int64s 8=format `len` Doubles (len counts values)
+ *         9=add 10=mul 11=divmod 12=pow (bignum, see ic_bench_bignum)
+ *         13=newBuffer + copy in 14=newBufferUninit + copy in (the cost of
+ *         zeroing memory that is overwritten anyway)
+ * Returns 0 for an unknown kernel or if allocation fails.
+ */
+#ifdef IC_HAVE_BIGNUM
+#define IC_BENCH_BIGNUM_REPS 64
+
+/* Deterministic operand of exactly `bits` bits */
+static void bench_operand(mpz_t x, int32_t bits, uint32_t seed) {
+    mpz_set_ui(x, 1);
+    while ((int32_t)mpz_sizeinbase(x, 2) < bits) {
+        seed = seed * 1103515245u + 12345u;
+        mpz_mul_2exp(x, x, 31);
+        mpz_add_ui(x, x, seed & 0x7fffffffu);
+    }
+    mpz_tdiv_r_2exp(x, x, (mp_bitcnt_t)bits);
+    mpz_setbit(x, (mp_bitcnt_t)bits - 1);
+}
+
+/*
+ * Bignum kernels on `bits`-bit operands, IC_BENCH_BIGNUM_REPS operations per
+ * run: a+b, a*b, (a*b) divmod b, a^8. Build with --bignum=mini-gmp and
+ * --bignum=fast to compare the backends.
+ */
+static uint64_t ic_bench_bignum(int32_t kernel, int32_t bits) {
+    if (bits <= 0) return 0;
+    mpz_t a, b, n, q, r;
+    mpz_inits(a, b, n, q, r, NULL);
+    bench_operand(a, bits, 1);
+    bench_operand(b, bits, 2);
+    mpz_mul(n, a, b);
+
+    uint64_t start = ic0_performance_counter_impl(0);
+    for (int i = 0; i < IC_BENCH_BIGNUM_REPS; i++) {
+        switch (kernel) {
+            case 9: mpz_add(r, a, b); break;
+            case 10: mpz_mul(r, a, b); break;
+            case 11: mpz_tdiv_qr(q, r, n, b); break;
+            default: mpz_pow_ui(r, a, 8); break;
+        }
+    }
+    uint64_t spent = ic0_performance_counter_impl(0) - start;
+    mpz_clears(a, b, n, q, r, NULL);
+    return spent;
+}
+
+/* 1 when the fast bignum backend is linked, 0 for mini-gmp */
+int32_t ic_bignum_backend(void) {
+#ifdef FASTBN_H
+    return 1;
+#else
+    return 0;
+#endif
+}
+#endif
+
+uint64_t ic_bench_kernel(int32_t kernel, int32_t len) {
+    if (len < 0) return 0;
+#ifdef IC_HAVE_BIGNUM
+    if (kernel >= 9 && kernel <= 12) return ic_bench_bignum(kernel, len);
+#endif
+    char* a = malloc((size_t)len + 1);
+    char* b = malloc((size_t)len + 1);
+    if (!a || !b) { free(a); free(b); return 0; }
+    for (int32_t i = 0; i < len; i++) a[i] = b[i] = (char)('a' + i % 26);
+    a[len] = b[len] = '\0';
+
+    volatile uintptr_t sink = 0;
+    uint64_t start = ic0_performance_counter_impl(0);
+    switch (kernel) {
+        case 0: sink = (uintptr_t)idris2_simd_memeq(a, b, (size_t)len); break;
+        case 1: sink = (uintptr_t)idris2_simd_strcmp(a, b); break;
+        case 2: idris2_simd_reverse(b, a, (size_t)len); break;
+        case 3: sink = (uintptr_t)idris2_simd_utf8_valid(a, (size_t)len); break;
+        case 4: sink = (uintptr_t)idris2_simd_memchr(a, '#', (size_t)len); break;
+        case 5: idris2_simd_fill(b, 0x5A, (size_t)len); break;
+        case 6: idris2_simd_copy(b, a, (size_t)len); break;
+        case 7: {
+            char out[32];
+            int64_t v = 1;
+            for (int32_t i = 0; i < len; i++, v = v * 31 + i) sink += idris2_formatInt64(out, v);
+            break;
+        }
+        case 8: {
+            char out[32];
+            double v = 0.1;
+            for (int32_t i = 0; i < len; i++, v = v * 1.37 + i) sink += idris2_formatDouble(out, v);
+            break;
+        }
+        case 13:
+        case 14: {
+            Buffer* buf = kernel == 13 ? newBuffer(len) : newBufferUninit(len);
+            if (!buf) break;
+            idris2_simd_copy(buf->data, a, (size_t)len);
+            sink = (uintptr_t)buf;
+            freeBuffer(buf);
+            break;
+        }
+        default: break;
+    }
+    uint64_t spent = ic0_performance_counter_impl(0) - start;
+    (void)sink;
+    free(a);
+    free(b);
+    return ((kernel >= 0 && kernel <= 8) || kernel == 13 || kernel == 14) ? spent : 0;
+}
+#endif
 int32_t ic0_is_controller(int32_t src, int32_t size) {
     return (int32_t)ic0_is_controller_impl((uint32_t)src, (uint32_t)size);
 }
@@ -372,318 +626,44 @@ int64_t ouc_inc_auditor_count(void) {
     return (int64_t)ouc_auditor_count;  /* Return new count to prevent optimization */
 }
 
-/* =============================================================================
- * Stable KV Storage (Phase 1 for idris2-icp-indexer)
- *
- * Simple key-value storage backed by stable memory.
- * Layout:
- *   [0..3]   : Magic "STKV" (4 bytes)
- *   [4..7]   : Entry count (4 bytes, little-endian)
- *   [8..11]  : Next free offset (4 bytes)
- *   [12..]   : Entries [key_len:4, key:key_len, val_len:4, val:val_len]
- *
- * This is a simple linear scan implementation. For production, use BTree.
- * ============================================================================= */
-
-#define STKV_MAGIC_OFFSET 0
-#define STKV_COUNT_OFFSET 4
-#define STKV_NEXT_OFFSET  8
-#define STKV_DATA_START   12
-#define STKV_PAGE_SIZE    65536  /* 64KB per page */
-
-/* In-memory cache for header (avoids repeated stable reads) */
-static uint32_t stkv_count = 0;
-static uint32_t stkv_next_free = STKV_DATA_START;
-static int stkv_initialized = 0;
-
-/* Ensure stable memory has enough pages */
-static void stkv_ensure_capacity(uint32_t needed_bytes) {
-    uint32_t current_pages = ic0_stable_size_impl();
-    uint32_t current_bytes = current_pages * STKV_PAGE_SIZE;
-    if (needed_bytes > current_bytes) {
-        uint32_t needed_pages = (needed_bytes + STKV_PAGE_SIZE - 1) / STKV_PAGE_SIZE;
-        ic0_stable_grow_impl(needed_pages - current_pages);
-    }
-}
-
-/* Initialize KV storage if needed */
-static void stkv_init_if_needed(void) {
-    if (stkv_initialized) return;
-
-    /* Check if stable memory has valid magic */
-    uint32_t current_pages = ic0_stable_size_impl();
-    if (current_pages == 0) {
-        /* First time: allocate 1 page and write header */
-        ic0_stable_grow_impl(1);
-        uint8_t header[12] = {
-            'S', 'T', 'K', 'V',    /* Magic */
-            0, 0, 0, 0,            /* Count = 0 */
-            12, 0, 0, 0            /* Next free = 12 */
-        };
-        ic0_stable_write_impl(0, (uint32_t)(uintptr_t)header, 12);
-        stkv_count = 0;
-        stkv_next_free = STKV_DATA_START;
-    } else {
-        /* Read existing header */
-        uint8_t header[12];
-        ic0_stable_read_impl((uint32_t)(uintptr_t)header, 0, 12);
-        if (header[0] == 'S' && header[1] == 'T' &&
-            header[2] == 'K' && header[3] == 'V') {
-            stkv_count = header[4] | (header[5] << 8) |
-                        (header[6] << 16) | (header[7] << 24);
-            stkv_next_free = header[8] | (header[9] << 8) |
-                            (header[10] << 16) | (header[11] << 24);
-        } else {
-            /* Invalid magic, reinitialize */
-            uint8_t init_header[12] = {
-                'S', 'T', 'K', 'V',
-                0, 0, 0, 0,
-                12, 0, 0, 0
-            };
-            ic0_stable_write_impl(0, (uint32_t)(uintptr_t)init_header, 12);
-            stkv_count = 0;
-            stkv_next_free = STKV_DATA_START;
-        }
-    }
-    stkv_initialized = 1;
-}
-
-/* Flush header to stable memory */
-static void stkv_flush_header(void) {
-    uint8_t header[12] = {
-        'S', 'T', 'K', 'V',
-        (uint8_t)(stkv_count & 0xFF),
-        (uint8_t)((stkv_count >> 8) & 0xFF),
-        (uint8_t)((stkv_count >> 16) & 0xFF),
-        (uint8_t)((stkv_count >> 24) & 0xFF),
-        (uint8_t)(stkv_next_free & 0xFF),
-        (uint8_t)((stkv_next_free >> 8) & 0xFF),
-        (uint8_t)((stkv_next_free >> 16) & 0xFF),
-        (uint8_t)((stkv_next_free >> 24) & 0xFF)
-    };
-    ic0_stable_write_impl(0, (uint32_t)(uintptr_t)header, 12);
-}
-
-/* Compare memory regions */
-static int mem_eq(const uint8_t* a, const uint8_t* b, uint32_t len) {
-    for (uint32_t i = 0; i < len; i++) {
-        if (a[i] != b[i]) return 0;
-    }
-    return 1;
-}
-
-/*
- * Put key-value pair
- * key_ptr: pointer to key bytes
- * key_len: length of key
- * val_ptr: pointer to value bytes
- * val_len: length of value
- * Returns: 0 on success, -1 on error
- */
-int64_t stkv_put(int64_t key_ptr, int64_t key_len, int64_t val_ptr, int64_t val_len) {
-    stkv_init_if_needed();
-
-    uint32_t k_len = (uint32_t)key_len;
-    uint32_t v_len = (uint32_t)val_len;
-    uint8_t* key = (uint8_t*)(uintptr_t)key_ptr;
-    uint8_t* val = (uint8_t*)(uintptr_t)val_ptr;
-
-    /* Search for existing key (linear scan) */
-    uint32_t offset = STKV_DATA_START;
-    uint8_t len_buf[4];
-    uint8_t key_buf[256];  /* Max key size */
-
-    for (uint32_t i = 0; i < stkv_count && offset < stkv_next_free; i++) {
-        /* Read key length */
-        ic0_stable_read_impl((uint32_t)(uintptr_t)len_buf, offset, 4);
-        uint32_t stored_key_len = len_buf[0] | (len_buf[1] << 8) |
-                                  (len_buf[2] << 16) | (len_buf[3] << 24);
-
-        if (stored_key_len == k_len && stored_key_len <= 256) {
-            /* Read key and compare */
-            ic0_stable_read_impl((uint32_t)(uintptr_t)key_buf, offset + 4, stored_key_len);
-            if (mem_eq(key, key_buf, k_len)) {
-                /* Key found - read value length and update in place if same size */
-                ic0_stable_read_impl((uint32_t)(uintptr_t)len_buf, offset + 4 + stored_key_len, 4);
-                uint32_t stored_val_len = len_buf[0] | (len_buf[1] << 8) |
-                                          (len_buf[2] << 16) | (len_buf[3] << 24);
-                if (stored_val_len == v_len) {
-                    /* Update value in place */
-                    ic0_stable_write_impl(offset + 4 + stored_key_len + 4,
-                                          (uint32_t)(uintptr_t)val, v_len);
-                    return 0;
-                }
-                /* Different size - for simplicity, append new (wastes space) */
-                break;
-            }
-        }
-
-        /* Skip to next entry */
-        ic0_stable_read_impl((uint32_t)(uintptr_t)len_buf, offset + 4 + stored_key_len, 4);
-        uint32_t stored_val_len = len_buf[0] | (len_buf[1] << 8) |
-                                  (len_buf[2] << 16) | (len_buf[3] << 24);
-        offset += 4 + stored_key_len + 4 + stored_val_len;
-    }
-
-    /* Append new entry */
-    uint32_t entry_size = 4 + k_len + 4 + v_len;
-    stkv_ensure_capacity(stkv_next_free + entry_size);
-
-    /* Write key length */
-    uint8_t entry_header[4] = {
-        (uint8_t)(k_len & 0xFF),
-        (uint8_t)((k_len >> 8) & 0xFF),
-        (uint8_t)((k_len >> 16) & 0xFF),
-        (uint8_t)((k_len >> 24) & 0xFF)
-    };
-    ic0_stable_write_impl(stkv_next_free, (uint32_t)(uintptr_t)entry_header, 4);
-
-    /* Write key */
-    ic0_stable_write_impl(stkv_next_free + 4, (uint32_t)(uintptr_t)key, k_len);
-
-    /* Write value length */
-    uint8_t val_header[4] = {
-        (uint8_t)(v_len & 0xFF),
-        (uint8_t)((v_len >> 8) & 0xFF),
-        (uint8_t)((v_len >> 16) & 0xFF),
-        (uint8_t)((v_len >> 24) & 0xFF)
-    };
-    ic0_stable_write_impl(stkv_next_free + 4 + k_len, (uint32_t)(uintptr_t)val_header, 4);
-
-    /* Write value */
-    ic0_stable_write_impl(stkv_next_free + 4 + k_len + 4, (uint32_t)(uintptr_t)val, v_len);
-
-    stkv_next_free += entry_size;
-    stkv_count++;
-    stkv_flush_header();
-
-    return 0;
-}
-
-/*
- * Get value by key
- * key_ptr: pointer to key bytes
- * key_len: length of key
- * val_ptr: pointer to buffer for value
- * max_val_len: maximum bytes to copy
- * Returns: actual value length, or -1 if not found
- */
-int64_t stkv_get(int64_t key_ptr, int64_t key_len, int64_t val_ptr, int64_t max_val_len) {
-    stkv_init_if_needed();
-
-    uint32_t k_len = (uint32_t)key_len;
-    uint8_t* key = (uint8_t*)(uintptr_t)key_ptr;
-    uint8_t* val = (uint8_t*)(uintptr_t)val_ptr;
-    uint32_t max_len = (uint32_t)max_val_len;
-
-    /* Linear scan */
-    uint32_t offset = STKV_DATA_START;
-    uint8_t len_buf[4];
-    uint8_t key_buf[256];
-
-    for (uint32_t i = 0; i < stkv_count && offset < stkv_next_free; i++) {
-        /* Read key length */
-        ic0_stable_read_impl((uint32_t)(uintptr_t)len_buf, offset, 4);
-        uint32_t stored_key_len = len_buf[0] | (len_buf[1] << 8) |
-                                  (len_buf[2] << 16) | (len_buf[3] << 24);
-
-        if (stored_key_len == k_len && stored_key_len <= 256) {
-            /* Read key and compare */
-            ic0_stable_read_impl((uint32_t)(uintptr_t)key_buf, offset + 4, stored_key_len);
-            if (mem_eq(key, key_buf, k_len)) {
-                /* Key found - read value */
-                ic0_stable_read_impl((uint32_t)(uintptr_t)len_buf, offset + 4 + stored_key_len, 4);
-                uint32_t stored_val_len = len_buf[0] | (len_buf[1] << 8) |
-                                          (len_buf[2] << 16) | (len_buf[3] << 24);
-                uint32_t copy_len = (stored_val_len < max_len) ? stored_val_len : max_len;
-                ic0_stable_read_impl((uint32_t)(uintptr_t)val,
-                                     offset + 4 + stored_key_len + 4, copy_len);
-                return (int64_t)stored_val_len;
-            }
-        }
-
-        /* Skip to next entry */
-        ic0_stable_read_impl((uint32_t)(uintptr_t)len_buf, offset + 4 + stored_key_len, 4);
-        uint32_t stored_val_len = len_buf[0] | (len_buf[1] << 8) |
-                                  (len_buf[2] << 16) | (len_buf[3] << 24);
-        offset += 4 + stored_key_len + 4 + stored_val_len;
-    }
-
-    return -1;  /* Not found */
-}
-
-/*
- * Delete key
- * key_ptr: pointer to key bytes
- * key_len: length of key
- * Returns: 0 on success (or not found), -1 on error
- *
- * Note: This implementation doesn't actually reclaim space (tombstone pattern).
- * For production, implement compaction.
- */
-int64_t stkv_delete(int64_t key_ptr, int64_t key_len) {
-    /* For simplicity, we don't implement delete in Phase 1 */
-    /* A proper implementation would mark entries as deleted */
-    (void)key_ptr;
-    (void)key_len;
-    return 0;
-}
-
-/*
- * Get entry count
- */
-int64_t stkv_count_entries(void) {
-    stkv_init_if_needed();
-    return (int64_t)stkv_count;
-}
-
-/*
- * Clear all entries
- */
-void stkv_clear(void) {
-    stkv_count = 0;
-    stkv_next_free = STKV_DATA_START;
-    stkv_flush_header();
-}
-
 /* =============================================================================
  * Candid Encoding Buffer (for Idris2 -> C communication)
  *
  * Allows Idris2 to write Candid-encoded bytes that C can then use for
- * IC0 calls (e.g., EVM RPC requests).
+ * IC0 calls (e.g., EVM RPC requests). Grows up to IC_BYTES_MAX (ic_bytes.h).
  * ============================================================================= */
 
-#define OUC_CANDID_BUF_SIZE 4096
-static uint8_t ouc_candid_buf[OUC_CANDID_BUF_SIZE];
-static int32_t ouc_candid_len = 0;
+static ic_bytes ouc_candid = {0};
 
 /* Called from Idris2 to write a byte at index */
 void ouc_candid_write_byte(int64_t index, int64_t byte) {
-    if (index >= 0 && index < OUC_CANDID_BUF_SIZE) {
-        ouc_candid_buf[(int32_t)index] = (uint8_t)byte;
-    }
+    ic_bytes_put(&ouc_candid, index, (uint8_t)byte);
 }
 
 /* Called from Idris2 to set the total length */
 void ouc_candid_set_len(int64_t len) {
-    if (len >= 0 && len <= OUC_CANDID_BUF_SIZE) {
-        ouc_candid_len = (int32_t)len;
-    }
+    ic_bytes_set_len(&ouc_candid, len);
 }
 
 /* Called from Idris2 to clear the buffer */
 void ouc_candid_clear(void) {
-    ouc_candid_len = 0;
+    ic_bytes_clear(&ouc_candid);
 }
 
 /* Called from C to get buffer pointer */
 uint8_t* ouc_c_get_candid_buf(void) {
-    return ouc_candid_buf;
+    return ouc_candid.data;
 }
 
 /* Called from C to get buffer length */
 int32_t ouc_c_get_candid_len(void) {
-    return ouc_candid_len;
+    return (int32_t)ouc_candid.len;
+}
+
+/* Called from C or Idris2: nonzero if a write past IC_BYTES_MAX was rejected
+ * since the last clear */
+int32_t ouc_c_candid_overflowed(void) {
+    return (int32_t)ouc_candid.overflow;
 }
 
 /* =============================================================================
@@ -692,29 +672,24 @@ int32_t ouc_c_get_candid_len(void) {
  * Allows C to pass JSON strings to Idris2 for Candid encoding.
  * ============================================================================= */
 
-#define OUC_JSON_BUF_SIZE 1024
-static char ouc_json_buf[OUC_JSON_BUF_SIZE];
-static int32_t ouc_json_len = 0;
+static ic_bytes ouc_json = {0};
 
-/* Called from C to set JSON string */
-void ouc_c_set_json(const char* json) {
-    ouc_json_len = 0;
-    while (json[ouc_json_len] && ouc_json_len < OUC_JSON_BUF_SIZE - 1) {
-        ouc_json_buf[ouc_json_len] = json[ouc_json_len];
-        ouc_json_len++;
-    }
-    ouc_json_buf[ouc_json_len] = '\0';
+/* Called from C to set JSON string; -1 (buffer left empty) past
+ * IC_BYTES_MAX */
+int32_t ouc_c_set_json(const char* json) {
+    ic_bytes_clear(&ouc_json);
+    return ic_bytes_assign(&ouc_json, json, (int64_t)strlen(json));
 }
 
 /* Called from Idris2 to get JSON length */
 int64_t ouc_json_get_len(void) {
-    return (int64_t)ouc_json_len;
+    return (int64_t)ouc_json.len;
 }
 
 /* Called from Idris2 to get JSON byte at index */
 int64_t ouc_json_get_byte(int64_t index) {
-    if (index >= 0 && index < ouc_json_len) {
-        return (int64_t)(uint8_t)ouc_json_buf[(int32_t)index];
+    if (index >= 0 && index < ouc_json.len) {
+        return (int64_t)ouc_json.data[index];
     }
     return 0;
 }
@@ -0,0 +1,153 @@
+/*
+ * IC Bridge Byte Buffers - Growable C ↔ Idris2 transfer buffers
+ *
+ * Storage grows geometrically on demand up to IC_BYTES_MAX (the IC's 2 MiB
+ * message limit) and keeps its high-water capacity, so steady-state calls
+ * allocate nothing. A write that would pass the limit (or fail to allocate)
+ * is not dropped silently: it leaves the buffer unchanged and sets
+ * `overflow`, which the owning bridge reports to both C and Idris2.
+ *
+ * Clearing is O(1): only the dirty length `hi` is reset. Bytes below it hold
+ * this message's data; anything the length or a write skips over is zeroed
+ * when it is exposed, so a message never sees a previous one's bytes and no
+ * call pays for zeroing more than it uses.
+ *
+ * Storage handed out to a Buffer view is pinned: it is allocated at the
+ * full limit once and never moved or freed again, so no view can dangle.
+ */
+#ifndef IC_BYTES_H
+#define IC_BYTES_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define IC_BYTES_MAX (2u * 1024u * 1024u)
+#define IC_BYTES_MIN_CAPACITY 256u
+
+typedef struct {
+    uint8_t* data;
+    uint32_t len;
+    uint32_t cap;
+    uint32_t hi;        /* [0, hi) written or zeroed since the last clear */
+    uint32_t overflow;  /* a write was rejected since the last clear */
+    uint32_t pinned;    /* storage handed out; never moved or freed again */
+} ic_bytes;
+
+/* Make room for `need` bytes; 0 on success, -1 (and overflow set) if not.
+ * One byte past `cap` is always allocated for a NUL terminator. A pinned
+ * buffer already has the full capacity, so it is never reallocated. */
+static inline int ic_bytes_reserve(ic_bytes* b, int64_t need) {
+    if (need <= (int64_t)b->cap) {
+        return 0;
+    }
+    if (need < 0 || need > (int64_t)IC_BYTES_MAX) {
+        b->overflow = 1;
+        return -1;
+    }
+    uint32_t cap = b->cap < IC_BYTES_MIN_CAPACITY ? IC_BYTES_MIN_CAPACITY : b->cap;
+    while (cap < (uint32_t)need) {
+        cap *= 2;
+    }
+    if (cap > IC_BYTES_MAX) {
+        cap = IC_BYTES_MAX;
+    }
+    uint8_t* data = realloc(b->data, (size_t)cap + 1);
+    if (data == NULL) {
+        b->overflow = 1;
+        return -1;
+    }
+    b->data = data;
+    b->cap = cap;
+    return 0;
+}
+
+/* Zero the bytes between the dirty length and `end` */
+static inline void ic_bytes_touch(ic_bytes* b, uint32_t end) {
+    if (end > b->hi) {
+        memset(b->data + b->hi, 0, end - b->hi);
+        b->hi = end;
+    }
+}
+
+/* Store one byte at `index` without changing the length */
+static inline void ic_bytes_put(ic_bytes* b, int64_t index, uint8_t byte) {
+    if (index >= 0 && ic_bytes_reserve(b, index + 1) == 0) {
+        ic_bytes_touch(b, (uint32_t)index);
+        b->data[index] = byte;
+        if (index >= b->hi) {
+            b->hi = (uint32_t)index + 1;
+        }
+    } else {
+        b->overflow = 1;
+    }
+}
+
+/* Set the length; bytes never written since the last clear read as zero */
+static inline int ic_bytes_set_len(ic_bytes* b, int64_t len) {
+    if (len < 0 || ic_bytes_reserve(b, len) != 0) {
+        b->overflow = 1;
+        return -1;
+    }
+    ic_bytes_touch(b, (uint32_t)len);
+    b->len = (uint32_t)len;
+    return 0;
+}
+
+/* Allocate the full IC_BYTES_MAX capacity and pin it, for callers handing
+ * out the storage (a Buffer view). The whole capacity is treated as
+ * written, so bytes they do not write are unspecified. 0, or -1 if the
+ * storage cannot be allocated. */
+static inline int ic_bytes_pin(ic_bytes* b) {
+    if (!b->pinned) {
+        if (ic_bytes_reserve(b, IC_BYTES_MAX) != 0) {
+            return -1;
+        }
+        b->pinned = 1;
+    }
+    b->hi = b->cap;
+    return 0;
+}
+
+/* Replace the contents with `n` bytes of `src`, keeping a NUL after them */
+static inline int ic_bytes_assign(ic_bytes* b, const void* src, int64_t n) {
+    if (n < 0 || ic_bytes_reserve(b, n > 0 ? n : 1) != 0) {
+        b->overflow = 1;
+        return -1;
+    }
+    if (n > 0) {
+        memcpy(b->data, src, (size_t)n);
+    }
+    b->data[n] = 0;
+    b->len = (uint32_t)n;
+    b->hi = (uint32_t)n + 1;
+    return 0;
+}
+
+static inline void ic_bytes_clear(ic_bytes* b) {
+    b->len = 0;
+    b->hi = 0;
+    b->overflow = 0;
+}
+
+/* Clear, and give back the storage if it grew past `keep` bytes (unless a
+ * view may still point at it) */
+static inline void ic_bytes_reset(ic_bytes* b, uint32_t keep) {
+    ic_bytes_clear(b);
+    if (b->cap > keep && !b->pinned) {
+        free(b->data);
+        b->data = NULL;
+        b->cap = 0;
+    }
+}
+
+/* NUL-terminated contents ("" when nothing was ever stored) */
+static inline const char* ic_bytes_cstr(ic_bytes* b) {
+    if (b->data == NULL) {
+        return "";
+    }
+    b->data[b->len] = 0;
+    return (const char*)b->data;
+}
+
+#endif /* IC_BYTES_H */
@@ -21,6 +21,17 @@
 #include <stdint.h>
 #include <string.h>
 
+#include "ic_bytes.h"
+#include "ic_stable.h"
+
+/* RefC Buffer layout, for the bulk transfer functions below */
+#if defined(__has_include)
+#if __has_include("buffer.h")
+#include "buffer.h"
+#define IC_HAVE_REFC_BUFFER 1
+#endif
+#endif
+
 /* =============================================================================
  * FFI Bridge: Argument/Result Passing
  * ============================================================================= */
@@ -55,84 +66,122 @@ int64_t ic_ffi_c_get_result(void) {
     return ic_ffi_result;
 }
 
+/* =============================================================================
+ * Bridge Buffers
+ *
+ * The Candid, JSON and string buffers grow on demand up to the IC message
+ * limit (ic_bytes.h). Writes past it are rejected rather than dropped: the
+ * buffer keeps its previous contents and ic_ffi_overflow() reports it.
+ * ic_ffi_reset() gives back storage a large previous call left behind.
+ * ============================================================================= */
+
+/* Capacity each buffer keeps across ic_ffi_reset() */
+#define IC_BRIDGE_RETAIN_BYTES (64 * 1024)
+
+static ic_bytes ic_candid = {0};
+static ic_bytes ic_json = {0};
+static ic_bytes ic_str = {0};
+
 /* Reset communication state between calls */
 void ic_ffi_reset(void) {
     ic_ffi_result = 0;
     for (int i = 0; i < IC_FFI_MAX_ARGS; i++) {
         ic_ffi_args[i] = 0;
     }
+    ic_bytes_reset(&ic_candid, IC_BRIDGE_RETAIN_BYTES);
+    ic_bytes_reset(&ic_json, IC_BRIDGE_RETAIN_BYTES);
+    ic_bytes_reset(&ic_str, IC_BRIDGE_RETAIN_BYTES);
+}
+
+/* Called from Idris2: 1 if a bridge buffer rejected a write past
+ * IC_BYTES_MAX (or ran out of memory) since it was last cleared */
+int64_t ic_ffi_overflow(void) {
+    return (ic_candid.overflow | ic_json.overflow | ic_str.overflow) ? 1 : 0;
 }
 
 /* =============================================================================
  * Candid Buffer: Idris2 writes Candid bytes for C to send as reply
  * ============================================================================= */
 
-#define IC_CANDID_BUF_SIZE 4096
-static uint8_t ic_candid_buf[IC_CANDID_BUF_SIZE];
-static int32_t ic_candid_len = 0;
-
 /* Called from Idris2 to write a byte to Candid buffer */
 void ic_candid_write_byte(int64_t index, int64_t byte) {
-    if (index >= 0 && index < IC_CANDID_BUF_SIZE) {
-        ic_candid_buf[index] = (uint8_t)byte;
-    }
+    ic_bytes_put(&ic_candid, index, (uint8_t)byte);
 }
 
 /* Called from Idris2 to set Candid buffer length */
 void ic_candid_set_len(int64_t len) {
-    if (len >= 0 && len <= IC_CANDID_BUF_SIZE) {
-        ic_candid_len = (int32_t)len;
-    }
+    ic_bytes_set_len(&ic_candid, len);
 }
 
 /* Called from Idris2 to clear Candid buffer */
 void ic_candid_clear(void) {
-    ic_candid_len = 0;
-    memset(ic_candid_buf, 0, IC_CANDID_BUF_SIZE);
+    ic_bytes_clear(&ic_candid);
+}
+
+/* Called from Idris2: make room for `size` bytes; -1 past the limit. Once
+ * a view was taken the storage is pinned and never moves. */
+int64_t ic_candid_reserve(int64_t size) {
+    return ic_bytes_reserve(&ic_candid, size);
+}
+
+/* Called from C: storage with room for `size` bytes, to be written through
+ * a view. It is pinned at the full message limit, so the view stays valid
+ * whatever the buffer is used for later; NULL past the limit. */
+uint8_t* ic_candid_c_expose(int64_t size) {
+    if (size < 0 || size > (int64_t)IC_BYTES_MAX || ic_bytes_pin(&ic_candid) != 0) {
+        return NULL;
+    }
+    return ic_candid.data;
 }
 
 /* Called from C to get Candid buffer pointer */
 uint8_t* ic_candid_c_get_buf(void) {
-    return ic_candid_buf;
+    return ic_candid.data;
 }
 
 /* Called from C to get Candid buffer length */
 int32_t ic_candid_c_get_len(void) {
-    return ic_candid_len;
+    return (int32_t)ic_candid.len;
+}
+
+/* Called from C to get the Candid buffer size in bytes */
+int32_t ic_candid_c_get_capacity(void) {
+    return (int32_t)ic_candid.cap;
+}
+
+/* Called from C: nonzero if the reply was cut short and must not be sent */
+int32_t ic_candid_c_overflowed(void) {
+    return (int32_t)ic_candid.overflow;
 }
 
 /* =============================================================================
  * JSON Buffer: C sets JSON for Idris2 to parse
  * ============================================================================= */
 
-#define IC_JSON_BUF_SIZE 4096
-static char ic_json_buf[IC_JSON_BUF_SIZE];
-static int32_t ic_json_len = 0;
-
-/* Called from C to set JSON string for Idris2 */
-void ic_json_c_set(const char* json) {
-    if (json) {
-        ic_json_len = strlen(json);
-        if (ic_json_len >= IC_JSON_BUF_SIZE) {
-            ic_json_len = IC_JSON_BUF_SIZE - 1;
-        }
-        memcpy(ic_json_buf, json, ic_json_len);
-        ic_json_buf[ic_json_len] = '\0';
-    } else {
-        ic_json_len = 0;
-        ic_json_buf[0] = '\0';
+/* Called from C to set JSON string for Idris2; -1 (buffer left empty) if
+ * it is larger than IC_BYTES_MAX */
+int32_t ic_json_c_set(const char* json) {
+    ic_bytes_clear(&ic_json);
+    if (json == NULL) {
+        return 0;
     }
+    return ic_bytes_assign(&ic_json, json, (int64_t)strlen(json));
+}
+
+/* Called from C to get the JSON bytes (NUL-terminated) */
+const char* ic_json_c_get_buf(void) {
+    return ic_bytes_cstr(&ic_json);
 }
 
 /* Called from Idris2 to get JSON buffer length */
 int64_t ic_json_get_len(void) {
-    return (int64_t)ic_json_len;
+    return (int64_t)ic_json.len;
 }
 
 /* Called from Idris2 to get byte at index */
 int64_t ic_json_get_byte(int64_t index) {
-    if (index >= 0 && index < ic_json_len) {
-        return (int64_t)(uint8_t)ic_json_buf[index];
+    if (index >= 0 && index < ic_json.len) {
+        return (int64_t)ic_json.data[index];
     }
     return 0;
 }
@@ -141,59 +190,86 @@ int64_t ic_json_get_byte(int64_t index) {
  * String Buffer: Idris2 writes string for C to read (e.g., for debug)
  * ============================================================================= */
 
-#define IC_STR_BUF_SIZE 1024
-static char ic_str_buf[IC_STR_BUF_SIZE];
-static int32_t ic_str_len = 0;
-
 /* Called from Idris2 to write a byte to string buffer */
 void ic_str_write_byte(int64_t index, int64_t byte) {
-    if (index >= 0 && index < IC_STR_BUF_SIZE - 1) {
-        ic_str_buf[index] = (char)byte;
-    }
+    ic_bytes_put(&ic_str, index, (uint8_t)byte);
 }
 
 /* Called from Idris2 to set string length */
 void ic_str_set_len(int64_t len) {
-    if (len >= 0 && len < IC_STR_BUF_SIZE) {
-        ic_str_len = (int32_t)len;
-        ic_str_buf[ic_str_len] = '\0';
-    }
+    ic_bytes_set_len(&ic_str, len);
 }
 
 /* Called from C to get string buffer */
 const char* ic_str_c_get(void) {
-    return ic_str_buf;
+    return ic_bytes_cstr(&ic_str);
 }
 
 /* Called from C to get string length */
 int32_t ic_str_c_get_len(void) {
-    return ic_str_len;
+    return (int32_t)ic_str.len;
+}
+
+/* =============================================================================
+ * Bulk Transfer: one FFI call per message instead of one per byte
+ *
+ * Idris2 passes a RefC Buffer (its storage is read or written directly) or a
+ * String (a NUL-terminated char*). Buffer functions return the number of bytes
+ * moved, or -1 when the range does not fit; nothing is written in that case.
+ * ============================================================================= */
+
+/* Called from Idris2: Candid reply = `len` bytes of `buffer` from `loc` */
+#ifdef IC_HAVE_REFC_BUFFER
+int64_t ic_candid_write_buffer(void* buffer, int64_t loc, int64_t len) {
+    Buffer* b = buffer;
+    if (loc < 0 || len < 0 || loc + len > b->size) {
+        return -1;
+    }
+    if (ic_bytes_assign(&ic_candid, b->data + loc, len) != 0) {
+        return -1;
+    }
+    return len;
+}
+
+/* Called from Idris2: copy the JSON input into `buffer` at `loc` */
+int64_t ic_json_read_buffer(void* buffer, int64_t loc) {
+    Buffer* b = buffer;
+    if (loc < 0 || loc + ic_json.len > b->size) {
+        return -1;
+    }
+    if (ic_json.len > 0) {
+        memcpy(b->data + loc, ic_json.data, ic_json.len);
+    }
+    return ic_json.len;
+}
+#endif
+
+/* Called from Idris2: the whole JSON input as a String */
+const char* ic_json_get_string(void) {
+    return ic_bytes_cstr(&ic_json);
+}
+
+/* Called from Idris2: string buffer = `str` (-1 past IC_BYTES_MAX) */
+int64_t ic_str_write_string(const char* str) {
+    return ic_bytes_assign(&ic_str, str, (int64_t)strlen(str));
 }
 
 /* =============================================================================
  * Stable Memory Helpers (high-level wrappers for Idris2)
  *
  * These provide convenient Int32/Int64 read/write without pointer manipulation.
- * The underlying ic0_stable_* functions are in ic0_stubs.c
+ * They go through the page cache (ic_stable.c), so runs of small accesses
+ * to the same page cost one ic0 call, and grow stable memory through its
+ * cached size (a bounds check unless a new chunk is needed).
  * ============================================================================= */
 
-/* Extern declarations for ic0_stable_* (defined in ic0_stubs.c) */
-extern void ic0_stable_read(int32_t dst, int32_t offset, int32_t size);
-extern void ic0_stable_write(int32_t offset, int32_t src, int32_t size);
-extern int32_t ic0_stable_size(void);
-extern int32_t ic0_stable_grow(int32_t new_pages);
-
 /* Temporary buffer for stable memory operations */
 static uint8_t ic_stable_tmp[8];
 
 /* Write Int64 to stable memory at offset */
 void ic_stable_write_i64(int64_t offset, int64_t value) {
     /* Ensure we have enough stable memory */
-    int32_t needed_pages = ((int32_t)offset + 8 + 65535) / 65536;
-    int32_t current_pages = ic0_stable_size();
-    if (needed_pages > current_pages) {
-        ic0_stable_grow(needed_pages - current_pages);
-    }
+    ic_stable_ensure((uint64_t)offset + 8);
 
     /* Write value to temp buffer (little-endian) */
     for (int i = 0; i < 8; i++) {
@@ -201,13 +277,13 @@ void ic_stable_write_i64(int64_t offset, int64_t value) {
     }
 
     /* Write to stable memory */
-    ic0_stable_write((int32_t)offset, (int32_t)(uintptr_t)ic_stable_tmp, 8);
+    ic_stable_write((uint64_t)offset, ic_stable_tmp, 8);
 }
 
 /* Read Int64 from stable memory at offset */
 int64_t ic_stable_read_i64(int64_t offset) {
     /* Read from stable memory */
-    ic0_stable_read((int32_t)(uintptr_t)ic_stable_tmp, (int32_t)offset, 8);
+    ic_stable_read((uint64_t)offset, ic_stable_tmp, 8);
 
     /* Reconstruct value (little-endian) */
     int64_t value = 0;
@@ -220,11 +296,7 @@ int64_t ic_stable_read_i64(int64_t offset) {
 /* Write Int32 to stable memory at offset */
 void ic_stable_write_i32(int64_t offset, int64_t value) {
     /* Ensure we have enough stable memory */
-    int32_t needed_pages = ((int32_t)offset + 4 + 65535) / 65536;
-    int32_t current_pages = ic0_stable_size();
-    if (needed_pages > current_pages) {
-        ic0_stable_grow(needed_pages - current_pages);
-    }
+    ic_stable_ensure((uint64_t)offset + 4);
 
     /* Write value to temp buffer (little-endian) */
     int32_t val32 = (int32_t)value;
@@ -233,13 +305,13 @@ void ic_stable_write_i32(int64_t offset, int64_t value) {
     }
 
     /* Write to stable memory */
-    ic0_stable_write((int32_t)offset, (int32_t)(uintptr_t)ic_stable_tmp, 4);
+    ic_stable_write((uint64_t)offset, ic_stable_tmp, 4);
 }
 
 /* Read Int32 from stable memory at offset */
 int64_t ic_stable_read_i32(int64_t offset) {
     /* Read from stable memory */
-    ic0_stable_read((int32_t)(uintptr_t)ic_stable_tmp, (int32_t)offset, 4);
+    ic_stable_read((uint64_t)offset, ic_stable_tmp, 4);
 
     /* Reconstruct value (little-endian) */
     int32_t value = 0;
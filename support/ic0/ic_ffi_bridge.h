@@ -28,6 +28,20 @@ void ic_ffi_c_set_arg(int32_t index, int64_t value);
 int64_t ic_ffi_c_get_result(void);
 void ic_ffi_reset(void);
 
+/* =============================================================================
+ * Overflow Reporting
+ *
+ * The buffers below grow up to IC_BYTES_MAX (2 MiB, ic_bytes.h); a write past
+ * it is rejected and flagged instead of being dropped silently.
+ *
+ * Idris2 FFI declarations:
+ *   %foreign "C:ic_ffi_overflow,libic0"
+ *   ffiOverflow : PrimIO Int
+ * ============================================================================= */
+
+/* Called from Idris2 via %foreign */
+int64_t ic_ffi_overflow(void);
+
 /* =============================================================================
  * Candid Buffer: Idris2 writes Candid for C to send
  *
@@ -46,10 +60,14 @@ void ic_ffi_reset(void);
 void ic_candid_write_byte(int64_t index, int64_t byte);
 void ic_candid_set_len(int64_t len);
 void ic_candid_clear(void);
+int64_t ic_candid_reserve(int64_t size);
 
 /* Called from C */
+uint8_t* ic_candid_c_expose(int64_t size);
 uint8_t* ic_candid_c_get_buf(void);
 int32_t ic_candid_c_get_len(void);
+int32_t ic_candid_c_get_capacity(void);
+int32_t ic_candid_c_overflowed(void);
 
 /* =============================================================================
  * JSON Buffer: C sets JSON for Idris2 to parse
@@ -62,8 +80,9 @@ int32_t ic_candid_c_get_len(void);
  *   jsonGetByte : Int -> PrimIO Int
  * ============================================================================= */
 
-/* Called from C */
-void ic_json_c_set(const char* json);
+/* Called from C; -1 if the JSON exceeds IC_BYTES_MAX */
+int32_t ic_json_c_set(const char* json);
+const char* ic_json_c_get_buf(void);
 
 /* Called from Idris2 via %foreign */
 int64_t ic_json_get_len(void);
@@ -88,4 +107,27 @@ void ic_str_set_len(int64_t len);
 const char* ic_str_c_get(void);
 int32_t ic_str_c_get_len(void);
 
+/* =============================================================================
+ * Bulk Transfer (Buffer = RefC Buffer*, String = char*)
+ *
+ * Idris2 FFI declarations:
+ *   %foreign "C:ic_candid_write_buffer,libic0"
+ *   candidWriteBuffer : Buffer -> Int -> Int -> PrimIO Int
+ *
+ *   %foreign "C:ic_json_read_buffer,libic0"
+ *   jsonReadBuffer : Buffer -> Int -> PrimIO Int
+ *
+ *   %foreign "C:ic_json_get_string,libic0"
+ *   jsonGetString : PrimIO String
+ *
+ *   %foreign "C:ic_str_write_string,libic0"
+ *   strWriteString : String -> PrimIO Int
+ * ============================================================================= */
+
+/* Called from Idris2 via %foreign; -1 when the range does not fit */
+int64_t ic_candid_write_buffer(void* buffer, int64_t loc, int64_t len);
+int64_t ic_json_read_buffer(void* buffer, int64_t loc);
+const char* ic_json_get_string(void);
+int64_t ic_str_write_string(const char* str);
+
 #endif /* IC_FFI_BRIDGE_H */
@@ -0,0 +1,376 @@
+/*
+ * IC Stable Memory Page Cache
+ *
+ * Every ic0.stable64_read/write is a system call with a fixed cost far above
+ * that of copying a few bytes, and the stable structures (stkv nodes and
+ * headers, the Int32/Int64 helpers) mostly touch a few bytes at a time, the
+ * same pages over and over. This cache keeps copies of up to `limit` 4 KB
+ * pages in the Wasm heap, least recently used evicted first:
+ *
+ * - a read is served from the cached page, loading it on a miss;
+ * - a write lands in the cached page and marks the bytes dirty (a write
+ *   covering a whole page does not load it first);
+ * - dirty bytes go back to stable memory on ic_stable_flush, when their
+ *   page is evicted, or before a raw ic0_stable_* read covers them.
+ *
+ * Transfers larger than IC_STABLE_DIRECT bypass the cache (after writing
+ * back / refreshing the pages they overlap), as the call cost is already
+ * amortised there.
+ *
+ * Heap and stable memory commit or roll back together at the end of each
+ * message, so dirty pages may outlive a message safely; only an upgrade
+ * loses them. canister_pre_upgrade must therefore call ic_stable_flush, and
+ * the generated entry points also flush after each update call so stable
+ * memory is always current between messages.
+ *
+ * Growth: the size is queried once and cached (raw grows through
+ * ic0_stubs.c report back), and ic_stable_reserve grows by a quarter of
+ * the current size, clamped to [grow_min, grow_max] pages, rather than to
+ * the exact page needed. Callers check bounds against ic_stable_capacity
+ * inline and only call in when they pass it.
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ic_stable.h"
+
+/* The ic0 imports themselves, as declared in ic0_stubs.c: the wrappers
+ * there call back into the cache for coherence */
+extern void ic0_stable64_read_impl(uint64_t dst, uint64_t offset, uint64_t size)
+    __attribute__((import_module("ic0"), import_name("stable64_read")));
+extern void ic0_stable64_write_impl(uint64_t offset, uint64_t src, uint64_t size)
+    __attribute__((import_module("ic0"), import_name("stable64_write")));
+extern uint64_t ic0_stable64_size_impl(void)
+    __attribute__((import_module("ic0"), import_name("stable64_size")));
+extern uint64_t ic0_stable64_grow_impl(uint64_t new_pages)
+    __attribute__((import_module("ic0"), import_name("stable64_grow")));
+
+#define IC_STABLE_PAGE    4096u
+#define IC_STABLE_PAGES   1024  /* default capacity: 4 MiB */
+#define IC_STABLE_DIRECT  (4u * IC_STABLE_PAGE)
+#define NIL               UINT32_MAX
+
+typedef struct {
+    uint64_t page;        /* stable offset / IC_STABLE_PAGE */
+    uint32_t prev, next;  /* LRU list, most recently used first */
+    uint16_t lo, hi;      /* dirty bytes [lo, hi); clean when equal */
+    uint8_t listed;       /* on the dirty list */
+} cache_slot;
+
+static cache_slot* slots = NULL;
+static uint8_t* data = NULL;    /* slot i's page at data + i * IC_STABLE_PAGE */
+static uint32_t* table = NULL;  /* page -> slot + 1, linear probing; 0 = empty */
+static uint32_t table_mask = 0;
+static uint32_t* dirty = NULL;  /* slots with (possibly) dirty bytes */
+static uint32_t ndirty = 0;
+static uint32_t cap = 0;
+static uint32_t used = 0;
+static uint32_t head = NIL, tail = NIL;
+static int32_t limit = IC_STABLE_PAGES;
+
+static uint64_t hits = 0, misses = 0, writebacks = 0, direct = 0;
+
+static void cache_free(void) {
+    free(slots);
+    free(data);
+    free(table);
+    free(dirty);
+    slots = NULL;
+    data = NULL;
+    table = NULL;
+    dirty = NULL;
+    cap = used = ndirty = 0;
+    head = tail = NIL;
+}
+
+/* Allocate on first use; 0 when the cache is off (or out of memory) */
+static int cache_ready(void) {
+    if (cap != 0) return 1;
+    if (limit <= 0) return 0;
+    uint32_t buckets = 16;
+    while (buckets < 2u * (uint32_t)limit) buckets *= 2;
+    slots = malloc((size_t)limit * sizeof(cache_slot));
+    data = malloc((size_t)limit * IC_STABLE_PAGE);
+    table = calloc(buckets, sizeof(uint32_t));
+    dirty = malloc((size_t)limit * sizeof(uint32_t));
+    if (slots == NULL || data == NULL || table == NULL || dirty == NULL) {
+        cache_free();
+        limit = 0;
+        return 0;
+    }
+    cap = (uint32_t)limit;
+    table_mask = buckets - 1;
+    return 1;
+}
+
+static inline uint32_t bucket(uint64_t page) {
+    return (uint32_t)((page * 0x9E3779B97F4A7C15ull) >> 32) & table_mask;
+}
+
+static inline uint8_t* slot_data(uint32_t s) {
+    return data + (size_t)s * IC_STABLE_PAGE;
+}
+
+static uint32_t lookup(uint64_t page) {
+    for (uint32_t i = bucket(page); table[i] != 0; i = (i + 1) & table_mask) {
+        if (slots[table[i] - 1].page == page) return table[i] - 1;
+    }
+    return NIL;
+}
+
+static void table_insert(uint64_t page, uint32_t s) {
+    uint32_t i = bucket(page);
+    while (table[i] != 0) i = (i + 1) & table_mask;
+    table[i] = s + 1;
+}
+
+/* Delete by shifting later entries of the probe run back */
+static void table_remove(uint64_t page) {
+    uint32_t i = bucket(page);
+    while (slots[table[i] - 1].page != page) i = (i + 1) & table_mask;
+    for (uint32_t j = i;;) {
+        j = (j + 1) & table_mask;
+        if (table[j] == 0) break;
+        uint32_t k = bucket(slots[table[j] - 1].page);
+        if (i <= j ? (i < k && k <= j) : (i < k || k <= j)) continue;
+        table[i] = table[j];
+        i = j;
+    }
+    table[i] = 0;
+}
+
+static void lru_unlink(uint32_t s) {
+    if (slots[s].prev != NIL) slots[slots[s].prev].next = slots[s].next; else head = slots[s].next;
+    if (slots[s].next != NIL) slots[slots[s].next].prev = slots[s].prev; else tail = slots[s].prev;
+}
+
+static void lru_push(uint32_t s) {
+    slots[s].prev = NIL;
+    slots[s].next = head;
+    if (head != NIL) slots[head].prev = s; else tail = s;
+    head = s;
+}
+
+static void write_back(uint32_t s) {
+    cache_slot* c = &slots[s];
+    if (c->lo < c->hi) {
+        ic0_stable64_write_impl(c->page * IC_STABLE_PAGE + c->lo,
+                                (uint64_t)(uintptr_t)(slot_data(s) + c->lo),
+                                (uint64_t)(c->hi - c->lo));
+        writebacks++;
+        c->lo = c->hi = 0;
+    }
+}
+
+/* The slot caching `page`, loading it unless `fill` is 0 (about to be
+ * overwritten whole) */
+static uint32_t get_slot(uint64_t page, int fill) {
+    uint32_t s = lookup(page);
+    if (s != NIL) {
+        hits++;
+        if (s != head) {
+            lru_unlink(s);
+            lru_push(s);
+        }
+        return s;
+    }
+    misses++;
+    if (used < cap) {
+        s = used++;
+        slots[s].listed = 0;
+    } else {
+        s = tail;
+        write_back(s);
+        table_remove(slots[s].page);
+        lru_unlink(s);
+    }
+    slots[s].page = page;
+    slots[s].lo = slots[s].hi = 0;
+    table_insert(page, s);
+    lru_push(s);
+    if (fill) {
+        ic0_stable64_read_impl((uint64_t)(uintptr_t)slot_data(s), page * IC_STABLE_PAGE,
+                               IC_STABLE_PAGE);
+    }
+    return s;
+}
+
+void ic_stable_read(uint64_t offset, void* dst, uint64_t size) {
+    if (size == 0) return;
+    if (size > IC_STABLE_DIRECT || !cache_ready()) {
+        ic_stable_sync(offset, size);
+        ic0_stable64_read_impl((uint64_t)(uintptr_t)dst, offset, size);
+        direct++;
+        return;
+    }
+    uint8_t* out = dst;
+    while (size > 0) {
+        uint32_t in = (uint32_t)(offset % IC_STABLE_PAGE);
+        uint32_t take = IC_STABLE_PAGE - in < size ? IC_STABLE_PAGE - in : (uint32_t)size;
+        uint32_t s = get_slot(offset / IC_STABLE_PAGE, 1);
+        memcpy(out, slot_data(s) + in, take);
+        offset += take;
+        out += take;
+        size -= take;
+    }
+}
+
+void ic_stable_write(uint64_t offset, const void* src, uint64_t size) {
+    if (size == 0) return;
+    if (size > IC_STABLE_DIRECT || !cache_ready()) {
+        ic0_stable64_write_impl(offset, (uint64_t)(uintptr_t)src, size);
+        ic_stable_patch(offset, src, size);
+        direct++;
+        return;
+    }
+    const uint8_t* in_bytes = src;
+    while (size > 0) {
+        uint32_t in = (uint32_t)(offset % IC_STABLE_PAGE);
+        uint32_t take = IC_STABLE_PAGE - in < size ? IC_STABLE_PAGE - in : (uint32_t)size;
+        uint32_t s = get_slot(offset / IC_STABLE_PAGE, take < IC_STABLE_PAGE);
+        cache_slot* c = &slots[s];
+        memcpy(slot_data(s) + in, in_bytes, take);
+        if (c->lo == c->hi) {
+            c->lo = (uint16_t)in;
+            c->hi = (uint16_t)(in + take);
+        } else {
+            if (in < c->lo) c->lo = (uint16_t)in;
+            if (in + take > c->hi) c->hi = (uint16_t)(in + take);
+        }
+        if (!c->listed) {
+            c->listed = 1;
+            dirty[ndirty++] = s;
+        }
+        offset += take;
+        in_bytes += take;
+        size -= take;
+    }
+}
+
+void ic_stable_flush(void) {
+    for (uint32_t i = 0; i < ndirty; i++) {
+        write_back(dirty[i]);
+        slots[dirty[i]].listed = 0;
+    }
+    ndirty = 0;
+}
+
+void ic_stable_sync(uint64_t offset, uint64_t size) {
+    if (ndirty == 0 || size == 0) return;
+    uint64_t first = offset / IC_STABLE_PAGE;
+    uint64_t last = (offset + size - 1) / IC_STABLE_PAGE;
+    if (last - first >= ndirty) {
+        for (uint32_t i = 0; i < ndirty; i++) {
+            uint64_t page = slots[dirty[i]].page;
+            if (page >= first && page <= last) write_back(dirty[i]);
+        }
+    } else {
+        for (uint64_t page = first; page <= last; page++) {
+            uint32_t s = lookup(page);
+            if (s != NIL) write_back(s);
+        }
+    }
+}
+
+/* Copy the part of a direct write that falls in slot `s` */
+static void patch_slot(uint32_t s, uint64_t offset, const uint8_t* src, uint64_t size) {
+    uint64_t start = slots[s].page * IC_STABLE_PAGE;
+    uint64_t lo = offset > start ? offset : start;
+    uint64_t hi = offset + size < start + IC_STABLE_PAGE ? offset + size : start + IC_STABLE_PAGE;
+    memcpy(slot_data(s) + (lo - start), src + (lo - offset), (size_t)(hi - lo));
+}
+
+void ic_stable_patch(uint64_t offset, const void* src, uint64_t size) {
+    if (used == 0 || size == 0) return;
+    uint64_t first = offset / IC_STABLE_PAGE;
+    uint64_t last = (offset + size - 1) / IC_STABLE_PAGE;
+    if (last - first >= used) {
+        for (uint32_t s = 0; s < used; s++) {
+            if (slots[s].page >= first && slots[s].page <= last) patch_slot(s, offset, src, size);
+        }
+    } else {
+        for (uint64_t page = first; page <= last; page++) {
+            uint32_t s = lookup(page);
+            if (s != NIL) patch_slot(s, offset, src, size);
+        }
+    }
+}
+
+void ic_stable_cache_limit(int32_t pages) {
+    ic_stable_flush();
+    cache_free();
+    limit = pages < 0 ? IC_STABLE_PAGES : pages;
+}
+
+/* =============================================================================
+ * Size and growth
+ * ============================================================================= */
+
+#define IC_STABLE_WASM_PAGE  65536u
+#define IC_STABLE_GROW_MIN   16     /* 1 MiB */
+#define IC_STABLE_GROW_MAX   4096   /* 256 MiB */
+
+uint64_t ic_stable_capacity = 0;
+static int size_known = 0;
+static uint64_t grow_min = IC_STABLE_GROW_MIN;
+static uint64_t grow_max = IC_STABLE_GROW_MAX;
+static uint64_t grows = 0;
+
+uint64_t ic_stable_pages(void) {
+    if (!size_known) {
+        ic_stable_capacity = ic0_stable64_size_impl() * IC_STABLE_WASM_PAGE;
+        size_known = 1;
+    }
+    return ic_stable_capacity / IC_STABLE_WASM_PAGE;
+}
+
+int64_t ic_stable_reserve(uint64_t end) {
+    uint64_t pages = ic_stable_pages();
+    if (end <= ic_stable_capacity) return 0;
+    uint64_t need = (end + IC_STABLE_WASM_PAGE - 1) / IC_STABLE_WASM_PAGE - pages;
+    uint64_t step = pages / 4;
+    if (step < grow_min) step = grow_min;
+    if (step > grow_max) step = grow_max;
+    if (step < need) step = need;
+    /* Ahead of need if possible, exactly to it otherwise (near the limit) */
+    if (ic0_stable64_grow_impl(step) == UINT64_MAX) {
+        if (step == need || ic0_stable64_grow_impl(need) == UINT64_MAX) return -1;
+        step = need;
+    }
+    grows++;
+    ic_stable_capacity = (pages + step) * IC_STABLE_WASM_PAGE;
+    return 0;
+}
+
+void ic_stable_grow_policy(int64_t min_pages, int64_t max_pages) {
+    if (min_pages >= 0) grow_min = (uint64_t)min_pages;
+    if (max_pages >= 0) grow_max = (uint64_t)max_pages;
+    if (grow_max < grow_min) grow_max = grow_min;
+}
+
+void ic_stable_resized(uint64_t pages) {
+    ic_stable_capacity = pages * IC_STABLE_WASM_PAGE;
+    size_known = 1;
+}
+
+/*
+ * which: 0=hits 1=misses (pages loaded or claimed) 2=write-backs
+ *        3=direct transfers (past the cache) 4=cached pages
+ *        5=pages awaiting write-back 6=capacity in pages
+ *        7=stable memory grow calls 8=stable memory size in bytes
+ */
+int64_t ic_stable_cache_stat(int32_t which) {
+    switch (which) {
+        case 0: return (int64_t)hits;
+        case 1: return (int64_t)misses;
+        case 2: return (int64_t)writebacks;
+        case 3: return (int64_t)direct;
+        case 4: return (int64_t)used;
+        case 5: return (int64_t)ndirty;
+        case 6: return limit;
+        case 7: return (int64_t)grows;
+        case 8: return (int64_t)(ic_stable_pages() * IC_STABLE_WASM_PAGE);
+        default: return -1;
+    }
+}
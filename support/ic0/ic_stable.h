@@ -0,0 +1,57 @@
+/*
+ * IC Stable Memory Page Cache - write-back LRU cache over ic0.stable64_*
+ *
+ * Small stable reads and writes go through heap-resident copies of 4 KB
+ * pages, so repeated accesses to a page cost one system call instead of
+ * one each. Dirty bytes are written back by ic_stable_flush (end of each
+ * update message and canister_pre_upgrade), on eviction, or before a raw
+ * ic0_stable_* access overlaps them; see ic_stable.c.
+ *
+ * The same module owns stable memory growth: the size is cached and grown
+ * ahead of need in geometric chunks, so a bounds check is all a write pays.
+ */
+#ifndef IC_STABLE_H
+#define IC_STABLE_H
+
+#include <stdint.h>
+
+/* Cached access; the caller has grown stable memory to cover the range */
+void ic_stable_read(uint64_t offset, void* dst, uint64_t size);
+void ic_stable_write(uint64_t offset, const void* src, uint64_t size);
+
+/* Write every dirty page back to stable memory */
+void ic_stable_flush(void);
+
+/* Coherence with uncached access (ic0_stubs.c): write back dirty bytes in
+ * a range before it is read directly; refresh cached copies after it was
+ * written directly */
+void ic_stable_sync(uint64_t offset, uint64_t size);
+void ic_stable_patch(uint64_t offset, const void* src, uint64_t size);
+
+/* Cache capacity in pages (0 disables it; negative: the default) */
+void ic_stable_cache_limit(int32_t pages);
+
+/* Counters (see ic_stable.c) */
+int64_t ic_stable_cache_stat(int32_t which);
+
+/* Current stable memory size in bytes, as far as ic_stable_reserve knows
+ * (0 until its first call) */
+extern uint64_t ic_stable_capacity;
+
+/* Grow stable memory to cover [0, end); 0, or -1 if it cannot */
+int64_t ic_stable_reserve(uint64_t end);
+
+static inline int64_t ic_stable_ensure(uint64_t end) {
+    return end <= ic_stable_capacity ? 0 : ic_stable_reserve(end);
+}
+
+/* Stable memory size in 64 KiB pages (cached) */
+uint64_t ic_stable_pages(void);
+
+/* Chunk bounds for growth, in 64 KiB pages (negative: keep the default) */
+void ic_stable_grow_policy(int64_t min_pages, int64_t max_pages);
+
+/* A raw ic0 grow happened (ic0_stubs.c); `pages` is the new size */
+void ic_stable_resized(uint64_t pages);
+
+#endif /* IC_STABLE_H */
@@ -0,0 +1,956 @@
+/*
+ * Stable structures - vector, hash map and log over IC stable memory
+ *
+ * Canisters that keep tables in stable memory used to lay them out by hand
+ * on ic_stable_read_i64 / ic_stable_write_i64, one call and one bounds
+ * check per 8 bytes. These structures do the layout once, in C, and move
+ * whole ranges per call:
+ *
+ * - StableVec: fixed-size elements, appended or overwritten in place,
+ *   element i found by arithmetic (O(1), no search);
+ * - StableMap: fixed-size keys and values, open addressing with linear
+ *   probing, doubled at 3/4 load;
+ * - StableLog: byte strings of any length appended to segments, entry i
+ *   located through an index vector.
+ *
+ * Space comes from the stkv store's extent allocator (stkv_extent_alloc,
+ * ic_stkv.c), so these share the heap with stkv without fixed regions, and
+ * every access goes through the page cache of ic_stable.c. A handle is the
+ * stable offset of a structure's header run; it stays valid across
+ * upgrades and can be kept under a name with stds_root_set.
+ *
+ * Runs start with the 16-byte header of ic_stkv.c (magic "XRUN", extents,
+ * owner): the owner of a header run names its kind, that of a data run is
+ * its structure's handle. Integers are little-endian.
+ *
+ * Vector header run (1 extent):
+ *   [16] u32 element size  [20] u32 elements per chunk  [24] u64 length
+ *   [32] u64 chunks        [64] u64 chunk offsets
+ *   Chunks are runs of VEC_CHUNK_EXTENTS extents with elements from byte 16;
+ *   an element never straddles two chunks.
+ * Map header run (1 extent):
+ *   [16] u32 key size  [20] u32 value size  [24] u64 entries
+ *   [32] u64 table run [40] u64 slots (a power of two)
+ *   Table slots from byte 16: u8 used, key, value.
+ * Log header run (1 extent):
+ *   [16] u64 entries  [24] u64 index (vector of u64 offset, u32 length)
+ *   [32] u64 segments (vector of u64 run offsets)  [40] u64 current segment
+ *   [48] u64 next free byte in it  [56] u64 its end
+ *   Segments hold the entries' bytes back to back.
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ic_stable.h"
+#include "ic_stkv.h"
+#include "ic_stable_structs.h"
+
+/* RefC Buffer layout, for the bulk functions */
+#if defined(__has_include)
+#if __has_include("buffer.h")
+#include "buffer.h"
+#define IC_HAVE_REFC_BUFFER 1
+#endif
+#endif
+
+/* ic0_stubs.c, ic_ffi_bridge.c */
+extern void ic0_trap(int32_t src, int32_t size);
+extern uint64_t ic0_performance_counter(int32_t type);
+extern int64_t ic_stable_read_i64(int64_t offset);
+
+#define STDS_EXTENT        65536u
+#define STDS_RUN_HEADER    16
+#define STDS_HEADER        64
+#define VEC_CHUNK_EXTENTS  16  /* 1 MiB */
+#define VEC_CHUNK_BYTES    (VEC_CHUNK_EXTENTS * STDS_EXTENT - STDS_RUN_HEADER)
+#define VEC_MAX_CHUNKS     ((STDS_EXTENT - STDS_HEADER) / 8)
+#define VEC_MAX_ELEM       STDS_EXTENT
+#define MAP_MAX_KEY        1024
+#define MAP_MAX_VALUE      4096
+#define MAP_MIN_SLOTS      64u
+#define LOG_SEGMENT_EXTENTS 16
+#define LOG_READ_BYTES     (1u << 20)  /* one stlog_read page */
+
+/* Owner tags of header runs */
+#define KIND_VEC  0x43455653u  /* "SVEC" */
+#define KIND_MAP  0x50414D53u  /* "SMAP" */
+#define KIND_LOG  0x474F4C53u  /* "SLOG" */
+
+static inline uint32_t ld32(const uint8_t* p) { uint32_t v; memcpy(&v, p, 4); return v; }
+static inline uint64_t ld64(const uint8_t* p) { uint64_t v; memcpy(&v, p, 8); return v; }
+static inline void st32(uint8_t* p, uint32_t v) { memcpy(p, &v, 4); }
+static inline void st64(uint8_t* p, uint64_t v) { memcpy(p, &v, 8); }
+
+static void stds_trap(const char* msg) {
+    ic0_trap((int32_t)(uintptr_t)msg, (int32_t)strlen(msg));
+}
+
+static uint64_t get64(uint64_t off) {
+    uint8_t b[8];
+    ic_stable_read(off, b, 8);
+    return ld64(b);
+}
+
+static void put64(uint64_t off, uint64_t v) {
+    uint8_t b[8];
+    st64(b, v);
+    ic_stable_write(off, b, 8);
+}
+
+/* Read the header run of a structure of kind `kind`; -1 if `h` is not one */
+static int header_load(uint64_t h, uint32_t kind, uint8_t* hdr) {
+    if (h == 0 || h % STDS_EXTENT != 0 || h + STDS_EXTENT > ic_stable_pages() * STDS_EXTENT) {
+        return -1;
+    }
+    ic_stable_read(h, hdr, STDS_HEADER);
+    if (memcmp(hdr, "XRUN", 4) != 0 || ld64(hdr + 8) != kind) return -1;
+    return 0;
+}
+
+/* A header run with its fields cleared; 0 when out of stable memory */
+static uint64_t header_new(uint32_t kind, uint8_t* hdr) {
+    uint64_t h = stkv_extent_alloc(1, kind);
+    if (h == 0) return 0;
+    ic_stable_read(h, hdr, STDS_RUN_HEADER);
+    memset(hdr + STDS_RUN_HEADER, 0, STDS_HEADER - STDS_RUN_HEADER);
+    return h;
+}
+
+/* Zero [off, off + size) with a few large writes */
+static void zero_range(uint64_t off, uint64_t size) {
+    static uint8_t* zeros = NULL;
+    if (zeros == NULL && (zeros = calloc(1, STDS_EXTENT)) == NULL) {
+        stds_trap("stds: out of memory");
+    }
+    while (size > 0) {
+        uint64_t n = size < STDS_EXTENT ? size : STDS_EXTENT;
+        ic_stable_write(off, zeros, n);
+        off += n;
+        size -= n;
+    }
+}
+
+/* =============================================================================
+ * StableVec
+ * ============================================================================= */
+
+typedef struct {
+    uint64_t h;
+    uint32_t elem;
+    uint32_t per_chunk;
+    uint64_t len;
+    uint64_t chunks;
+} stvec;
+
+static int vec_load(uint64_t h, stvec* v) {
+    uint8_t hdr[STDS_HEADER];
+    if (header_load(h, KIND_VEC, hdr) != 0) return -1;
+    v->h = h;
+    v->elem = ld32(hdr + 16);
+    v->per_chunk = ld32(hdr + 20);
+    v->len = ld64(hdr + 24);
+    v->chunks = ld64(hdr + 32);
+    return 0;
+}
+
+static void vec_store(const stvec* v) {
+    uint8_t b[16];
+    st64(b, v->len);
+    st64(b + 8, v->chunks);
+    ic_stable_write(v->h + 24, b, 16);
+}
+
+static uint64_t vec_new(uint32_t elem) {
+    uint8_t hdr[STDS_HEADER];
+    uint64_t h = header_new(KIND_VEC, hdr);
+    if (h == 0) return 0;
+    st32(hdr + 16, elem);
+    st32(hdr + 20, VEC_CHUNK_BYTES / elem);
+    ic_stable_write(h, hdr, STDS_HEADER);
+    return h;
+}
+
+static inline uint64_t vec_chunk(const stvec* v, uint64_t c) {
+    return get64(v->h + STDS_HEADER + c * 8);
+}
+
+/* Add chunks until `len` elements fit; -1 past the directory or when out
+ * of stable memory (the chunks added so far stay) */
+static int vec_reserve(stvec* v, uint64_t len) {
+    while (v->chunks * v->per_chunk < len) {
+        if (v->chunks >= VEC_MAX_CHUNKS) return -1;
+        uint64_t run = stkv_extent_alloc(VEC_CHUNK_EXTENTS, v->h);
+        if (run == 0) return -1;
+        put64(v->h + STDS_HEADER + v->chunks * 8, run);
+        v->chunks++;
+        vec_store(v);
+    }
+    return 0;
+}
+
+/* Copy elements [first, first + count) out of / into stable memory, one
+ * transfer per chunk touched */
+static void vec_io(const stvec* v, uint64_t first, uint64_t count, uint8_t* p, int write) {
+    while (count > 0) {
+        uint64_t c = first / v->per_chunk;
+        uint64_t i = first % v->per_chunk;
+        uint64_t n = v->per_chunk - i;
+        if (n > count) n = count;
+        uint64_t off = vec_chunk(v, c) + STDS_RUN_HEADER + i * v->elem;
+        if (write) ic_stable_write(off, p, n * v->elem);
+        else ic_stable_read(off, p, n * v->elem);
+        p += n * v->elem;
+        first += n;
+        count -= n;
+    }
+}
+
+static int64_t vec_append(stvec* v, const uint8_t* items, uint64_t count) {
+    uint64_t first = v->len;
+    if (vec_reserve(v, first + count) != 0) return -1;
+    vec_io(v, first, count, (uint8_t*)items, 1);
+    v->len = first + count;
+    vec_store(v);
+    return (int64_t)first;
+}
+
+static void vec_drop(stvec* v) {
+    for (uint64_t c = 0; c < v->chunks; c++) stkv_extent_free(vec_chunk(v, c));
+    stkv_extent_free(v->h);
+}
+
+/*
+ * New vector of `elem_size`-byte elements (1 to 64 KiB). Chunks of 1 MiB
+ * are added as it grows, up to 8184 of them (8 GiB less per-chunk slack).
+ * Returns its handle, or 0.
+ */
+int64_t stvec_new(int64_t elem_size) {
+    if (elem_size <= 0 || elem_size > VEC_MAX_ELEM) return 0;
+    return (int64_t)vec_new((uint32_t)elem_size);
+}
+
+int64_t stvec_len(int64_t h) {
+    stvec v;
+    return vec_load((uint64_t)h, &v) == 0 ? (int64_t)v.len : -1;
+}
+
+/*
+ * Shrink to `len` elements, freeing the chunks no longer needed
+ */
+int64_t stvec_truncate(int64_t h, int64_t len) {
+    stvec v;
+    if (vec_load((uint64_t)h, &v) != 0 || len < 0 || (uint64_t)len > v.len) return -1;
+    uint64_t keep = ((uint64_t)len + v.per_chunk - 1) / v.per_chunk;
+    while (v.chunks > keep) stkv_extent_free(vec_chunk(&v, --v.chunks));
+    v.len = (uint64_t)len;
+    vec_store(&v);
+    return 0;
+}
+
+int64_t stvec_push_i64(int64_t h, int64_t value) {
+    stvec v;
+    if (vec_load((uint64_t)h, &v) != 0 || v.elem != 8) return -1;
+    uint8_t b[8];
+    st64(b, (uint64_t)value);
+    return vec_append(&v, b, 1);
+}
+
+/* Element `index` of a vector of 8-byte elements; 0 if out of range */
+int64_t stvec_get_i64(int64_t h, int64_t index) {
+    stvec v;
+    if (vec_load((uint64_t)h, &v) != 0 || v.elem != 8 || index < 0 ||
+        (uint64_t)index >= v.len) {
+        return 0;
+    }
+    uint8_t b[8];
+    vec_io(&v, (uint64_t)index, 1, b, 0);
+    return (int64_t)ld64(b);
+}
+
+int64_t stvec_set_i64(int64_t h, int64_t index, int64_t value) {
+    stvec v;
+    if (vec_load((uint64_t)h, &v) != 0 || v.elem != 8 || index < 0 ||
+        (uint64_t)index >= v.len) {
+        return -1;
+    }
+    uint8_t b[8];
+    st64(b, (uint64_t)value);
+    vec_io(&v, (uint64_t)index, 1, b, 1);
+    return 0;
+}
+
+#ifdef IC_HAVE_REFC_BUFFER
+
+/*
+ * Append the elements packed in `items` (a whole number of them).
+ * Returns the index of the first, or -1 (nothing appended).
+ */
+int64_t stvec_push(int64_t h, void* items) {
+    const Buffer* b = items;
+    stvec v;
+    if (vec_load((uint64_t)h, &v) != 0 || b->size < 0 || b->size % v.elem != 0) return -1;
+    return vec_append(&v, (const uint8_t*)b->data, (uint64_t)b->size / v.elem);
+}
+
+/*
+ * Append elements [first, first + count) to `out`, clipped to the length.
+ * Returns how many, or -1.
+ */
+int64_t stvec_get(int64_t h, int64_t first, int64_t count, void* out) {
+    Buffer* o = out;
+    stvec v;
+    if (vec_load((uint64_t)h, &v) != 0 || first < 0 || count < 0) return -1;
+    if ((uint64_t)first >= v.len) return 0;
+    if ((uint64_t)count > v.len - (uint64_t)first) count = (int64_t)(v.len - (uint64_t)first);
+    uint64_t bytes = (uint64_t)count * v.elem;
+    if (bytes > INT32_MAX - (uint64_t)o->size) return -1;
+    reserveBuffer(o, (int)bytes);
+    vec_io(&v, (uint64_t)first, (uint64_t)count, (uint8_t*)o->data + o->size, 0);
+    o->size += (int)bytes;
+    return count;
+}
+
+/*
+ * Overwrite elements from `first` with those packed in `items`; they must
+ * all exist already. Returns how many, or -1.
+ */
+int64_t stvec_set(int64_t h, int64_t first, void* items) {
+    const Buffer* b = items;
+    stvec v;
+    if (vec_load((uint64_t)h, &v) != 0 || first < 0 || b->size < 0 ||
+        b->size % v.elem != 0) {
+        return -1;
+    }
+    uint64_t count = (uint64_t)b->size / v.elem;
+    if ((uint64_t)first > v.len || count > v.len - (uint64_t)first) return -1;
+    vec_io(&v, (uint64_t)first, count, (uint8_t*)b->data, 1);
+    return (int64_t)count;
+}
+
+#endif /* IC_HAVE_REFC_BUFFER */
+
+/* =============================================================================
+ * StableMap
+ * ============================================================================= */
+
+typedef struct {
+    uint64_t h;
+    uint32_t key;
+    uint32_t val;
+    uint32_t slot;   /* 1 + key + val */
+    uint64_t count;
+    uint64_t table;  /* run offset; slot i at table + 16 + i * slot */
+    uint64_t mask;   /* slots - 1 */
+} stmap;
+
+static uint8_t map_slot_buf[1 + MAP_MAX_KEY + MAP_MAX_VALUE];
+
+static int map_load(uint64_t h, stmap* m) {
+    uint8_t hdr[STDS_HEADER];
+    if (header_load(h, KIND_MAP, hdr) != 0) return -1;
+    m->h = h;
+    m->key = ld32(hdr + 16);
+    m->val = ld32(hdr + 20);
+    m->slot = 1 + m->key + m->val;
+    m->count = ld64(hdr + 24);
+    m->table = ld64(hdr + 32);
+    m->mask = ld64(hdr + 40) - 1;
+    return 0;
+}
+
+static void map_store(const stmap* m) {
+    uint8_t b[24];
+    st64(b, m->count);
+    st64(b + 8, m->table);
+    st64(b + 16, m->mask + 1);
+    ic_stable_write(m->h + 24, b, 24);
+}
+
+static uint64_t map_hash(const uint8_t* key, uint32_t n) {
+    uint64_t x = 0xCBF29CE484222325ull;
+    for (uint32_t i = 0; i < n; i++) x = (x ^ key[i]) * 0x100000001B3ull;
+    x ^= x >> 33;
+    x *= 0xFF51AFD7ED558CCDull;
+    return x ^ (x >> 33);
+}
+
+static inline uint64_t map_slot(const stmap* m, uint64_t i) {
+    return m->table + STDS_RUN_HEADER + i * m->slot;
+}
+
+/* A cleared table of `slots` slots for map `h`; 0 when out of stable memory */
+static uint64_t map_table(uint64_t h, uint32_t slot, uint64_t slots) {
+    uint64_t bytes = STDS_RUN_HEADER + slots * slot;
+    uint64_t run = stkv_extent_alloc((bytes + STDS_EXTENT - 1) / STDS_EXTENT, h);
+    if (run != 0) zero_range(run + STDS_RUN_HEADER, slots * slot);
+    return run;
+}
+
+/* Slot holding `key` (1), or the empty slot ending its probe run (0) */
+static int map_find(const stmap* m, const uint8_t* key, uint64_t* index) {
+    uint8_t* s = map_slot_buf;
+    for (uint64_t i = map_hash(key, m->key) & m->mask;; i = (i + 1) & m->mask) {
+        ic_stable_read(map_slot(m, i), s, 1 + m->key);
+        if (s[0] == 0 || memcmp(s + 1, key, m->key) == 0) {
+            *index = i;
+            return s[0] != 0;
+        }
+    }
+}
+
+/* Double the table, moving the entries over a block of slots at a time */
+static int map_grow(stmap* m) {
+    static uint8_t* block = NULL;
+    if (block == NULL && (block = malloc(STDS_EXTENT)) == NULL) {
+        stds_trap("stds: out of memory");
+    }
+    uint64_t slots = m->mask + 1;
+    uint64_t table = map_table(m->h, m->slot, slots * 2);
+    if (table == 0) return -1;
+    stmap old = *m;
+    m->table = table;
+    m->mask = slots * 2 - 1;
+    uint64_t per_block = STDS_EXTENT / m->slot;
+    if (per_block == 0) per_block = 1;
+    for (uint64_t first = 0; first < slots; first += per_block) {
+        uint64_t n = slots - first < per_block ? slots - first : per_block;
+        ic_stable_read(map_slot(&old, first), block, n * m->slot);
+        for (uint64_t j = 0; j < n; j++) {
+            const uint8_t* s = block + j * m->slot;
+            if (s[0] == 0) continue;
+            uint64_t i;
+            map_find(m, s + 1, &i);
+            ic_stable_write(map_slot(m, i), s, m->slot);
+        }
+    }
+    stkv_extent_free(old.table);
+    map_store(m);
+    return 0;
+}
+
+static int map_put(stmap* m, const uint8_t* key, const uint8_t* val) {
+    if ((m->count + 1) * 4 > (m->mask + 1) * 3 && map_grow(m) != 0) return -1;
+    uint64_t i;
+    int found = map_find(m, key, &i);
+    uint8_t* s = map_slot_buf;
+    s[0] = 1;
+    memcpy(s + 1, key, m->key);
+    memcpy(s + 1 + m->key, val, m->val);
+    ic_stable_write(map_slot(m, i), s, m->slot);
+    if (!found) m->count++;
+    return 0;
+}
+
+/* Delete by shifting later entries of the probe run back */
+static int map_remove(stmap* m, const uint8_t* key) {
+    uint64_t i;
+    if (!map_find(m, key, &i)) return 0;
+    uint8_t* s = map_slot_buf;
+    for (uint64_t j = i;;) {
+        j = (j + 1) & m->mask;
+        ic_stable_read(map_slot(m, j), s, m->slot);
+        if (s[0] == 0) break;
+        uint64_t k = map_hash(s + 1, m->key) & m->mask;
+        if (i <= j ? (i < k && k <= j) : (i < k || k <= j)) continue;
+        ic_stable_write(map_slot(m, i), s, m->slot);
+        i = j;
+    }
+    s[0] = 0;
+    ic_stable_write(map_slot(m, i), s, 1);
+    m->count--;
+    return 1;
+}
+
+/*
+ * New map of `key_size`-byte keys (1 to 1 KiB) and `val_size`-byte values
+ * (0 to 4 KiB). Returns its handle, or 0.
+ */
+int64_t stmap_new(int64_t key_size, int64_t val_size) {
+    if (key_size <= 0 || key_size > MAP_MAX_KEY || val_size < 0 || val_size > MAP_MAX_VALUE) {
+        return 0;
+    }
+    uint8_t hdr[STDS_HEADER];
+    uint64_t h = header_new(KIND_MAP, hdr);
+    if (h == 0) return 0;
+    uint64_t table = map_table(h, (uint32_t)(1 + key_size + val_size), MAP_MIN_SLOTS);
+    if (table == 0) {
+        stkv_extent_free(h);
+        return 0;
+    }
+    st32(hdr + 16, (uint32_t)key_size);
+    st32(hdr + 20, (uint32_t)val_size);
+    st64(hdr + 32, table);
+    st64(hdr + 40, MAP_MIN_SLOTS);
+    ic_stable_write(h, hdr, STDS_HEADER);
+    return (int64_t)h;
+}
+
+int64_t stmap_len(int64_t h) {
+    stmap m;
+    return map_load((uint64_t)h, &m) == 0 ? (int64_t)m.count : -1;
+}
+
+int64_t stmap_put_i64(int64_t h, int64_t key, int64_t value) {
+    stmap m;
+    if (map_load((uint64_t)h, &m) != 0 || m.key != 8 || m.val != 8) return -1;
+    uint8_t k[8], v[8];
+    st64(k, (uint64_t)key);
+    st64(v, (uint64_t)value);
+    int r = map_put(&m, k, v);
+    map_store(&m);
+    return r;
+}
+
+/* Value of `key` in a map of 8-byte keys and values, or `absent` */
+int64_t stmap_get_i64(int64_t h, int64_t key, int64_t absent) {
+    stmap m;
+    if (map_load((uint64_t)h, &m) != 0 || m.key != 8 || m.val != 8) return absent;
+    uint8_t k[8];
+    st64(k, (uint64_t)key);
+    uint64_t i;
+    if (!map_find(&m, k, &i)) return absent;
+    return (int64_t)get64(map_slot(&m, i) + 9);
+}
+
+#ifdef IC_HAVE_REFC_BUFFER
+
+/*
+ * Insert or replace the entries packed in `entries` as [key, value]*, in
+ * order. Returns how many were stored, or -1 (a malformed list stores
+ * nothing; running out of stable memory keeps those stored before).
+ */
+int64_t stmap_put(int64_t h, void* entries) {
+    const Buffer* b = entries;
+    stmap m;
+    if (map_load((uint64_t)h, &m) != 0 || b->size < 0) return -1;
+    uint32_t size = m.key + m.val;
+    if (b->size % size != 0) return -1;
+    int64_t n = 0;
+    for (const uint8_t* p = (const uint8_t*)b->data; n < b->size / size; p += size, n++) {
+        if (map_put(&m, p, p + m.key) != 0) {
+            n = -1;
+            break;
+        }
+    }
+    map_store(&m);
+    return n;
+}
+
+/*
+ * Look up the keys packed in `keys`, appending per key a u8 (1: found) and
+ * the value (zeros when absent) to `out`. Returns the keys found, or -1.
+ */
+int64_t stmap_get(int64_t h, void* keys, void* out) {
+    const Buffer* b = keys;
+    Buffer* o = out;
+    stmap m;
+    if (map_load((uint64_t)h, &m) != 0 || b->size < 0 || b->size % m.key != 0) return -1;
+    uint64_t n = (uint64_t)b->size / m.key;
+    if (n * (1 + m.val) > INT32_MAX - (uint64_t)o->size) return -1;
+    reserveBuffer(o, (int)(n * (1 + m.val)));
+    uint8_t* r = (uint8_t*)o->data + o->size;
+    int64_t found = 0;
+    for (uint64_t k = 0; k < n; k++, r += 1 + m.val) {
+        uint64_t i;
+        if (map_find(&m, (const uint8_t*)b->data + k * m.key, &i)) {
+            r[0] = 1;
+            ic_stable_read(map_slot(&m, i) + 1 + m.key, r + 1, m.val);
+            found++;
+        } else {
+            memset(r, 0, 1 + m.val);
+        }
+    }
+    o->size += (int)(n * (1 + m.val));
+    return found;
+}
+
+/*
+ * Remove the keys packed in `keys`; how many were present, or -1
+ */
+int64_t stmap_delete(int64_t h, void* keys) {
+    const Buffer* b = keys;
+    stmap m;
+    if (map_load((uint64_t)h, &m) != 0 || b->size < 0 || b->size % m.key != 0) return -1;
+    int64_t removed = 0;
+    for (int i = 0; i < b->size; i += (int)m.key) {
+        removed += map_remove(&m, (const uint8_t*)b->data + i);
+    }
+    map_store(&m);
+    return removed;
+}
+
+#endif /* IC_HAVE_REFC_BUFFER */
+
+/* =============================================================================
+ * StableLog
+ * ============================================================================= */
+
+#define LOG_INDEX_ELEM 12  /* u64 offset, u32 length */
+
+typedef struct {
+    uint64_t h;
+    uint64_t count;
+    stvec index;
+    stvec segments;
+    uint64_t segment;
+    uint64_t pos;
+    uint64_t end;
+} stlog;
+
+static int log_load(uint64_t h, stlog* l) {
+    uint8_t hdr[STDS_HEADER];
+    if (header_load(h, KIND_LOG, hdr) != 0) return -1;
+    l->h = h;
+    l->count = ld64(hdr + 16);
+    if (vec_load(ld64(hdr + 24), &l->index) != 0) return -1;
+    if (vec_load(ld64(hdr + 32), &l->segments) != 0) return -1;
+    l->segment = ld64(hdr + 40);
+    l->pos = ld64(hdr + 48);
+    l->end = ld64(hdr + 56);
+    return 0;
+}
+
+static void log_store(const stlog* l) {
+    uint8_t b[8];
+    st64(b, l->count);
+    ic_stable_write(l->h + 16, b, 8);
+    uint8_t s[24];
+    st64(s, l->segment);
+    st64(s + 8, l->pos);
+    st64(s + 16, l->end);
+    ic_stable_write(l->h + 40, s, 24);
+}
+
+/* Room for `len` more bytes, in a fresh segment if the current one is
+ * short; -1 when out of stable memory */
+static int log_room(stlog* l, uint64_t len) {
+    if (l->segment != 0 && len <= l->end - l->pos) return 0;
+    uint64_t extents = (STDS_RUN_HEADER + len + STDS_EXTENT - 1) / STDS_EXTENT;
+    if (extents < LOG_SEGMENT_EXTENTS) extents = LOG_SEGMENT_EXTENTS;
+    uint64_t run = stkv_extent_alloc(extents, l->h);
+    if (run == 0) return -1;
+    uint8_t b[8];
+    st64(b, run);
+    if (vec_append(&l->segments, b, 1) < 0) {
+        stkv_extent_free(run);
+        return -1;
+    }
+    l->segment = run;
+    l->pos = run + STDS_RUN_HEADER;
+    l->end = run + extents * STDS_EXTENT;
+    return 0;
+}
+
+/*
+ * New empty log. Returns its handle, or 0.
+ */
+int64_t stlog_new(void) {
+    uint8_t hdr[STDS_HEADER];
+    uint64_t h = header_new(KIND_LOG, hdr);
+    if (h == 0) return 0;
+    uint64_t index = vec_new(LOG_INDEX_ELEM);
+    uint64_t segments = index != 0 ? vec_new(8) : 0;
+    if (segments == 0) {
+        if (index != 0) stkv_extent_free(index);
+        stkv_extent_free(h);
+        return 0;
+    }
+    st64(hdr + 24, index);
+    st64(hdr + 32, segments);
+    ic_stable_write(h, hdr, STDS_HEADER);
+    return (int64_t)h;
+}
+
+int64_t stlog_len(int64_t h) {
+    stlog l;
+    return log_load((uint64_t)h, &l) == 0 ? (int64_t)l.count : -1;
+}
+
+#ifdef IC_HAVE_REFC_BUFFER
+
+/*
+ * Append the entries packed in `entries` as [u32 len, bytes]*. Returns the
+ * index of the first, or -1 (a malformed list or a lack of stable memory
+ * appends nothing).
+ */
+int64_t stlog_append(int64_t h, void* entries) {
+    static uint8_t* index = NULL;
+    static uint64_t index_cap = 0;
+    const Buffer* b = entries;
+    stlog l;
+    if (log_load((uint64_t)h, &l) != 0 || b->size < 0) return -1;
+    const uint8_t* p = (const uint8_t*)b->data;
+    uint64_t n = 0;
+    for (int pos = 0; pos < b->size; n++) {
+        if (b->size - pos < 4 || ld32(p + pos) > (uint32_t)(b->size - pos - 4)) return -1;
+        pos += 4 + (int)ld32(p + pos);
+    }
+    if (n * LOG_INDEX_ELEM > index_cap) {
+        uint8_t* q = realloc(index, (size_t)(n * LOG_INDEX_ELEM));
+        if (q == NULL) stds_trap("stds: out of memory");
+        index = q;
+        index_cap = n * LOG_INDEX_ELEM;
+    }
+    /* On failure the bytes written stay behind as dead space; the count
+     * (and so every read) is unchanged */
+    uint8_t* e = index;
+    for (int pos = 0; pos < b->size; e += LOG_INDEX_ELEM) {
+        uint32_t len = ld32(p + pos);
+        if (log_room(&l, len) != 0) {
+            log_store(&l);
+            return -1;
+        }
+        ic_stable_write(l.pos, p + pos + 4, len);
+        st64(e, l.pos);
+        st32(e + 8, len);
+        l.pos += len;
+        pos += 4 + (int)len;
+    }
+    if (vec_append(&l.index, index, n) < 0) {
+        log_store(&l);
+        return -1;
+    }
+    int64_t first = (int64_t)l.count;
+    l.count += n;
+    log_store(&l);
+    return first;
+}
+
+/*
+ * Append entries from `first` to `out` as [u32 len, bytes]*: at most
+ * `count`, stopping after about 1 MiB (but at least one). Entries written
+ * back to back are read in one transfer. Returns how many, or -1.
+ */
+int64_t stlog_read(int64_t h, int64_t first, int64_t count, void* out) {
+    static uint8_t* index = NULL;
+    static uint64_t index_cap = 0;
+    Buffer* o = out;
+    stlog l;
+    if (log_load((uint64_t)h, &l) != 0 || first < 0 || count < 0) return -1;
+    if ((uint64_t)first >= l.count) return 0;
+    if ((uint64_t)count > l.count - (uint64_t)first) count = (int64_t)(l.count - (uint64_t)first);
+    if (count > LOG_READ_BYTES / 4) count = LOG_READ_BYTES / 4;  /* more never fit */
+    if ((uint64_t)count * LOG_INDEX_ELEM > index_cap) {
+        uint8_t* q = realloc(index, (size_t)count * LOG_INDEX_ELEM);
+        if (q == NULL) stds_trap("stds: out of memory");
+        index = q;
+        index_cap = (uint64_t)count * LOG_INDEX_ELEM;
+    }
+    /* Entries that fit in the page, and the bytes they take in `out` */
+    uint64_t taken = 0, bytes = 0;
+    const uint64_t step = 4096;
+    while (taken < (uint64_t)count) {
+        uint64_t n = (uint64_t)count - taken < step ? (uint64_t)count - taken : step;
+        vec_io(&l.index, (uint64_t)first + taken, n, index + taken * LOG_INDEX_ELEM, 0);
+        uint64_t j = taken;
+        for (; j < taken + n; j++) {
+            uint64_t size = 4 + ld32(index + j * LOG_INDEX_ELEM + 8);
+            if (j > 0 && bytes + size > LOG_READ_BYTES) break;
+            bytes += size;
+        }
+        if (j < taken + n) {
+            taken = j;
+            break;
+        }
+        taken += n;
+    }
+    if (bytes > INT32_MAX - (uint64_t)o->size) return -1;
+    reserveBuffer(o, (int)bytes);
+    uint8_t* w = (uint8_t*)o->data + o->size;
+    for (uint64_t j = 0; j < taken;) {
+        /* A run of entries stored back to back */
+        uint64_t start = ld64(index + j * LOG_INDEX_ELEM);
+        uint64_t k = j, end = start;
+        for (; k < taken && ld64(index + k * LOG_INDEX_ELEM) == end; k++) {
+            end += ld32(index + k * LOG_INDEX_ELEM + 8);
+        }
+        /* Read them past the room for their lengths, then move each one
+         * down behind its length, first to last */
+        const uint8_t* data = w + 4 * (k - j);
+        ic_stable_read(start, w + 4 * (k - j), end - start);
+        for (; j < k; j++) {
+            uint32_t len = ld32(index + j * LOG_INDEX_ELEM + 8);
+            st32(w, len);
+            memmove(w + 4, data, len);
+            data += len;
+            w += 4 + len;
+        }
+    }
+    o->size += (int)bytes;
+    return (int64_t)taken;
+}
+
+#endif /* IC_HAVE_REFC_BUFFER */
+
+/* =============================================================================
+ * Lifetime and roots
+ * ============================================================================= */
+
+/*
+ * Free a vector, map or log with all its runs; the handle is invalid after.
+ * Returns 0, or -1 if `h` is none of them.
+ */
+int64_t stds_drop(int64_t h) {
+    stvec v;
+    stmap m;
+    stlog l;
+    if (vec_load((uint64_t)h, &v) == 0) {
+        vec_drop(&v);
+    } else if (map_load((uint64_t)h, &m) == 0) {
+        stkv_extent_free(m.table);
+        stkv_extent_free(m.h);
+    } else if (log_load((uint64_t)h, &l) == 0) {
+        for (uint64_t s = 0; s < l.segments.len; s++) {
+            uint8_t b[8];
+            vec_io(&l.segments, s, 1, b, 0);
+            stkv_extent_free(ld64(b));
+        }
+        vec_drop(&l.segments);
+        vec_drop(&l.index);
+        stkv_extent_free(l.h);
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+#ifdef IC_HAVE_REFC_BUFFER
+
+#define ROOT_PREFIX "stds/"
+
+static uint8_t* root_key(const Buffer* name, int64_t* len) {
+    static uint8_t* key = NULL;
+    static int64_t cap = 0;
+    *len = (int64_t)(sizeof ROOT_PREFIX - 1) + name->size;
+    if (*len > cap) {
+        uint8_t* k = realloc(key, (size_t)*len);
+        if (k == NULL) stds_trap("stds: out of memory");
+        key = k;
+        cap = *len;
+    }
+    memcpy(key, ROOT_PREFIX, sizeof ROOT_PREFIX - 1);
+    memcpy(key + sizeof ROOT_PREFIX - 1, name->data, (size_t)name->size);
+    return key;
+}
+
+/*
+ * Handle kept under `name` (stkv key "stds/" + name), or 0
+ */
+int64_t stds_root_get(void* name) {
+    int64_t len;
+    uint8_t* key = root_key(name, &len);
+    uint8_t b[8];
+    if (stkv_get((int64_t)(uintptr_t)key, len, (int64_t)(uintptr_t)b, 8) != 8) return 0;
+    return (int64_t)ld64(b);
+}
+
+/*
+ * Keep `h` under `name` (0 forgets it); 0, or -1
+ */
+int64_t stds_root_set(void* name, int64_t h) {
+    int64_t len;
+    uint8_t* key = root_key(name, &len);
+    if (h == 0) return stkv_delete((int64_t)(uintptr_t)key, len);
+    uint8_t b[8];
+    st64(b, (uint64_t)h);
+    return stkv_put((int64_t)(uintptr_t)key, len, (int64_t)(uintptr_t)b, 8);
+}
+
+#endif /* IC_HAVE_REFC_BUFFER */
+
+/* =============================================================================
+ * Benchmark (canister only: uses ic0.performance_counter)
+ *
+ * Instructions spent by IC_BENCH_STDS_REPS reads, hand-rolled versus
+ * through the structures:
+ * op 0: fill a bench vector and map with 0..n-1 and a log with n 32-byte
+ *       entries, at most IC_BENCH_STDS_BATCH more per call; returns how
+ *       many each holds
+ * op 1: ic_stable_read_i64 from a table of i64s at stable page 1
+ *       (read only, n <= 73728 so it stays within the canister data pages)
+ * op 2: stvec_get_i64 at the same spread of indices
+ * op 3: one stvec_get of IC_BENCH_STDS_REPS consecutive elements
+ * op 4: stmap_get_i64 of spread keys
+ * op 5: one stlog_read of IC_BENCH_STDS_REPS consecutive entries
+ * ============================================================================= */
+
+#define IC_BENCH_STDS_BATCH 20000
+#define IC_BENCH_STDS_REPS 64
+
+static uint64_t bench_handle(uint64_t* h, const char* name, int kind) {
+    if (*h != 0) return *h;
+    uint8_t b[8];
+    if (stkv_get((int64_t)(uintptr_t)name, (int64_t)strlen(name), (int64_t)(uintptr_t)b, 8) == 8) {
+        return *h = ld64(b);
+    }
+    *h = (uint64_t)(kind == 0 ? stvec_new(8) : kind == 1 ? stmap_new(8, 8) : stlog_new());
+    if (*h == 0) stds_trap("stds: out of stable memory");
+    st64(b, *h);
+    stkv_put((int64_t)(uintptr_t)name, (int64_t)strlen(name), (int64_t)(uintptr_t)b, 8);
+    return *h;
+}
+
+uint64_t ic_bench_stds(int32_t op, int32_t n) {
+    static uint64_t vec = 0, map = 0, log = 0;
+    if (n <= 0) return 0;
+    bench_handle(&vec, "stds/bench:vec", 0);
+    bench_handle(&map, "stds/bench:map", 1);
+    bench_handle(&log, "stds/bench:log", 2);
+    uint64_t have = (uint64_t)stvec_len((int64_t)vec);
+
+    if (op == 0) {
+        uint64_t stop = have + IC_BENCH_STDS_BATCH;
+        if (stop > (uint64_t)n) stop = (uint64_t)n;
+        for (uint64_t i = have; i < stop; i++) {
+            if (stvec_push_i64((int64_t)vec, (int64_t)i) < 0) break;
+            stmap_put_i64((int64_t)map, (int64_t)i, (int64_t)i);
+            have = i + 1;
+        }
+#ifdef IC_HAVE_REFC_BUFFER
+        uint64_t logged = (uint64_t)stlog_len((int64_t)log);
+        if (logged < have) {
+            Buffer* b = newBufferWithCapacity((int)((have - logged) * 36));
+            if (b == NULL) stds_trap("stds: out of memory");
+            for (uint64_t i = logged; i < have; i++) {
+                uint8_t* p = (uint8_t*)b->data + b->size;
+                st32(p, 32);
+                memset(p + 4, (int)(i & 0xFF), 32);
+                b->size += 36;
+            }
+            stlog_append((int64_t)log, b);
+            freeBuffer(b);
+        }
+#endif
+        return have;
+    }
+    if (op < 1 || op > 5 || have < (uint64_t)n) return 0;
+    if (op == 1 && n > 73728) return 0;
+
+    volatile int64_t sink = 0;
+    uint64_t start = ic0_performance_counter(0);
+    if (op == 3 || op == 5) {
+#ifdef IC_HAVE_REFC_BUFFER
+        Buffer* out = newBufferWithCapacity(0);
+        if (out == NULL) stds_trap("stds: out of memory");
+        start = ic0_performance_counter(0);
+        int64_t first = n > IC_BENCH_STDS_REPS ? (n - IC_BENCH_STDS_REPS) / 2 : 0;
+        if (op == 3) sink += stvec_get((int64_t)vec, first, IC_BENCH_STDS_REPS, out);
+        else sink += stlog_read((int64_t)log, first, IC_BENCH_STDS_REPS, out);
+        uint64_t cost = ic0_performance_counter(0) - start;
+        freeBuffer(out);
+        return cost;
+#else
+        return 0;
+#endif
+    }
+    for (uint32_t r = 0; r < IC_BENCH_STDS_REPS; r++) {
+        int64_t i = (int64_t)(((uint64_t)r * 2654435761u) % (uint32_t)n);
+        if (op == 1) sink += ic_stable_read_i64(STDS_EXTENT + i * 8);
+        else if (op == 2) sink += stvec_get_i64((int64_t)vec, i);
+        else sink += stmap_get_i64((int64_t)map, i, -1);
+    }
+    uint64_t cost = ic0_performance_counter(0) - start;
+    (void)sink;
+    return cost;
+}
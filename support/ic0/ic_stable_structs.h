@@ -0,0 +1,57 @@
+/*
+ * Stable structures - vector, hash map and log in IC stable memory
+ *
+ * See ic_stable_structs.c for the layouts. Handles are stable offsets and
+ * survive upgrades; the Buffer arguments are RefC Buffers.
+ */
+#ifndef IC_STABLE_STRUCTS_H
+#define IC_STABLE_STRUCTS_H
+
+#include <stdint.h>
+
+/* Vector of fixed-size elements: handle, or 0 */
+int64_t stvec_new(int64_t elem_size);
+int64_t stvec_len(int64_t h);
+/* Elements packed back to back; index of the first appended, or -1 */
+int64_t stvec_push(int64_t h, void* items);
+/* Append elements [first, first + count) to `out`; how many, or -1 */
+int64_t stvec_get(int64_t h, int64_t first, int64_t count, void* out);
+int64_t stvec_set(int64_t h, int64_t first, void* items);
+int64_t stvec_truncate(int64_t h, int64_t len);
+/* 8-byte elements without a Buffer */
+int64_t stvec_push_i64(int64_t h, int64_t value);
+int64_t stvec_get_i64(int64_t h, int64_t index);
+int64_t stvec_set_i64(int64_t h, int64_t index, int64_t value);
+
+/* Hash map of fixed-size keys and values: handle, or 0 */
+int64_t stmap_new(int64_t key_size, int64_t val_size);
+int64_t stmap_len(int64_t h);
+/* Entries packed as [key, value]*; entries stored, or -1 */
+int64_t stmap_put(int64_t h, void* entries);
+/* Per key appends [u8 found, value]; keys found, or -1 */
+int64_t stmap_get(int64_t h, void* keys, void* out);
+int64_t stmap_delete(int64_t h, void* keys);
+/* 8-byte keys and values without a Buffer */
+int64_t stmap_put_i64(int64_t h, int64_t key, int64_t value);
+int64_t stmap_get_i64(int64_t h, int64_t key, int64_t absent);
+
+/* Append-only log of byte strings: handle, or 0 */
+int64_t stlog_new(void);
+int64_t stlog_len(int64_t h);
+/* Entries packed as [u32 len, bytes]*; index of the first, or -1 */
+int64_t stlog_append(int64_t h, void* entries);
+/* Append entries from `first` to `out` as [u32 len, bytes]* (about 1 MiB
+ * at most, at least one entry); how many, or -1 */
+int64_t stlog_read(int64_t h, int64_t first, int64_t count, void* out);
+
+/* Free a vector, map or log and everything it holds; 0, or -1 */
+int64_t stds_drop(int64_t h);
+
+/* Handles kept by name in the stkv store: the handle or 0; 0 or -1 */
+int64_t stds_root_get(void* name);
+int64_t stds_root_set(void* name, int64_t h);
+
+/* Benchmark (canister only), see ic_stable_structs.c */
+uint64_t ic_bench_stds(int32_t op, int32_t n);
+
+#endif /* IC_STABLE_STRUCTS_H */
@@ -0,0 +1,2183 @@
+/*
+ * Stable KV Store - B+tree over IC stable memory
+ *
+ * Keys are indexed by a B+tree of 4 KB nodes: binary search within a node,
+ * leaves chained in key order for range scans. Values live out of line in
+ * append-only segments, so a lookup reads one node per level plus the value
+ * and its cost grows with the tree height (log n), not the entry count.
+ *
+ * Layout (integers little-endian, offsets 64-bit, through the stable64 API
+ * so the store is not limited to 4 GiB):
+ *   [0, 128)   header: magic "STKB", format version, entry count, root node,
+ *              tree height, heap bounds, node cursor, current segment,
+ *              space counters, free lists, compaction cursor
+ *   [heap_start, ...)  64 KiB extents, each holding 16 nodes or a value
+ *              segment (larger records get a run of extents of their own)
+ *
+ * The heap starts after the pages canister_init reserves (0-9 canister data,
+ * 10-25 ic-wasm profiling), so the header is all that shares page 0.
+ *
+ * Node (4096 bytes):
+ *   [0] kind (1 = leaf, 2 = internal)   [2] u16 number of cells
+ *   [4] u16 start of the cell area      [8] u64 next leaf / leftmost child
+ *   [16] u16 cell offsets, sorted by key; cells fill the node from the end:
+ *        u32 key_len, u32 aux, u64 ptr, key bytes
+ *   leaf cell: aux = value length, ptr = value record
+ *   internal cell: ptr = child holding the keys >= the cell's key
+ *
+ * Keys of any length are stored. A cell holds at most the first
+ * STKV_INLINE_KEY bytes followed, for longer keys, by a u64: the rest of a
+ * leaf key is read from its value record, the rest of an internal one from
+ * a chain of overflow nodes (u64 next, then key bytes). Comparisons that get
+ * past the inline bytes stream the remainder in node-sized chunks.
+ * Separators are cut to the shortest prefix that still divides the leaves,
+ * so overflow chains only appear for keys sharing over 1 KB of prefix.
+ *
+ * Value segment: u32 magic "SEGV", u32 size, u32 bytes used, u32 live bytes,
+ * then records of u32 key_len, u32 value_len, key, value.
+ *
+ * Free run of extents: u32 magic "FREE", u32 extents, u64 next run.
+ *
+ * Batch log run: u32 magic "WLOG", u32 extents, then staged records (see
+ * Batch log below); the header keeps the first run's extent number.
+ *
+ * Run lent to another structure (ic_stable_structs.c): u32 magic "XRUN",
+ * u32 extents, u64 owner tag; the rest belongs to the borrower and the
+ * store only steps over it.
+ *
+ * Deleting a key removes its cell (a leaf left empty leaves the tree) and
+ * its record becomes dead space; freed nodes and extents are kept on free
+ * lists for reuse and segments are compacted in bounded slices (below).
+ *
+ * A heap hash index (rebuilt after upgrades, capped in size) lets most
+ * point lookups skip the tree and read just the value record. All stable
+ * access goes through the page cache of ic_stable.c. Batched gets and puts
+ * walk their keys in sorted order; range scans follow the leaf chain.
+ *
+ * Format 1 (the "STKV" linear log of earlier releases) is migrated into a
+ * tree on first access; formats 2 (no deletion), 3 (keys of at most
+ * STKV_INLINE_KEY bytes) and 4 (no batch log) are read as is. A newer
+ * format than this build knows traps.
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ic_stable.h"
+#include "ic_stkv.h"
+
+/* RefC Buffer layout, for the batched functions */
+#if defined(__has_include)
+#if __has_include("buffer.h")
+#include "buffer.h"
+#define IC_HAVE_REFC_BUFFER 1
+#endif
+#endif
+
+/* ic0_stubs.c */
+extern void ic0_trap(int32_t src, int32_t size);
+extern uint64_t ic0_performance_counter(int32_t type);
+
+#define STKV_FORMAT       5
+#define STKV_HEADER_SIZE  128
+#define STKV_NODE_SIZE    4096
+#define STKV_EXTENT_SIZE  65536u
+#define STKV_HEAP_START   (26ull * STKV_EXTENT_SIZE)
+#define STKV_INLINE_KEY   1024  /* key bytes kept in a cell */
+#define STKV_MAX_DEPTH    32
+#define STKV_RUN_SCAN     16  /* free runs looked at per allocation */
+#define STKV_SCAN_BYTES   (1u << 20)  /* one scan page, well under a reply */
+
+#define NODE_LEAF      1
+#define NODE_INTERNAL  2
+#define NODE_SLOTS     16
+#define NODE_MAX_CELLS ((STKV_NODE_SIZE - NODE_SLOTS) / (CELL_HEADER + 2) + 1)
+#define CELL_HEADER    16
+#define CELL_MAX       (CELL_HEADER + STKV_INLINE_KEY + 8)
+#define SEG_HEADER     16
+#define REC_HEADER     8
+
+static const uint8_t stkv_magic[4] = {'S', 'T', 'K', 'B'};
+static const uint8_t seg_magic[4] = {'S', 'E', 'G', 'V'};
+static const uint8_t free_magic[4] = {'F', 'R', 'E', 'E'};
+static const uint8_t wal_magic[4] = {'W', 'L', 'O', 'G'};
+static const uint8_t lent_magic[4] = {'X', 'R', 'U', 'N'};
+
+/* wasm32 is little-endian: fields are copied as they are laid out */
+static inline uint16_t ld16(const uint8_t* p) { uint16_t v; memcpy(&v, p, 2); return v; }
+static inline uint32_t ld32(const uint8_t* p) { uint32_t v; memcpy(&v, p, 4); return v; }
+static inline uint64_t ld64(const uint8_t* p) { uint64_t v; memcpy(&v, p, 8); return v; }
+static inline void st16(uint8_t* p, uint16_t v) { memcpy(p, &v, 2); }
+static inline void st32(uint8_t* p, uint32_t v) { memcpy(p, &v, 4); }
+static inline void st64(uint8_t* p, uint64_t v) { memcpy(p, &v, 8); }
+
+static void stkv_trap(const char* msg) {
+    ic0_trap((int32_t)(uintptr_t)msg, (int32_t)strlen(msg));
+}
+
+/* =============================================================================
+ * Stable memory access
+ * ============================================================================= */
+
+/* Through the page cache (ic_stable.c): nodes, headers and small records
+ * are served from the heap; updates are written back at the end of the
+ * message */
+static void sm_read(uint64_t offset, void* dst, uint64_t size) {
+    ic_stable_read(offset, dst, size);
+}
+
+static void sm_write(uint64_t offset, const void* src, uint64_t size) {
+    ic_stable_write(offset, src, size);
+}
+
+/* Grow stable memory to cover [0, end); -1 if it cannot */
+static int sm_ensure(uint64_t end) {
+    return ic_stable_ensure(end) == 0 ? 0 : -1;
+}
+
+/* Growable heap buffer, kept between calls */
+typedef struct {
+    uint8_t* p;
+    uint64_t cap;
+} stkv_buf;
+
+static uint8_t* buf_reserve(stkv_buf* b, uint64_t size) {
+    if (b->p == NULL || size > b->cap) {
+        uint64_t cap = b->cap ? b->cap : 256;
+        while (cap < size) cap *= 2;
+        uint8_t* p = realloc(b->p, (size_t)cap);
+        if (p == NULL) stkv_trap("stkv: out of memory");
+        b->p = p;
+        b->cap = cap;
+    }
+    return b->p;
+}
+
+static int key_cmp(const uint8_t* a, uint32_t alen, const uint8_t* b, uint32_t blen) {
+    int c = memcmp(a, b, alen < blen ? alen : blen);
+    if (c != 0) return c;
+    return alen < blen ? -1 : (alen > blen ? 1 : 0);
+}
+
+/*
+ * Compare `len` key bytes in stable memory with key[0, klen), reading them a
+ * node-sized chunk at a time: contiguous from `off`, or from the chain of
+ * overflow nodes starting there when `chained`.
+ */
+static int stable_key_cmp(uint64_t off, int chained, uint64_t len,
+                          const uint8_t* key, uint64_t klen) {
+    static uint8_t chunk[STKV_NODE_SIZE];
+    uint64_t n = len < klen ? len : klen;
+    for (uint64_t pos = 0; pos < n;) {
+        uint64_t take = n - pos;
+        const uint8_t* p = chunk;
+        if (chained) {
+            if (take > STKV_NODE_SIZE - 8) take = STKV_NODE_SIZE - 8;
+            sm_read(off, chunk, 8 + take);
+            off = ld64(chunk);
+            p = chunk + 8;
+        } else {
+            if (take > STKV_NODE_SIZE) take = STKV_NODE_SIZE;
+            sm_read(off, chunk, take);
+            off += take;
+        }
+        int c = memcmp(p, key + pos, (size_t)take);
+        if (c != 0) return c;
+        pos += take;
+    }
+    return len < klen ? -1 : (len > klen ? 1 : 0);
+}
+
+/* =============================================================================
+ * Store state (cached copy of the header)
+ * ============================================================================= */
+
+typedef struct {
+    uint64_t count;
+    uint64_t root;          /* 0 when empty */
+    uint32_t height;        /* levels, 1 = root is a leaf */
+    uint64_t heap_start;
+    uint64_t next_extent;
+    uint64_t node_cursor;   /* next unused node in the current node extent */
+    uint64_t segment;       /* value segment being appended to, 0 = none */
+    uint64_t live_bytes;    /* value records reachable from the tree */
+    uint64_t node_free;     /* freed nodes, linked through their link field */
+    uint64_t extent_free;   /* freed single extents, linked through their header */
+    uint64_t run_free;      /* freed runs of several extents */
+    uint64_t free_extents;
+    uint64_t segment_bytes; /* extents holding value segments */
+    uint64_t nodes;         /* nodes in use */
+    uint64_t compact_cursor;
+    uint64_t wal;           /* first run of the open batch log, 0 = none */
+} stkv_state;
+
+static stkv_state st;
+static uint32_t seg_used = 0;  /* of st.segment */
+static uint32_t seg_live = 0;
+static int stkv_initialized = 0;
+
+static void stkv_flush_header(void) {
+    uint8_t h[STKV_HEADER_SIZE] = {0};
+    memcpy(h, stkv_magic, 4);
+    st32(h + 4, STKV_FORMAT);
+    st64(h + 8, st.count);
+    st64(h + 16, st.root);
+    st32(h + 24, st.height);
+    st32(h + 28, st.wal ? (uint32_t)((st.wal - st.heap_start) / STKV_EXTENT_SIZE + 1) : 0);
+    st64(h + 32, st.heap_start);
+    st64(h + 40, st.next_extent);
+    st64(h + 48, st.node_cursor);
+    st64(h + 56, st.segment);
+    st64(h + 64, st.live_bytes);
+    st64(h + 72, st.node_free);
+    st64(h + 80, st.extent_free);
+    st64(h + 88, st.free_extents);
+    st64(h + 96, st.segment_bytes);
+    st64(h + 104, st.nodes);
+    st64(h + 112, st.compact_cursor);
+    st64(h + 120, st.run_free);
+    if (sm_ensure(STKV_HEADER_SIZE) != 0) stkv_trap("stkv: cannot grow stable memory");
+    sm_write(0, h, STKV_HEADER_SIZE);
+}
+
+static void stkv_reset(uint64_t heap_start) {
+    memset(&st, 0, sizeof st);
+    st.heap_start = heap_start;
+    st.next_extent = heap_start;
+    st.compact_cursor = heap_start;
+    seg_used = 0;
+    seg_live = 0;
+}
+
+static void push_free(uint64_t off, uint64_t n) {
+    uint64_t* list = n == 1 ? &st.extent_free : &st.run_free;
+    uint8_t h[16];
+    memcpy(h, free_magic, 4);
+    st32(h + 4, (uint32_t)n);
+    st64(h + 8, *list);
+    sm_write(off, h, 16);
+    *list = off;
+}
+
+/* Allocate `n` contiguous extents; 0 when stable memory cannot grow.
+ * Freed extents are reused first: single ones from their own list, longer
+ * runs first-fit from the first few free runs (splitting off the rest). */
+static uint64_t alloc_extents(uint64_t n) {
+    uint8_t h[16];
+    if (n == 1 && st.extent_free != 0) {
+        uint64_t off = st.extent_free;
+        sm_read(off, h, 16);
+        st.extent_free = ld64(h + 8);
+        st.free_extents--;
+        return off;
+    }
+    uint64_t prev = 0;
+    uint64_t off = st.run_free;
+    for (int i = 0; off != 0 && i < STKV_RUN_SCAN; i++) {
+        sm_read(off, h, 16);
+        uint64_t len = ld32(h + 4);
+        uint64_t next = ld64(h + 8);
+        if (len >= n) {
+            if (prev != 0) {
+                st64(h + 8, next);
+                sm_write(prev + 8, h + 8, 8);
+            } else {
+                st.run_free = next;
+            }
+            if (len > n) push_free(off + n * STKV_EXTENT_SIZE, len - n);
+            st.free_extents -= n;
+            return off;
+        }
+        prev = off;
+        off = next;
+    }
+    off = st.next_extent;
+    if (sm_ensure(off + n * STKV_EXTENT_SIZE) != 0) return 0;
+    st.next_extent = off + n * STKV_EXTENT_SIZE;
+    return off;
+}
+
+static void free_extents(uint64_t off, uint64_t n) {
+    push_free(off, n);
+    st.free_extents += n;
+}
+
+static uint64_t alloc_node(void) {
+    uint64_t off;
+    if (st.node_free != 0) {
+        off = st.node_free;
+        uint8_t b[16];
+        sm_read(off, b, 16);
+        st.node_free = ld64(b + 8);
+    } else {
+        if (st.node_cursor == 0 || st.node_cursor % STKV_EXTENT_SIZE == 0) {
+            uint64_t extent = alloc_extents(1);
+            if (extent == 0) return 0;
+            st.node_cursor = extent;
+        }
+        off = st.node_cursor;
+        st.node_cursor += STKV_NODE_SIZE;
+    }
+    st.nodes++;
+    return off;
+}
+
+static void free_node(uint64_t off) {
+    uint8_t b[16] = {0};
+    st64(b + 8, st.node_free);
+    sm_write(off, b, 16);
+    st.node_free = off;
+    st.nodes--;
+}
+
+/* Make sure the next `n` alloc_node calls succeed: allocate the nodes and
+ * put them back at the head of the free list. -1 when out of stable memory
+ * (the nodes that could be allocated are on the free list too). */
+static int reserve_nodes(uint32_t n) {
+    uint64_t offs[STKV_MAX_DEPTH + 1];
+    uint32_t got = 0;
+    while (got < n && (offs[got] = alloc_node()) != 0) got++;
+    int r = got == n ? 0 : -1;
+    while (got > 0) free_node(offs[--got]);
+    return r;
+}
+
+/* =============================================================================
+ * Value records
+ * ============================================================================= */
+
+static void segment_header(uint64_t seg, uint32_t size, uint32_t used, uint32_t live) {
+    uint8_t h[SEG_HEADER];
+    memcpy(h, seg_magic, 4);
+    st32(h + 4, size);
+    st32(h + 8, used);
+    st32(h + 12, live);
+    sm_write(seg, h, SEG_HEADER);
+}
+
+/* Append a record; its stable offset, or 0 when out of stable memory */
+static uint64_t value_append(const uint8_t* key, uint32_t klen,
+                             const uint8_t* val, uint32_t vlen) {
+    uint64_t size = (uint64_t)REC_HEADER + klen + vlen;
+    uint64_t rec;
+    if (size > STKV_EXTENT_SIZE - SEG_HEADER) {
+        /* Large record: a run of extents of its own */
+        uint64_t extents = (SEG_HEADER + size + STKV_EXTENT_SIZE - 1) / STKV_EXTENT_SIZE;
+        if (extents * STKV_EXTENT_SIZE > 0xFFFFFFFFull) return 0;
+        uint64_t seg = alloc_extents(extents);
+        if (seg == 0) return 0;
+        segment_header(seg, (uint32_t)(extents * STKV_EXTENT_SIZE),
+                       (uint32_t)(SEG_HEADER + size), (uint32_t)size);
+        st.segment_bytes += extents * STKV_EXTENT_SIZE;
+        rec = seg + SEG_HEADER;
+    } else {
+        if (st.segment == 0 || seg_used + size > STKV_EXTENT_SIZE) {
+            uint64_t seg = alloc_extents(1);
+            if (seg == 0) return 0;
+            st.segment = seg;
+            st.segment_bytes += STKV_EXTENT_SIZE;
+            seg_used = SEG_HEADER;
+            seg_live = 0;
+        }
+        rec = st.segment + seg_used;
+        seg_used += (uint32_t)size;
+        seg_live += (uint32_t)size;
+        segment_header(st.segment, STKV_EXTENT_SIZE, seg_used, seg_live);
+    }
+    uint8_t h[REC_HEADER];
+    st32(h, klen);
+    st32(h + 4, vlen);
+    sm_write(rec, h, REC_HEADER);
+    sm_write(rec + REC_HEADER, key, klen);
+    sm_write(rec + REC_HEADER + klen, val, vlen);
+    st.live_bytes += size;
+    return rec;
+}
+
+static void free_segment(uint64_t seg, uint32_t size) {
+    free_extents(seg, size / STKV_EXTENT_SIZE);
+    st.segment_bytes -= size;
+}
+
+/* A record is no longer reachable: take it off its segment's live bytes.
+ * A segment left with nothing live is freed at once; partly dead ones wait
+ * for stkv_compact. */
+static void value_release(uint64_t rec, uint64_t size) {
+    uint64_t seg = rec & ~(uint64_t)(STKV_EXTENT_SIZE - 1);
+    uint8_t h[SEG_HEADER];
+    sm_read(seg, h, SEG_HEADER);
+    uint32_t live = ld32(h + 12) - (uint32_t)size;
+    st.live_bytes -= size;
+    if (seg == st.segment) {
+        seg_live = live;
+    } else if (live == 0) {
+        free_segment(seg, ld32(h + 4));
+        return;
+    }
+    st32(h + 12, live);
+    sm_write(seg + 12, h + 12, 4);
+}
+
+/* =============================================================================
+ * Heap hash index
+ *
+ * Point lookups first try an in-heap hash table from key to value record:
+ * one stable read (the record, checked against the key) instead of a walk
+ * down the tree. The table lives in the Wasm heap, so it starts empty after
+ * an upgrade; it is rebuilt lazily from the leaf chain, a few leaves per stkv
+ * call, and kept current by every put, delete and compaction move. It never
+ * grows past idx_limit bytes: keys it has no room for are found through the
+ * tree. Once it holds every key, a miss needs no tree walk either.
+ * ============================================================================= */
+
+#define STKV_INDEX_LIMIT        (64u << 20)
+#define STKV_INDEX_MIN_SLOTS    1024u
+#define STKV_INDEX_WARM_LEAVES  128
+
+#define IDX_EMPTY    0
+#define IDX_DELETED  1  /* never a record offset */
+
+typedef struct {
+    uint64_t rec;
+    uint32_t tag;  /* high hash bits */
+    uint32_t klen;
+    uint32_t vlen;
+    uint32_t unused;
+} idx_entry;
+
+static idx_entry* idx_slots = NULL;
+static uint32_t idx_cap = 0;      /* power of two */
+static uint32_t idx_live = 0;
+static uint32_t idx_filled = 0;   /* live + deleted */
+static uint64_t idx_limit = STKV_INDEX_LIMIT;
+static int idx_warm = 0;          /* the leaf chain has been indexed */
+static int idx_dropped = 0;       /* a key did not fit */
+static int idx_bypass = 0;        /* benchmark: tree lookups only */
+
+static uint64_t key_hash(const uint8_t* key, uint32_t klen) {
+    uint64_t h = 0x9E3779B97F4A7C15ull ^ klen;
+    uint32_t i = 0;
+    for (; i + 8 <= klen; i += 8) {
+        h = (h ^ ld64(key + i)) * 0xBF58476D1CE4E5B9ull;
+        h ^= h >> 31;
+    }
+    uint64_t tail = 0;
+    memcpy(&tail, key + i, klen - i);
+    h = (h ^ tail) * 0x94D049BB133111EBull;
+    return h ^ (h >> 29);
+}
+
+static inline int idx_complete(void) { return idx_warm && !idx_dropped; }
+
+/* Forget everything; `warm` when the tree is known to be empty */
+static void idx_reset(int warm) {
+    free(idx_slots);
+    idx_slots = NULL;
+    idx_cap = idx_live = idx_filled = 0;
+    idx_warm = warm;
+    idx_dropped = 0;
+}
+
+static int idx_rehash(uint32_t cap) {
+    idx_entry* slots = calloc(cap, sizeof(idx_entry));
+    if (slots == NULL) return -1;
+    for (uint32_t i = 0; i < idx_cap; i++) {
+        if (idx_slots[i].rec > IDX_DELETED) {
+            uint32_t j = (uint32_t)idx_slots[i].tag & (cap - 1);
+            while (slots[j].rec != IDX_EMPTY) j = (j + 1) & (cap - 1);
+            slots[j] = idx_slots[i];
+        }
+    }
+    free(idx_slots);
+    idx_slots = slots;
+    idx_cap = cap;
+    idx_filled = idx_live;
+    return 0;
+}
+
+/* Add a key known not to be in the table */
+static void idx_insert(uint64_t h, uint64_t rec, uint32_t klen, uint32_t vlen) {
+    if ((uint64_t)(idx_filled + 1) * 10 > (uint64_t)idx_cap * 7) {
+        uint32_t cap = idx_cap ? idx_cap : STKV_INDEX_MIN_SLOTS;
+        while ((uint64_t)(idx_live + 1) * 2 > cap) cap *= 2;
+        if ((uint64_t)cap * sizeof(idx_entry) > idx_limit || idx_rehash(cap) != 0) {
+            /* No room to grow: purge deleted slots, or give up on this key */
+            if (idx_cap == 0 || (uint64_t)(idx_live + 1) * 10 > (uint64_t)idx_cap * 7 ||
+                idx_rehash(idx_cap) != 0) {
+                idx_dropped = 1;
+                return;
+            }
+        }
+    }
+    uint32_t tag = (uint32_t)(h >> 32);
+    uint32_t i = tag & (idx_cap - 1);
+    while (idx_slots[i].rec > IDX_DELETED) i = (i + 1) & (idx_cap - 1);
+    if (idx_slots[i].rec == IDX_EMPTY) idx_filled++;
+    idx_slots[i] = (idx_entry){rec, tag, klen, vlen, 0};
+    idx_live++;
+}
+
+/* The slot pointing at `rec`, if the key is indexed */
+static idx_entry* idx_find(uint64_t h, uint64_t rec) {
+    if (idx_slots == NULL) return NULL;
+    uint32_t tag = (uint32_t)(h >> 32);
+    for (uint32_t i = tag & (idx_cap - 1);; i = (i + 1) & (idx_cap - 1)) {
+        if (idx_slots[i].rec == IDX_EMPTY) return NULL;
+        if (idx_slots[i].rec == rec) return &idx_slots[i];
+    }
+}
+
+/* A key's value moved from record `old` to `rec` */
+static void idx_moved(uint64_t h, uint64_t old, uint64_t rec, uint32_t vlen) {
+    idx_entry* e = idx_find(h, old);
+    if (e != NULL) {
+        e->rec = rec;
+        e->vlen = vlen;
+    }
+}
+
+static void idx_remove(uint64_t h, uint64_t rec) {
+    idx_entry* e = idx_find(h, rec);
+    if (e != NULL) {
+        e->rec = IDX_DELETED;
+        idx_live--;
+    }
+}
+
+/*
+ * Look a key up in the table, copying up to `max` value bytes to `out` and
+ * its record offset to `*rec`. Returns the value length, -1 if the key is
+ * certainly absent, or -2 if the table cannot tell (ask the tree).
+ */
+static int64_t idx_get(uint64_t h, const uint8_t* key, uint32_t klen, uint8_t* out, int64_t max,
+                       uint64_t* rec) {
+    static stkv_buf scratch;
+    if (idx_bypass) return -2;
+    if (idx_slots != NULL) {
+        uint32_t tag = (uint32_t)(h >> 32);
+        for (uint32_t i = tag & (idx_cap - 1); idx_slots[i].rec != IDX_EMPTY;
+             i = (i + 1) & (idx_cap - 1)) {
+            idx_entry* e = &idx_slots[i];
+            if (e->rec == IDX_DELETED || e->tag != tag || e->klen != klen) continue;
+            uint32_t copy = max <= 0 ? 0 : (max < e->vlen ? (uint32_t)max : e->vlen);
+            /* Key and value in one read, unless they are large */
+            if ((uint64_t)klen + copy <= STKV_EXTENT_SIZE) {
+                uint8_t* p = buf_reserve(&scratch, (uint64_t)klen + copy);
+                sm_read(e->rec + REC_HEADER, p, (uint64_t)klen + copy);
+                if (memcmp(p, key, klen) != 0) continue;
+                memcpy(out, p + klen, copy);
+            } else {
+                if (stable_key_cmp(e->rec + REC_HEADER, 0, klen, key, klen) != 0) continue;
+                sm_read(e->rec + REC_HEADER + klen, out, copy);
+            }
+            *rec = e->rec;
+            return e->vlen;
+        }
+    }
+    return idx_complete() ? -1 : -2;
+}
+
+/* =============================================================================
+ * Nodes
+ * ============================================================================= */
+
+typedef struct {
+    uint64_t off;
+    uint8_t b[STKV_NODE_SIZE];
+} stkv_node;
+
+static inline uint32_t node_count(const uint8_t* b) { return ld16(b + 2); }
+static inline uint64_t node_link(const uint8_t* b) { return ld64(b + 8); }
+static inline uint8_t* node_cell(uint8_t* b, uint32_t i) {
+    return b + ld16(b + NODE_SLOTS + 2 * i);
+}
+static inline uint32_t inline_len(uint32_t klen) {
+    return klen < STKV_INLINE_KEY ? klen : STKV_INLINE_KEY;
+}
+static inline uint32_t cell_size(const uint8_t* c) {
+    uint32_t klen = ld32(c);
+    return CELL_HEADER + (klen > STKV_INLINE_KEY ? STKV_INLINE_KEY + 8 : klen);
+}
+/* Overflow chain of a long internal key */
+static inline uint64_t cell_overflow(const uint8_t* c) {
+    return ld64(c + CELL_HEADER + STKV_INLINE_KEY);
+}
+
+static void node_read(stkv_node* n, uint64_t off) {
+    n->off = off;
+    sm_read(off, n->b, STKV_NODE_SIZE);
+}
+
+static void node_write(const stkv_node* n) {
+    sm_write(n->off, n->b, STKV_NODE_SIZE);
+}
+
+static void node_init(uint8_t* b, uint8_t kind, uint64_t link) {
+    memset(b, 0, STKV_NODE_SIZE);
+    b[0] = kind;
+    st16(b + 4, STKV_NODE_SIZE);
+    st64(b + 8, link);
+}
+
+static inline uint32_t node_cells_start(const uint8_t* b) { return ld16(b + 4); }
+
+/* Cell for a key held in full in memory (a long key's tail pointer is
+ * left to the caller) */
+static void make_cell(uint8_t* cell, const uint8_t* key, uint32_t klen,
+                      uint32_t aux, uint64_t ptr) {
+    st32(cell, klen);
+    st32(cell + 4, aux);
+    st64(cell + 8, ptr);
+    memcpy(cell + CELL_HEADER, key, inline_len(klen));
+    if (klen > STKV_INLINE_KEY) st64(cell + CELL_HEADER + STKV_INLINE_KEY, 0);
+}
+
+/* Compare a cell's key with `key`; long keys read their tail from stable memory */
+static int cell_cmp(uint8_t kind, const uint8_t* c, const uint8_t* key, uint32_t klen) {
+    uint32_t clen = ld32(c);
+    if (clen <= STKV_INLINE_KEY) return key_cmp(c + CELL_HEADER, clen, key, klen);
+    if (klen <= STKV_INLINE_KEY) {
+        int r = memcmp(c + CELL_HEADER, key, klen);
+        return r != 0 ? r : 1;
+    }
+    int r = memcmp(c + CELL_HEADER, key, STKV_INLINE_KEY);
+    if (r != 0) return r;
+    if (kind == NODE_LEAF) {
+        return stable_key_cmp(ld64(c + 8) + REC_HEADER + STKV_INLINE_KEY, 0, clen - STKV_INLINE_KEY,
+                              key + STKV_INLINE_KEY, klen - STKV_INLINE_KEY);
+    }
+    return stable_key_cmp(cell_overflow(c), 1, clen - STKV_INLINE_KEY,
+                          key + STKV_INLINE_KEY, klen - STKV_INLINE_KEY);
+}
+
+/* Store `len` key bytes from `src` in a chain of overflow nodes; its head,
+ * or 0 when out of stable memory */
+static void overflow_free(uint64_t off);
+static uint64_t overflow_store(uint64_t src, uint64_t len) {
+    static uint8_t page[STKV_NODE_SIZE];
+    uint64_t head = alloc_node();
+    if (head == 0) return 0;
+    for (uint64_t off = head;;) {
+        uint64_t take = len < STKV_NODE_SIZE - 8 ? len : STKV_NODE_SIZE - 8;
+        sm_read(src, page + 8, take);
+        src += take;
+        len -= take;
+        uint64_t next = len > 0 ? alloc_node() : 0;
+        st64(page, next);
+        sm_write(off, page, 8 + take);
+        if (len > 0 && next == 0) {
+            overflow_free(head);
+            return 0;
+        }
+        if (next == 0) return head;
+        off = next;
+    }
+}
+
+static void overflow_free(uint64_t off) {
+    while (off != 0) {
+        uint8_t next[8];
+        sm_read(off, next, 8);
+        free_node(off);
+        off = ld64(next);
+    }
+}
+
+/* Index of the first cell whose key is >= key; *found if it is equal */
+static uint32_t node_search(uint8_t* b, const uint8_t* key, uint32_t klen, int* found) {
+    uint32_t lo = 0, hi = node_count(b);
+    int c = 1;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        int r = cell_cmp(b[0], node_cell(b, mid), key, klen);
+        if (r < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+            c = r;
+        }
+    }
+    *found = lo < node_count(b) && c == 0;
+    return lo;
+}
+
+/* Child to descend into for `key`, and its index (0 = leftmost) */
+static uint64_t node_child(uint8_t* b, const uint8_t* key, uint32_t klen, uint32_t* index) {
+    int found;
+    uint32_t i = node_search(b, key, klen, &found);
+    if (found) i++;
+    *index = i;
+    return i == 0 ? node_link(b) : ld64(node_cell(b, i - 1) + 8);
+}
+
+/* Rewrite the cells contiguously at the end of the node */
+static void node_compact(uint8_t* b) {
+    static uint8_t tmp[STKV_NODE_SIZE];
+    memcpy(tmp, b, STKV_NODE_SIZE);
+    uint32_t n = node_count(b);
+    uint32_t pos = STKV_NODE_SIZE;
+    for (uint32_t i = 0; i < n; i++) {
+        uint8_t* c = node_cell(tmp, i);
+        uint32_t sz = cell_size(c);
+        pos -= sz;
+        memcpy(b + pos, c, sz);
+        st16(b + NODE_SLOTS + 2 * i, (uint16_t)pos);
+    }
+    st16(b + 4, (uint16_t)pos);
+}
+
+/* Insert a cell at index `idx`; -1 if the node is full */
+static int node_insert(uint8_t* b, uint32_t idx, const uint8_t* cell, uint32_t sz) {
+    uint32_t n = node_count(b);
+    uint32_t slots_end = NODE_SLOTS + 2 * (n + 1);
+    if (node_cells_start(b) < slots_end + sz) {
+        uint32_t used = 0;
+        for (uint32_t i = 0; i < n; i++) used += cell_size(node_cell(b, i));
+        if (STKV_NODE_SIZE - used < slots_end + sz) return -1;
+        node_compact(b);
+    }
+    uint32_t pos = node_cells_start(b) - sz;
+    memcpy(b + pos, cell, sz);
+    uint8_t* slots = b + NODE_SLOTS;
+    memmove(slots + 2 * (idx + 1), slots + 2 * idx, 2 * (n - idx));
+    st16(slots + 2 * idx, (uint16_t)pos);
+    st16(b + 2, (uint16_t)(n + 1));
+    st16(b + 4, (uint16_t)pos);
+    return 0;
+}
+
+static void node_append(uint8_t* b, const uint8_t* cell) {
+    uint32_t n = node_count(b);
+    uint32_t sz = cell_size(cell);
+    uint32_t pos = node_cells_start(b) - sz;
+    memcpy(b + pos, cell, sz);
+    st16(b + NODE_SLOTS + 2 * n, (uint16_t)pos);
+    st16(b + 2, (uint16_t)(n + 1));
+    st16(b + 4, (uint16_t)pos);
+}
+
+static void node_remove(uint8_t* b, uint32_t idx) {
+    uint32_t n = node_count(b);
+    uint8_t* slots = b + NODE_SLOTS;
+    memmove(slots + 2 * idx, slots + 2 * (idx + 1), 2 * (n - idx - 1));
+    st16(b + 2, (uint16_t)(n - 1));
+}
+
+/*
+ * Separator between two adjacent leaf cells: the shortest prefix of `hi`'s
+ * key that is still above `lo`'s. Only keys agreeing on all their inline
+ * bytes need the whole of `hi`, with its tail copied to overflow nodes.
+ * Returns -1 when out of stable memory.
+ */
+static int leaf_separator(const uint8_t* lo, const uint8_t* hi, uint8_t* sep) {
+    uint32_t lo_len = ld32(lo), hi_len = ld32(hi);
+    uint32_t n = inline_len(lo_len) < inline_len(hi_len) ? inline_len(lo_len) : inline_len(hi_len);
+    uint32_t p = 0;
+    while (p < n && lo[CELL_HEADER + p] == hi[CELL_HEADER + p]) p++;
+    if ((p < n || p == lo_len) && p + 1 <= inline_len(hi_len)) {
+        make_cell(sep, hi + CELL_HEADER, p + 1, 0, 0);
+        return 0;
+    }
+    uint64_t chain = overflow_store(ld64(hi + 8) + REC_HEADER + STKV_INLINE_KEY,
+                                    hi_len - STKV_INLINE_KEY);
+    if (chain == 0) return -1;
+    memcpy(sep, hi, CELL_HEADER + STKV_INLINE_KEY);
+    st32(sep + 4, 0);
+    st64(sep + CELL_HEADER + STKV_INLINE_KEY, chain);
+    return 0;
+}
+
+/*
+ * Split a full node while inserting `cell` at `idx`. The lower half stays in
+ * `left`, the upper half goes to the fresh node `right`; `sep` receives the
+ * cell the parent needs (its child pointer is left to the caller). An
+ * internal node's middle cell moves up rather than being copied: its child
+ * becomes right's leftmost. Returns -1 (nothing changed) when out of
+ * stable memory.
+ */
+static int node_split(stkv_node* left, uint32_t idx, const uint8_t* cell,
+                      stkv_node* right, uint8_t* sep) {
+    static uint8_t tmp[STKV_NODE_SIZE];
+    static const uint8_t* cells[NODE_MAX_CELLS + 1];
+    memcpy(tmp, left->b, STKV_NODE_SIZE);
+    uint32_t n = node_count(tmp);
+    uint32_t total = 0;
+    for (uint32_t i = 0, j = 0; i <= n; i++) {
+        cells[i] = i == idx ? cell : node_cell(tmp, j++);
+        total += cell_size(cells[i]) + 2;
+    }
+    n++;
+
+    /* First index past half the bytes, leaving both sides non-empty */
+    uint32_t m = 0, acc = 0;
+    while (m < n - 1 && acc + cell_size(cells[m]) + 2 <= total / 2) {
+        acc += cell_size(cells[m]) + 2;
+        m++;
+    }
+    if (m == 0) m = 1;
+
+    int leaf = tmp[0] == NODE_LEAF;
+    if (leaf) {
+        if (leaf_separator(cells[m - 1], cells[m], sep) != 0) return -1;
+    } else {
+        if (m == n - 1) m--;  /* the moved-up cell needs a right side */
+        memcpy(sep, cells[m], cell_size(cells[m]));
+    }
+
+    if (leaf) {
+        node_init(right->b, NODE_LEAF, node_link(tmp));
+        node_init(left->b, NODE_LEAF, right->off);
+        for (uint32_t i = m; i < n; i++) node_append(right->b, cells[i]);
+    } else {
+        node_init(right->b, NODE_INTERNAL, ld64(cells[m] + 8));
+        node_init(left->b, NODE_INTERNAL, node_link(tmp));
+        for (uint32_t i = m + 1; i < n; i++) node_append(right->b, cells[i]);
+    }
+    for (uint32_t i = 0; i < m; i++) node_append(left->b, cells[i]);
+    return 0;
+}
+
+/* =============================================================================
+ * Tree operations
+ * ============================================================================= */
+
+static stkv_node node_a, node_b;
+
+/* Read the leaf that holds (or would hold) `key` into `n`; -1 if empty */
+static int find_leaf(const uint8_t* key, uint32_t klen, stkv_node* n,
+                     uint64_t* path, uint32_t* path_idx) {
+    if (st.root == 0) return -1;
+    node_read(n, st.root);
+    for (uint32_t level = 0; level + 1 < st.height; level++) {
+        uint32_t i;
+        uint64_t child = node_child(n->b, key, klen, &i);
+        if (path) {
+            path[level] = n->off;
+            path_idx[level] = i;
+        }
+        node_read(n, child);
+    }
+    return 0;
+}
+
+/* The whole key of a leaf cell, read into `b` if it is not all inline */
+static const uint8_t* leaf_key(const uint8_t* c, stkv_buf* b) {
+    uint32_t klen = ld32(c);
+    if (klen <= STKV_INLINE_KEY) return c + CELL_HEADER;
+    uint8_t* key = buf_reserve(b, klen);
+    sm_read(ld64(c + 8) + REC_HEADER, key, klen);
+    return key;
+}
+
+/*
+ * Insert or replace without writing the header; 0 or -1. On -1 (out of
+ * stable memory) the tree is as it was: every allocation that can fail
+ * happens before the first node is written. Splitting the leaf is the only
+ * step that needs a variable number of nodes (the separator of a long key);
+ * the levels above need at most one node each plus a new root, reserved
+ * before the split leaf is written.
+ */
+static int stkv_insert(const uint8_t* key, uint32_t klen, const uint8_t* val, uint32_t vlen) {
+    static uint8_t cell[CELL_MAX];
+    static uint8_t sep[CELL_MAX];
+    uint64_t path[STKV_MAX_DEPTH];
+    uint32_t path_idx[STKV_MAX_DEPTH];
+
+    uint64_t rec = value_append(key, klen, val, vlen);
+    if (rec == 0) return -1;
+    uint64_t rec_size = (uint64_t)REC_HEADER + klen + vlen;
+    uint64_t h = key_hash(key, klen);
+
+    stkv_node* n = &node_a;
+    if (find_leaf(key, klen, n, path, path_idx) != 0) {
+        uint64_t off = alloc_node();
+        if (off == 0) {
+            value_release(rec, rec_size);
+            return -1;
+        }
+        n->off = off;
+        node_init(n->b, NODE_LEAF, 0);
+        make_cell(cell, key, klen, vlen, rec);
+        node_append(n->b, cell);
+        node_write(n);
+        st.root = off;
+        st.height = 1;
+        st.count = 1;
+        idx_insert(h, rec, klen, vlen);
+        return 0;
+    }
+
+    int found;
+    uint32_t idx = node_search(n->b, key, klen, &found);
+    if (found) {
+        uint8_t* c = node_cell(n->b, idx);
+        value_release(ld64(c + 8), (uint64_t)REC_HEADER + klen + ld32(c + 4));
+        idx_moved(h, ld64(c + 8), rec, vlen);
+        st32(c + 4, vlen);
+        st64(c + 8, rec);
+        node_write(n);
+        return 0;
+    }
+
+    make_cell(cell, key, klen, vlen, rec);
+    uint32_t depth = st.height - 1;
+    for (;;) {
+        if (node_insert(n->b, idx, cell, cell_size(cell)) == 0) {
+            node_write(n);
+            break;
+        }
+        stkv_node* right = &node_b;
+        right->off = alloc_node();
+        if (right->off == 0) {
+            /* only the leaf can get here: the levels above are reserved */
+            value_release(rec, rec_size);
+            return -1;
+        }
+        if (node_split(n, idx, cell, right, sep) != 0) {
+            free_node(right->off);
+            value_release(rec, rec_size);
+            return -1;
+        }
+        if (depth == st.height - 1 &&
+            (st.height >= STKV_MAX_DEPTH || reserve_nodes(st.height) != 0)) {
+            /* nothing written yet: drop the split leaf's new parts */
+            if (ld32(sep) > STKV_INLINE_KEY) overflow_free(cell_overflow(sep));
+            free_node(right->off);
+            value_release(rec, rec_size);
+            return -1;
+        }
+        node_write(n);
+        node_write(right);
+        memcpy(cell, sep, cell_size(sep));
+        st64(cell + 8, right->off);
+        if (depth == 0) {
+            uint64_t root = alloc_node();
+            uint64_t old_root = n->off;
+            n->off = root;
+            node_init(n->b, NODE_INTERNAL, old_root);
+            node_append(n->b, cell);
+            node_write(n);
+            st.root = root;
+            st.height++;
+            break;
+        }
+        depth--;
+        node_read(n, path[depth]);
+        idx = path_idx[depth];
+    }
+    st.count++;
+    idx_insert(h, rec, klen, vlen);
+    return 0;
+}
+
+/*
+ * Detach the now empty node at path level `level` (child `idx` of the node
+ * above it) and free it. A parent left without children goes the same way;
+ * a root left with a single child is replaced by that child.
+ */
+static void remove_child(uint64_t* path, uint32_t* path_idx, uint32_t level, uint64_t child) {
+    stkv_node* p = &node_b;
+    free_node(child);
+    for (;;) {
+        if (level == 0) {
+            /* child was the root */
+            st.root = 0;
+            st.height = 0;
+            return;
+        }
+        level--;
+        node_read(p, path[level]);
+        uint32_t idx = path_idx[level];
+        if (node_count(p->b) > 0) {
+            uint32_t gone = idx > 0 ? idx - 1 : 0;
+            uint8_t* c = node_cell(p->b, gone);
+            if (ld32(c) > STKV_INLINE_KEY) overflow_free(cell_overflow(c));
+            if (idx == 0) st64(p->b + 8, ld64(c + 8));
+            node_remove(p->b, gone);
+        } else {
+            free_node(p->off);
+            continue;
+        }
+        break;
+    }
+    node_write(p);
+    while (st.height > 1) {
+        node_read(p, st.root);
+        if (node_count(p->b) > 0) break;
+        st.root = node_link(p->b);
+        st.height--;
+        free_node(p->off);
+    }
+}
+
+/* Point the leaf before the one at the end of `path` past it */
+static void unlink_leaf(uint64_t* path, uint32_t* path_idx, uint64_t next) {
+    stkv_node* n = &node_b;
+    int32_t level = (int32_t)st.height - 2;
+    while (level >= 0 && path_idx[level] == 0) level--;
+    if (level < 0) return;  /* leftmost leaf: nothing links to it */
+
+    node_read(n, path[level]);
+    uint32_t i = path_idx[level] - 1;
+    uint64_t off = i == 0 ? node_link(n->b) : ld64(node_cell(n->b, i - 1) + 8);
+    for (level++; level < (int32_t)st.height - 1; level++) {
+        node_read(n, off);
+        uint32_t c = node_count(n->b);
+        off = c == 0 ? node_link(n->b) : ld64(node_cell(n->b, c - 1) + 8);
+    }
+    node_read(n, off);
+    st64(n->b + 8, next);
+    node_write(n);
+}
+
+/* Remove a key; 1 if it was present, 0 if not */
+static int stkv_remove(const uint8_t* key, uint32_t klen) {
+    uint64_t path[STKV_MAX_DEPTH];
+    uint32_t path_idx[STKV_MAX_DEPTH];
+    stkv_node* n = &node_a;
+    if (find_leaf(key, klen, n, path, path_idx) != 0) return 0;
+    int found;
+    uint32_t idx = node_search(n->b, key, klen, &found);
+    if (!found) return 0;
+
+    uint8_t* c = node_cell(n->b, idx);
+    value_release(ld64(c + 8), (uint64_t)REC_HEADER + klen + ld32(c + 4));
+    idx_remove(key_hash(key, klen), ld64(c + 8));
+    node_remove(n->b, idx);
+    st.count--;
+    if (node_count(n->b) > 0) {
+        node_write(n);
+    } else {
+        /* Empty leaves leave the tree (no merging of sparse ones) */
+        if (st.height > 1) unlink_leaf(path, path_idx, node_link(n->b));
+        remove_child(path, path_idx, st.height - 1, n->off);
+    }
+    return 1;
+}
+
+/* =============================================================================
+ * Compaction
+ *
+ * Replaced and deleted values leave dead records in their segments. A
+ * segment with nothing live is freed immediately; one that is at least half
+ * dead is evacuated by copying its live records to the current segment and
+ * freeing it. The sweep over the heap runs in slices of bounded size, from
+ * stkv_compact (e.g. on a timer) and automatically after a put or delete
+ * once dead bytes outweigh live ones.
+ * ============================================================================= */
+
+#define STKV_COMPACT_SLICE       (256u * 1024u)
+#define STKV_COMPACT_MIN_GARBAGE (1u << 20)
+#define STKV_COMPACT_PROBE       1024u  /* budget charged per extent looked at */
+
+/* Copy the live records of a segment elsewhere and free it; -1 if out of
+ * stable memory (the segment stays, minus what was already moved) */
+static int evacuate_segment(uint64_t seg, uint32_t used, uint32_t live) {
+    static uint8_t* data = NULL;
+    if (data == NULL && (data = malloc(STKV_EXTENT_SIZE)) == NULL) return -1;
+    sm_read(seg, data, used);
+    stkv_node* n = &node_a;
+    for (uint32_t pos = SEG_HEADER; pos + REC_HEADER <= used;) {
+        uint32_t klen = ld32(data + pos);
+        uint32_t vlen = ld32(data + pos + 4);
+        uint32_t size = REC_HEADER + klen + vlen;
+        const uint8_t* key = data + pos + REC_HEADER;
+        int found = 0;
+        uint32_t idx = 0;
+        if (find_leaf(key, klen, n, NULL, NULL) == 0) {
+            idx = node_search(n->b, key, klen, &found);
+        }
+        if (found && ld64(node_cell(n->b, idx) + 8) == seg + pos) {
+            uint64_t rec = value_append(key, klen, key + klen, vlen);
+            if (rec == 0) {
+                st32(data + 12, live);
+                sm_write(seg + 12, data + 12, 4);
+                return -1;
+            }
+            st64(node_cell(n->b, idx) + 8, rec);
+            node_write(n);
+            idx_moved(key_hash(key, klen), seg + pos, rec, vlen);
+            live -= size;
+            st.live_bytes -= size;
+        }
+        pos += size;
+    }
+    free_segment(seg, STKV_EXTENT_SIZE);
+    return 0;
+}
+
+/* Sweep at most about `budget` bytes of the heap; 1 if the pass is not
+ * finished yet, 0 once it wrapped around */
+static int stkv_compact_slice(int64_t budget) {
+    if (st.compact_cursor < st.heap_start || st.compact_cursor >= st.next_extent) {
+        st.compact_cursor = st.heap_start;
+    }
+    while (budget > 0) {
+        if (st.compact_cursor >= st.next_extent) {
+            st.compact_cursor = st.heap_start;
+            return 0;
+        }
+        uint64_t off = st.compact_cursor;
+        uint8_t h[SEG_HEADER];
+        sm_read(off, h, SEG_HEADER);
+        uint64_t step = STKV_EXTENT_SIZE;
+        budget -= STKV_COMPACT_PROBE;
+        if (memcmp(h, seg_magic, 4) == 0) {
+            uint32_t size = ld32(h + 4);
+            uint32_t used = ld32(h + 8);
+            uint32_t live = ld32(h + 12);
+            step = size;
+            if (off != st.segment && size == STKV_EXTENT_SIZE &&
+                2ull * live <= used - SEG_HEADER) {
+                if (evacuate_segment(off, used, live) != 0) return 1;
+                budget -= used;
+            }
+        } else if (memcmp(h, free_magic, 4) == 0 || memcmp(h, wal_magic, 4) == 0 ||
+                   memcmp(h, lent_magic, 4) == 0) {
+            step = (uint64_t)ld32(h + 4) * STKV_EXTENT_SIZE;
+        }
+        st.compact_cursor = off + step;
+    }
+    return 1;
+}
+
+static void stkv_maybe_compact(void) {
+    uint64_t dead = st.segment_bytes > st.live_bytes ? st.segment_bytes - st.live_bytes : 0;
+    if (dead > STKV_COMPACT_MIN_GARBAGE && dead > st.live_bytes) {
+        stkv_compact_slice(STKV_COMPACT_SLICE);
+    }
+}
+
+/* Index up to `leaves` more leaves of the chain, resuming after the last
+ * key indexed (leaves may have split or gone since) */
+static void idx_warm_slice(int leaves) {
+    static stkv_buf resume, scratch;
+    static uint32_t resume_len = 0;
+    static int resuming = 0;
+    stkv_node* n = &node_b;
+    if (idx_warm) return;
+    if (st.root == 0 || idx_dropped) {
+        idx_warm = 1;
+        resuming = 0;
+        return;
+    }
+    if (resuming) {
+        find_leaf(resume.p, resume_len, n, NULL, NULL);
+    } else {
+        node_read(n, st.root);
+        for (uint32_t level = 1; level < st.height; level++) node_read(n, node_link(n->b));
+    }
+    for (; leaves > 0; leaves--) {
+        uint32_t count = node_count(n->b);
+        for (uint32_t i = 0; i < count; i++) {
+            uint8_t* c = node_cell(n->b, i);
+            uint32_t klen = ld32(c);
+            const uint8_t* key = leaf_key(c, &scratch);
+            if (resuming && key_cmp(key, klen, resume.p, resume_len) <= 0) continue;
+            uint64_t h = key_hash(key, klen);
+            if (idx_find(h, ld64(c + 8)) == NULL) idx_insert(h, ld64(c + 8), klen, ld32(c + 4));
+        }
+        if (count > 0) {
+            uint8_t* last = node_cell(n->b, count - 1);
+            resume_len = ld32(last);
+            memcpy(buf_reserve(&resume, resume_len), leaf_key(last, &scratch), resume_len);
+            resuming = 1;
+        }
+        if (node_link(n->b) == 0 || idx_dropped) {
+            idx_warm = 1;
+            resuming = 0;
+            return;
+        }
+        node_read(n, node_link(n->b));
+    }
+}
+
+/* =============================================================================
+ * Batch log
+ *
+ * A batch stages puts and deletes in a log instead of the tree, over as
+ * many messages as it takes, and its commit applies them all with one
+ * header write. Reads do not see staged operations until then. The log
+ * is in stable memory, so an open batch survives upgrades, and a commit
+ * that traps leaves it open; abort drops it.
+ *
+ * The commit runs in a single message, so a batch is capped at what one
+ * message can apply: STKV_BATCH_MAX_RECORDS records of at most
+ * STKV_BATCH_MAX_BYTES log bytes in all. Staging past either fails.
+ *
+ * The log is a chain of extent runs. Each starts with WAL_RUN_HEADER bytes:
+ *   u32 magic "WLOG", u32 extents, u64 next run, u64 bytes used, and in the
+ *   first run u32 state, u32 bytes staged, u64 last run, u64 records
+ * Record: u32 CRC-32 of the rest, u32 op, u32 key_len, u32 value_len, key,
+ *   value (none for deletes)
+ *
+ * Commit applies the records and frees the log in the same message, so a
+ * log is only ever found open. Recovery (stkv_recover, from
+ * canister_post_upgrade) cuts it back after its last record whose
+ * checksum holds.
+ * ============================================================================= */
+
+#define WAL_RUN_HEADER  48
+#define WAL_REC_HEADER  16
+#define WAL_NEXT        8   /* run header fields */
+#define WAL_USED        16
+#define WAL_STATE       24
+#define WAL_BYTES       28  /* u32 */
+#define WAL_TAIL        32
+#define WAL_RECORDS     40
+#define WAL_OPEN        1
+#define WAL_PUT         1
+#define WAL_DELETE      2
+
+/* Well inside one message's instruction limit when applied */
+#define STKV_BATCH_MAX_RECORDS 16384u
+#define STKV_BATCH_MAX_BYTES   (8u << 20)
+
+static uint32_t crc_table[256];
+
+/* CRC-32 (IEEE); chains as crc32_update(crc32_update(0, a), b) */
+static uint32_t crc32_update(uint32_t crc, const uint8_t* p, uint64_t n) {
+    if (crc_table[1] == 0) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            crc_table[i] = c;
+        }
+    }
+    crc = ~crc;
+    for (uint64_t i = 0; i < n; i++) crc = crc_table[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+static uint64_t wal_get(uint64_t run, uint32_t field) {
+    uint8_t b[8];
+    sm_read(run + field, b, 8);
+    return ld64(b);
+}
+
+static void wal_set(uint64_t run, uint32_t field, uint64_t v) {
+    uint8_t b[8];
+    st64(b, v);
+    sm_write(run + field, b, 8);
+}
+
+static uint32_t wal_bytes(void) {
+    uint8_t b[4];
+    sm_read(st.wal + WAL_BYTES, b, 4);
+    return ld32(b);
+}
+
+static void wal_set_bytes(uint32_t v) {
+    uint8_t b[4];
+    st32(b, v);
+    sm_write(st.wal + WAL_BYTES, b, 4);
+}
+
+static uint64_t wal_run_bytes(uint64_t run) {
+    uint8_t h[8];
+    sm_read(run, h, 8);
+    return (uint64_t)ld32(h + 4) * STKV_EXTENT_SIZE;
+}
+
+/* A fresh run of `n` extents; 0 when out of stable memory */
+static uint64_t wal_new_run(uint64_t n) {
+    uint64_t off = alloc_extents(n);
+    if (off == 0) return 0;
+    uint8_t h[WAL_RUN_HEADER] = {0};
+    memcpy(h, wal_magic, 4);
+    st32(h + 4, (uint32_t)n);
+    st64(h + WAL_USED, WAL_RUN_HEADER);
+    sm_write(off, h, WAL_RUN_HEADER);
+    return off;
+}
+
+static void wal_free_runs(uint64_t run) {
+    while (run != 0) {
+        uint64_t next = wal_get(run, WAL_NEXT);
+        free_extents(run, wal_run_bytes(run) / STKV_EXTENT_SIZE);
+        run = next;
+    }
+}
+
+/* Cut the log back to `records` records ending at `used` in `run` */
+static void wal_truncate(uint64_t run, uint64_t used, uint64_t records) {
+    wal_free_runs(wal_get(run, WAL_NEXT));
+    wal_set(run, WAL_NEXT, 0);
+    wal_set(run, WAL_USED, used);
+    wal_set(st.wal, WAL_TAIL, run);
+    wal_set(st.wal, WAL_RECORDS, records);
+    uint64_t bytes = 0;
+    for (uint64_t r = st.wal; r != 0; r = wal_get(r, WAL_NEXT)) {
+        bytes += wal_get(r, WAL_USED) - WAL_RUN_HEADER;
+    }
+    wal_set_bytes((uint32_t)bytes);
+}
+
+/* Stage one record in the open log; -1 when out of stable memory or past
+ * the batch limits */
+static int wal_append(uint32_t op, const uint8_t* key, uint32_t klen,
+                      const uint8_t* val, uint32_t vlen) {
+    uint64_t size = WAL_REC_HEADER + (uint64_t)klen + vlen;
+    uint32_t bytes = wal_bytes();
+    if (wal_get(st.wal, WAL_RECORDS) >= STKV_BATCH_MAX_RECORDS ||
+        size > STKV_BATCH_MAX_BYTES - bytes) {
+        return -1;
+    }
+    uint64_t tail = wal_get(st.wal, WAL_TAIL);
+    uint64_t used = wal_get(tail, WAL_USED);
+    if (used + size > wal_run_bytes(tail)) {
+        uint64_t n = (WAL_RUN_HEADER + size + STKV_EXTENT_SIZE - 1) / STKV_EXTENT_SIZE;
+        if (n > 0xFFFFFFFFull) return -1;
+        uint64_t run = wal_new_run(n);
+        if (run == 0) return -1;
+        wal_set(tail, WAL_NEXT, run);
+        wal_set(st.wal, WAL_TAIL, run);
+        tail = run;
+        used = WAL_RUN_HEADER;
+        stkv_flush_header();  /* the free lists changed */
+    }
+    uint8_t h[WAL_REC_HEADER];
+    st32(h + 4, op);
+    st32(h + 8, klen);
+    st32(h + 12, vlen);
+    uint32_t crc = crc32_update(0, h + 4, WAL_REC_HEADER - 4);
+    crc = crc32_update(crc, key, klen);
+    st32(h, crc32_update(crc, val, vlen));
+    sm_write(tail + used, h, WAL_REC_HEADER);
+    if (klen > 0) sm_write(tail + used + WAL_REC_HEADER, key, klen);
+    if (vlen > 0) sm_write(tail + used + WAL_REC_HEADER + klen, val, vlen);
+    wal_set(tail, WAL_USED, used + size);
+    wal_set(st.wal, WAL_RECORDS, wal_get(st.wal, WAL_RECORDS) + 1);
+    wal_set_bytes(bytes + (uint32_t)size);
+    return 0;
+}
+
+/*
+ * Check the records in order, applying each to the tree when `apply`
+ * (trapping if the tree cannot take it: the message is rolled back).
+ * Returns how many have a valid checksum; the first that does not is
+ * reported in *bad_run / *bad_pos (0 when there is none).
+ */
+static uint64_t wal_replay(int apply, uint64_t* bad_run, uint64_t* bad_pos) {
+    static stkv_buf rec;
+    uint64_t records = 0;
+    *bad_run = 0;
+    for (uint64_t run = st.wal; run != 0; run = wal_get(run, WAL_NEXT)) {
+        uint64_t used = wal_get(run, WAL_USED);
+        for (uint64_t pos = WAL_RUN_HEADER; pos < used;) {
+            uint8_t h[WAL_REC_HEADER];
+            int ok = used - pos >= WAL_REC_HEADER;
+            uint64_t size = WAL_REC_HEADER;
+            if (ok) {
+                sm_read(run + pos, h, WAL_REC_HEADER);
+                size += (uint64_t)ld32(h + 8) + ld32(h + 12);
+                ok = ld32(h + 8) <= 0x7FFFFFFF && ld32(h + 12) <= 0x7FFFFFFF &&
+                     size <= used - pos;
+            }
+            uint8_t* body = NULL;
+            if (ok) {
+                body = buf_reserve(&rec, size - WAL_REC_HEADER);
+                sm_read(run + pos + WAL_REC_HEADER, body, size - WAL_REC_HEADER);
+                uint32_t crc = crc32_update(0, h + 4, WAL_REC_HEADER - 4);
+                ok = crc32_update(crc, body, size - WAL_REC_HEADER) == ld32(h);
+            }
+            if (!ok) {
+                *bad_run = run;
+                *bad_pos = pos;
+                return records;
+            }
+            if (apply) {
+                uint32_t op = ld32(h + 4);
+                uint32_t klen = ld32(h + 8);
+                int r = 0;
+                if (op == WAL_PUT) {
+                    r = stkv_insert(body, klen, body + klen, ld32(h + 12));
+                } else if (op == WAL_DELETE) {
+                    stkv_remove(body, klen);
+                }
+                if (r != 0) stkv_trap("stkv: cannot apply the batch (out of stable memory)");
+            }
+            records++;
+            pos += size;
+        }
+    }
+    return records;
+}
+
+/* Apply the batch and drop the log; the records applied. A damaged record
+ * traps before anything is kept. */
+static int64_t wal_commit(void) {
+    uint64_t bad_run, bad_pos;
+    uint64_t records = wal_replay(1, &bad_run, &bad_pos);
+    if (bad_run != 0) stkv_trap("stkv: batch log checksum mismatch");
+    wal_free_runs(st.wal);
+    st.wal = 0;
+    stkv_maybe_compact();
+    stkv_flush_header();
+    return (int64_t)records;
+}
+
+/* =============================================================================
+ * Initialization and format migration
+ * ============================================================================= */
+
+/*
+ * Format 1 kept entries [key_len:4, key, val_len:4, val] from offset 12 with
+ * the count at 4 and the end at 8; a replaced value was appended again, so
+ * later entries win.
+ */
+static void stkv_migrate_v1(const uint8_t* h) {
+    uint32_t count = ld32(h + 4);
+    uint32_t end = ld32(h + 8);
+    uint64_t base = end > STKV_HEAP_START ? end : STKV_HEAP_START;
+    stkv_reset((base + STKV_EXTENT_SIZE - 1) & ~(uint64_t)(STKV_EXTENT_SIZE - 1));
+    idx_reset(1);
+
+    static stkv_buf key, val;
+    uint64_t off = 12;
+    for (uint32_t i = 0; i < count && off + 8 <= end; i++) {
+        uint8_t len[4];
+        sm_read(off, len, 4);
+        uint32_t klen = ld32(len);
+        sm_read(off + 4 + klen, len, 4);
+        uint32_t vlen = ld32(len);
+        sm_read(off + 4, buf_reserve(&key, klen), klen);
+        sm_read(off + 8 + klen, buf_reserve(&val, vlen), vlen);
+        if (stkv_insert(key.p, klen, val.p, vlen) != 0) {
+            stkv_trap("stkv: cannot grow stable memory migrating format 1");
+        }
+        off += 8ull + klen + vlen;
+    }
+    stkv_flush_header();
+}
+
+/*
+ * Format 2 had no free lists: every node extent is full except the current
+ * one, so the space counters format 3 keeps can be recovered by one sweep.
+ */
+static void stkv_upgrade_v2(void) {
+    st.compact_cursor = st.heap_start;
+    for (uint64_t off = st.heap_start; off < st.next_extent;) {
+        uint8_t h[SEG_HEADER];
+        sm_read(off, h, SEG_HEADER);
+        if (memcmp(h, seg_magic, 4) == 0) {
+            st.segment_bytes += ld32(h + 4);
+            off += ld32(h + 4);
+        } else {
+            uint64_t end = off + STKV_EXTENT_SIZE;
+            int current = st.node_cursor > off && st.node_cursor <= end;
+            st.nodes += (current ? st.node_cursor - off : STKV_EXTENT_SIZE) / STKV_NODE_SIZE;
+            off = end;
+        }
+    }
+}
+
+static void stkv_init_if_needed(void) {
+    if (stkv_initialized) return;
+    stkv_initialized = 1;
+    stkv_reset(STKV_HEAP_START);
+    if (ic_stable_pages() == 0) return;
+
+    uint8_t h[STKV_HEADER_SIZE];
+    sm_read(0, h, STKV_HEADER_SIZE);
+    if (memcmp(h, stkv_magic, 4) == 0) {
+        if (ld32(h + 4) > STKV_FORMAT) stkv_trap("stkv: stable store has a newer format");
+        st.count = ld64(h + 8);
+        st.root = ld64(h + 16);
+        st.height = ld32(h + 24);
+        st.heap_start = ld64(h + 32);
+        st.next_extent = ld64(h + 40);
+        st.node_cursor = ld64(h + 48);
+        st.segment = ld64(h + 56);
+        st.live_bytes = ld64(h + 64);
+        st.node_free = ld64(h + 72);
+        st.extent_free = ld64(h + 80);
+        st.free_extents = ld64(h + 88);
+        st.segment_bytes = ld64(h + 96);
+        st.nodes = ld64(h + 104);
+        st.compact_cursor = ld64(h + 112);
+        st.run_free = ld64(h + 120);
+        if (ld32(h + 28) != 0) {
+            st.wal = st.heap_start + (uint64_t)(ld32(h + 28) - 1) * STKV_EXTENT_SIZE;
+        }
+        if (ld32(h + 4) < 3) stkv_upgrade_v2();
+        if (st.segment != 0) {
+            uint8_t s[SEG_HEADER];
+            sm_read(st.segment, s, SEG_HEADER);
+            seg_used = ld32(s + 8);
+            seg_live = ld32(s + 12);
+        }
+    } else if (memcmp(h, "STKV", 4) == 0) {
+        stkv_migrate_v1(h);
+    }
+    /* Anything else: start empty; the header is written by the first put */
+}
+
+/* Every stkv call: load the header once, then extend the index a little */
+static void stkv_enter(void) {
+    stkv_init_if_needed();
+    if (!idx_warm) idx_warm_slice(STKV_INDEX_WARM_LEAVES);
+}
+
+/* =============================================================================
+ * API
+ * ============================================================================= */
+
+/*
+ * Put key-value pair
+ * key_ptr: pointer to key bytes
+ * key_len: length of key
+ * val_ptr: pointer to value bytes
+ * val_len: length of value
+ * Returns: 0 on success, -1 on error
+ */
+int64_t stkv_put(int64_t key_ptr, int64_t key_len, int64_t val_ptr, int64_t val_len) {
+    stkv_enter();
+    if (key_len < 0 || key_len > 0x7FFFFFFF || val_len < 0 || val_len > 0x7FFFFFFF) {
+        return -1;
+    }
+    int r = stkv_insert((const uint8_t*)(uintptr_t)key_ptr, (uint32_t)key_len,
+                        (const uint8_t*)(uintptr_t)val_ptr, (uint32_t)val_len);
+    stkv_maybe_compact();
+    stkv_flush_header();
+    return r == 0 ? 0 : -1;
+}
+
+/*
+ * Get value by key
+ * key_ptr: pointer to key bytes
+ * key_len: length of key
+ * val_ptr: pointer to buffer for value
+ * max_val_len: maximum bytes to copy
+ * Returns: actual value length, or -1 if not found
+ */
+int64_t stkv_get(int64_t key_ptr, int64_t key_len, int64_t val_ptr, int64_t max_val_len) {
+    stkv_enter();
+    if (key_len < 0 || key_len > 0x7FFFFFFF) return -1;
+    const uint8_t* key = (const uint8_t*)(uintptr_t)key_ptr;
+    uint32_t klen = (uint32_t)key_len;
+
+    uint64_t rec;
+    int64_t r = idx_get(key_hash(key, klen), key, klen, (uint8_t*)(uintptr_t)val_ptr, max_val_len,
+                        &rec);
+    if (r != -2) return r;
+
+    stkv_node* n = &node_a;
+    if (find_leaf(key, klen, n, NULL, NULL) != 0) return -1;
+    int found;
+    uint32_t idx = node_search(n->b, key, klen, &found);
+    if (!found) return -1;
+
+    uint8_t* c = node_cell(n->b, idx);
+    uint32_t vlen = ld32(c + 4);
+    uint32_t copy = max_val_len <= 0 ? 0 : (max_val_len < vlen ? (uint32_t)max_val_len : vlen);
+    sm_read(ld64(c + 8) + REC_HEADER + klen, (uint8_t*)(uintptr_t)val_ptr, copy);
+    return (int64_t)vlen;
+}
+
+/*
+ * Delete key
+ * key_ptr: pointer to key bytes
+ * key_len: length of key
+ * Returns: 0 on success (or not found), -1 on error
+ */
+int64_t stkv_delete(int64_t key_ptr, int64_t key_len) {
+    stkv_enter();
+    if (key_len < 0 || key_len > 0x7FFFFFFF) return -1;
+    if (stkv_remove((const uint8_t*)(uintptr_t)key_ptr, (uint32_t)key_len)) {
+        stkv_maybe_compact();
+        stkv_flush_header();
+    }
+    return 0;
+}
+
+/*
+ * Open a batch: later stkv_batch_put / stkv_batch_delete calls are staged
+ * (across messages if need be) until stkv_batch_commit applies them.
+ * Returns 0, or -1 if a batch is already open or stable memory is full.
+ */
+int64_t stkv_batch_begin(void) {
+    stkv_enter();
+    if (st.wal != 0) return -1;
+    uint64_t run = wal_new_run(1);
+    if (run == 0) return -1;
+    wal_set(run, WAL_STATE, WAL_OPEN);
+    wal_set(run, WAL_TAIL, run);
+    st.wal = run;
+    stkv_flush_header();
+    return 0;
+}
+
+/* Stage a put or a delete; 0, or -1 (no open batch, bad length, full,
+ * batch limits reached) */
+int64_t stkv_batch_put(int64_t key_ptr, int64_t key_len, int64_t val_ptr, int64_t val_len) {
+    stkv_enter();
+    if (st.wal == 0 || key_len < 0 || key_len > 0x7FFFFFFF || val_len < 0 ||
+        val_len > 0x7FFFFFFF) {
+        return -1;
+    }
+    return wal_append(WAL_PUT, (const uint8_t*)(uintptr_t)key_ptr, (uint32_t)key_len,
+                      (const uint8_t*)(uintptr_t)val_ptr, (uint32_t)val_len);
+}
+
+int64_t stkv_batch_delete(int64_t key_ptr, int64_t key_len) {
+    stkv_enter();
+    if (st.wal == 0 || key_len < 0 || key_len > 0x7FFFFFFF) return -1;
+    return wal_append(WAL_DELETE, (const uint8_t*)(uintptr_t)key_ptr, (uint32_t)key_len, NULL, 0);
+}
+
+/*
+ * Apply every staged operation in order, with one header write, and close
+ * the batch. Returns the number applied, or -1 if no batch is open.
+ */
+int64_t stkv_batch_commit(void) {
+    stkv_enter();
+    if (st.wal == 0) return -1;
+    return wal_commit();
+}
+
+/* Drop the open batch, if any */
+void stkv_batch_abort(void) {
+    stkv_init_if_needed();
+    if (st.wal == 0) return;
+    wal_free_runs(st.wal);
+    st.wal = 0;
+    stkv_flush_header();
+}
+
+/* Operations staged in the open batch, or -1 if none is open */
+int64_t stkv_batch_pending(void) {
+    stkv_init_if_needed();
+    return st.wal != 0 ? (int64_t)wal_get(st.wal, WAL_RECORDS) : -1;
+}
+
+/*
+ * Check the batch log after an upgrade (canister_post_upgrade): an open
+ * batch is cut back after its last intact record and stays open. Returns
+ * 0; a batch is never left half committed, so there is nothing to replay.
+ */
+int64_t stkv_recover(void) {
+    stkv_init_if_needed();
+    if (st.wal == 0) return 0;
+    uint64_t bad_run, bad_pos;
+    uint64_t records = wal_replay(0, &bad_run, &bad_pos);
+    if (bad_run != 0) {
+        wal_truncate(bad_run, bad_pos, records);
+        stkv_flush_header();
+    }
+    return 0;
+}
+
+/*
+ * Get entry count
+ */
+int64_t stkv_count_entries(void) {
+    stkv_init_if_needed();
+    return (int64_t)st.count;
+}
+
+/*
+ * Run one compaction slice of about `budget` bytes (<= 0: the default).
+ * Returns 1 while the current pass over the heap is unfinished, 0 after it
+ * wrapped around. Meant for canister_global_timer / heartbeat handlers;
+ * puts and deletes already run a slice when dead bytes outweigh live ones.
+ */
+int64_t stkv_compact(int64_t budget) {
+    stkv_init_if_needed();
+    if (st.root == 0 && st.segment_bytes == 0) return 0;
+    int more = stkv_compact_slice(budget > 0 ? budget : STKV_COMPACT_SLICE);
+    stkv_flush_header();
+    return more;
+}
+
+/*
+ * Space statistics, in bytes unless noted
+ * which: 0=entries 1=live (reachable records: key + value + 8)
+ *        2=value segments 3=B+tree nodes in use 4=free extents
+ *        5=heap (all extents ever allocated) 6=tree height (levels)
+ *        7=keys in the heap index 8=heap index size
+ *        9=1 if the index holds every key (misses skip the tree)
+ * Space amplification is (heap - free) / live.
+ */
+int64_t stkv_stat(int32_t which) {
+    stkv_init_if_needed();
+    switch (which) {
+        case 0: return (int64_t)st.count;
+        case 1: return (int64_t)st.live_bytes;
+        case 2: return (int64_t)st.segment_bytes;
+        case 3: return (int64_t)(st.nodes * STKV_NODE_SIZE);
+        case 4: return (int64_t)(st.free_extents * STKV_EXTENT_SIZE);
+        case 5: return (int64_t)(st.next_extent - st.heap_start);
+        case 6: return (int64_t)st.height;
+        case 7: return (int64_t)idx_live;
+        case 8: return (int64_t)idx_cap * (int64_t)sizeof(idx_entry);
+        case 9: return idx_complete();
+        default: return -1;
+    }
+}
+
+/*
+ * Cap the heap index at `bytes` of Wasm memory (0 disables it; negative:
+ * the 64 MiB default). The index is dropped and rebuilt under the new cap.
+ */
+void stkv_index_limit(int64_t bytes) {
+    idx_limit = bytes < 0 ? STKV_INDEX_LIMIT : (uint64_t)bytes;
+    idx_reset(0);
+}
+
+/*
+ * Clear all entries and any open batch. Runs lent by stkv_extent_alloc
+ * stay where they are; the extents between them are freed and the heap
+ * shrinks back to the end of the last one.
+ */
+void stkv_clear(void) {
+    stkv_init_if_needed();
+    uint64_t end = st.next_extent;
+    stkv_reset(st.heap_start);
+    uint64_t span = st.heap_start;
+    for (uint64_t off = st.heap_start; off < end;) {
+        uint8_t h[8];
+        sm_read(off, h, 8);
+        uint64_t step = STKV_EXTENT_SIZE;
+        if (memcmp(h, seg_magic, 4) == 0) {
+            step = ld32(h + 4);
+        } else if (memcmp(h, free_magic, 4) == 0 || memcmp(h, wal_magic, 4) == 0 ||
+                   memcmp(h, lent_magic, 4) == 0) {
+            step = (uint64_t)ld32(h + 4) * STKV_EXTENT_SIZE;
+        }
+        if (memcmp(h, lent_magic, 4) == 0) {
+            if (off > span) free_extents(span, (off - span) / STKV_EXTENT_SIZE);
+            span = off + step;
+        }
+        off += step;
+    }
+    st.next_extent = span;
+    idx_reset(1);
+    stkv_flush_header();
+}
+
+/*
+ * Lend a run of `extents` 64 KiB extents to another stable structure
+ * (ic_stable_structs.c), tagged with `owner`. Its first 16 bytes hold the
+ * run header; the rest is the caller's, untouched by compaction and by
+ * stkv_clear. Returns its stable offset, or 0 when out of stable memory.
+ */
+uint64_t stkv_extent_alloc(uint64_t extents, uint64_t owner) {
+    stkv_init_if_needed();
+    if (extents == 0 || extents > UINT32_MAX) return 0;
+    uint64_t off = alloc_extents(extents);
+    if (off == 0) return 0;
+    uint8_t h[16];
+    memcpy(h, lent_magic, 4);
+    st32(h + 4, (uint32_t)extents);
+    st64(h + 8, owner);
+    sm_write(off, h, 16);
+    stkv_flush_header();
+    return off;
+}
+
+/*
+ * Return a run from stkv_extent_alloc to the free lists
+ */
+void stkv_extent_free(uint64_t off) {
+    stkv_init_if_needed();
+    uint8_t h[8];
+    sm_read(off, h, 8);
+    if (memcmp(h, lent_magic, 4) != 0) stkv_trap("stkv: not a lent extent run");
+    free_extents(off, ld32(h + 4));
+    stkv_flush_header();
+}
+
+/* =============================================================================
+ * Batched access
+ *
+ * stkv_get_many / stkv_put_many take a whole batch in one RefC Buffer: one
+ * FFI call, one header write, and a single pass in key order, so successive
+ * keys mostly land in the leaf just read or in pages the cache still holds.
+ * Gets then copy the values out in stable-memory order.
+ *
+ * Key list:  repeated [u32 key_len, key]
+ * Entries:   repeated [u32 key_len, u32 value_len, key, value]
+ * Results:   per key, in the order given: [i32 value_len (-1: absent), value]
+ * ============================================================================= */
+
+#ifdef IC_HAVE_REFC_BUFFER
+
+typedef struct {
+    const uint8_t* key;
+    const uint8_t* val;
+    uint32_t klen;
+    uint32_t vlen;
+    uint64_t rec;    /* gets: value record, 0 if absent */
+    uint64_t order;  /* position in the batch; gets: then in the results */
+} stkv_item;
+
+static stkv_buf batch;
+
+static int item_key_order(const void* a, const void* b) {
+    const stkv_item* x = a;
+    const stkv_item* y = b;
+    int c = key_cmp(x->key, x->klen, y->key, y->klen);
+    if (c != 0) return c;
+    return x->order < y->order ? -1 : x->order > y->order;
+}
+
+static int item_batch_order(const void* a, const void* b) {
+    uint64_t x = ((const stkv_item*)a)->order;
+    uint64_t y = ((const stkv_item*)b)->order;
+    return x < y ? -1 : x > y;
+}
+
+static int item_record_order(const void* a, const void* b) {
+    uint64_t x = ((const stkv_item*)a)->rec;
+    uint64_t y = ((const stkv_item*)b)->rec;
+    return x < y ? -1 : x > y;
+}
+
+/* Split a packed list into `batch`; the number of items, or -1 if malformed */
+static int64_t batch_parse(const Buffer* b, int with_values) {
+    const uint8_t* p = (const uint8_t*)b->data;
+    uint64_t len = b->size > 0 ? (uint64_t)b->size : 0;
+    uint64_t head = with_values ? 8 : 4;
+    uint64_t n = 0;
+    for (uint64_t pos = 0; pos < len; n++) {
+        if (len - pos < head) return -1;
+        uint32_t klen = ld32(p + pos);
+        uint32_t vlen = with_values ? ld32(p + pos + 4) : 0;
+        if (klen > 0x7FFFFFFF || vlen > 0x7FFFFFFF) return -1;
+        if (len - pos - head < (uint64_t)klen + vlen) return -1;
+        stkv_item* it = (stkv_item*)buf_reserve(&batch, (n + 1) * sizeof(stkv_item)) + n;
+        it->key = p + pos + head;
+        it->val = it->key + klen;
+        it->klen = klen;
+        it->vlen = vlen;
+        it->rec = 0;
+        it->order = n;
+        pos += head + klen + vlen;
+    }
+    return (int64_t)n;
+}
+
+/* Find the record of each item, in key order; the number found */
+static int64_t batch_locate(stkv_item* items, int64_t n) {
+    stkv_node* leaf = &node_a;
+    int have_leaf = 0;
+    int64_t found = 0;
+    for (int64_t i = 0; i < n; i++) {
+        stkv_item* it = &items[i];
+        uint8_t none;
+        uint64_t rec = 0;
+        int64_t r = idx_get(key_hash(it->key, it->klen), it->key, it->klen, &none, 0, &rec);
+        if (r == -2) {
+            /* The previous leaf decides every key up to its last one */
+            int hit = 0;
+            uint32_t idx = 0;
+            if (have_leaf) idx = node_search(leaf->b, it->key, it->klen, &hit);
+            if (!have_leaf || idx == node_count(leaf->b)) {
+                have_leaf = find_leaf(it->key, it->klen, leaf, NULL, NULL) == 0;
+                if (have_leaf) idx = node_search(leaf->b, it->key, it->klen, &hit);
+            }
+            r = -1;
+            if (have_leaf && hit) {
+                uint8_t* c = node_cell(leaf->b, idx);
+                rec = ld64(c + 8);
+                r = ld32(c + 4);
+            }
+        }
+        if (r >= 0) {
+            it->rec = rec;
+            it->vlen = (uint32_t)r;
+            found++;
+        }
+    }
+    return found;
+}
+
+/*
+ * Look up every key of a packed key list and append the results to `out`
+ * (a Buffer, grown as needed). Returns how many keys were found, or -1 if
+ * the list is malformed or the results would not fit in a Buffer (`out` is
+ * left as it was).
+ */
+int64_t stkv_get_many(void* keys, void* out) {
+    stkv_enter();
+    Buffer* ob = out;
+    int64_t n = batch_parse(keys, 0);
+    if (n <= 0) return n;  /* an empty list leaves batch.p unset */
+    stkv_item* items = (stkv_item*)batch.p;
+    qsort(items, (size_t)n, sizeof *items, item_key_order);
+    int64_t found = batch_locate(items, n);
+
+    /* Lay the results out in batch order */
+    qsort(items, (size_t)n, sizeof *items, item_batch_order);
+    uint64_t total = 0;
+    for (int64_t i = 0; i < n; i++) {
+        items[i].order = total;
+        total += 4 + (items[i].rec ? items[i].vlen : 0);
+    }
+    if (total > (uint64_t)(INT32_MAX - ob->size)) return -1;
+    reserveBuffer(ob, (int)total);
+    uint8_t* base = (uint8_t*)ob->data + ob->size;
+    for (int64_t i = 0; i < n; i++) {
+        st32(base + items[i].order, items[i].rec ? items[i].vlen : 0xFFFFFFFFu);
+    }
+
+    /* Copy the values in stable-memory order */
+    qsort(items, (size_t)n, sizeof *items, item_record_order);
+    for (int64_t i = 0; i < n; i++) {
+        if (items[i].rec == 0) continue;
+        sm_read(items[i].rec + REC_HEADER + items[i].klen, base + items[i].order + 4,
+                items[i].vlen);
+    }
+    ob->size += (int)total;
+    return found;
+}
+
+/*
+ * Store every entry of a packed entry list, in key order, with one
+ * compaction check and one header write for the batch. Of entries with the
+ * same key the last one wins. Returns the number of entries, or -1 if the
+ * list is malformed (nothing is stored) or stable memory ran out: an
+ * insert that fails changes nothing (stkv_insert), so the entries before
+ * the failing key, in key order, are stored and none from it on.
+ */
+int64_t stkv_put_many(void* entries) {
+    stkv_enter();
+    int64_t n = batch_parse(entries, 1);
+    if (n <= 0) return n;
+    stkv_item* items = (stkv_item*)batch.p;
+    qsort(items, (size_t)n, sizeof *items, item_key_order);
+    int r = 0;
+    for (int64_t i = 0; i < n && r == 0; i++) {
+        const stkv_item* it = &items[i];
+        if (i + 1 < n && key_cmp(it->key, it->klen, items[i + 1].key, items[i + 1].klen) == 0) {
+            continue;
+        }
+        r = stkv_insert(it->key, it->klen, it->val, it->vlen);
+    }
+    stkv_maybe_compact();
+    stkv_flush_header();
+    return r == 0 ? n : -1;
+}
+
+/*
+ * Stage every entry of a packed entry list (stkv_put_many) or key list
+ * (stkv_get_many) in the open batch, all or none. Returns the number
+ * staged, or -1 (malformed list, no open batch, stable memory full, batch
+ * limits reached).
+ */
+static int64_t batch_stage(void* list, uint32_t op) {
+    stkv_enter();
+    if (st.wal == 0) return -1;
+    int64_t n = batch_parse(list, op == WAL_PUT);
+    if (n < 0) return -1;
+    const stkv_item* items = (const stkv_item*)batch.p;
+    uint64_t tail = wal_get(st.wal, WAL_TAIL);
+    uint64_t used = wal_get(tail, WAL_USED);
+    uint64_t records = wal_get(st.wal, WAL_RECORDS);
+    for (int64_t i = 0; i < n; i++) {
+        if (wal_append(op, items[i].key, items[i].klen, items[i].val, items[i].vlen) != 0) {
+            wal_truncate(tail, used, records);
+            stkv_flush_header();
+            return -1;
+        }
+    }
+    return n;
+}
+
+int64_t stkv_batch_put_many(void* entries) {
+    return batch_stage(entries, WAL_PUT);
+}
+
+int64_t stkv_batch_delete_many(void* keys) {
+    return batch_stage(keys, WAL_DELETE);
+}
+
+/* =============================================================================
+ * Range scans
+ *
+ * A scan finds its first key with one descent, then follows the leaf chain,
+ * so a page of K entries costs O(log n + K) node reads. Pages are appended
+ * to a Buffer in the entry list format of stkv_put_many and end after
+ * `limit` entries or about STKV_SCAN_BYTES; the last key of a page is the
+ * cursor the next page resumes after.
+ * ============================================================================= */
+
+/* Whether a leaf cell's key starts with prefix[0, plen) */
+static int cell_has_prefix(const uint8_t* c, const uint8_t* prefix, uint32_t plen) {
+    uint32_t klen = ld32(c);
+    if (klen < plen) return 0;
+    if (memcmp(c + CELL_HEADER, prefix, inline_len(plen)) != 0) return 0;
+    if (plen <= STKV_INLINE_KEY) return 1;
+    return stable_key_cmp(ld64(c + 8) + REC_HEADER + STKV_INLINE_KEY, 0, plen - STKV_INLINE_KEY,
+                          prefix + STKV_INLINE_KEY, plen - STKV_INLINE_KEY) == 0;
+}
+
+/*
+ * Append the entries from `from` (or just past it, when `after`) while
+ * their keys are below `to` and start with `prefix` (either may be NULL).
+ */
+static int64_t scan_range(const uint8_t* from, uint32_t flen, int after,
+                          const uint8_t* to, uint32_t tlen,
+                          const uint8_t* prefix, uint32_t plen,
+                          int64_t limit, Buffer* out) {
+    stkv_node* n = &node_a;
+    if (find_leaf(from, flen, n, NULL, NULL) != 0) return 0;
+    int found;
+    uint32_t idx = node_search(n->b, from, flen, &found);
+    if (found && after) idx++;
+
+    int64_t count = 0;
+    uint64_t bytes = 0;
+    for (;; idx++) {
+        while (idx == node_count(n->b)) {
+            uint64_t next = node_link(n->b);
+            if (next == 0) return count;
+            node_read(n, next);
+            idx = 0;
+        }
+        const uint8_t* c = node_cell(n->b, idx);
+        if (to != NULL && cell_cmp(NODE_LEAF, c, to, tlen) >= 0) return count;
+        if (prefix != NULL && !cell_has_prefix(c, prefix, plen)) return count;
+
+        uint32_t klen = ld32(c);
+        uint32_t vlen = ld32(c + 4);
+        uint64_t size = 8 + (uint64_t)klen + vlen;
+        int full = size > (uint64_t)(INT32_MAX - out->size);
+        if ((limit > 0 && count == limit) || (count > 0 && (full || bytes + size > STKV_SCAN_BYTES))) {
+            return count + STKV_SCAN_MORE;
+        }
+        if (full) return -1;
+        reserveBuffer(out, (int)size);
+        uint8_t* p = (uint8_t*)out->data + out->size;
+        st32(p, klen);
+        st32(p + 4, vlen);
+        sm_read(ld64(c + 8) + REC_HEADER, p + 8, (uint64_t)klen + vlen);
+        out->size += (int)size;
+        bytes += size;
+        count++;
+    }
+}
+
+/*
+ * One page of the entries with from <= key < to, in key order, appended to
+ * `out` as [u32 key_len, u32 value_len, key, value]. With `after` the page
+ * starts past `from` (a cursor: the last key of the previous page). An
+ * empty `to` means no upper bound; `limit` <= 0 means no entry limit.
+ * Returns the number of entries, plus STKV_SCAN_MORE when the range
+ * continues past them, or -1 if one entry does not fit in a Buffer.
+ */
+int64_t stkv_scan(void* from, int32_t after, void* to, int64_t limit, void* out) {
+    stkv_enter();
+    Buffer* f = from;
+    Buffer* t = to;
+    return scan_range((const uint8_t*)f->data, (uint32_t)f->size, after != 0,
+                      t->size > 0 ? (const uint8_t*)t->data : NULL, (uint32_t)t->size,
+                      NULL, 0, limit, out);
+}
+
+/*
+ * As stkv_scan over the keys that start with `prefix`, from `from` (past
+ * it with `after`); a `from` below the prefix starts at the prefix.
+ */
+int64_t stkv_scan_prefix(void* prefix, void* from, int32_t after, int64_t limit, void* out) {
+    stkv_enter();
+    Buffer* p = prefix;
+    Buffer* f = from;
+    const uint8_t* pk = (const uint8_t*)p->data;
+    const uint8_t* start = (const uint8_t*)f->data;
+    uint32_t plen = (uint32_t)p->size;
+    uint32_t slen = (uint32_t)f->size;
+    if (key_cmp(start, slen, pk, plen) < 0) {
+        start = pk;
+        slen = plen;
+        after = 0;
+    }
+    return scan_range(start, slen, after != 0, NULL, 0, pk, plen, limit, out);
+}
+
+#endif /* IC_HAVE_REFC_BUFFER */
+
+/* =============================================================================
+ * Benchmark (canister only: uses ic0.performance_counter)
+ *
+ * op 0: store bench keys 0..n-1 ("bench:" + 10 digits, 32-byte values),
+ *       at most IC_BENCH_STKV_BATCH per call so a fill of millions of keys
+ *       spans messages; returns how many are stored
+ * op 1: instructions spent by IC_BENCH_STKV_REPS lookups of keys spread
+ *       over 0..n-1 (fill first)
+ * op 2: as op 1 with the heap index bypassed (tree walks only)
+ * op 3: as op 1, the keys fetched by one stkv_get_many call
+ * ============================================================================= */
+
+#define IC_BENCH_STKV_BATCH 20000
+#define IC_BENCH_STKV_REPS 64
+
+static const char bench_count_key[] = "bench:count";
+
+static void bench_key(uint8_t* key, uint32_t i) {
+    memcpy(key, "bench:", 6);
+    for (int d = 15; d >= 6; d--, i /= 10) key[d] = (uint8_t)('0' + i % 10);
+}
+
+uint64_t ic_bench_stkv(int32_t op, int32_t n) {
+    if (n <= 0) return 0;
+    uint8_t key[16];
+    uint8_t val[32];
+    uint8_t cnt[8] = {0};
+    stkv_get((int64_t)(uintptr_t)bench_count_key, sizeof bench_count_key - 1,
+             (int64_t)(uintptr_t)cnt, 8);
+    uint32_t have = ld32(cnt);
+
+    if (op == 0) {
+        uint32_t stop = have + IC_BENCH_STKV_BATCH;
+        if (stop > (uint32_t)n) stop = (uint32_t)n;
+        for (uint32_t i = have; i < stop; i++) {
+            bench_key(key, i);
+            memset(val, (int)(i & 0xFF), sizeof val);
+            if (stkv_insert(key, sizeof key, val, sizeof val) != 0) break;
+            have = i + 1;
+        }
+        st32(cnt, have);
+        stkv_put((int64_t)(uintptr_t)bench_count_key, sizeof bench_count_key - 1,
+                 (int64_t)(uintptr_t)cnt, 8);
+        return have;
+    }
+    if (op < 1 || op > 3 || have < (uint32_t)n) return 0;
+
+#ifdef IC_HAVE_REFC_BUFFER
+    if (op == 3) {
+        Buffer* keys = newBufferWithCapacity(IC_BENCH_STKV_REPS * (4 + sizeof key));
+        Buffer* out = newBufferWithCapacity(0);
+        if (keys == NULL || out == NULL) stkv_trap("stkv: out of memory");
+        for (uint32_t r = 0; r < IC_BENCH_STKV_REPS; r++) {
+            uint8_t* p = (uint8_t*)keys->data + keys->size;
+            st32(p, sizeof key);
+            bench_key(p + 4, (uint32_t)(((uint64_t)r * 2654435761u) % (uint32_t)n));
+            keys->size += 4 + sizeof key;
+        }
+        uint64_t start = ic0_performance_counter(0);
+        stkv_get_many(keys, out);
+        uint64_t cost = ic0_performance_counter(0) - start;
+        freeBuffer(keys);
+        freeBuffer(out);
+        return cost;
+    }
+#else
+    if (op == 3) return 0;
+#endif
+
+    /* op 2: the same lookups through the tree alone */
+    idx_bypass = op == 2;
+    volatile int64_t sink = 0;
+    uint64_t start = ic0_performance_counter(0);
+    for (uint32_t r = 0; r < IC_BENCH_STKV_REPS; r++) {
+        bench_key(key, (uint32_t)(((uint64_t)r * 2654435761u) % (uint32_t)n));
+        sink += stkv_get((int64_t)(uintptr_t)key, sizeof key, (int64_t)(uintptr_t)val,
+                         sizeof val);
+    }
+    uint64_t cost = ic0_performance_counter(0) - start;
+    idx_bypass = 0;
+    (void)sink;
+    return cost;
+}
@@ -0,0 +1,65 @@
+/*
+ * Stable KV Store - ordered key-value map in IC stable memory
+ *
+ * See ic_stkv.c for the on-disk format. Pointers are WASM linear-memory
+ * addresses passed as Idris2 Ints; the batched functions take RefC Buffers.
+ */
+#ifndef IC_STKV_H
+#define IC_STKV_H
+
+#include <stdint.h>
+
+/* Insert or replace; 0 on success, -1 on error */
+int64_t stkv_put(int64_t key_ptr, int64_t key_len, int64_t val_ptr, int64_t val_len);
+
+/* Copy up to max_val_len bytes of the value; its full length, or -1 */
+int64_t stkv_get(int64_t key_ptr, int64_t key_len, int64_t val_ptr, int64_t max_val_len);
+
+/* Remove a key; 0 whether or not it was present, -1 on error */
+int64_t stkv_delete(int64_t key_ptr, int64_t key_len);
+int64_t stkv_count_entries(void);
+void stkv_clear(void);
+
+/* Batches packed in Buffers (see ic_stkv.c): results are appended to `out`.
+ * Keys found / entries stored, or -1 */
+int64_t stkv_get_many(void* keys, void* out);
+int64_t stkv_put_many(void* entries);
+
+/* Range and prefix scans, one page per call appended to `out` (see
+ * ic_stkv.c); entries in the page, plus STKV_SCAN_MORE if more follow */
+#define STKV_SCAN_MORE (1ll << 32)
+int64_t stkv_scan(void* from, int32_t after, void* to, int64_t limit, void* out);
+int64_t stkv_scan_prefix(void* prefix, void* from, int32_t after, int64_t limit, void* out);
+
+/* Batches applied atomically by commit, staged (possibly over several
+ * messages) in a log in stable memory; see ic_stkv.c */
+int64_t stkv_batch_begin(void);
+int64_t stkv_batch_put(int64_t key_ptr, int64_t key_len, int64_t val_ptr, int64_t val_len);
+int64_t stkv_batch_delete(int64_t key_ptr, int64_t key_len);
+int64_t stkv_batch_put_many(void* entries);
+int64_t stkv_batch_delete_many(void* keys);
+int64_t stkv_batch_commit(void);
+void stkv_batch_abort(void);
+int64_t stkv_batch_pending(void);
+
+/* Trim a damaged batch log after an upgrade (canister_post_upgrade) */
+int64_t stkv_recover(void);
+
+/* Extent runs for other stable structures (ic_stable_structs.c): the
+ * run's offset (its first 16 bytes are a header), or 0 */
+uint64_t stkv_extent_alloc(uint64_t extents, uint64_t owner);
+void stkv_extent_free(uint64_t off);
+
+/* One bounded compaction slice; 1 while the sweep is unfinished */
+int64_t stkv_compact(int64_t budget);
+
+/* Space statistics (see ic_stkv.c) */
+int64_t stkv_stat(int32_t which);
+
+/* Heap index memory cap in bytes (0: off, negative: default) */
+void stkv_index_limit(int64_t bytes);
+
+/* Lookup benchmark (canister only), see ic_stkv.c */
+uint64_t ic_bench_stkv(int32_t op, int32_t n);
+
+#endif /* IC_STKV_H */
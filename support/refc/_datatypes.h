@@ -26,6 +26,11 @@
 #define POINTER_TAG 22
 #define GC_POINTER_TAG 23
 #define BUFFER_TAG 24
+#define BITS128_TAG 25
+#define BITS256_TAG 26
+#define INT_ARRAY_TAG 27
+#define DOUBLE_ARRAY_TAG 28
+#define BYTE_ARRAY_TAG 29
 
 #define MUTEX_TAG 30
 #define CONDITION_TAG 31
@@ -97,8 +102,12 @@ actually an Int. But places like newReference/removeReference require this flag.
 #define idris2_vp_to_Int64(p) (((Value_Int64 *)(p))->i64)
 #define idris2_vp_to_Int16(p) ((int16_t)((uintptr_t)(p) >> idris2_vp_int_shift))
 #define idris2_vp_to_Int8(p) ((int8_t)((uintptr_t)(p) >> idris2_vp_int_shift))
+// Chars hold Unicode code points. Ones that do not fit beside the pointer tag
+// (above U+FFFF on 32-bit targets) are boxed, see idris2_mkChar.
 #define idris2_vp_to_Char(p)                                                   \
-  ((unsigned char)((uintptr_t)(p) >> idris2_vp_int_shift))
+  (idris2_vp_is_unboxed(p)                                                     \
+       ? (uint32_t)((uintptr_t)(p) >> idris2_vp_int_shift)                     \
+       : ((Value_Bits32 *)(p))->ui32)
 #define idris2_vp_to_Double(p) (((Value_Double *)(p))->d)
 #define idris2_vp_to_Bool(p) (idris2_vp_to_Int8(p))
 
@@ -122,11 +131,39 @@ typedef struct {
   int64_t i64;
 } Value_Int64;
 
+// Fixed-width 128/256-bit naturals (wideInts.c): little-endian 32-bit
+// digits held inline, so they never touch the bignum allocator.
+#define IDRIS2_BITS128_DIGITS 4
+#define IDRIS2_BITS256_DIGITS 8
+
+typedef struct {
+  Value_header header;
+  uint32_t d[IDRIS2_BITS128_DIGITS];
+} Value_Bits128;
+
+typedef struct {
+  Value_header header;
+  uint32_t d[IDRIS2_BITS256_DIGITS];
+} Value_Bits256;
+
+#define IDRIS2_INT_SMALL_LIMBS (sizeof(int64_t) / sizeof(mp_limb_t))
+
 typedef struct {
   Value_header header;
   mpz_t i;
+  // Values that fit in an int64_t are "small" (IDRIS2_INT_SMALL set in
+  // header.reserved): `small` holds the value and `i` is a read-only mpz view
+  // of `limbs` (_mp_alloc == 0), so no limb array is allocated and code that
+  // only reads `i` keeps working. Never write to `i` of a small Integer.
+  int64_t small;
+  mp_limb_t limbs[IDRIS2_INT_SMALL_LIMBS];
 } Value_Integer;
 
+// Value_Integer header.reserved flags
+#define IDRIS2_INT_SMALL 0x01
+#define idris2_isSmallInteger(v)                                               \
+  ((((Value *)(v))->header.reserved & IDRIS2_INT_SMALL) != 0)
+
 typedef struct {
   Value_header header;
   double d;
@@ -135,8 +172,21 @@ typedef struct {
 typedef struct {
   Value_header header;
   char *str;
+  // UTF-8 metadata, filled in lazily by stringOps.c. The fields below are
+  // valid only while `header.reserved` has IDRIS2_STR_META set, and are never
+  // cached on immortal (possibly read-only) strings.
+  uint32_t byteLen;
+  uint32_t charLen;
+  // Byte offset of every IDRIS2_STR_INDEX_STRIDE-th code point, built on the
+  // first random access into a long non-ASCII string. NULL otherwise.
+  uint32_t *index;
 } Value_String;
 
+// Value_String header.reserved flags
+#define IDRIS2_STR_META 0x01
+#define IDRIS2_STR_ASCII 0x02
+#define IDRIS2_STR_INDEX_STRIDE 32
+
 typedef struct {
   Value_header header;
   int32_t total;
@@ -170,12 +220,35 @@ typedef struct {
   Value_Closure *onCollectFct;
 } Value_GCPointer;
 
-typedef struct {
+typedef struct Value_Array {
   Value_header header;
   int capacity;
   Value **arr;
+  // Logical length; slots [length, capacity) are NULL. See arrays.h.
+  int length;
+  // Slice views borrow `arr` from `base` and hold a reference to it.
+  struct Value_Array *base;
 } Value_Array;
 
+// Unboxed arrays: elements stored inline, contiguous. See unboxedArrays.h.
+typedef struct {
+  Value_header header;
+  int32_t length;
+  int64_t data[];
+} Value_IntArray;
+
+typedef struct {
+  Value_header header;
+  int32_t length;
+  double data[];
+} Value_DoubleArray;
+
+typedef struct {
+  Value_header header;
+  int32_t length;
+  uint8_t data[];
+} Value_ByteArray;
+
 typedef struct {
   Value_header header;
   Buffer *buffer;
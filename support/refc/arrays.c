@@ -0,0 +1,172 @@
+#include "arrays.h"
+#include "refc_util.h"
+
+#define ARRAY_MIN_CAPACITY 8
+
+static Value_Array *newArray(int capacity) {
+  // slots past the length are never read, so they are left unset
+  Value_Array *a = idris2_makeArrayUninit(capacity);
+  a->length = 0;
+  return a;
+}
+
+static int ownedUniquely(Value_Array *a) {
+  return idris2_isUnique(a) && (!a->base || idris2_isUnique(a->base));
+}
+
+static int64_t clampIndex(int64_t i, int64_t length) {
+  return i < 0 ? 0 : i > length ? length : i;
+}
+
+static Value_Array *cloneWithCapacity(Value_Array *a, int capacity) {
+  Value_Array *c = newArray(capacity);
+  for (int i = 0; i < a->length; i++)
+    c->arr[i] = idris2_newReference(a->arr[i]);
+  c->length = a->length;
+  return c;
+}
+
+// The array to update: `a` itself when it may be changed in place, else a copy
+static Value_Array *writable(Value_Array *a) {
+  if (ownedUniquely(a))
+    return (Value_Array *)idris2_newReference((Value *)a);
+  return cloneWithCapacity(a, a->length);
+}
+
+static void grow(Value_Array *a, int needed) {
+  int capacity = a->capacity < ARRAY_MIN_CAPACITY / 2 ? ARRAY_MIN_CAPACITY
+                                                      : a->capacity * 2;
+  if (capacity < needed)
+    capacity = needed;
+  Value **arr = (Value **)realloc(a->arr, sizeof(Value *) * capacity);
+  IDRIS2_REFC_VERIFY(arr, "realloc failed");
+  a->arr = arr;
+  a->capacity = capacity;
+}
+
+// Replaces dst[0, len) with new references to src[0, len). The references are
+// taken before any old element is dropped, so overlapping ranges are fine.
+static void assignRange(Value **dst, Value **src, int len) {
+  if (len <= 0)
+    return;
+  Value **tmp = (Value **)malloc(sizeof(Value *) * len);
+  IDRIS2_REFC_VERIFY(tmp, "malloc failed");
+  for (int i = 0; i < len; i++)
+    tmp[i] = idris2_newReference(src[i]);
+  for (int i = 0; i < len; i++) {
+    idris2_removeReference(dst[i]);
+    dst[i] = tmp[i];
+  }
+  free(tmp);
+}
+
+static void fillRange(Value **dst, int len, Value *v) {
+  for (int i = 0; i < len; i++) {
+    idris2_removeReference(dst[i]);
+    dst[i] = idris2_newReference(v);
+  }
+}
+
+Value *idris2_arrayEmpty(int64_t capacity) {
+  return (Value *)newArray(capacity > 0 ? (int)capacity : 0);
+}
+
+int64_t idris2_arrayLength(Value *a) { return ((Value_Array *)a)->length; }
+
+Value *idris2_arrayIndex(Value *a, int64_t i) {
+  Value_Array *arr = (Value_Array *)a;
+  if (i < 0 || i >= arr->length)
+    return NULL;
+  return idris2_newReference(arr->arr[i]);
+}
+
+Value *idris2_arrayClone(Value *a) {
+  Value_Array *arr = (Value_Array *)a;
+  return (Value *)cloneWithCapacity(arr, arr->length);
+}
+
+Value *idris2_arraySlice(Value *a, int64_t off, int64_t len) {
+  Value_Array *arr = (Value_Array *)a;
+  off = clampIndex(off, arr->length);
+  len = clampIndex(len, arr->length - off);
+
+  Value_Array *s = IDRIS2_NEW_VALUE(Value_Array);
+  s->header.tag = ARRAY_TAG;
+  // slices of slices share the root storage directly
+  s->base = arr->base ? arr->base : arr;
+  idris2_newReference((Value *)s->base);
+  s->arr = arr->arr + off;
+  s->length = s->capacity = (int)len;
+  return (Value *)s;
+}
+
+Value *idris2_arraySet(Value *a, int64_t i, Value *v) {
+  Value_Array *arr = (Value_Array *)a;
+  if (i < 0 || i >= arr->length)
+    return idris2_newReference(a);
+  Value_Array *r = writable(arr);
+  idris2_removeReference(r->arr[i]);
+  r->arr[i] = idris2_newReference(v);
+  return (Value *)r;
+}
+
+Value *idris2_arrayPush(Value *a, Value *v) {
+  Value_Array *arr = (Value_Array *)a;
+  Value_Array *r;
+  if (ownedUniquely(arr) && !arr->base) {
+    r = (Value_Array *)idris2_newReference(a);
+    if (r->length == r->capacity)
+      grow(r, r->length + 1);
+  } else {
+    // a shared array or a slice: copy once, leaving room to push again
+    int capacity = arr->length * 2;
+    r = cloneWithCapacity(arr, capacity < ARRAY_MIN_CAPACITY ? ARRAY_MIN_CAPACITY
+                                                             : capacity);
+  }
+  r->arr[r->length++] = idris2_newReference(v);
+  return (Value *)r;
+}
+
+Value *idris2_arrayFill(Value *a, int64_t off, int64_t len, Value *v) {
+  Value_Array *arr = (Value_Array *)a;
+  off = clampIndex(off, arr->length);
+  len = clampIndex(len, arr->length - off);
+  if (len == 0)
+    return idris2_newReference(a);
+  Value_Array *r = writable(arr);
+  fillRange(r->arr + off, (int)len, v);
+  return (Value *)r;
+}
+
+Value *idris2_arrayCopy(Value *src, int64_t srcOff, Value *dst, int64_t dstOff,
+                        int64_t len) {
+  Value_Array *s = (Value_Array *)src;
+  Value_Array *d = (Value_Array *)dst;
+  srcOff = clampIndex(srcOff, s->length);
+  dstOff = clampIndex(dstOff, d->length);
+  len = clampIndex(len, s->length - srcOff);
+  len = clampIndex(len, d->length - dstOff);
+  if (len == 0)
+    return idris2_newReference(dst);
+  Value_Array *r = writable(d);
+  assignRange(r->arr + dstOff, s->arr + srcOff, (int)len);
+  return (Value *)r;
+}
+
+void idris2_arrayFillIO(Value *a, int64_t off, int64_t len, Value *v) {
+  Value_Array *arr = (Value_Array *)a;
+  off = clampIndex(off, arr->length);
+  len = clampIndex(len, arr->length - off);
+  fillRange(arr->arr + off, (int)len, v);
+}
+
+void idris2_arrayCopyIO(Value *src, int64_t srcOff, Value *dst, int64_t dstOff,
+                        int64_t len) {
+  Value_Array *s = (Value_Array *)src;
+  Value_Array *d = (Value_Array *)dst;
+  srcOff = clampIndex(srcOff, s->length);
+  dstOff = clampIndex(dstOff, d->length);
+  len = clampIndex(len, s->length - srcOff);
+  len = clampIndex(len, d->length - dstOff);
+  assignRange(d->arr + dstOff, s->arr + srcOff, (int)len);
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "cBackend.h"
+
+/*
+ * Growable arrays and slice views over Value_Array.
+ *
+ * The functional operations (set/push/fill/copy) borrow their arguments and
+ * return the updated array. When the array is uniquely referenced (and, for a
+ * slice, so is its base) the update happens in place and the same object is
+ * returned; otherwise a copy is updated, so a shared array is never observed
+ * changing. The Idris side (WasmBuilder.Runtime.Array) keeps the updated array
+ * linear, which is what makes the in-place path the common one.
+ *
+ * A slice shares the storage of its base and holds a reference to it. The
+ * base therefore stops being unique, and pushes or updates on it copy instead
+ * of moving the storage out from under the slice.
+ *
+ * Indices and ranges are clamped to the logical length; callers check bounds.
+ */
+
+Value *idris2_arrayEmpty(int64_t capacity);
+int64_t idris2_arrayLength(Value *a);
+// New reference to element `i`, NULL when out of range
+Value *idris2_arrayIndex(Value *a, int64_t i);
+// Fresh unshared copy with the same elements
+Value *idris2_arrayClone(Value *a);
+Value *idris2_arraySlice(Value *a, int64_t off, int64_t len);
+
+Value *idris2_arraySet(Value *a, int64_t i, Value *v);
+// Amortized O(1) when unique: capacity doubles on growth
+Value *idris2_arrayPush(Value *a, Value *v);
+Value *idris2_arrayFill(Value *a, int64_t off, int64_t len, Value *v);
+// Copies src[srcOff, srcOff+len) over dst[dstOff, ...); ranges may overlap
+Value *idris2_arrayCopy(Value *src, int64_t srcOff, Value *dst, int64_t dstOff,
+                        int64_t len);
+
+// IOArray (ArrayData) versions: always in place, shared or not
+void idris2_arrayFillIO(Value *a, int64_t off, int64_t len, Value *v);
+void idris2_arrayCopyIO(Value *src, int64_t srcOff, Value *dst, int64_t dstOff,
+                        int64_t len);
@@ -1,22 +1,127 @@
 #include "buffer.h"
 #include "refc_util.h"
+#include "simdOps.h"
 #include <string.h>
 #include <sys/stat.h>
 
-void *newBuffer(int bytes) {
-  size_t size = sizeof(Buffer) + bytes * sizeof(uint8_t);
+#define BUFFER_MIN_CAPACITY 64
+
+#define INLINE_DATA(b) ((char *)((Buffer *)(b) + 1))
+
+void *newBufferWithCapacity(int capacity) {
+  if (capacity < 0)
+    capacity = 0;
+  Buffer *buf = malloc(sizeof(Buffer) + capacity * sizeof(uint8_t));
+  if (buf == NULL) {
+    return NULL;
+  }
+
+  buf->size = 0;
+  buf->capacity = capacity;
+  buf->flags = 0;
+  buf->data = INLINE_DATA(buf);
+  return (void *)buf;
+}
+
+void *newGrowableBuffer(int capacity) {
+  Buffer *buf = newBufferWithCapacity(capacity);
+  IDRIS2_REFC_VERIFY(buf, "malloc failed");
+  return buf;
+}
+
+void *newBufferView(void *data, int size) {
+  Buffer *buf = malloc(sizeof(Buffer));
+  if (buf == NULL) {
+    return NULL;
+  }
+
+  buf->size = size;
+  buf->capacity = size;
+  buf->flags = IDRIS2_BUFFER_EXTERNAL;
+  buf->data = data;
+  return (void *)buf;
+}
+
+// Storage that is neither inline nor external belongs to the buffer
+static int ownsBlock(Buffer *b) {
+  return b->data != INLINE_DATA(b) && !(b->flags & IDRIS2_BUFFER_EXTERNAL);
+}
 
-  Buffer *buf = malloc(size);
+void *newBufferUninit(int bytes) {
+  Buffer *buf = newBufferWithCapacity(bytes);
   if (buf == NULL) {
     return NULL;
   }
 
-  buf->size = bytes;
-  memset(buf->data, 0, bytes);
+  buf->size = bytes < 0 ? 0 : bytes;
+  return (void *)buf;
+}
 
+void *newBuffer(int bytes) {
+  Buffer *buf = newBufferUninit(bytes);
+  if (buf == NULL) {
+    return NULL;
+  }
+
+  idris2_simd_fill(buf->data, 0, buf->size);
   return (void *)buf;
 }
 
+void freeBuffer(void *buffer) {
+  Buffer *b = buffer;
+  if (ownsBlock(b))
+    free(b->data);
+  free(b);
+}
+
+int getBufferCapacity(void *buffer) { return ((Buffer *)buffer)->capacity; }
+
+void reserveBuffer(void *buffer, int extra) {
+  Buffer *b = buffer;
+  IDRIS2_REFC_VERIFY(extra >= 0 && (int64_t)b->size + extra <= INT32_MAX,
+                     "bad buffer reservation (%d + %d)", b->size, extra);
+  int needed = b->size + extra;
+  if (needed <= b->capacity)
+    return;
+
+  int64_t capacity = b->capacity < BUFFER_MIN_CAPACITY / 2
+                         ? BUFFER_MIN_CAPACITY
+                         : (int64_t)b->capacity * 2;
+  if (capacity < needed)
+    capacity = needed;
+  if (capacity > INT32_MAX)
+    capacity = INT32_MAX;
+
+  char *data;
+  if (!ownsBlock(b)) {
+    data = malloc(capacity);
+    IDRIS2_REFC_VERIFY(data, "malloc failed");
+    idris2_simd_copy(data, b->data, b->size);
+    b->flags &= ~IDRIS2_BUFFER_EXTERNAL;
+  } else {
+    // realloc can often extend the block in place, with no copy
+    data = realloc(b->data, capacity);
+    IDRIS2_REFC_VERIFY(data, "realloc failed");
+  }
+  b->data = data;
+  b->capacity = (int)capacity;
+}
+
+void growBuffer(void *buffer, int size) {
+  Buffer *b = buffer;
+  if (size <= b->size)
+    return;
+  reserveBuffer(b, size - b->size);
+  idris2_simd_fill(b->data + b->size, 0, size - b->size);
+  b->size = size;
+}
+
+void truncateBuffer(void *buffer, int size) {
+  Buffer *b = buffer;
+  if (size >= 0 && size < b->size)
+    b->size = size;
+}
+
 static void assert_valid_range(Buffer *buf, int64_t offset, int64_t len) {
   IDRIS2_REFC_VERIFY(offset >= 0, "offset (%lld) < 0", (long long)offset);
   IDRIS2_REFC_VERIFY(len >= 0, "len (%lld) < 0", (long long)offset);
@@ -25,6 +130,11 @@ static void assert_valid_range(Buffer *buf, int64_t offset, int64_t len) {
                      (long long)offset, (long long)len, (long long)buf->size);
 }
 
+// Out-of-line failure path of idris2_checkBufferRange; does not return.
+void idris2_bufferRangeError(void *buffer, int64_t loc, int64_t len) {
+  assert_valid_range((Buffer *)buffer, loc, len);
+}
+
 void copyBuffer(void *from, int from_offset, int len, void *to, int to_offset) {
   Buffer *bfrom = from;
   Buffer *bto = to;
@@ -32,13 +142,27 @@ void copyBuffer(void *from, int from_offset, int len, void *to, int to_offset) {
   assert_valid_range(bfrom, from_offset, len);
   assert_valid_range(bto, to_offset, len);
 
-  memcpy(bto->data + to_offset, bfrom->data + from_offset, len);
+  idris2_simd_copy(bto->data + to_offset, bfrom->data + from_offset, len);
 }
 
 int getBufferSize(void *buffer) { return ((Buffer *)buffer)->size; }
 
 void setBufferUIntLE(void *b, int loc, uint64_t val, size_t len) {
   assert_valid_range((Buffer *)b, loc, len);
+  switch (len) {
+  case 1:
+    idris2_setBufferLE8(b, loc, (uint8_t)val);
+    return;
+  case 2:
+    idris2_setBufferLE16(b, loc, (uint16_t)val);
+    return;
+  case 4:
+    idris2_setBufferLE32(b, loc, (uint32_t)val);
+    return;
+  case 8:
+    idris2_setBufferLE64(b, loc, val);
+    return;
+  }
   while (len--) {
     ((Buffer *)b)->data[loc++] = (uint8_t)val;
     val >>= 8;
@@ -47,6 +171,16 @@ void setBufferUIntLE(void *b, int loc, uint64_t val, size_t len) {
 
 uint64_t getBufferUIntLE(void *b, int loc, size_t len) {
   assert_valid_range((Buffer *)b, loc, len);
+  switch (len) {
+  case 1:
+    return idris2_getBufferLE8(b, loc);
+  case 2:
+    return idris2_getBufferLE16(b, loc);
+  case 4:
+    return idris2_getBufferLE32(b, loc);
+  case 8:
+    return idris2_getBufferLE64(b, loc);
+  }
   uint64_t r = 0;
   loc += len;
   while (len--) {
@@ -57,28 +191,23 @@ uint64_t getBufferUIntLE(void *b, int loc, size_t len) {
 }
 
 void setBufferDouble(void *buffer, int loc, double val) {
-  union {
-    double d;
-    uint64_t i;
-  } tmp;
-  tmp.d = val;
-  setBufferUIntLE(buffer, loc, tmp.i, 8);
+  uint64_t i;
+  memcpy(&i, &val, sizeof i);
+  idris2_setBufferLE64(buffer, loc, i);
 }
 
 void setBufferString(void *buffer, int loc, char *str) {
   Buffer *b = buffer;
   size_t len = strlen(str);
   assert_valid_range(b, loc, len);
-  memcpy((b->data) + loc, str, len);
+  idris2_simd_copy((b->data) + loc, str, len);
 }
 
 double getBufferDouble(void *buffer, int loc) {
-  union {
-    double d;
-    uint64_t i;
-  } tmp;
-  tmp.i = getBufferUIntLE(buffer, loc, 8);
-  return tmp.d;
+  uint64_t i = idris2_getBufferLE64(buffer, loc);
+  double d;
+  memcpy(&d, &i, sizeof d);
+  return d;
 }
 
 char *getBufferString(void *buffer, int loc, int len) {
@@ -90,3 +219,50 @@ char *getBufferString(void *buffer, int loc, int len) {
   rs[len] = '\0';
   return rs;
 }
+
+void fillBuffer(void *buffer, int loc, int len, uint8_t byte) {
+  Buffer *b = buffer;
+  assert_valid_range(b, loc, len);
+  idris2_simd_fill(b->data + loc, byte, len);
+}
+
+int compareBuffer(void *a, int aLoc, void *b, int bLoc, int len) {
+  assert_valid_range((Buffer *)a, aLoc, len);
+  assert_valid_range((Buffer *)b, bLoc, len);
+  int r = memcmp(((Buffer *)a)->data + aLoc, ((Buffer *)b)->data + bLoc, len);
+  return (r > 0) - (r < 0);
+}
+
+void *sliceBuffer(void *buffer, int loc, int len) {
+  Buffer *b = buffer;
+  assert_valid_range(b, loc, len);
+  Buffer *r = newBufferWithCapacity(len);
+  IDRIS2_REFC_VERIFY(r, "malloc failed");
+  r->size = len;
+  idris2_simd_copy(r->data, b->data + loc, len);
+  return r;
+}
+
+void appendBufferUIntLE(void *buffer, uint64_t val, int len) {
+  Buffer *b = buffer;
+  reserveBuffer(b, len);
+  b->size += len;
+  setBufferUIntLE(b, b->size - len, val, len);
+}
+
+void appendBuffer(void *buffer, void *from, int loc, int len) {
+  Buffer *b = buffer;
+  assert_valid_range((Buffer *)from, loc, len);
+  reserveBuffer(b, len);
+  // `from` may be `buffer` itself; read it only after the reallocation
+  idris2_simd_copy(b->data + b->size, ((Buffer *)from)->data + loc, len);
+  b->size += len;
+}
+
+void appendBufferString(void *buffer, char *str) {
+  Buffer *b = buffer;
+  int len = strlen(str);
+  reserveBuffer(b, len);
+  idris2_simd_copy(b->data + b->size, str, len);
+  b->size += len;
+}
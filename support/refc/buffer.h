@@ -3,49 +3,123 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
+/* `size` bytes are in use out of `capacity` allocated at `data`. The storage
+ * starts out inline after the struct; growing past it moves it to a separate
+ * block (realloc'd from then on), so the Buffer pointer held by a
+ * Value_Buffer never changes.
+ *
+ * An external buffer is a non-owning view of memory it did not allocate
+ * (message data, bridge buffers): freeing it leaves the memory alone, and
+ * growing it first copies the bytes into storage of its own. */
 typedef struct {
   int size;
-  char data[];
+  int capacity;
+  int flags;
+  char *data;
 } Buffer;
 
+#define IDRIS2_BUFFER_EXTERNAL 0x01
+
 void *newBuffer(int bytes);
+// `bytes` bytes of unspecified content, for callers that overwrite them all
+void *newBufferUninit(int bytes);
+// Empty buffer with room for `capacity` bytes; the storage is not cleared
+void *newBufferWithCapacity(int capacity);
+// As newBufferWithCapacity, but stops the program when malloc fails rather
+// than returning NULL (for Idris code, which cannot check)
+void *newGrowableBuffer(int capacity);
+// View of `size` bytes at `data`; the memory must outlive the buffer
+void *newBufferView(void *data, int size);
+void freeBuffer(void *buffer);
 
 int getBufferSize(void *buffer);
+int getBufferCapacity(void *buffer);
+// Capacity for at least `extra` more bytes, doubling as needed
+void reserveBuffer(void *buffer, int extra);
+// Resize to `size` bytes; bytes past the old size read as 0
+void growBuffer(void *buffer, int size);
+// Shrink to `size` bytes, keeping the capacity
+void truncateBuffer(void *buffer, int size);
 
 void setBufferUIntLE(void *buffer, int loc, uint64_t val, size_t len);
+
+/* Fixed-width accessors: one range check, then a single (possibly unaligned)
+ * little-endian word load or store. Wasm is little-endian, so the byte swap
+ * only exists on big-endian hosts. */
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define IDRIS2_LE8(x) (x)
+#define IDRIS2_LE16(x) __builtin_bswap16(x)
+#define IDRIS2_LE32(x) __builtin_bswap32(x)
+#define IDRIS2_LE64(x) __builtin_bswap64(x)
+#else
+#define IDRIS2_LE8(x) (x)
+#define IDRIS2_LE16(x) (x)
+#define IDRIS2_LE32(x) (x)
+#define IDRIS2_LE64(x) (x)
+#endif
+
+void idris2_bufferRangeError(void *buffer, int64_t loc, int64_t len);
+
+static inline void idris2_checkBufferRange(void *buffer, int64_t loc,
+                                           int64_t len) {
+  if (loc < 0 || len < 0 || loc + len > ((Buffer *)buffer)->size)
+    idris2_bufferRangeError(buffer, loc, len);
+}
+
+#define IDRIS2_BUFFER_WORD(bits)                                               \
+  static inline void idris2_setBufferLE##bits(void *buffer, int loc,           \
+                                              uint##bits##_t val) {            \
+    idris2_checkBufferRange(buffer, loc, bits / 8);                            \
+    val = IDRIS2_LE##bits(val);                                                \
+    memcpy(((Buffer *)buffer)->data + loc, &val, bits / 8);                    \
+  }                                                                            \
+  static inline uint##bits##_t idris2_getBufferLE##bits(void *buffer,          \
+                                                        int loc) {             \
+    uint##bits##_t val;                                                        \
+    idris2_checkBufferRange(buffer, loc, bits / 8);                            \
+    memcpy(&val, ((Buffer *)buffer)->data + loc, bits / 8);                    \
+    return IDRIS2_LE##bits(val);                                               \
+  }
+
+IDRIS2_BUFFER_WORD(8)
+IDRIS2_BUFFER_WORD(16)
+IDRIS2_BUFFER_WORD(32)
+IDRIS2_BUFFER_WORD(64)
+
 #define setBufferUInt8(b, l, v)                                                \
   do {                                                                         \
-    setBufferUIntLE(b, l, (uint64_t)v, 1);                                     \
+    idris2_setBufferLE8(b, l, (uint8_t)(v));                                   \
   } while (0)
 #define setBufferUInt16LE(b, l, v)                                             \
   do {                                                                         \
-    setBufferUIntLE(b, l, (uint64_t)v, 2);                                     \
+    idris2_setBufferLE16(b, l, (uint16_t)(v));                                 \
   } while (0)
 #define setBufferUInt32LE(b, l, v)                                             \
   do {                                                                         \
-    setBufferUIntLE(b, l, (uint64_t)v, 4);                                     \
+    idris2_setBufferLE32(b, l, (uint32_t)(v));                                 \
   } while (0)
 #define setBufferUInt64LE(b, l, v)                                             \
   do {                                                                         \
-    setBufferUIntLE(b, l, (uint64_t)v, 8);                                     \
+    idris2_setBufferLE64(b, l, (uint64_t)(v));                                 \
   } while (0)
 
 #define setBufferByte(b, l, v)                                                 \
   do {                                                                         \
-    setBufferUIntLE(b, l, (uint64_t)v, 1);                                     \
+    idris2_setBufferLE8(b, l, (uint8_t)(v));                                   \
   } while (0)
 #define setBufferInt16LE(b, l, v)                                              \
   do {                                                                         \
-    setBufferUIntLE(b, l, (uint64_t)v, 2);                                     \
+    idris2_setBufferLE16(b, l, (uint16_t)(v));                                 \
   } while (0)
 #define setBufferInt32LE(b, l, v)                                              \
   do {                                                                         \
-    setBufferUIntLE(b, l, (uint64_t)v, 4);                                     \
+    idris2_setBufferLE32(b, l, (uint32_t)(v));                                 \
   } while (0)
 #define setBufferInt64LE(b, l, v)                                              \
   do {                                                                         \
-    setBufferUIntLE(b, l, (uint64_t)v, 8);                                     \
+    idris2_setBufferLE64(b, l, (uint64_t)(v));                                 \
   } while (0)
 
 void setBufferDouble(void *buffer, int loc, double val);
@@ -54,14 +128,27 @@ void setBufferString(void *buffer, int loc, char *str);
 void copyBuffer(void *from, int start, int len, void *to, int loc);
 
 uint64_t getBufferUIntLE(void *buffer, int loc, size_t len);
-#define getBufferUInt8(b, l) ((uint8_t)getBufferUIntLE(b, l, 1))
-#define getBufferUInt16LE(b, l) ((uint16_t)getBufferUIntLE(b, l, 2))
-#define getBufferUInt32LE(b, l) ((uint32_t)getBufferUIntLE(b, l, 4))
-#define getBufferUInt64LE(b, l) ((uint64_t)getBufferUIntLE(b, l, 8))
-
-#define getBufferByte(b, l) ((int64_t)getBufferUIntLE(b, l, 1))
-#define getBufferInt16LE(b, l) ((int64_t)getBufferUIntLE(b, l, 2))
-#define getBufferInt32LE(b, l) ((int64_t)getBufferUIntLE(b, l, 4))
-#define getBufferInt64LE(b, l) ((int64_t)getBufferUIntLE(b, l, 8))
+#define getBufferUInt8(b, l) (idris2_getBufferLE8(b, l))
+#define getBufferUInt16LE(b, l) (idris2_getBufferLE16(b, l))
+#define getBufferUInt32LE(b, l) (idris2_getBufferLE32(b, l))
+#define getBufferUInt64LE(b, l) (idris2_getBufferLE64(b, l))
+
+#define getBufferByte(b, l) ((int64_t)idris2_getBufferLE8(b, l))
+#define getBufferInt16LE(b, l) ((int64_t)idris2_getBufferLE16(b, l))
+#define getBufferInt32LE(b, l) ((int64_t)idris2_getBufferLE32(b, l))
+#define getBufferInt64LE(b, l) ((int64_t)idris2_getBufferLE64(b, l))
 double getBufferDouble(void *buffer, int loc);
 char *getBufferString(void *buffer, int loc, int len);
+
+// Bulk operations. copyBuffer above is the blit.
+void fillBuffer(void *buffer, int loc, int len, uint8_t byte);
+// memcmp order of the two ranges: -1, 0 or 1
+int compareBuffer(void *a, int aLoc, void *b, int bLoc, int len);
+// New buffer holding a copy of [loc, loc+len)
+void *sliceBuffer(void *buffer, int loc, int len);
+
+// Appends grow the size (and capacity, geometrically) and write the new bytes
+// directly, without clearing them first.
+void appendBufferUIntLE(void *buffer, uint64_t val, int len);
+void appendBuffer(void *buffer, void *from, int loc, int len);
+void appendBufferString(void *buffer, char *str);
@@ -6,6 +6,7 @@
 #include <string.h>
 
 #include "_datatypes.h"
+#include "arrays.h"
 #include "buffer.h"
 #include "casts.h"
 #include "clock.h"
@@ -13,5 +14,8 @@
 #include "memoryManagement.h"
 #include "prim.h"
 #include "runtime.h"
+#include "simdOps.h"
 #include "stringOps.h"
 #include "threads.h"
+#include "unboxedArrays.h"
+#include "wideInts.h"
@@ -1,232 +1,672 @@
 #include "casts.h"
 
 #include <inttypes.h>
+#include <limits.h>
+#include <math.h>
+
+/* Number formatting
+ *
+ * Integers are written two digits at a time straight into the string
+ * buffer. Doubles use Grisu2 (Loitsch, "Printing Floating-Point Numbers
+ * Quickly and Accurately with Integers"): the output always round-trips
+ * and is the shortest representation for the vast majority of inputs.
+ * Neither path goes through printf. */
+
+static const char idris2_digitPairs[201] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536"
+    "37383940414243444546474849505152535455565758596061626364656667686970717273"
+    "74757677787980818283848586878889909192939495969798"
+    "99";
+
+static int countDigits(uint64_t v) {
+  int n = 1;
+  for (;;) {
+    if (v < 10)
+      return n;
+    if (v < 100)
+      return n + 1;
+    if (v < 1000)
+      return n + 2;
+    if (v < 10000)
+      return n + 3;
+    v /= 10000;
+    n += 4;
+  }
+}
+
+// Writes the `n` digits of `v` ending just before `end`.
+static void writeDigits(char *end, uint64_t v) {
+  while (v >= 100) {
+    unsigned pair = (unsigned)(v % 100) * 2;
+    v /= 100;
+    *--end = idris2_digitPairs[pair + 1];
+    *--end = idris2_digitPairs[pair];
+  }
+  if (v >= 10) {
+    *--end = idris2_digitPairs[v * 2 + 1];
+    *--end = idris2_digitPairs[v * 2];
+  } else {
+    *--end = (char)('0' + v);
+  }
+}
+
+size_t idris2_formatUInt64(char *buf, uint64_t v) {
+  int n = countDigits(v);
+  writeDigits(buf + n, v);
+  buf[n] = '\0';
+  return n;
+}
+
+size_t idris2_formatInt64(char *buf, int64_t v) {
+  if (v >= 0)
+    return idris2_formatUInt64(buf, (uint64_t)v);
+  buf[0] = '-';
+  return 1 + idris2_formatUInt64(buf + 1, 0 - (uint64_t)v);
+}
+
+static Value *mkUIntString(uint64_t v) {
+  int n = countDigits(v);
+  Value_String *retVal = idris2_mkEmptyStringUninit(n + 1);
+  writeDigits(retVal->str + n, v);
+  return (Value *)retVal;
+}
 
-/*  conversions from Int8  */
-Value *idris2_cast_Int8_to_Integer(Value *input) {
-  Value_Integer *retVal = idris2_mkInteger();
-  mpz_set_si(retVal->i, idris2_vp_to_Int8(input));
-
+static Value *mkIntString(int64_t v) {
+  if (v >= 0)
+    return mkUIntString((uint64_t)v);
+  uint64_t m = 0 - (uint64_t)v;
+  int n = countDigits(m);
+  Value_String *retVal = idris2_mkEmptyStringUninit(n + 2);
+  retVal->str[0] = '-';
+  writeDigits(retVal->str + 1 + n, m);
   return (Value *)retVal;
 }
 
-Value *idris2_cast_Int8_to_string(Value *input) {
-  int8_t x = idris2_vp_to_Int8(input);
+/* Grisu2 */
+
+typedef struct {
+  uint64_t f;
+  int e;
+} DiyFp;
+
+#define DP_SIGNIFICAND_MASK 0x000FFFFFFFFFFFFFULL
+#define DP_HIDDEN_BIT 0x0010000000000000ULL
+
+static DiyFp diyMultiply(DiyFp x, DiyFp y) {
+  const uint64_t m32 = 0xFFFFFFFFu;
+  uint64_t a = x.f >> 32, b = x.f & m32, c = y.f >> 32, d = y.f & m32;
+  uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+  uint64_t tmp = (bd >> 32) + (ad & m32) + (bc & m32);
+  tmp += 1u << 31; // round
+  DiyFp r = {ac + (ad >> 32) + (bc >> 32) + (tmp >> 32), x.e + y.e + 64};
+  return r;
+}
+
+static DiyFp diyNormalize(DiyFp x) {
+  int s = __builtin_clzll(x.f);
+  DiyFp r = {x.f << s, x.e - s};
+  return r;
+}
+
+// 10^k for k = -348, -340, ..., 340, as normalized 64-bit significands
+static const uint64_t cachedPowersF[] = {
+    0xfa8fd5a0081c0288ULL, 0xbaaee17fa23ebf76ULL, 0x8b16fb203055ac76ULL,
+    0xcf42894a5dce35eaULL, 0x9a6bb0aa55653b2dULL, 0xe61acf033d1a45dfULL,
+    0xab70fe17c79ac6caULL, 0xff77b1fcbebcdc4fULL, 0xbe5691ef416bd60cULL,
+    0x8dd01fad907ffc3cULL, 0xd3515c2831559a83ULL, 0x9d71ac8fada6c9b5ULL,
+    0xea9c227723ee8bcbULL, 0xaecc49914078536dULL, 0x823c12795db6ce57ULL,
+    0xc21094364dfb5637ULL, 0x9096ea6f3848984fULL, 0xd77485cb25823ac7ULL,
+    0xa086cfcd97bf97f4ULL, 0xef340a98172aace5ULL, 0xb23867fb2a35b28eULL,
+    0x84c8d4dfd2c63f3bULL, 0xc5dd44271ad3cdbaULL, 0x936b9fcebb25c996ULL,
+    0xdbac6c247d62a584ULL, 0xa3ab66580d5fdaf6ULL, 0xf3e2f893dec3f126ULL,
+    0xb5b5ada8aaff80b8ULL, 0x87625f056c7c4a8bULL, 0xc9bcff6034c13053ULL,
+    0x964e858c91ba2655ULL, 0xdff9772470297ebdULL, 0xa6dfbd9fb8e5b88fULL,
+    0xf8a95fcf88747d94ULL, 0xb94470938fa89bcfULL, 0x8a08f0f8bf0f156bULL,
+    0xcdb02555653131b6ULL, 0x993fe2c6d07b7facULL, 0xe45c10c42a2b3b06ULL,
+    0xaa242499697392d3ULL, 0xfd87b5f28300ca0eULL, 0xbce5086492111aebULL,
+    0x8cbccc096f5088ccULL, 0xd1b71758e219652cULL, 0x9c40000000000000ULL,
+    0xe8d4a51000000000ULL, 0xad78ebc5ac620000ULL, 0x813f3978f8940984ULL,
+    0xc097ce7bc90715b3ULL, 0x8f7e32ce7bea5c70ULL, 0xd5d238a4abe98068ULL,
+    0x9f4f2726179a2245ULL, 0xed63a231d4c4fb27ULL, 0xb0de65388cc8ada8ULL,
+    0x83c7088e1aab65dbULL, 0xc45d1df942711d9aULL, 0x924d692ca61be758ULL,
+    0xda01ee641a708deaULL, 0xa26da3999aef774aULL, 0xf209787bb47d6b85ULL,
+    0xb454e4a179dd1877ULL, 0x865b86925b9bc5c2ULL, 0xc83553c5c8965d3dULL,
+    0x952ab45cfa97a0b3ULL, 0xde469fbd99a05fe3ULL, 0xa59bc234db398c25ULL,
+    0xf6c69a72a3989f5cULL, 0xb7dcbf5354e9beceULL, 0x88fcf317f22241e2ULL,
+    0xcc20ce9bd35c78a5ULL, 0x98165af37b2153dfULL, 0xe2a0b5dc971f303aULL,
+    0xa8d9d1535ce3b396ULL, 0xfb9b7cd9a4a7443cULL, 0xbb764c4ca7a44410ULL,
+    0x8bab8eefb6409c1aULL, 0xd01fef10a657842cULL, 0x9b10a4e5e9913129ULL,
+    0xe7109bfba19c0c9dULL, 0xac2820d9623bf429ULL, 0x80444b5e7aa7cf85ULL,
+    0xbf21e44003acdd2dULL, 0x8e679c2f5e44ff8fULL, 0xd433179d9c8cb841ULL,
+    0x9e19db92b4e31ba9ULL, 0xeb96bf6ebadf77d9ULL, 0xaf87023b9bf0ee6bULL,
+};
+static const int16_t cachedPowersE[] = {
+    -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980,
+    -954, -927, -901, -874, -847, -821, -794, -768, -741, -715,
+    -688, -661, -635, -608, -582, -555, -529, -502, -475, -449,
+    -422, -396, -369, -343, -316, -289, -263, -236, -210, -183,
+    -157, -130, -103, -77, -50, -24, 3, 30, 56, 83,
+    109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+    375, 402, 428, 455, 481, 508, 534, 561, 588, 614,
+    641, 667, 694, 720, 747, 774, 800, 827, 853, 880,
+    907, 933, 960, 986, 1013, 1039, 1066,
+};
+
+static DiyFp cachedPower(int e, int *k) {
+  double dk = (-61 - e) * 0.30102999566398114 + 347; // log10(2)
+  int kk = (int)dk;
+  if (kk != dk)
+    kk++;
+  int index = (kk >> 3) + 1;
+  *k = -(-348 + index * 8);
+  DiyFp r = {cachedPowersF[index], cachedPowersE[index]};
+  return r;
+}
+
+static const uint64_t pow10u64[20] = {1ULL,
+                                      10ULL,
+                                      100ULL,
+                                      1000ULL,
+                                      10000ULL,
+                                      100000ULL,
+                                      1000000ULL,
+                                      10000000ULL,
+                                      100000000ULL,
+                                      1000000000ULL,
+                                      10000000000ULL,
+                                      100000000000ULL,
+                                      1000000000000ULL,
+                                      10000000000000ULL,
+                                      100000000000000ULL,
+                                      1000000000000000ULL,
+                                      10000000000000000ULL,
+                                      100000000000000000ULL,
+                                      1000000000000000000ULL,
+                                      10000000000000000000ULL};
+
+static void grisuRound(char *buf, int len, uint64_t delta, uint64_t rest,
+                       uint64_t tenKappa, uint64_t wpw) {
+  while (rest < wpw && delta - rest >= tenKappa &&
+         (rest + tenKappa < wpw || wpw - rest > rest + tenKappa - wpw)) {
+    buf[len - 1]--;
+    rest += tenKappa;
+  }
+}
+
+static int digitGen(DiyFp w, DiyFp mp, uint64_t delta, char *buf, int *k) {
+  DiyFp one = {(uint64_t)1 << -mp.e, mp.e};
+  uint64_t wpw = mp.f - w.f;
+  uint32_t p1 = (uint32_t)(mp.f >> -one.e);
+  uint64_t p2 = mp.f & (one.f - 1);
+  int kappa = countDigits(p1);
+  int len = 0;
+
+  while (kappa > 0) {
+    uint32_t div = (uint32_t)pow10u64[kappa - 1];
+    uint32_t d = p1 / div;
+    p1 %= div;
+    if (d || len)
+      buf[len++] = (char)('0' + d);
+    kappa--;
+    uint64_t rest = ((uint64_t)p1 << -one.e) + p2;
+    if (rest <= delta) {
+      *k += kappa;
+      grisuRound(buf, len, delta, rest, pow10u64[kappa] << -one.e, wpw);
+      return len;
+    }
+  }
+
+  for (;;) {
+    p2 *= 10;
+    delta *= 10;
+    char d = (char)(p2 >> -one.e);
+    if (d || len)
+      buf[len++] = (char)('0' + d);
+    p2 &= one.f - 1;
+    kappa--;
+    if (p2 < delta) {
+      *k += kappa;
+      // kappa stays above -20: at most 17 significant digits are produced
+      grisuRound(buf, len, delta, p2, one.f,
+                 wpw * (-kappa < 20 ? pow10u64[-kappa] : 0));
+      return len;
+    }
+  }
+}
+
+// Shortest digits of a finite, positive `v`; value = digits * 10^k.
+static int grisu2(double v, char *digits, int *k) {
+  uint64_t bits;
+  memcpy(&bits, &v, sizeof bits);
+  int be = (int)((bits >> 52) & 0x7FF);
+  DiyFp w = {bits & DP_SIGNIFICAND_MASK, 0};
+  if (be) {
+    w.f += DP_HIDDEN_BIT;
+    w.e = be - 1075;
+  } else {
+    w.e = -1074;
+  }
+
+  // Boundaries m- and m+ halfway to the neighbouring doubles
+  DiyFp pl = {(w.f << 1) + 1, w.e - 1};
+  pl = diyNormalize(pl);
+  DiyFp mi = (w.f == DP_HIDDEN_BIT) ? (DiyFp){(w.f << 2) - 1, w.e - 2}
+                                    : (DiyFp){(w.f << 1) - 1, w.e - 1};
+  mi.f <<= mi.e - pl.e;
+  mi.e = pl.e;
+
+  DiyFp c = cachedPower(pl.e, k);
+  DiyFp W = diyMultiply(diyNormalize(w), c);
+  DiyFp Wp = diyMultiply(pl, c);
+  DiyFp Wm = diyMultiply(mi, c);
+  Wm.f++;
+  Wp.f--;
+  return digitGen(W, Wp, Wp.f - Wm.f, digits, k);
+}
+
+// Lays out `len` digits with decimal exponent `k` (value = digits * 10^k):
+// fixed notation for 1e-5 <= |v| < 1e21, otherwise d.ddde[-]x.
+static size_t prettify(char *buf, const char *digits, int len, int k) {
+  int kk = len + k; // position of the decimal point
+  char *p = buf;
+  if (kk > 0 && kk <= 21) {
+    if (k >= 0) {
+      memcpy(p, digits, len);
+      memset(p + len, '0', k);
+      p += kk;
+      *p++ = '.';
+      *p++ = '0';
+    } else {
+      memcpy(p, digits, kk);
+      p[kk] = '.';
+      memcpy(p + kk + 1, digits + kk, len - kk);
+      p += len + 1;
+    }
+  } else if (kk <= 0 && kk > -5) {
+    *p++ = '0';
+    *p++ = '.';
+    memset(p, '0', -kk);
+    p += -kk;
+    memcpy(p, digits, len);
+    p += len;
+  } else {
+    *p++ = digits[0];
+    if (len > 1) {
+      *p++ = '.';
+      memcpy(p, digits + 1, len - 1);
+      p += len - 1;
+    }
+    *p++ = 'e';
+    int exp10 = kk - 1;
+    if (exp10 < 0) {
+      *p++ = '-';
+      exp10 = -exp10;
+    }
+    p += idris2_formatUInt64(p, (uint64_t)exp10);
+  }
+  *p = '\0';
+  return (size_t)(p - buf);
+}
+
+size_t idris2_formatDouble(char *buf, double x) {
+  if (isnan(x)) {
+    memcpy(buf, "nan", 4);
+    return 3;
+  }
+  char *p = buf;
+  if (signbit(x)) {
+    *p++ = '-';
+    x = -x;
+  }
+  if (isinf(x)) {
+    memcpy(p, "inf", 4);
+    return (size_t)(p - buf) + 3;
+  }
+  if (x == 0.0) {
+    memcpy(p, "0.0", 4);
+    return (size_t)(p - buf) + 3;
+  }
+  char digits[18];
+  int k;
+  int len = grisu2(x, digits, &k);
+  return (size_t)(p - buf) + prettify(p, digits, len, k);
+}
+
+/* Number parsing
+ *
+ * Decimal integers are parsed eight digits at a time (SWAR) without libc.
+ * Doubles take Clinger's exact fast path when the significand fits in 53
+ * bits and the power of ten is exactly representable, which covers typical
+ * amounts in JSON/Candid text; anything else falls back to strtod. */
+
+static int isSpace(char c) {
+  return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+// Non-zero if all 8 bytes of `v` (little-endian) are ASCII digits.
+static int isEightDigits(uint64_t v) {
+  return (((v & 0xF0F0F0F0F0F0F0F0ULL) |
+           (((v + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) >> 4)) ==
+          0x3333333333333333ULL);
+}
+
+static uint32_t parseEightDigits(uint64_t v) {
+  const uint64_t mask = 0x000000FF000000FFULL;
+  const uint64_t mul1 = 100 + (1000000ULL << 32);
+  const uint64_t mul2 = 1 + (10000ULL << 32);
+  v -= 0x3030303030303030ULL;
+  v = (v * 10) + (v >> 8);
+  return (uint32_t)(((v & mask) * mul1 + ((v >> 16) & mask) * mul2) >> 32);
+}
+#endif
+
+// Accumulates the digits at `p` (up to `end`) into `*acc` (mod 2^64).
+// Returns the first non-digit position.
+static const char *parseDigits(const char *p, const char *end,
+                               uint64_t *acc) {
+  uint64_t v = *acc;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  while (end - p >= 8) {
+    uint64_t chunk;
+    memcpy(&chunk, p, 8);
+    if (!isEightDigits(chunk))
+      break;
+    v = v * 100000000ULL + parseEightDigits(chunk);
+    p += 8;
+  }
+#endif
+  while (p < end && *p >= '0' && *p <= '9')
+    v = v * 10 + (uint64_t)(*p++ - '0');
+  *acc = v;
+  return p;
+}
+
+size_t idris2_parseDecimal(const char *s, size_t n, int *neg, uint64_t *mag,
+                           int *ndigits) {
+  const char *p = s;
+  const char *end = s + n;
+  while (p < end && isSpace(*p))
+    p++;
+  *neg = 0;
+  if (p < end && (*p == '-' || *p == '+'))
+    *neg = *p++ == '-';
+  const char *digits = p;
+  while (p < end && *p == '0')
+    p++;
+  const char *significant = p;
+  *mag = 0;
+  p = parseDigits(p, end, mag);
+  *ndigits = (int)(p - significant);
+  return p == digits ? 0 : (size_t)(p - s);
+}
+
+static int64_t parseInt64(Value *input) {
+  int neg, nd;
+  uint64_t mag;
+  idris2_parseDecimal(((Value_String *)input)->str,
+                      idris2_strByteLength(input), &neg, &mag, &nd);
+  return (int64_t)(neg ? 0 - mag : mag);
+}
+
+void idris2_mpz_set_u64(mpz_t r, uint64_t v) {
+  if (v <= ULONG_MAX) {
+    mpz_set_ui(r, (unsigned long)v);
+  } else {
+    mpz_set_ui(r, (unsigned long)(v >> 32));
+    mpz_mul_2exp(r, r, 32);
+    mpz_add_ui(r, r, (unsigned long)(v & 0xFFFFFFFFu));
+  }
+}
+
+int idris2_mpz_set_decimal(mpz_t r, const char *s) {
+  int neg, nd;
+  uint64_t mag;
+  size_t n = strlen(s);
+  size_t used = idris2_parseDecimal(s, n, &neg, &mag, &nd);
+  // Small, well-formed literals never reach the general parser
+  if (used == n && used > 0 && nd <= 19) {
+    idris2_mpz_set_u64(r, mag);
+    if (neg)
+      mpz_neg(r, r);
+    return 0;
+  }
+  return mpz_set_str(r, s, 10);
+}
+
+static const double exactPow10[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+double idris2_parseDouble(const char *s, size_t n) {
+  const char *p = s;
+  const char *end = s + n;
+  while (p < end && isSpace(*p))
+    p++;
+  int neg = 0;
+  if (p < end && (*p == '-' || *p == '+'))
+    neg = *p++ == '-';
+
+  // Significand: up to 19 significant digits fit in a uint64_t
+  uint64_t w = 0;
+  int nd = 0;
+  int64_t exp10 = 0;
+  int seen = 0;
+  while (p < end && *p == '0') {
+    p++;
+    seen = 1;
+  }
+  const char *q = parseDigits(p, end, &w);
+  nd += (int)(q - p);
+  seen |= q != p;
+  p = q;
+  if (p < end && *p == '.') {
+    p++;
+    if (nd == 0) {
+      while (p < end && *p == '0') {
+        p++;
+        exp10--;
+        seen = 1;
+      }
+    }
+    q = parseDigits(p, end, &w);
+    nd += (int)(q - p);
+    exp10 -= q - p;
+    seen |= q != p;
+    p = q;
+  }
+  if (!seen || nd > 19 || (p < end && (*p == 'x' || *p == 'X')))
+    return strtod(s, NULL); // hex, inf/nan, long significands, no digits
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    const char *e = p + 1;
+    int eneg = 0;
+    if (e < end && (*e == '-' || *e == '+'))
+      eneg = *e++ == '-';
+    if (e < end && *e >= '0' && *e <= '9') {
+      int64_t x = 0;
+      while (e < end && *e >= '0' && *e <= '9' && x < 100000)
+        x = x * 10 + (*e++ - '0');
+      if (e < end && *e >= '0' && *e <= '9')
+        return strtod(s, NULL);
+      exp10 += eneg ? -x : x;
+    }
+  }
+
+  // Clinger: both w and 10^|exp10| are exact doubles, so a single IEEE
+  // multiplication or division is correctly rounded.
+  if (w <= (1ULL << 53)) {
+    double d = (double)w;
+    if (w == 0) {
+      d = 0.0;
+    } else if (exp10 >= 0 && exp10 <= 22) {
+      d *= exactPow10[exp10];
+    } else if (exp10 < 0 && exp10 >= -22) {
+      d /= exactPow10[-exp10];
+    } else if (exp10 > 22 && exp10 <= 22 + 15) {
+      // Shift zeros into the significand while it stays exact
+      double t = d * exactPow10[exp10 - 22];
+      if (t > 9007199254740992.0)
+        return strtod(s, NULL);
+      d = t * exactPow10[22];
+    } else {
+      return strtod(s, NULL);
+    }
+    return neg ? -d : d;
+  }
+  return strtod(s, NULL);
+}
 
-  int l = snprintf(NULL, 0, "%" PRId8 "", x);
-  Value_String *retVal = idris2_mkEmptyString(l + 1);
-  sprintf(retVal->str, "%" PRId8 "", x);
+/*  conversions from Int8  */
+Value *idris2_cast_Int8_to_Integer(Value *input) {
+  return idris2_mkIntegerSmall(idris2_vp_to_Int8(input));
+}
 
-  return (Value *)retVal;
+Value *idris2_cast_Int8_to_string(Value *input) {
+  return mkIntString(idris2_vp_to_Int8(input));
 }
 
 /*  conversions from Int16  */
 Value *idris2_cast_Int16_to_Integer(Value *input) {
-  Value_Integer *retVal = idris2_mkInteger();
-  mpz_set_si(retVal->i, idris2_vp_to_Int16(input));
-
-  return (Value *)retVal;
+  return idris2_mkIntegerSmall(idris2_vp_to_Int16(input));
 }
 
 Value *idris2_cast_Int16_to_string(Value *input) {
-  int16_t x = idris2_vp_to_Int16(input);
-
-  int l = snprintf(NULL, 0, "%" PRId16 "", x);
-  Value_String *retVal = idris2_mkEmptyString(l + 1);
-  sprintf(retVal->str, "%" PRId16 "", x);
-
-  return (Value *)retVal;
+  return mkIntString(idris2_vp_to_Int16(input));
 }
 
 /*  conversions from Int32  */
 Value *idris2_cast_Int32_to_Integer(Value *input) {
-  Value_Integer *retVal = idris2_mkInteger();
-  mpz_set_si(retVal->i, idris2_vp_to_Int32(input));
-
-  return (Value *)retVal;
+  return idris2_mkIntegerSmall(idris2_vp_to_Int32(input));
 }
 
 Value *idris2_cast_Int32_to_string(Value *input) {
-  int32_t x = idris2_vp_to_Int32(input);
-
-  int l = snprintf(NULL, 0, "%" PRId32 "", x);
-  Value_String *retVal = idris2_mkEmptyString(l + 1);
-  sprintf(retVal->str, "%" PRId32 "", x);
-
-  return (Value *)retVal;
+  return mkIntString(idris2_vp_to_Int32(input));
 }
 
 /*  conversions from Int64  */
 Value *idris2_cast_Int64_to_Integer(Value *input) {
-  Value_Integer *retVal = idris2_mkInteger();
-  mpz_set_si(retVal->i, idris2_vp_to_Int64(input));
-
-  return (Value *)retVal;
+  return idris2_mkIntegerSmall(idris2_vp_to_Int64(input));
 }
 
 Value *idris2_cast_Int64_to_string(Value *input) {
-  int64_t from = idris2_vp_to_Int64(input);
-  int l = snprintf(NULL, 0, "%" PRId64 "", from);
-  Value_String *retVal = idris2_mkEmptyString(l + 1);
-  sprintf(retVal->str, "%" PRId64 "", from);
-
-  return (Value *)retVal;
+  return mkIntString(idris2_vp_to_Int64(input));
 }
 
 Value *idris2_cast_Double_to_Integer(Value *input) {
   Value_Integer *retVal = idris2_mkInteger();
   mpz_set_d(retVal->i, idris2_vp_to_Double(input));
 
-  return (Value *)retVal;
+  return idris2_normalizeInteger(retVal);
 }
 
 Value *idris2_cast_Double_to_string(Value *input) {
-  double x = idris2_vp_to_Double(input);
-
-  int l = snprintf(NULL, 0, "%f", x);
-  Value_String *retVal = idris2_mkEmptyString(l + 1);
-  sprintf(retVal->str, "%f", x);
+  char buf[IDRIS2_DOUBLE_STRING_MAX];
+  size_t l = idris2_formatDouble(buf, idris2_vp_to_Double(input));
+  Value_String *retVal = idris2_mkEmptyStringUninit(l + 1);
+  memcpy(retVal->str, buf, l);
 
   return (Value *)retVal;
 }
 
 Value *idris2_cast_Char_to_Integer(Value *input) {
-  Value_Integer *retVal = idris2_mkInteger();
-  mpz_set_si(retVal->i, idris2_vp_to_Char(input));
-
-  return (Value *)retVal;
+  return idris2_mkIntegerSmall(idris2_vp_to_Char(input));
 }
 
 Value *idris2_cast_Char_to_string(Value *input) {
-  Value_String *retVal = idris2_mkEmptyString(2);
-  retVal->str[0] = idris2_vp_to_Char(input);
+  uint32_t c = idris2_vp_to_Char(input);
+  Value_String *retVal = idris2_mkEmptyStringUninit(idris2_utf8Width(c) + 1);
+  idris2_utf8Encode(retVal->str, c);
 
   return (Value *)retVal;
 }
 
 Value *idris2_cast_String_to_Bits8(Value *input) {
-  Value_String *from = (Value_String *)input;
-  return (Value *)idris2_mkBits8((uint8_t)atoi(from->str));
+  return (Value *)idris2_mkBits8((uint8_t)parseInt64(input));
 }
 
 Value *idris2_cast_String_to_Bits16(Value *input) {
-  Value_String *from = (Value_String *)input;
-  return (Value *)idris2_mkBits16((uint16_t)atoi(from->str));
+  return (Value *)idris2_mkBits16((uint16_t)parseInt64(input));
 }
 
 Value *idris2_cast_String_to_Bits32(Value *input) {
-  Value_String *from = (Value_String *)input;
-  return (Value *)idris2_mkBits32((uint32_t)atoi(from->str));
+  return (Value *)idris2_mkBits32((uint32_t)parseInt64(input));
 }
 
 Value *idris2_cast_String_to_Bits64(Value *input) {
-  Value_String *from = (Value_String *)input;
-  return (Value *)idris2_mkBits64((uint64_t)atoi(from->str));
+  return (Value *)idris2_mkBits64((uint64_t)parseInt64(input));
 }
 
 Value *idris2_cast_String_to_Int8(Value *input) {
-  Value_String *from = (Value_String *)input;
-  return (Value *)idris2_mkInt8((int8_t)atoi(from->str));
+  return (Value *)idris2_mkInt8((int8_t)parseInt64(input));
 }
 
 Value *idris2_cast_String_to_Int16(Value *input) {
-  Value_String *from = (Value_String *)input;
-  return (Value *)idris2_mkInt16((int16_t)atoi(from->str));
+  return (Value *)idris2_mkInt16((int16_t)parseInt64(input));
 }
 
 Value *idris2_cast_String_to_Int32(Value *input) {
-  Value_String *from = (Value_String *)input;
-  return (Value *)idris2_mkInt32((int32_t)atoi(from->str));
+  return (Value *)idris2_mkInt32((int32_t)parseInt64(input));
 }
 
 Value *idris2_cast_String_to_Int64(Value *input) {
-  Value_String *from = (Value_String *)input;
-  return (Value *)idris2_mkInt64((int64_t)atoi(from->str));
+  return (Value *)idris2_mkInt64((int64_t)parseInt64(input));
 }
 
 Value *idris2_cast_String_to_Integer(Value *input) {
   Value_String *from = (Value_String *)input;
 
   Value_Integer *retVal = idris2_mkInteger();
-  mpz_set_str(retVal->i, from->str, 10);
+  idris2_mpz_set_decimal(retVal->i, from->str);
 
-  return (Value *)retVal;
+  return idris2_normalizeInteger(retVal);
 }
 
 Value *idris2_cast_String_to_Double(Value *input) {
-  return (Value *)idris2_mkDouble(atof(((Value_String *)input)->str));
+  return (Value *)idris2_mkDouble(idris2_parseDouble(
+      ((Value_String *)input)->str, idris2_strByteLength(input)));
 }
 
 /*  conversions from Bits8  */
 Value *idris2_cast_Bits8_to_Integer(Value *input) {
-  Value_Integer *retVal = idris2_mkInteger();
-  mpz_set_ui(retVal->i, idris2_vp_to_Bits8(input));
-
-  return (Value *)retVal;
+  return idris2_mkIntegerSmall(idris2_vp_to_Bits8(input));
 }
 
 Value *idris2_cast_Bits8_to_string(Value *input) {
-  uint8_t x = idris2_vp_to_Bits8(input);
-
-  int l = snprintf(NULL, 0, "%" PRIu8 "", x);
-  Value_String *retVal = idris2_mkEmptyString(l + 1);
-  sprintf(retVal->str, "%" PRIu8 "", x);
-
-  return (Value *)retVal;
+  return mkUIntString(idris2_vp_to_Bits8(input));
 }
 
 /*  conversions from Bits16  */
 Value *idris2_cast_Bits16_to_Integer(Value *input) {
-  Value_Integer *retVal = idris2_mkInteger();
-  mpz_set_ui(retVal->i, idris2_vp_to_Bits16(input));
-
-  return (Value *)retVal;
+  return idris2_mkIntegerSmall(idris2_vp_to_Bits16(input));
 }
 
 Value *idris2_cast_Bits16_to_string(Value *input) {
-  uint16_t x = idris2_vp_to_Bits16(input);
-
-  int l = snprintf(NULL, 0, "%" PRIu16 "", x);
-  Value_String *retVal = idris2_mkEmptyString(l + 1);
-  sprintf(retVal->str, "%" PRIu16 "", x);
-
-  return (Value *)retVal;
+  return mkUIntString(idris2_vp_to_Bits16(input));
 }
 
 /*  conversions from Bits32  */
 Value *idris2_cast_Bits32_to_Integer(Value *input) {
-  Value_Integer *retVal = idris2_mkInteger();
-  mpz_set_ui(retVal->i, idris2_vp_to_Bits32(input));
-
-  return (Value *)retVal;
+  return idris2_mkIntegerSmall(idris2_vp_to_Bits32(input));
 }
 
 Value *idris2_cast_Bits32_to_string(Value *input) {
-  uint32_t x = idris2_vp_to_Bits32(input);
-
-  int l = snprintf(NULL, 0, "%" PRIu32 "", x);
-  Value_String *retVal = idris2_mkEmptyString(l + 1);
-  sprintf(retVal->str, "%" PRIu32 "", x);
-
-  return (Value *)retVal;
+  return mkUIntString(idris2_vp_to_Bits32(input));
 }
 
 /*  conversions from Bits64  */
 Value *idris2_cast_Bits64_to_Integer(Value *input) {
+  uint64_t v = idris2_vp_to_Bits64(input);
+  if (v <= INT64_MAX)
+    return idris2_mkIntegerSmall((int64_t)v);
+
   Value_Integer *retVal = idris2_mkInteger();
-  mpz_set_ui(retVal->i, idris2_vp_to_Bits64(input));
+  idris2_mpz_set_u64(retVal->i, v);
 
   return (Value *)retVal;
 }
 
 Value *idris2_cast_Bits64_to_string(Value *input) {
-  uint64_t x = idris2_vp_to_Bits64(input);
-
-  int l = snprintf(NULL, 0, "%" PRIu64 "", x);
-  Value_String *retVal = idris2_mkEmptyString(l + 1);
-  sprintf(retVal->str, "%" PRIu64 "", x);
-
-  return (Value *)retVal;
+  return mkUIntString(idris2_vp_to_Bits64(input));
 }
 
 /*  conversions from Integer */
@@ -241,56 +681,78 @@ uint64_t mpz_get_lsb(mpz_t i, mp_bitcnt_t b) {
 
 Value *idris2_cast_Integer_to_Bits8(Value *input) {
   Value_Integer *from = (Value_Integer *)input;
+  if (idris2_isSmallInteger(input))
+    return (Value *)idris2_mkBits8((uint8_t)from->small);
   return (Value *)idris2_mkBits8((uint8_t)mpz_get_lsb(from->i, 8));
 }
 
 Value *idris2_cast_Integer_to_Bits16(Value *input) {
   Value_Integer *from = (Value_Integer *)input;
+  if (idris2_isSmallInteger(input))
+    return (Value *)idris2_mkBits16((uint16_t)from->small);
   return (Value *)idris2_mkBits16((uint16_t)mpz_get_lsb(from->i, 16));
 }
 
 Value *idris2_cast_Integer_to_Bits32(Value *input) {
   Value_Integer *from = (Value_Integer *)input;
+  if (idris2_isSmallInteger(input))
+    return (Value *)idris2_mkBits32((uint32_t)from->small);
   return (Value *)idris2_mkBits32((uint32_t)mpz_get_lsb(from->i, 32));
 }
 
 Value *idris2_cast_Integer_to_Bits64(Value *input) {
   Value_Integer *from = (Value_Integer *)input;
+  if (idris2_isSmallInteger(input))
+    return (Value *)idris2_mkBits64((uint64_t)from->small);
   return (Value *)idris2_mkBits64((uint64_t)mpz_get_lsb(from->i, 64));
 }
 
 Value *idris2_cast_Integer_to_Int8(Value *input) {
   Value_Integer *from = (Value_Integer *)input;
+  if (idris2_isSmallInteger(input))
+    return (Value *)idris2_mkInt8((int8_t)from->small);
   return (Value *)idris2_mkInt8((int8_t)mpz_get_lsb(from->i, 8));
 }
 
 Value *idris2_cast_Integer_to_Int16(Value *input) {
   Value_Integer *from = (Value_Integer *)input;
+  if (idris2_isSmallInteger(input))
+    return (Value *)idris2_mkInt16((int16_t)from->small);
   return (Value *)idris2_mkInt16((int16_t)mpz_get_lsb(from->i, 16));
 }
 
 Value *idris2_cast_Integer_to_Int32(Value *input) {
   Value_Integer *from = (Value_Integer *)input;
+  if (idris2_isSmallInteger(input))
+    return (Value *)idris2_mkInt32((int32_t)from->small);
   return (Value *)idris2_mkInt32((int32_t)mpz_get_lsb(from->i, 32));
 }
 
 Value *idris2_cast_Integer_to_Int64(Value *input) {
   Value_Integer *from = (Value_Integer *)input;
+  if (idris2_isSmallInteger(input))
+    return (Value *)idris2_mkInt64((int64_t)from->small);
   return (Value *)idris2_mkInt64((int64_t)mpz_get_lsb(from->i, 64));
 }
 
 Value *idris2_cast_Integer_to_Double(Value *input) {
   Value_Integer *from = (Value_Integer *)input;
+  if (idris2_isSmallInteger(input))
+    return (Value *)idris2_mkDouble((double)from->small);
   return (Value *)idris2_mkDouble(mpz_get_d(from->i));
 }
 
 Value *idris2_cast_Integer_to_Char(Value *input) {
   Value_Integer *from = (Value_Integer *)input;
-  return (Value *)idris2_mkChar((unsigned char)mpz_get_lsb(from->i, 8));
+  if (idris2_isSmallInteger(input))
+    return (Value *)idris2_mkChar((uint32_t)from->small);
+  return (Value *)idris2_mkChar((uint32_t)mpz_get_lsb(from->i, 32));
 }
 
 Value *idris2_cast_Integer_to_string(Value *input) {
   Value_Integer *from = (Value_Integer *)input;
+  if (idris2_isSmallInteger(input))
+    return mkIntString(from->small);
 
   Value_String *retVal = IDRIS2_NEW_VALUE(Value_String);
   retVal->header.tag = STRING_TAG;
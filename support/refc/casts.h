@@ -4,6 +4,23 @@
 #include <gmp.h>
 #include <stdio.h>
 
+// printf-free number formatting; `buf` is NUL-terminated, return value is the
+// length without the terminator. Integers need at most 21 bytes.
+#define IDRIS2_DOUBLE_STRING_MAX 32
+size_t idris2_formatUInt64(char *buf, uint64_t v);
+size_t idris2_formatInt64(char *buf, int64_t v);
+size_t idris2_formatDouble(char *buf, double x);
+
+// libc-free decimal parsing. idris2_parseDecimal accepts leading whitespace,
+// a sign and digits; it returns the bytes consumed (0 without digits), the
+// magnitude mod 2^64 and the number of significant digits.
+size_t idris2_parseDecimal(const char *s, size_t n, int *neg, uint64_t *mag,
+                           int *ndigits);
+double idris2_parseDouble(const char *s, size_t n);
+void idris2_mpz_set_u64(mpz_t r, uint64_t v);
+// mpz_set_str(r, s, 10) with a fast path for literals that fit in 64 bits.
+int idris2_mpz_set_decimal(mpz_t r, const char *s);
+
 #define idris2_cast_Int8_to_Bits8(x) (x)
 #define idris2_cast_Int8_to_Bits16(x) (x)
 #define idris2_cast_Int8_to_Bits32(x) (x)
@@ -19,7 +36,7 @@ Value *idris2_cast_Int8_to_Integer(Value *);
 #define idris2_cast_Int8_to_Double(x)                                          \
   (idris2_mkDouble((double)idris2_vp_to_Int8(x)))
 #define idris2_cast_Int8_to_Char(x)                                            \
-  (idris2_mkChar((unsigned char)idris2_vp_to_Int8(x)))
+  (idris2_mkChar((uint32_t)idris2_vp_to_Int8(x)))
 Value *idris2_cast_Int8_to_string(Value *);
 
 #define idris2_cast_Int16_to_Bits8(x)                                          \
@@ -37,7 +54,7 @@ Value *idris2_cast_Int16_to_Integer(Value *);
 #define idris2_cast_Int16_to_Double(x)                                         \
   (idris2_mkDouble((double)idris2_vp_to_Int16(x)))
 #define idris2_cast_Int16_to_Char(x)                                           \
-  (idris2_mkChar((unsigned char)idris2_vp_to_Int16(x)))
+  (idris2_mkChar((uint32_t)idris2_vp_to_Int16(x)))
 Value *idris2_cast_Int16_to_string(Value *);
 
 #define idris2_cast_Int32_to_Bits8(x)                                          \
@@ -57,7 +74,7 @@ Value *idris2_cast_Int32_to_Integer(Value *);
 #define idris2_cast_Int32_to_Double(x)                                         \
   (idris2_mkDouble((double)idris2_vp_to_Int32(x)))
 #define idris2_cast_Int32_to_Char(x)                                           \
-  (idris2_mkChar((unsigned char)idris2_vp_to_Int32(x)))
+  (idris2_mkChar((uint32_t)idris2_vp_to_Int32(x)))
 Value *idris2_cast_Int32_to_string(Value *);
 
 #define idris2_cast_Int64_to_Bits8(x)                                          \
@@ -79,7 +96,7 @@ Value *idris2_cast_Int64_to_Integer(Value *);
 #define idris2_cast_Int64_to_Double(x)                                         \
   (idris2_mkDouble((double)idris2_vp_to_Int64(x)))
 #define idris2_cast_Int64_to_Char(x)                                           \
-  (idris2_mkChar((unsigned char)idris2_vp_to_Int64(x)))
+  (idris2_mkChar((uint32_t)idris2_vp_to_Int64(x)))
 Value *idris2_cast_Int64_to_string(Value *);
 
 #define idris2_cast_Double_to_Bits8(x)                                         \
@@ -100,7 +117,7 @@ Value *idris2_cast_Int64_to_string(Value *);
   (idris2_mkInt64((int64_t)idris2_vp_to_Double(x)))
 Value *idris2_cast_Double_to_Integer(Value *);
 #define idris2_cast_Double_to_Char(x)                                          \
-  (idris2_mkChar((unsigned char)idris2_vp_to_Double))
+  (idris2_mkChar((uint32_t)idris2_vp_to_Double))
 Value *idris2_cast_Double_to_string(Value *);
 
 #define idris2_cast_Char_to_Bits8(x)                                           \
@@ -135,7 +152,7 @@ Value *idris2_cast_String_to_Int64(Value *);
 Value *idris2_cast_String_to_Integer(Value *);
 Value *idris2_cast_String_to_Double(Value *);
 #define idris2_cast_String_to_Char(x)                                          \
-  (idris2_mkChar(((Value_String *)(x))->str[0]))
+  (idris2_mkChar(idris2_utf8Decode(((Value_String *)(x))->str, NULL)))
 
 #define idris2_cast_Bits8_to_Bits16(x) (x)
 #define idris2_cast_Bits8_to_Bits32(x) (x)
@@ -150,7 +167,7 @@ Value *idris2_cast_Bits8_to_Integer(Value *input);
 #define idris2_cast_Bits8_to_Double(x)                                         \
   (idris2_mkDouble((double)idris2_vp_to_Bits8(x)))
 #define idris2_cast_Bits8_to_Char(x)                                           \
-  (idris2_mkChar((unsigned char)idris2_vp_to_Bits8(x)))
+  (idris2_mkChar((uint32_t)idris2_vp_to_Bits8(x)))
 Value *idris2_cast_Bits8_to_string(Value *input);
 
 #define idris2_cast_Bits16_to_Bits8(x)                                         \
@@ -171,7 +188,7 @@ Value *idris2_cast_Bits16_to_Integer(Value *input);
 #define idris2_cast_Bits16_to_Double(x)                                        \
   (idris2_mkDouble((double)idris2_vp_to_Bits16(x)))
 #define idris2_cast_Bits16_to_Char(x)                                          \
-  (idris2_mkChar((unsigned char)idris2_vp_to_Bits16(x)))
+  (idris2_mkChar((uint32_t)idris2_vp_to_Bits16(x)))
 Value *idris2_cast_Bits16_to_string(Value *input);
 
 #define idris2_cast_Bits32_to_Bits8(x)                                         \
@@ -192,7 +209,7 @@ Value *idris2_cast_Bits32_to_Integer(Value *input);
 #define idris2_cast_Bits32_to_Double(x)                                        \
   (idris2_mkDouble((double)idris2_vp_to_Bits32(x)))
 #define idris2_cast_Bits32_to_Char(x)                                          \
-  (idris2_mkChar((unsigned char)idris2_vp_to_Bits32(x)))
+  (idris2_mkChar((uint32_t)idris2_vp_to_Bits32(x)))
 Value *idris2_cast_Bits32_to_string(Value *input);
 
 #define idris2_cast_Bits64_to_Bits8(x)                                         \
@@ -213,7 +230,7 @@ Value *idris2_cast_Bits64_to_Integer(Value *input);
 #define idris2_cast_Bits64_to_Double(x)                                        \
   (idris2_mkDouble((double)idris2_vp_to_Bits64(x)))
 #define idris2_cast_Bits64_to_Char(x)                                          \
-  (idris2_mkChar((unsigned char)idris2_vp_to_Bits64(x)))
+  (idris2_mkChar((uint32_t)idris2_vp_to_Bits64(x)))
 Value *idris2_cast_Bits64_to_string(Value *input);
 
 Value *idris2_cast_Integer_to_Bits8(Value *input);
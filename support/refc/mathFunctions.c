@@ -2,32 +2,63 @@
 #include "memoryManagement.h"
 #include "runtime.h"
 
+/* Integer
+ *
+ * Small Integers (see Value_Integer) are handled with overflow-checked
+ * machine arithmetic; only results that do not fit in an int64_t go through
+ * mpz, and mpz results that fit are turned back into the small form. */
+
+#define IDRIS2_SMALL(v) (((Value_Integer *)(v))->small)
+#define IDRIS2_BOTH_SMALL(x, y)                                                \
+  (idris2_isSmallInteger(x) && idris2_isSmallInteger(y))
+
+int idris2_cmp_Integer(Value *x, Value *y) {
+  if (IDRIS2_BOTH_SMALL(x, y))
+    return (IDRIS2_SMALL(x) > IDRIS2_SMALL(y)) -
+           (IDRIS2_SMALL(x) < IDRIS2_SMALL(y));
+  return mpz_cmp(((Value_Integer *)x)->i, ((Value_Integer *)y)->i);
+}
+
 /* add */
 Value *idris2_add_Integer(Value *x, Value *y) {
+  int64_t r;
+  if (IDRIS2_BOTH_SMALL(x, y) &&
+      !__builtin_add_overflow(IDRIS2_SMALL(x), IDRIS2_SMALL(y), &r))
+    return idris2_mkIntegerSmall(r);
   Value_Integer *retVal = idris2_mkInteger();
   mpz_add(retVal->i, ((Value_Integer *)x)->i, ((Value_Integer *)y)->i);
-  return (Value *)retVal;
+  return idris2_normalizeInteger(retVal);
 }
 
 /* sub */
 Value *idris2_sub_Integer(Value *x, Value *y) {
+  int64_t r;
+  if (IDRIS2_BOTH_SMALL(x, y) &&
+      !__builtin_sub_overflow(IDRIS2_SMALL(x), IDRIS2_SMALL(y), &r))
+    return idris2_mkIntegerSmall(r);
   Value_Integer *retVal = idris2_mkInteger();
   mpz_sub(retVal->i, ((Value_Integer *)x)->i, ((Value_Integer *)y)->i);
-  return (Value *)retVal;
+  return idris2_normalizeInteger(retVal);
 }
 
 /* negate */
 Value *idris2_negate_Integer(Value *x) {
+  if (idris2_isSmallInteger(x) && IDRIS2_SMALL(x) != INT64_MIN)
+    return idris2_mkIntegerSmall(-IDRIS2_SMALL(x));
   Value_Integer *retVal = idris2_mkInteger();
   mpz_neg(retVal->i, ((Value_Integer *)x)->i);
-  return (Value *)retVal;
+  return idris2_normalizeInteger(retVal);
 }
 
 /* mul */
 Value *idris2_mul_Integer(Value *x, Value *y) {
+  int64_t r;
+  if (IDRIS2_BOTH_SMALL(x, y) &&
+      !__builtin_mul_overflow(IDRIS2_SMALL(x), IDRIS2_SMALL(y), &r))
+    return idris2_mkIntegerSmall(r);
   Value_Integer *retVal = idris2_mkInteger();
   mpz_mul(retVal->i, ((Value_Integer *)x)->i, ((Value_Integer *)y)->i);
-  return (Value *)retVal;
+  return idris2_normalizeInteger(retVal);
 }
 
 /* div */
@@ -77,7 +108,36 @@ Value *idris2_div_Int64(Value *x, Value *y) {
                                  ((rem < 0) ? (denom < 0) ? 1 : -1 : 0));
 }
 
+// Euclidean remainder of small operands; false if mpz has to handle it
+// (division by zero keeps mpz's behaviour, INT64_MIN / -1 overflows).
+static int smallEuclid(Value *x, Value *y, int64_t *q, int64_t *r) {
+  if (!IDRIS2_BOTH_SMALL(x, y))
+    return 0;
+  int64_t a = IDRIS2_SMALL(x), b = IDRIS2_SMALL(y);
+  if (b == 0 || (a == INT64_MIN && b == -1))
+    return 0;
+  int64_t rem = a % b;
+  int64_t quo = a / b;
+  if (rem < 0) {
+    // b > 0: q - 1, r + b; b < 0: q + 1, r - b
+    if (b > 0) {
+      quo--;
+      rem += b;
+    } else {
+      quo++;
+      rem -= b;
+    }
+  }
+  *q = quo;
+  *r = rem;
+  return 1;
+}
+
 Value *idris2_div_Integer(Value *x, Value *y) {
+  int64_t q, r;
+  if (smallEuclid(x, y, &q, &r))
+    return idris2_mkIntegerSmall(q);
+
   mpz_t rem, yq;
   mpz_inits(rem, yq, NULL);
 
@@ -89,7 +149,7 @@ Value *idris2_div_Integer(Value *x, Value *y) {
 
   mpz_clears(rem, yq, NULL);
 
-  return (Value *)retVal;
+  return idris2_normalizeInteger(retVal);
 }
 
 /* mod */
@@ -119,44 +179,65 @@ Value *idris2_mod_Int64(Value *x, Value *y) {
   return (Value *)idris2_mkInt64(num % denom + (num < 0 ? denom : 0));
 }
 Value *idris2_mod_Integer(Value *x, Value *y) {
+  int64_t q, r;
+  if (smallEuclid(x, y, &q, &r))
+    return idris2_mkIntegerSmall(r);
   Value_Integer *retVal = idris2_mkInteger();
   mpz_mod(retVal->i, ((Value_Integer *)x)->i, ((Value_Integer *)y)->i);
-  return (Value *)retVal;
+  return idris2_normalizeInteger(retVal);
 }
 
 /* shiftl */
 Value *idris2_shiftl_Integer(Value *x, Value *y) {
-  Value_Integer *retVal = idris2_mkInteger();
   mp_bitcnt_t cnt = (mp_bitcnt_t)mpz_get_ui(((Value_Integer *)y)->i);
+  int64_t r;
+  if (idris2_isSmallInteger(x) && cnt < 63 &&
+      !__builtin_mul_overflow(IDRIS2_SMALL(x), (int64_t)1 << cnt, &r))
+    return idris2_mkIntegerSmall(r);
+  Value_Integer *retVal = idris2_mkInteger();
   mpz_mul_2exp(retVal->i, ((Value_Integer *)x)->i, cnt);
-  return (Value *)retVal;
+  return idris2_normalizeInteger(retVal);
 }
 
 /* shiftr */
 Value *idris2_shiftr_Integer(Value *x, Value *y) {
-  Value_Integer *retVal = idris2_mkInteger();
   mp_bitcnt_t cnt = (mp_bitcnt_t)mpz_get_ui(((Value_Integer *)y)->i);
+  if (idris2_isSmallInteger(x)) {
+    // Arithmetic shift rounds towards -inf, like mpz_fdiv_q_2exp
+    int64_t v = IDRIS2_SMALL(x);
+    return idris2_mkIntegerSmall(cnt >= 63 ? (v < 0 ? -1 : 0) : v >> cnt);
+  }
+  Value_Integer *retVal = idris2_mkInteger();
   mpz_fdiv_q_2exp(retVal->i, ((Value_Integer *)x)->i, cnt);
-  return (Value *)retVal;
+  return idris2_normalizeInteger(retVal);
 }
 
 /* and */
 Value *idris2_and_Integer(Value *x, Value *y) {
+  // Two's complement, same as mpz's semantics for negative operands
+  if (IDRIS2_BOTH_SMALL(x, y))
+    return idris2_mkIntegerSmall(IDRIS2_SMALL(x) & IDRIS2_SMALL(y));
   Value_Integer *retVal = idris2_mkInteger();
   mpz_and(retVal->i, ((Value_Integer *)x)->i, ((Value_Integer *)y)->i);
-  return (Value *)retVal;
+  return idris2_normalizeInteger(retVal);
 }
 
 /* or */
 Value *idris2_or_Integer(Value *x, Value *y) {
+  // Two's complement, same as mpz's semantics for negative operands
+  if (IDRIS2_BOTH_SMALL(x, y))
+    return idris2_mkIntegerSmall(IDRIS2_SMALL(x) | IDRIS2_SMALL(y));
   Value_Integer *retVal = idris2_mkInteger();
   mpz_ior(retVal->i, ((Value_Integer *)x)->i, ((Value_Integer *)y)->i);
-  return (Value *)retVal;
+  return idris2_normalizeInteger(retVal);
 }
 
 /* xor */
 Value *idris2_xor_Integer(Value *x, Value *y) {
+  // Two's complement, same as mpz's semantics for negative operands
+  if (IDRIS2_BOTH_SMALL(x, y))
+    return idris2_mkIntegerSmall(IDRIS2_SMALL(x) ^ IDRIS2_SMALL(y));
   Value_Integer *retVal = idris2_mkInteger();
   mpz_xor(retVal->i, ((Value_Integer *)x)->i, ((Value_Integer *)y)->i);
-  return (Value *)retVal;
+  return idris2_normalizeInteger(retVal);
 }
@@ -4,6 +4,8 @@
 #include <gmp.h>
 #include <math.h>
 
+#include "simdOps.h"
+
 #define idris2_binop(ty, op, l, r)                                             \
   ((Value *)idris2_mk##ty(idris2_vp_to_##ty(l) op idris2_vp_to_##ty(r)))
 
@@ -16,6 +18,7 @@
 #define idris2_add_Int16(l, r) (idris2_binop(Int16, +, l, r))
 #define idris2_add_Int32(l, r) (idris2_binop(Int32, +, l, r))
 #define idris2_add_Int64(l, r) (idris2_binop(Int64, +, l, r))
+int idris2_cmp_Integer(Value *x, Value *y);
 Value *idris2_add_Integer(Value *x, Value *y);
 #define idris2_add_Double(l, r) (idris2_binop(Double, +, l, r))
 
@@ -143,12 +146,13 @@ Value *idris2_xor_Integer(Value *x, Value *y);
 #define idris2_lt_Int64(l, r) (idris2_cmpop(Int64, <, l, r))
 #define idris2_lt_Integer(l, r)                                                \
   (idris2_mkBool(                                                              \
-      mpz_cmp(((Value_Integer *)(l))->i, ((Value_Integer *)(r))->i) < 0))
+      idris2_cmp_Integer((Value *)(l), (Value *)(r)) < 0))
 #define idris2_lt_Double(l, r) (idris2_cmpop(Double, <, l, r))
 #define idris2_lt_Char(l, r) (idris2_cmpop(Char, <, l, r))
 #define idris2_lt_string(l, r)                                                 \
   (idris2_mkBool(                                                              \
-      strcmp(((Value_String *)(l))->str, ((Value_String *)(r))->str) < 0))
+      idris2_simd_strcmp(((Value_String *)(l))->str,                           \
+                         ((Value_String *)(r))->str) < 0))
 
 /* gt */
 #define idris2_gt_Bits8(l, r) (idris2_cmpop(Bits8, >, l, r))
@@ -161,12 +165,13 @@ Value *idris2_xor_Integer(Value *x, Value *y);
 #define idris2_gt_Int64(l, r) (idris2_cmpop(Int64, >, l, r))
 #define idris2_gt_Integer(l, r)                                                \
   (idris2_mkBool(                                                              \
-      mpz_cmp(((Value_Integer *)(l))->i, ((Value_Integer *)(r))->i) > 0))
+      idris2_cmp_Integer((Value *)(l), (Value *)(r)) > 0))
 #define idris2_gt_Double(l, r) (idris2_cmpop(Double, >, l, r))
 #define idris2_gt_Char(l, r) (idris2_cmpop(Char, >, l, r))
 #define idris2_gt_string(l, r)                                                 \
   (idris2_mkBool(                                                              \
-      strcmp(((Value_String *)(l))->str, ((Value_String *)(r))->str) > 0))
+      idris2_simd_strcmp(((Value_String *)(l))->str,                           \
+                         ((Value_String *)(r))->str) > 0))
 
 /* eq */
 #define idris2_eq_Bits8(l, r) (idris2_cmpop(Bits8, ==, l, r))
@@ -179,12 +184,13 @@ Value *idris2_xor_Integer(Value *x, Value *y);
 #define idris2_eq_Int64(l, r) (idris2_cmpop(Int64, ==, l, r))
 #define idris2_eq_Integer(l, r)                                                \
   (idris2_mkBool(                                                              \
-      mpz_cmp(((Value_Integer *)(l))->i, ((Value_Integer *)(r))->i) == 0))
+      idris2_cmp_Integer((Value *)(l), (Value *)(r)) == 0))
 #define idris2_eq_Double(l, r) (idris2_cmpop(Double, ==, l, r))
 #define idris2_eq_Char(l, r) (idris2_cmpop(Char, ==, l, r))
 #define idris2_eq_string(l, r)                                                 \
   (idris2_mkBool(                                                              \
-      strcmp(((Value_String *)(l))->str, ((Value_String *)(r))->str) == 0))
+      idris2_simd_strcmp(((Value_String *)(l))->str,                           \
+                         ((Value_String *)(r))->str) == 0))
 
 /* lte */
 #define idris2_lte_Bits8(l, r) (idris2_cmpop(Bits8, <=, l, r))
@@ -197,12 +203,13 @@ Value *idris2_xor_Integer(Value *x, Value *y);
 #define idris2_lte_Int64(l, r) (idris2_cmpop(Int64, <=, l, r))
 #define idris2_lte_Integer(l, r)                                               \
   (idris2_mkBool(                                                              \
-      mpz_cmp(((Value_Integer *)(l))->i, ((Value_Integer *)(r))->i) <= 0))
+      idris2_cmp_Integer((Value *)(l), (Value *)(r)) <= 0))
 #define idris2_lte_Double(l, r) (idris2_cmpop(Double, <=, l, r))
 #define idris2_lte_Char(l, r) (idris2_cmpop(Char, <=, l, r))
 #define idris2_lte_string(l, r)                                                \
   (idris2_mkBool(                                                              \
-      strcmp(((Value_String *)(l))->str, ((Value_String *)(r))->str) <= 0))
+      idris2_simd_strcmp(((Value_String *)(l))->str,                           \
+                         ((Value_String *)(r))->str) <= 0))
 
 /* gte */
 #define idris2_gte_Bits8(l, r) (idris2_cmpop(Bits8, >=, l, r))
@@ -215,9 +222,10 @@ Value *idris2_xor_Integer(Value *x, Value *y);
 #define idris2_gte_Int64(l, r) (idris2_cmpop(Int64, >=, l, r))
 #define idris2_gte_Integer(l, r)                                               \
   (idris2_mkBool(                                                              \
-      mpz_cmp(((Value_Integer *)(l))->i, ((Value_Integer *)(r))->i) >= 0))
+      idris2_cmp_Integer((Value *)(l), (Value *)(r)) >= 0))
 #define idris2_gte_Double(l, r) (idris2_cmpop(Double, >=, l, r))
 #define idris2_gte_Char(l, r) (idris2_cmpop(Char, >=, l, r))
 #define idris2_gte_string(l, r)                                                \
   (idris2_mkBool(                                                              \
-      strcmp(((Value_String *)(l))->str, ((Value_String *)(r))->str) >= 0))
+      idris2_simd_strcmp(((Value_String *)(l))->str,                           \
+                         ((Value_String *)(r))->str) >= 0))
@@ -68,6 +68,7 @@ Value *idris2_newValue(size_t size) {
   IDRIS2_INC_MEMSTAT(n_newValue);
   retVal->header.refCounter = 1;
   retVal->header.tag = NO_TAG;
+  retVal->header.reserved = 0;
   return retVal;
 }
 
@@ -139,10 +140,55 @@ Value_Integer *idris2_mkInteger() {
   return retVal;
 }
 
+// Limb width modulo 64, so shifting by it is defined when limbs are 64-bit
+// (there is then only ever one limb to shift in or out).
+#define IDRIS2_LIMB_SHIFT ((8 * sizeof(mp_limb_t)) % 64)
+
+static void idris2_setSmallInteger(Value_Integer *v, int64_t x) {
+  uint64_t m = x < 0 ? 0 - (uint64_t)x : (uint64_t)x;
+  int n = 0;
+  for (; m && n < (int)IDRIS2_INT_SMALL_LIMBS; m >>= IDRIS2_LIMB_SHIFT)
+    v->limbs[n++] = (mp_limb_t)m;
+  v->small = x;
+  v->i->_mp_alloc = 0;
+  v->i->_mp_size = x < 0 ? -n : n;
+  v->i->_mp_d = v->limbs;
+  v->header.reserved |= IDRIS2_INT_SMALL;
+}
+
+Value *idris2_mkIntegerSmall(int64_t x) {
+  Value_Integer *retVal = IDRIS2_NEW_VALUE(Value_Integer);
+  retVal->header.tag = INTEGER_TAG;
+  idris2_setSmallInteger(retVal, x);
+  return (Value *)retVal;
+}
+
+Value *idris2_normalizeInteger(Value_Integer *v) {
+  if (idris2_isSmallInteger(v) ||
+      mpz_size(v->i) > IDRIS2_INT_SMALL_LIMBS)
+    return (Value *)v;
+  uint64_t m = 0;
+  for (size_t k = mpz_size(v->i); k-- > 0;)
+    m = (m << IDRIS2_LIMB_SHIFT) | mpz_getlimbn(v->i, k);
+  int neg = mpz_sgn(v->i) < 0;
+  if (m > (uint64_t)INT64_MAX + neg)
+    return (Value *)v;
+  mpz_clear(v->i);
+  idris2_setSmallInteger(v, neg ? (int64_t)(0 - m) : (int64_t)m);
+  return (Value *)v;
+}
+
 Value *idris2_mkIntegerLiteral(char *i) {
+  int neg, nd;
+  uint64_t mag;
+  size_t n = strlen(i);
+  if (idris2_parseDecimal(i, n, &neg, &mag, &nd) == n && n > 0 && nd <= 19 &&
+      mag <= (uint64_t)INT64_MAX + neg)
+    return idris2_mkIntegerSmall(neg ? (int64_t)(0 - mag) : (int64_t)mag);
+
   Value_Integer *retVal = idris2_mkInteger();
-  mpz_set_str(retVal->i, i, 10);
-  return (Value *)retVal;
+  idris2_mpz_set_decimal(retVal->i, i);
+  return idris2_normalizeInteger(retVal);
 }
 
 Value_String *idris2_mkEmptyString(size_t l) {
@@ -156,6 +202,17 @@ Value_String *idris2_mkEmptyString(size_t l) {
   return retVal;
 }
 
+Value_String *idris2_mkEmptyStringUninit(size_t l) {
+  if (l == 1)
+    return (Value_String *)&idris2_predefined_nullstring;
+
+  Value_String *retVal = IDRIS2_NEW_VALUE(Value_String);
+  retVal->header.tag = STRING_TAG;
+  retVal->str = malloc(l);
+  retVal->str[l - 1] = '\0';
+  return retVal;
+}
+
 Value_String *idris2_mkString(char *s) {
   if (s[0] == '\0')
     return (Value_String *)&idris2_predefined_nullstring;
@@ -164,8 +221,7 @@ Value_String *idris2_mkString(char *s) {
   int l = strlen(s);
   retVal->header.tag = STRING_TAG;
   retVal->str = malloc(l + 1);
-  memset(retVal->str, 0, l + 1);
-  memcpy(retVal->str, s, l);
+  memcpy(retVal->str, s, l + 1);
   return retVal;
 }
 
@@ -196,8 +252,21 @@ Value_Array *idris2_makeArray(int length) {
   Value_Array *a = IDRIS2_NEW_VALUE(Value_Array);
   a->header.tag = ARRAY_TAG;
   a->capacity = length;
-  a->arr = (Value **)malloc(sizeof(Value *) * length);
-  memset(a->arr, 0, sizeof(Value *) * length);
+  a->length = length;
+  a->base = NULL;
+  a->arr = (Value **)calloc(length ? length : 1, sizeof(Value *));
+  IDRIS2_REFC_VERIFY(a->arr, "calloc failed");
+  return a;
+}
+
+Value_Array *idris2_makeArrayUninit(int length) {
+  Value_Array *a = IDRIS2_NEW_VALUE(Value_Array);
+  a->header.tag = ARRAY_TAG;
+  a->capacity = length;
+  a->length = length;
+  a->base = NULL;
+  a->arr = (Value **)malloc(sizeof(Value *) * (length ? length : 1));
+  IDRIS2_REFC_VERIFY(a->arr, "malloc failed");
   return a;
 }
 
@@ -229,6 +298,11 @@ void idris2_removeReference(Value *elem) {
     switch (elem->header.tag) {
     case BITS32_TAG:
     case BITS64_TAG:
+    case BITS128_TAG:
+    case BITS256_TAG:
+    case INT_ARRAY_TAG:
+    case DOUBLE_ARRAY_TAG:
+    case BYTE_ARRAY_TAG:
     case INT32_TAG:
     case INT64_TAG:
       /* nothing to delete, added for sake of completeness */
@@ -242,6 +316,8 @@ void idris2_removeReference(Value *elem) {
       break;
 
     case STRING_TAG:
+      if (elem->header.reserved & IDRIS2_STR_META)
+        free(((Value_String *)elem)->index);
       free(((Value_String *)elem)->str);
       break;
 
@@ -265,13 +341,17 @@ void idris2_removeReference(Value *elem) {
 
     case BUFFER_TAG: {
       Value_Buffer *b = (Value_Buffer *)elem;
-      free(b->buffer);
+      freeBuffer(b->buffer);
       break;
     }
 
     case ARRAY_TAG: {
       Value_Array *a = (Value_Array *)elem;
-      for (int i = 0; i < a->capacity; i++) {
+      if (a->base) {
+        idris2_removeReference((Value *)a->base);
+        break;
+      }
+      for (int i = 0; i < a->length; i++) {
         idris2_removeReference(a->arr[i]);
       }
       free(a->arr);
@@ -350,9 +430,7 @@ Value *idris2_getPredefinedInteger(int n) {
       idris2_predefined_Integer[i].header.refCounter = IDRIS2_VP_REFCOUNTER_MAX;
       idris2_predefined_Integer[i].header.tag = INTEGER_TAG;
       idris2_predefined_Integer[i].header.reserved = 0;
-
-      mpz_init(idris2_predefined_Integer[i].i);
-      mpz_set_si(idris2_predefined_Integer[i].i, i);
+      idris2_setSmallInteger(&idris2_predefined_Integer[i], i);
     }
   }
   return (Value *)&idris2_predefined_Integer[n];
@@ -12,8 +12,7 @@ Value_Constructor *idris2_newConstructor(int total, int tag);
 Value_Closure *idris2_mkClosure(Value *(*f)(), uint8_t arity, uint8_t filled);
 
 Value *idris2_mkDouble(double d);
-#define idris2_mkChar(x)                                                       \
-  ((Value *)(((uintptr_t)(x) << idris2_vp_int_shift) + 1))
+#define idris2_mkChar(x) (idris2_mkCodePoint((uint32_t)(x)))
 #define idris2_mkBits8(x)                                                      \
   ((Value *)(((uintptr_t)(x) << idris2_vp_int_shift) + 1))
 #define idris2_mkBits16(x)                                                     \
@@ -54,9 +53,21 @@ Value *idris2_mkBits64(uint64_t i);
 Value *idris2_mkInt32_Boxed(int32_t i);
 Value *idris2_mkInt64(int64_t i);
 
+// Code points that do not fit beside the pointer tag are boxed.
+static inline Value *idris2_mkCodePoint(uint32_t c) {
+  if (idris2_vp_int_shift == 16 && c > 0xFFFF)
+    return idris2_mkBits32_Boxed(c);
+  return (Value *)(((uintptr_t)c << idris2_vp_int_shift) + 1);
+}
+
 Value_Integer *idris2_mkInteger();
 Value *idris2_mkIntegerLiteral(char *i);
+Value *idris2_mkIntegerSmall(int64_t x);
+// Turns a freshly computed mpz result into the small form if it fits.
+Value *idris2_normalizeInteger(Value_Integer *v);
 Value_String *idris2_mkEmptyString(size_t l);
+// Only the terminator is set; for callers that write all l - 1 bytes.
+Value_String *idris2_mkEmptyStringUninit(size_t l);
 Value_String *idris2_mkString(char *);
 
 Value_Pointer *idris2_makePointer(void *);
@@ -64,6 +75,8 @@ Value_GCPointer *idris2_makeGCPointer(void *ptr_Raw,
                                       Value_Closure *onCollectFct);
 Value_Buffer *idris2_makeBuffer(void *buf);
 Value_Array *idris2_makeArray(int length);
+// Slots are left unset; for callers that store every element first.
+Value_Array *idris2_makeArrayUninit(int length);
 
 extern Value_Int64 const idris2_predefined_Int64[100];
 extern Value_Bits64 const idris2_predefined_Bits64[100];
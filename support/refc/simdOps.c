@@ -0,0 +1,239 @@
+#include "simdOps.h"
+
+#include <string.h>
+
+#ifdef __wasm_simd128__
+#include <wasm_simd128.h>
+
+// A 16-byte load starting at `p` stays inside the 64 KiB Wasm page that
+// contains `p`. Used to read past a NUL terminator without trapping.
+#define IDRIS2_SIMD_PAGE_SAFE(p) ((((uintptr_t)(p)) & 0xFFFF) <= 0xFFF0)
+#endif
+
+int idris2_simd_memeq(const void *a, const void *b, size_t n) {
+  const unsigned char *p = a;
+  const unsigned char *q = b;
+  if (p == q)
+    return 1;
+#ifdef __wasm_simd128__
+  while (n >= 16) {
+    v128_t x = wasm_v128_load(p);
+    v128_t y = wasm_v128_load(q);
+    if (!wasm_i8x16_all_true(wasm_i8x16_eq(x, y)))
+      return 0;
+    p += 16;
+    q += 16;
+    n -= 16;
+  }
+  for (; n > 0; n--)
+    if (*p++ != *q++)
+      return 0;
+  return 1;
+#else
+  return memcmp(p, q, n) == 0;
+#endif
+}
+
+int idris2_simd_strcmp(const char *a, const char *b) {
+#ifdef __wasm_simd128__
+  const unsigned char *p = (const unsigned char *)a;
+  const unsigned char *q = (const unsigned char *)b;
+  const v128_t zero = wasm_i8x16_splat(0);
+  while (IDRIS2_SIMD_PAGE_SAFE(p) && IDRIS2_SIMD_PAGE_SAFE(q)) {
+    v128_t x = wasm_v128_load(p);
+    v128_t y = wasm_v128_load(q);
+    // Lanes where the strings differ or where `a` ends.
+    uint32_t stop =
+        wasm_i8x16_bitmask(wasm_v128_or(wasm_i8x16_ne(x, y),
+                                        wasm_i8x16_eq(x, zero)));
+    if (stop) {
+      unsigned i = __builtin_ctz(stop);
+      return (int)p[i] - (int)q[i];
+    }
+    p += 16;
+    q += 16;
+  }
+  // Near a page boundary: finish byte by byte.
+  while (*p && *p == *q) {
+    p++;
+    q++;
+  }
+  return (int)*p - (int)*q;
+#else
+  return strcmp(a, b);
+#endif
+}
+
+void idris2_simd_reverse(char *dst, const char *src, size_t n) {
+  char *out = dst + n;
+#ifdef __wasm_simd128__
+  while (n >= 16) {
+    v128_t x = wasm_v128_load(src);
+    x = wasm_i8x16_shuffle(x, x, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3,
+                           2, 1, 0);
+    out -= 16;
+    wasm_v128_store(out, x);
+    src += 16;
+    n -= 16;
+  }
+#endif
+  while (n-- > 0)
+    *--out = *src++;
+}
+
+size_t idris2_simd_ascii_prefix(const char *s, size_t n) {
+  size_t i = 0;
+#ifdef __wasm_simd128__
+  for (; i + 16 <= n; i += 16) {
+    uint32_t high = wasm_i8x16_bitmask(wasm_v128_load(s + i));
+    if (high)
+      return i + __builtin_ctz(high);
+  }
+#else
+  for (; i + 8 <= n; i += 8) {
+    uint64_t w;
+    memcpy(&w, s + i, 8);
+    if (w & 0x8080808080808080ULL)
+      break;
+  }
+#endif
+  while (i < n && !((unsigned char)s[i] & 0x80))
+    i++;
+  return i;
+}
+
+int idris2_simd_utf8_valid(const char *s, size_t n) {
+  const unsigned char *p = (const unsigned char *)s;
+  size_t i = 0;
+  while (i < n) {
+    i += idris2_simd_ascii_prefix((const char *)p + i, n - i);
+    if (i >= n)
+      break;
+    unsigned char c = p[i];
+    size_t len;
+    uint32_t cp;
+    if (c >= 0xC2 && c <= 0xDF) {
+      len = 2;
+      cp = c & 0x1F;
+    } else if (c >= 0xE0 && c <= 0xEF) {
+      len = 3;
+      cp = c & 0x0F;
+    } else if (c >= 0xF0 && c <= 0xF4) {
+      len = 4;
+      cp = c & 0x07;
+    } else {
+      return 0;
+    }
+    if (n - i < len)
+      return 0;
+    for (size_t k = 1; k < len; k++) {
+      if ((p[i + k] & 0xC0) != 0x80)
+        return 0;
+      cp = (cp << 6) | (p[i + k] & 0x3F);
+    }
+    // Reject overlong encodings, surrogates and values above U+10FFFF.
+    if ((len == 3 && cp < 0x800) || (len == 4 && cp < 0x10000) ||
+        (cp >= 0xD800 && cp <= 0xDFFF) || cp > 0x10FFFF)
+      return 0;
+    i += len;
+  }
+  return 1;
+}
+
+const char *idris2_simd_memchr(const char *s, int c, size_t n) {
+#ifdef __wasm_simd128__
+  const v128_t needle = wasm_i8x16_splat((int8_t)c);
+  while (n >= 16) {
+    uint32_t hit =
+        wasm_i8x16_bitmask(wasm_i8x16_eq(wasm_v128_load(s), needle));
+    if (hit)
+      return s + __builtin_ctz(hit);
+    s += 16;
+    n -= 16;
+  }
+  for (; n > 0; n--, s++)
+    if (*s == (char)c)
+      return s;
+  return NULL;
+#else
+  return memchr(s, c, n);
+#endif
+}
+
+const char *idris2_simd_memmem(const char *hay, size_t n, const char *needle,
+                               size_t m) {
+  if (m == 0)
+    return hay;
+  if (m > n)
+    return NULL;
+  if (m == 1)
+    return idris2_simd_memchr(hay, needle[0], n);
+  size_t last = n - m; // last valid start position
+#ifdef __wasm_simd128__
+  // Candidate starts are lanes where both the first and the last byte of the
+  // needle match; only those are verified with a full compare.
+  const v128_t first = wasm_i8x16_splat(needle[0]);
+  const v128_t final = wasm_i8x16_splat(needle[m - 1]);
+  size_t i = 0;
+  for (; i + 16 <= last + 1; i += 16) {
+    v128_t a = wasm_i8x16_eq(wasm_v128_load(hay + i), first);
+    v128_t b = wasm_i8x16_eq(wasm_v128_load(hay + i + m - 1), final);
+    uint32_t cand = wasm_i8x16_bitmask(wasm_v128_and(a, b));
+    while (cand) {
+      unsigned k = __builtin_ctz(cand);
+      if (idris2_simd_memeq(hay + i + k + 1, needle + 1, m - 2))
+        return hay + i + k;
+      cand &= cand - 1;
+    }
+  }
+  for (; i <= last; i++)
+    if (hay[i] == needle[0] && hay[i + m - 1] == needle[m - 1] &&
+        idris2_simd_memeq(hay + i + 1, needle + 1, m - 2))
+      return hay + i;
+  return NULL;
+#else
+  const char *p = hay;
+  const char *end = hay + last;
+  while (p <= end) {
+    p = memchr(p, needle[0], (size_t)(end - p) + 1);
+    if (!p)
+      return NULL;
+    if (p[m - 1] == needle[m - 1] && memcmp(p + 1, needle + 1, m - 2) == 0)
+      return p;
+    p++;
+  }
+  return NULL;
+#endif
+}
+
+void idris2_simd_fill(void *dst, uint8_t byte, size_t n) {
+#if defined(__wasm_bulk_memory__)
+  // Lowers to a single memory.fill.
+  __builtin_memset(dst, byte, n);
+#elif defined(__wasm_simd128__)
+  unsigned char *p = dst;
+  const v128_t v = wasm_i8x16_splat(byte);
+  for (; n >= 16; n -= 16, p += 16)
+    wasm_v128_store(p, v);
+  while (n-- > 0)
+    *p++ = byte;
+#else
+  memset(dst, byte, n);
+#endif
+}
+
+void idris2_simd_copy(void *dst, const void *src, size_t n) {
+#if defined(__wasm_bulk_memory__)
+  // Lowers to a single memory.copy.
+  __builtin_memcpy(dst, src, n);
+#elif defined(__wasm_simd128__)
+  unsigned char *p = dst;
+  const unsigned char *q = src;
+  for (; n >= 16; n -= 16, p += 16, q += 16)
+    wasm_v128_store(p, wasm_v128_load(q));
+  while (n-- > 0)
+    *p++ = *q++;
+#else
+  memcpy(dst, src, n);
+#endif
+}
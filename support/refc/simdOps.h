@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Byte-string kernels used by the string and buffer primitives.
+ *
+ * When compiled with `-msimd128` (`idris2-wasm build --simd`) these use Wasm
+ * SIMD128 and process 16 bytes per step. Otherwise they fall back to scalar
+ * code (word-at-a-time where that helps, libc elsewhere). The header is
+ * self-contained so that the IC0 support files can use it as well.
+ */
+
+// Non-zero if the first `n` bytes of `a` and `b` are equal.
+int idris2_simd_memeq(const void *a, const void *b, size_t n);
+// Same contract as strcmp(3).
+int idris2_simd_strcmp(const char *a, const char *b);
+// Writes the `n` bytes of `src` to `dst` in reverse order. No overlap.
+void idris2_simd_reverse(char *dst, const char *src, size_t n);
+// Length of the longest prefix of `s` consisting of ASCII bytes only.
+size_t idris2_simd_ascii_prefix(const char *s, size_t n);
+// Non-zero if the `n` bytes at `s` are well-formed UTF-8.
+int idris2_simd_utf8_valid(const char *s, size_t n);
+// Same contract as memchr(3).
+const char *idris2_simd_memchr(const char *s, int c, size_t n);
+// First occurrence of `needle` (length `m`) in `hay` (length `n`), or NULL.
+const char *idris2_simd_memmem(const char *hay, size_t n, const char *needle,
+                               size_t m);
+void idris2_simd_fill(void *dst, uint8_t byte, size_t n);
+void idris2_simd_copy(void *dst, const void *src, size_t n);
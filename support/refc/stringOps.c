@@ -1,72 +1,286 @@
 #include "stringOps.h"
 #include "refc_util.h"
 
+/* UTF-8 helpers
+ *
+ * Strings are UTF-8. Ill-formed sequences are never rejected: each offending
+ * byte is treated as one character (decoding to U+FFFD), so lengths, indexing
+ * and decoding always agree with each other. */
+
+// Bytes taken by the character starting at `p` (never more than `end - p`).
+static size_t utf8Step(const unsigned char *p, const unsigned char *end) {
+  unsigned char c = *p;
+  size_t n;
+  if (c < 0x80)
+    return 1;
+  else if (c >= 0xC2 && c <= 0xDF)
+    n = 2;
+  else if (c >= 0xE0 && c <= 0xEF)
+    n = 3;
+  else if (c >= 0xF0 && c <= 0xF4)
+    n = 4;
+  else
+    return 1;
+  if ((size_t)(end - p) < n)
+    return 1;
+  for (size_t k = 1; k < n; k++)
+    if ((p[k] & 0xC0) != 0x80)
+      return 1;
+  return n;
+}
+
+uint32_t idris2_utf8Decode(const char *str, size_t *advance) {
+  const unsigned char *p = (const unsigned char *)str;
+  unsigned char c = p[0];
+  if (c < 0x80) {
+    if (advance)
+      *advance = c ? 1 : 0;
+    return c;
+  }
+  // The string is NUL-terminated, and NUL is never a continuation byte, so
+  // utf8Step cannot run past the end with a 4-byte bound.
+  size_t n = utf8Step(p, p + 4);
+  if (advance)
+    *advance = n;
+  switch (n) {
+  case 2:
+    return ((uint32_t)(c & 0x1F) << 6) | (p[1] & 0x3F);
+  case 3:
+    return ((uint32_t)(c & 0x0F) << 12) | ((uint32_t)(p[1] & 0x3F) << 6) |
+           (p[2] & 0x3F);
+  case 4:
+    return ((uint32_t)(c & 0x07) << 18) | ((uint32_t)(p[1] & 0x3F) << 12) |
+           ((uint32_t)(p[2] & 0x3F) << 6) | (p[3] & 0x3F);
+  default:
+    return 0xFFFD;
+  }
+}
+
+size_t idris2_utf8Width(uint32_t c) {
+  if (c < 0x80)
+    return 1;
+  if (c < 0x800)
+    return 2;
+  if (c < 0x10000)
+    return 3;
+  if (c <= 0x10FFFF)
+    return 4;
+  return 3; // encoded as U+FFFD
+}
+
+size_t idris2_utf8Encode(char *dst, uint32_t c) {
+  unsigned char *d = (unsigned char *)dst;
+  if (c > 0x10FFFF)
+    c = 0xFFFD;
+  if (c < 0x80) {
+    d[0] = c;
+    return 1;
+  } else if (c < 0x800) {
+    d[0] = 0xC0 | (c >> 6);
+    d[1] = 0x80 | (c & 0x3F);
+    return 2;
+  } else if (c < 0x10000) {
+    d[0] = 0xE0 | (c >> 12);
+    d[1] = 0x80 | ((c >> 6) & 0x3F);
+    d[2] = 0x80 | (c & 0x3F);
+    return 3;
+  }
+  d[0] = 0xF0 | (c >> 18);
+  d[1] = 0x80 | ((c >> 12) & 0x3F);
+  d[2] = 0x80 | ((c >> 6) & 0x3F);
+  d[3] = 0x80 | (c & 0x3F);
+  return 4;
+}
+
+/* Per-string metadata: byte length, character count and an ASCII flag are
+ * computed once and cached on the Value_String (see _datatypes.h). */
+
+typedef struct {
+  size_t bytes;
+  size_t chars;
+  int ascii;
+} StrInfo;
+
+static size_t countChars(const char *str, size_t bytes, int *ascii) {
+  const unsigned char *p = (const unsigned char *)str;
+  const unsigned char *end = p + bytes;
+  size_t prefix = idris2_simd_ascii_prefix(str, bytes);
+  size_t chars = prefix;
+  *ascii = prefix == bytes;
+  for (p += prefix; p < end; chars++)
+    p += utf8Step(p, end);
+  return chars;
+}
+
+static void setStrInfo(Value_String *s, size_t bytes, size_t chars,
+                       int ascii) {
+  if (s->header.refCounter == IDRIS2_VP_REFCOUNTER_MAX || bytes > UINT32_MAX)
+    return;
+  s->byteLen = bytes;
+  s->charLen = chars;
+  s->index = NULL;
+  s->header.reserved =
+      IDRIS2_STR_META | (ascii ? IDRIS2_STR_ASCII : 0);
+}
+
+static StrInfo strInfo(Value_String *s) {
+  StrInfo info;
+  if (s->header.reserved & IDRIS2_STR_META) {
+    info.bytes = s->byteLen;
+    info.chars = s->charLen;
+    info.ascii = (s->header.reserved & IDRIS2_STR_ASCII) != 0;
+    return info;
+  }
+  info.bytes = strlen(s->str);
+  info.chars = countChars(s->str, info.bytes, &info.ascii);
+  setStrInfo(s, info.bytes, info.chars, info.ascii);
+  return info;
+}
+
+size_t idris2_strByteLength(Value *str) {
+  return strInfo((Value_String *)str).bytes;
+}
+
+size_t idris2_strCharLength(Value *str) {
+  return strInfo((Value_String *)str).chars;
+}
+
+size_t idris2_strByteOffset(Value *str, size_t charIdx) {
+  Value_String *s = (Value_String *)str;
+  StrInfo info = strInfo(s);
+  if (charIdx >= info.chars)
+    return info.bytes;
+  if (info.ascii)
+    return charIdx;
+
+  const unsigned char *base = (const unsigned char *)s->str;
+  const unsigned char *end = base + info.bytes;
+  const unsigned char *p = base;
+  size_t left = charIdx;
+
+  if (info.chars > IDRIS2_STR_INDEX_STRIDE &&
+      (s->header.reserved & IDRIS2_STR_META)) {
+    if (!s->index) {
+      size_t n = (info.chars - 1) / IDRIS2_STR_INDEX_STRIDE + 1;
+      uint32_t *index = malloc(n * sizeof(uint32_t));
+      if (index) {
+        const unsigned char *q = base;
+        for (size_t c = 0; c < info.chars; c++) {
+          if (c % IDRIS2_STR_INDEX_STRIDE == 0)
+            index[c / IDRIS2_STR_INDEX_STRIDE] = (uint32_t)(q - base);
+          q += utf8Step(q, end);
+        }
+        s->index = index;
+      }
+    }
+    if (s->index) {
+      p = base + s->index[charIdx / IDRIS2_STR_INDEX_STRIDE];
+      left = charIdx % IDRIS2_STR_INDEX_STRIDE;
+    }
+  }
+  for (; left > 0; left--)
+    p += utf8Step(p, end);
+  return (size_t)(p - base);
+}
+
+/* String primitives (character based) */
+
 Value *tail(Value *input) {
-  Value_String *tailStr = IDRIS2_NEW_VALUE(Value_String);
-  tailStr->header.tag = STRING_TAG;
   Value_String *s = (Value_String *)input;
-  int l = strlen(s->str);
-  if (l == 0)
+  StrInfo info = strInfo(s);
+  if (info.bytes == 0)
     return (Value *)&idris2_predefined_nullstring;
 
-  tailStr->str = malloc(l);
-  IDRIS2_REFC_VERIFY(tailStr->str, "malloc failed");
-  memset(tailStr->str, 0, l);
-  memcpy(tailStr->str, s->str + 1, l - 1);
+  size_t skip = info.ascii ? 1
+                           : utf8Step((const unsigned char *)s->str,
+                                      (const unsigned char *)s->str + info.bytes);
+  size_t l = info.bytes - skip;
+  Value_String *tailStr = idris2_mkEmptyStringUninit(l + 1);
+  memcpy(tailStr->str, s->str + skip, l);
+  if (l > 0)
+    setStrInfo(tailStr, l, info.chars - 1, info.ascii);
   return (Value *)tailStr;
 }
 
 Value *reverse(Value *str) {
-  Value_String *retVal = IDRIS2_NEW_VALUE(Value_String);
-  retVal->header.tag = STRING_TAG;
   Value_String *input = (Value_String *)str;
-  int l = strlen(input->str);
-  retVal->str = malloc(l + 1);
-  IDRIS2_REFC_VERIFY(retVal->str, "malloc failed");
-  memset(retVal->str, 0, l + 1);
-  char *p = retVal->str;
-  char *q = input->str + (l - 1);
-  for (int i = 0; i < l; i++) {
-    *p++ = *q--;
+  StrInfo info = strInfo(input);
+  Value_String *retVal = idris2_mkEmptyStringUninit(info.bytes + 1);
+  if (info.bytes == 0)
+    return (Value *)retVal;
+
+  if (info.ascii) {
+    idris2_simd_reverse(retVal->str, input->str, info.bytes);
+  } else {
+    // Characters go in reverse order; the bytes of each keep their order.
+    const unsigned char *p = (const unsigned char *)input->str;
+    const unsigned char *end = p + info.bytes;
+    char *out = retVal->str + info.bytes;
+    while (p < end) {
+      size_t n = utf8Step(p, end);
+      out -= n;
+      memcpy(out, p, n);
+      p += n;
+    }
   }
+  setStrInfo(retVal, info.bytes, info.chars, info.ascii);
   return (Value *)retVal;
 }
 
 Value *strIndex(Value *str, Value *i) {
-  char *s = ((Value_String *)str)->str;
-  int idx = idris2_vp_to_Int64(i);
-  return (Value *)idris2_mkChar(s[idx]);
+  Value_String *s = (Value_String *)str;
+  size_t idx = (size_t)idris2_vp_to_Int64(i);
+  return (Value *)idris2_mkChar(
+      idris2_utf8Decode(s->str + idris2_strByteOffset(str, idx), NULL));
 }
 
 Value *strCons(Value *c, Value *str) {
-  int l = strlen(((Value_String *)str)->str);
-  Value_String *retVal = idris2_mkEmptyString(l + 2);
-  retVal->str[0] = idris2_vp_to_Char(c);
-  memcpy(retVal->str + 1, ((Value_String *)str)->str, l);
+  Value_String *s = (Value_String *)str;
+  StrInfo info = strInfo(s);
+  uint32_t cp = idris2_vp_to_Char(c);
+  size_t w = idris2_utf8Width(cp);
+  Value_String *retVal = idris2_mkEmptyStringUninit(info.bytes + w + 1);
+  idris2_utf8Encode(retVal->str, cp);
+  memcpy(retVal->str + w, s->str, info.bytes);
+  setStrInfo(retVal, info.bytes + w, info.chars + 1, info.ascii && cp < 0x80);
   return (Value *)retVal;
 }
 
 Value *strAppend(Value *a, Value *b) {
-  int la = strlen(((Value_String *)a)->str);
-  int lb = strlen(((Value_String *)b)->str);
-  Value_String *retVal = idris2_mkEmptyString(la + lb + 1);
-  memcpy(retVal->str, ((Value_String *)a)->str, la);
-  memcpy(retVal->str + la, ((Value_String *)b)->str, lb);
+  Value_String *sa = (Value_String *)a;
+  Value_String *sb = (Value_String *)b;
+  int known = (sa->header.reserved & IDRIS2_STR_META) &&
+              (sb->header.reserved & IDRIS2_STR_META);
+  size_t la = known ? sa->byteLen : strlen(sa->str);
+  size_t lb = known ? sb->byteLen : strlen(sb->str);
+  Value_String *retVal = idris2_mkEmptyStringUninit(la + lb + 1);
+  memcpy(retVal->str, sa->str, la);
+  memcpy(retVal->str + la, sb->str, lb);
+  // Metadata is only carried over when both sides already have it; appending
+  // must not scan strings that nobody asked the length of.
+  if (known && la + lb > 0)
+    setStrInfo(retVal, la + lb, sa->charLen + sb->charLen,
+               (sa->header.reserved & sb->header.reserved & IDRIS2_STR_ASCII) !=
+                   0);
   return (Value *)retVal;
 }
 
 Value *strSubstr(Value *start, Value *len, Value *s) {
-  char *input = ((Value_String *)s)->str;
-  int offset = idris2_vp_to_Int64(start); /* start and len was come from Nat. */
-  int l = idris2_vp_to_Int64(len);
+  /* start and len was come from Nat. */
+  size_t offset = (size_t)idris2_vp_to_Int64(start);
+  size_t l = (size_t)idris2_vp_to_Int64(len);
+  StrInfo info = strInfo((Value_String *)s);
 
-  int tailLen = strlen(input) - offset;
-  if (tailLen < l) {
-    l = tailLen;
-  }
+  if (offset >= info.chars || l == 0)
+    return (Value *)&idris2_predefined_nullstring;
+  if (l > info.chars - offset)
+    l = info.chars - offset;
 
-  Value_String *retVal = idris2_mkEmptyString(l + 1);
-  memcpy(retVal->str, input + offset, l);
+  size_t from = idris2_strByteOffset(s, offset);
+  size_t to = idris2_strByteOffset(s, offset + l);
+  Value_String *retVal = idris2_mkEmptyStringUninit(to - from + 1);
+  memcpy(retVal->str, ((Value_String *)s)->str + from, to - from);
+  setStrInfo(retVal, to - from, l, info.ascii);
 
   return (Value *)retVal;
 }
@@ -74,20 +288,21 @@ Value *strSubstr(Value *start, Value *len, Value *s) {
 char *fastPack(Value *charList) {
   Value_Constructor *current;
 
-  int l = 0;
+  size_t l = 0;
   current = (Value_Constructor *)charList;
   while (current != NULL) {
-    l++;
+    l += idris2_utf8Width(idris2_vp_to_Char(current->args[0]));
     current = (Value_Constructor *)current->args[1];
   }
 
   char *retVal = malloc(l + 1);
+  IDRIS2_REFC_VERIFY(retVal, "malloc failed");
   retVal[l] = 0;
 
-  int i = 0;
+  size_t i = 0;
   current = (Value_Constructor *)charList;
   while (current != NULL) {
-    retVal[i++] = idris2_vp_to_Char(current->args[0]);
+    i += idris2_utf8Encode(retVal + i, idris2_vp_to_Char(current->args[0]));
     current = (Value_Constructor *)current->args[1];
   }
 
@@ -99,18 +314,19 @@ Value *fastUnpack(char *str) {
     return NULL;
   }
 
+  size_t n;
   Value_Constructor *retVal = idris2_newConstructor(2, 1);
-  retVal->args[0] = idris2_mkChar(str[0]);
+  retVal->args[0] = idris2_mkChar(idris2_utf8Decode(str, &n));
 
-  int i = 1;
+  size_t i = n;
   Value_Constructor *current = (Value_Constructor *)retVal;
   Value_Constructor *next;
   while (str[i] != '\0') {
     next = idris2_newConstructor(2, 1);
-    next->args[0] = idris2_mkChar(str[i]);
+    next->args[0] = idris2_mkChar(idris2_utf8Decode(str + i, &n));
     current->args[1] = (Value *)next;
 
-    i++;
+    i += n;
     current = next;
   }
   current->args[1] = NULL;
@@ -118,6 +334,42 @@ Value *fastUnpack(char *str) {
   return (Value *)retVal;
 }
 
+Value *idris2_getBufferBytes(void *buffer, int loc, int len) {
+  idris2_checkBufferRange(buffer, loc, len);
+  const uint8_t *data = (const uint8_t *)((Buffer *)buffer)->data + loc;
+  Value *retVal = NULL;
+  // built back to front so each cell is written once
+  for (int i = len; i-- > 0;) {
+    Value_Constructor *cell = idris2_newConstructor(2, 1);
+    cell->args[0] = idris2_mkBits8(data[i]);
+    cell->args[1] = retVal;
+    retVal = (Value *)cell;
+  }
+  return retVal;
+}
+
+void idris2_setBufferBytes(void *buffer, int loc, Value *byteList) {
+  int len = 0;
+  for (Value_Constructor *c = (Value_Constructor *)byteList; c != NULL;
+       c = (Value_Constructor *)c->args[1])
+    len++;
+  idris2_checkBufferRange(buffer, loc, len);
+
+  uint8_t *data = (uint8_t *)((Buffer *)buffer)->data + loc;
+  for (Value_Constructor *c = (Value_Constructor *)byteList; c != NULL;
+       c = (Value_Constructor *)c->args[1])
+    *data++ = idris2_vp_to_Bits8(c->args[0]);
+}
+
+Value *idris2_getBufferStringValue(void *buffer, int loc, int len) {
+  idris2_checkBufferRange(buffer, loc, len);
+  if (len == 0)
+    return (Value *)&idris2_predefined_nullstring;
+  Value_String *retVal = idris2_mkEmptyStringUninit(len + 1);
+  memcpy(retVal->str, ((Buffer *)buffer)->data + loc, len);
+  return (Value *)retVal;
+}
+
 char *fastConcat(Value *strList) {
   Value_Constructor *current;
 
@@ -138,7 +390,7 @@ char *fastConcat(Value *strList) {
   while (current != NULL) {
     currentStr = ((Value_String *)current->args[0])->str;
     currentStrLen = strlen(currentStr);
-    memcpy(retVal + offset, currentStr, currentStrLen);
+    idris2_simd_copy(retVal + offset, currentStr, currentStrLen);
 
     offset += currentStrLen;
     current = (Value_Constructor *)current->args[1];
@@ -147,6 +399,19 @@ char *fastConcat(Value *strList) {
   return retVal;
 }
 
+int64_t idris2_strFind(char *hay, char *needle) {
+  size_t n = strlen(hay);
+  const char *hit = idris2_simd_memmem(hay, n, needle, strlen(needle));
+  if (!hit)
+    return -1;
+  int ascii;
+  return (int64_t)countChars(hay, (size_t)(hit - hay), &ascii);
+}
+
+int64_t idris2_strValidUtf8(char *str) {
+  return idris2_simd_utf8_valid(str, strlen(str));
+}
+
 typedef struct {
   char *str;
   int pos;
@@ -184,12 +449,13 @@ Value *stringIteratorToString(void *a, char *str, Value *it_p,
 //   (str : String) -> (1 it : StringIterator str) -> UnconsResult str
 Value *stringIteratorNext(char *s, Value *it_p) {
   String_Iterator *it = (String_Iterator *)((Value_GCPointer *)it_p)->p->p;
-  char c = it->str[it->pos];
+  size_t n;
+  uint32_t c = idris2_utf8Decode(it->str + it->pos, &n);
 
-  if (c == '\0')
+  if (n == 0)
     return NULL; // EOF [nil]
 
-  it->pos++; // Ok to do this as StringIterator linear
+  it->pos += n; // Ok to do this as StringIterator linear
 
   // Character [cons]
   Value_Constructor *retVal = (Value_Constructor *)idris2_newConstructor(2, 1);
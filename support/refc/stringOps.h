@@ -5,7 +5,7 @@
 
 /* stringLength : String -> Int64!? WTH!. do you have over 4Gbytes text on
  * memory!? */
-#define stringLength(x) (idris2_mkInt64(strlen(((Value_String *)(x))->str)))
+#define stringLength(x) (idris2_mkInt64(idris2_strCharLength(x)))
 #define head(x) (idris2_cast_String_to_Char(x))
 Value *tail(Value *str);
 Value *reverse(Value *str);
@@ -16,6 +16,30 @@ Value *strSubstr(Value *s, Value *start, Value *len);
 char *fastPack(Value *charList);
 Value *fastUnpack(char *str);
 char *fastConcat(Value *strList);
+// Buffer range <-> List Bits8 in one call
+Value *idris2_getBufferBytes(void *buffer, int loc, int len);
+void idris2_setBufferBytes(void *buffer, int loc, Value *byteList);
+// getBufferString building the String value directly (one copy, no strlen)
+Value *idris2_getBufferStringValue(void *buffer, int loc, int len);
+
+// UTF-8 support. Decode returns U+FFFD for ill-formed input and sets
+// `*advance` (if given) to the bytes consumed, 0 at the terminator.
+uint32_t idris2_utf8Decode(const char *str, size_t *advance);
+size_t idris2_utf8Width(uint32_t c);
+size_t idris2_utf8Encode(char *dst, uint32_t c);
+
+// Cached per string after the first call; O(1) afterwards.
+size_t idris2_strByteLength(Value *str);
+size_t idris2_strCharLength(Value *str);
+// Byte offset of character `charIdx` (byte length if out of range). O(1) for
+// ASCII strings, otherwise at most IDRIS2_STR_INDEX_STRIDE steps once the
+// sparse index is built.
+size_t idris2_strByteOffset(Value *str, size_t charIdx);
+
+// Character index of the first occurrence of `needle` in `hay`, or -1.
+int64_t idris2_strFind(char *hay, char *needle);
+// 1 if `str` is well-formed UTF-8, 0 otherwise.
+int64_t idris2_strValidUtf8(char *str);
 
 Value *stringIteratorNew(char *str);
 Value *onCollectStringIterator(Value_Pointer *ptr, void *null);
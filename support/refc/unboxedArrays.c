@@ -0,0 +1,146 @@
+#include "unboxedArrays.h"
+#include "refc_util.h"
+
+static void checkRange(int32_t length, int64_t off, int64_t len) {
+  IDRIS2_REFC_VERIFY(off >= 0 && len >= 0 && off + len <= length,
+                     "array range [%lld, +%lld) outside length %lld",
+                     (long long)off, (long long)len, (long long)length);
+}
+
+/* One set of primitives per element kind. `acc` is the type the folds
+ * accumulate in; integer sums wrap like Int64 addition. */
+#define UNBOXED_PRIMITIVES(name, Struct, TAG, elem, acc)                       \
+  Value *idris2_##name##New(int64_t length) {                                  \
+    IDRIS2_REFC_VERIFY(length >= 0 && length <= INT32_MAX,                     \
+                       "bad array length %lld", (long long)length);            \
+    Struct *a = (Struct *)idris2_newValue(sizeof(Struct) +                     \
+                                          sizeof(elem) * (size_t)length);     \
+    a->header.tag = TAG;                                                       \
+    a->length = (int32_t)length;                                               \
+    memset(a->data, 0, sizeof(elem) * (size_t)length);                        \
+    return (Value *)a;                                                         \
+  }                                                                            \
+                                                                               \
+  int64_t idris2_##name##Length(Value *a) { return ((Struct *)a)->length; }    \
+                                                                               \
+  elem idris2_##name##Get(Value *a, int64_t i) {                               \
+    Struct *arr = (Struct *)a;                                                 \
+    checkRange(arr->length, i, 1);                                             \
+    return arr->data[i];                                                       \
+  }                                                                            \
+                                                                               \
+  void idris2_##name##Set(Value *a, int64_t i, elem x) {                       \
+    Struct *arr = (Struct *)a;                                                 \
+    checkRange(arr->length, i, 1);                                             \
+    arr->data[i] = x;                                                          \
+  }                                                                            \
+                                                                               \
+  void idris2_##name##Fill(Value *a, int64_t off, int64_t len, elem x) {       \
+    Struct *arr = (Struct *)a;                                                 \
+    checkRange(arr->length, off, len);                                         \
+    for (elem *p = arr->data + off, *end = p + len; p < end; p++)              \
+      *p = x;                                                                  \
+  }                                                                            \
+                                                                               \
+  void idris2_##name##Copy(Value *src, int64_t srcOff, Value *dst,             \
+                           int64_t dstOff, int64_t len) {                      \
+    Struct *s = (Struct *)src;                                                 \
+    Struct *d = (Struct *)dst;                                                 \
+    checkRange(s->length, srcOff, len);                                        \
+    checkRange(d->length, dstOff, len);                                        \
+    memmove(d->data + dstOff, s->data + srcOff, sizeof(elem) * (size_t)len);   \
+  }                                                                            \
+                                                                               \
+  Value *idris2_##name##Clone(Value *a) {                                      \
+    Struct *arr = (Struct *)a;                                                 \
+    Value *c = idris2_##name##New(arr->length);                                \
+    memcpy(((Struct *)c)->data, arr->data, sizeof(elem) * arr->length);        \
+    return c;                                                                  \
+  }                                                                            \
+                                                                               \
+  acc idris2_##name##Min(Value *a, int64_t off, int64_t len) {                 \
+    Struct *arr = (Struct *)a;                                                 \
+    checkRange(arr->length, off, len);                                         \
+    if (len == 0)                                                              \
+      return 0;                                                                \
+    elem m = arr->data[off];                                                   \
+    for (int64_t i = off + 1; i < off + len; i++)                              \
+      m = arr->data[i] < m ? arr->data[i] : m;                                 \
+    return m;                                                                  \
+  }                                                                            \
+                                                                               \
+  acc idris2_##name##Max(Value *a, int64_t off, int64_t len) {                 \
+    Struct *arr = (Struct *)a;                                                 \
+    checkRange(arr->length, off, len);                                         \
+    if (len == 0)                                                              \
+      return 0;                                                                \
+    elem m = arr->data[off];                                                   \
+    for (int64_t i = off + 1; i < off + len; i++)                              \
+      m = arr->data[i] > m ? arr->data[i] : m;                                 \
+    return m;                                                                  \
+  }
+
+UNBOXED_PRIMITIVES(intArray, Value_IntArray, INT_ARRAY_TAG, int64_t, int64_t)
+UNBOXED_PRIMITIVES(doubleArray, Value_DoubleArray, DOUBLE_ARRAY_TAG, double,
+                   double)
+UNBOXED_PRIMITIVES(byteArray, Value_ByteArray, BYTE_ARRAY_TAG, uint8_t,
+                   int64_t)
+
+int64_t idris2_intArraySum(Value *a, int64_t off, int64_t len) {
+  Value_IntArray *arr = (Value_IntArray *)a;
+  checkRange(arr->length, off, len);
+  uint64_t s = 0;
+  for (int64_t i = off; i < off + len; i++)
+    s += (uint64_t)arr->data[i];
+  return (int64_t)s;
+}
+
+int64_t idris2_byteArraySum(Value *a, int64_t off, int64_t len) {
+  Value_ByteArray *arr = (Value_ByteArray *)a;
+  checkRange(arr->length, off, len);
+  int64_t s = 0;
+  for (int64_t i = off; i < off + len; i++)
+    s += arr->data[i];
+  return s;
+}
+
+/* Four independent partial sums break the add dependency chain (and let the
+ * compiler use f64x2 lanes); the rounding differs slightly from a strict
+ * left-to-right sum. */
+static double sumDoubles(const double *x, const double *y, int64_t n) {
+  double s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+  int64_t i = 0;
+  if (y) {
+    for (; i + 4 <= n; i += 4) {
+      s0 += x[i] * y[i];
+      s1 += x[i + 1] * y[i + 1];
+      s2 += x[i + 2] * y[i + 2];
+      s3 += x[i + 3] * y[i + 3];
+    }
+    for (; i < n; i++)
+      s0 += x[i] * y[i];
+  } else {
+    for (; i + 4 <= n; i += 4) {
+      s0 += x[i];
+      s1 += x[i + 1];
+      s2 += x[i + 2];
+      s3 += x[i + 3];
+    }
+    for (; i < n; i++)
+      s0 += x[i];
+  }
+  return (s0 + s1) + (s2 + s3);
+}
+
+double idris2_doubleArraySum(Value *a, int64_t off, int64_t len) {
+  Value_DoubleArray *arr = (Value_DoubleArray *)a;
+  checkRange(arr->length, off, len);
+  return sumDoubles(arr->data + off, NULL, len);
+}
+
+double idris2_doubleArrayDot(Value *a, Value *b) {
+  Value_DoubleArray *x = (Value_DoubleArray *)a;
+  Value_DoubleArray *y = (Value_DoubleArray *)b;
+  int64_t n = x->length < y->length ? x->length : y->length;
+  return sumDoubles(x->data, y->data, n);
+}
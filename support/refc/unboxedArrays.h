@@ -0,0 +1,53 @@
+#pragma once
+
+#include "cBackend.h"
+
+/*
+ * Unboxed arrays of Int64, Double and Bits8.
+ *
+ * Elements live inline after the header in one allocation, so an array of n
+ * doubles is 8n bytes rather than n boxed values plus a pointer table, and
+ * the loops below run over contiguous memory. Arrays are mutable like
+ * IOArray / Buffer (WasmBuilder.Runtime.UnboxedArray wraps them in IO).
+ * Indices are range-checked like Buffer accesses; bulk ranges must lie
+ * inside the array.
+ */
+
+Value *idris2_intArrayNew(int64_t length);
+int64_t idris2_intArrayLength(Value *a);
+int64_t idris2_intArrayGet(Value *a, int64_t i);
+void idris2_intArraySet(Value *a, int64_t i, int64_t x);
+void idris2_intArrayFill(Value *a, int64_t off, int64_t len, int64_t x);
+void idris2_intArrayCopy(Value *src, int64_t srcOff, Value *dst,
+                         int64_t dstOff, int64_t len);
+Value *idris2_intArrayClone(Value *a);
+// Folds over [off, off+len); min / max of an empty range is 0
+int64_t idris2_intArraySum(Value *a, int64_t off, int64_t len);
+int64_t idris2_intArrayMin(Value *a, int64_t off, int64_t len);
+int64_t idris2_intArrayMax(Value *a, int64_t off, int64_t len);
+
+Value *idris2_doubleArrayNew(int64_t length);
+int64_t idris2_doubleArrayLength(Value *a);
+double idris2_doubleArrayGet(Value *a, int64_t i);
+void idris2_doubleArraySet(Value *a, int64_t i, double x);
+void idris2_doubleArrayFill(Value *a, int64_t off, int64_t len, double x);
+void idris2_doubleArrayCopy(Value *src, int64_t srcOff, Value *dst,
+                            int64_t dstOff, int64_t len);
+Value *idris2_doubleArrayClone(Value *a);
+double idris2_doubleArraySum(Value *a, int64_t off, int64_t len);
+double idris2_doubleArrayMin(Value *a, int64_t off, int64_t len);
+double idris2_doubleArrayMax(Value *a, int64_t off, int64_t len);
+// Sum of a[i] * b[i] over the shorter of the two arrays
+double idris2_doubleArrayDot(Value *a, Value *b);
+
+Value *idris2_byteArrayNew(int64_t length);
+int64_t idris2_byteArrayLength(Value *a);
+uint8_t idris2_byteArrayGet(Value *a, int64_t i);
+void idris2_byteArraySet(Value *a, int64_t i, uint8_t x);
+void idris2_byteArrayFill(Value *a, int64_t off, int64_t len, uint8_t x);
+void idris2_byteArrayCopy(Value *src, int64_t srcOff, Value *dst,
+                          int64_t dstOff, int64_t len);
+Value *idris2_byteArrayClone(Value *a);
+int64_t idris2_byteArraySum(Value *a, int64_t off, int64_t len);
+int64_t idris2_byteArrayMin(Value *a, int64_t off, int64_t len);
+int64_t idris2_byteArrayMax(Value *a, int64_t off, int64_t len);
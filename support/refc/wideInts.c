@@ -0,0 +1,351 @@
+#include "wideInts.h"
+
+/* Digit-vector arithmetic shared by both widths. `n` is the digit count;
+ * results may alias operands except where noted. A 32-bit digit times a
+ * 32-bit digit is a single i64.mul on wasm32. */
+
+#define WIDE_MAX_DIGITS IDRIS2_BITS256_DIGITS
+
+static Value_Bits128 *newBits128(void) {
+  Value_Bits128 *retVal = IDRIS2_NEW_VALUE(Value_Bits128);
+  retVal->header.tag = BITS128_TAG;
+  return retVal;
+}
+
+static Value_Bits256 *newBits256(void) {
+  Value_Bits256 *retVal = IDRIS2_NEW_VALUE(Value_Bits256);
+  retVal->header.tag = BITS256_TAG;
+  return retVal;
+}
+
+#define DIGITS128(v) (((Value_Bits128 *)(v))->d)
+#define DIGITS256(v) (((Value_Bits256 *)(v))->d)
+
+static int wideLength(const uint32_t *a, int n) {
+  while (n > 0 && a[n - 1] == 0)
+    n--;
+  return n;
+}
+
+static int wideCmp(const uint32_t *a, const uint32_t *b, int n) {
+  while (n-- > 0)
+    if (a[n] != b[n])
+      return a[n] > b[n] ? 1 : -1;
+  return 0;
+}
+
+static void wideAdd(uint32_t *r, const uint32_t *a, const uint32_t *b,
+                    int n) {
+  uint64_t c = 0;
+  for (int i = 0; i < n; i++) {
+    c += (uint64_t)a[i] + b[i];
+    r[i] = (uint32_t)c;
+    c >>= 32;
+  }
+}
+
+static void wideSub(uint32_t *r, const uint32_t *a, const uint32_t *b,
+                    int n) {
+  uint64_t borrow = 0;
+  for (int i = 0; i < n; i++) {
+    uint64_t t = (uint64_t)a[i] - b[i] - borrow;
+    r[i] = (uint32_t)t;
+    borrow = t >> 63;
+  }
+}
+
+// Low n digits of a * b
+static void wideMul(uint32_t *r, const uint32_t *a, const uint32_t *b,
+                    int n) {
+  uint32_t t[WIDE_MAX_DIGITS] = {0};
+  int an = wideLength(a, n);
+  for (int i = 0; i < an; i++) {
+    uint64_t c = 0;
+    for (int j = 0; j < n - i; j++) {
+      c += (uint64_t)a[i] * b[j] + t[i + j];
+      t[i + j] = (uint32_t)c;
+      c >>= 32;
+    }
+  }
+  memcpy(r, t, (size_t)n * sizeof(uint32_t));
+}
+
+// q = a / b, r = a % b (Knuth, TAOCP vol. 2, 4.3.1, algorithm D).
+// q and r must not alias the operands; either may be NULL.
+static void wideDivmod(uint32_t *q, uint32_t *r, const uint32_t *a,
+                       const uint32_t *b, int n) {
+  uint32_t qt[WIDE_MAX_DIGITS] = {0}, rt[WIDE_MAX_DIGITS] = {0};
+  int an = wideLength(a, n), bn = wideLength(b, n);
+  if (bn == 0)
+    __builtin_trap(); // same as Bits64 division by zero on wasm
+
+  if (an < bn) {
+    memcpy(rt, a, (size_t)n * sizeof(uint32_t));
+  } else if (bn == 1) {
+    uint64_t rem = 0;
+    for (int i = an; i-- > 0;) {
+      uint64_t cur = (rem << 32) | a[i];
+      qt[i] = (uint32_t)(cur / b[0]);
+      rem = cur % b[0];
+    }
+    rt[0] = (uint32_t)rem;
+  } else {
+    // Normalize so the divisor's top bit is set
+    uint32_t un[WIDE_MAX_DIGITS + 1], vn[WIDE_MAX_DIGITS];
+    int s = __builtin_clz(b[bn - 1]);
+    for (int i = bn - 1; i > 0; i--)
+      vn[i] = (b[i] << s) | (s ? b[i - 1] >> (32 - s) : 0);
+    vn[0] = b[0] << s;
+    un[an] = s ? a[an - 1] >> (32 - s) : 0;
+    for (int i = an - 1; i > 0; i--)
+      un[i] = (a[i] << s) | (s ? a[i - 1] >> (32 - s) : 0);
+    un[0] = a[0] << s;
+
+    for (int j = an - bn; j >= 0; j--) {
+      uint64_t num = ((uint64_t)un[j + bn] << 32) | un[j + bn - 1];
+      uint64_t qhat = num / vn[bn - 1];
+      uint64_t rhat = num % vn[bn - 1];
+      while (qhat >> 32 ||
+             qhat * vn[bn - 2] > ((rhat << 32) | un[j + bn - 2])) {
+        qhat--;
+        rhat += vn[bn - 1];
+        if (rhat >> 32)
+          break;
+      }
+
+      // un[j .. j+bn] -= qhat * vn
+      uint64_t carry = 0, borrow = 0;
+      for (int i = 0; i < bn; i++) {
+        uint64_t p = qhat * vn[i] + carry;
+        carry = p >> 32;
+        uint64_t t = (uint64_t)un[i + j] - (uint32_t)p - borrow;
+        un[i + j] = (uint32_t)t;
+        borrow = t >> 63;
+      }
+      uint64_t t = (uint64_t)un[j + bn] - carry - borrow;
+      un[j + bn] = (uint32_t)t;
+
+      if (t >> 63) {
+        // qhat was one too large: add the divisor back
+        qhat--;
+        uint64_t c = 0;
+        for (int i = 0; i < bn; i++) {
+          c += (uint64_t)un[i + j] + vn[i];
+          un[i + j] = (uint32_t)c;
+          c >>= 32;
+        }
+        un[j + bn] += (uint32_t)c;
+      }
+      qt[j] = (uint32_t)qhat;
+    }
+
+    for (int i = 0; i < bn; i++)
+      rt[i] = (un[i] >> s) | (s ? un[i + 1] << (32 - s) : 0);
+  }
+
+  if (q)
+    memcpy(q, qt, (size_t)n * sizeof(uint32_t));
+  if (r)
+    memcpy(r, rt, (size_t)n * sizeof(uint32_t));
+}
+
+static void wideDiv(uint32_t *r, const uint32_t *a, const uint32_t *b,
+                    int n) {
+  wideDivmod(r, NULL, a, b, n);
+}
+
+static void wideMod(uint32_t *r, const uint32_t *a, const uint32_t *b,
+                    int n) {
+  wideDivmod(NULL, r, a, b, n);
+}
+
+static void wideAnd(uint32_t *r, const uint32_t *a, const uint32_t *b,
+                    int n) {
+  for (int i = 0; i < n; i++)
+    r[i] = a[i] & b[i];
+}
+
+static void wideOr(uint32_t *r, const uint32_t *a, const uint32_t *b,
+                   int n) {
+  for (int i = 0; i < n; i++)
+    r[i] = a[i] | b[i];
+}
+
+static void wideXor(uint32_t *r, const uint32_t *a, const uint32_t *b,
+                    int n) {
+  for (int i = 0; i < n; i++)
+    r[i] = a[i] ^ b[i];
+}
+
+// r = a << s; r must not alias a
+static void wideShiftl(uint32_t *r, const uint32_t *a, int64_t s, int n) {
+  int64_t ws = s / 32;
+  int bs = (int)(s % 32);
+  for (int i = 0; i < n; i++) {
+    int64_t k = i - ws;
+    uint32_t lo = k >= 0 && k < n ? a[k] << bs : 0;
+    uint32_t carry = bs && k >= 1 && k <= n ? a[k - 1] >> (32 - bs) : 0;
+    r[i] = lo | carry;
+  }
+}
+
+// r = a >> s; r must not alias a
+static void wideShiftr(uint32_t *r, const uint32_t *a, int64_t s, int n) {
+  int64_t ws = s / 32;
+  int bs = (int)(s % 32);
+  for (int i = 0; i < n; i++) {
+    int64_t k = i + ws;
+    uint32_t hi = k < n ? a[k] >> bs : 0;
+    uint32_t carry = bs && k + 1 < n ? a[k + 1] << (32 - bs) : 0;
+    r[i] = hi | carry;
+  }
+}
+
+// Decimal digits of a into buf (at least 80 bytes), returns the length
+static size_t wideFormat(char *buf, const uint32_t *a, int n) {
+  uint32_t t[WIDE_MAX_DIGITS];
+  uint32_t chunks[9]; // 10^9-chunks, 2^256 < 10^81
+  int nchunks = 0;
+  memcpy(t, a, (size_t)n * sizeof(uint32_t));
+  for (int len = wideLength(t, n); len > 0; len = wideLength(t, len)) {
+    uint64_t rem = 0;
+    for (int i = len; i-- > 0;) {
+      uint64_t cur = (rem << 32) | t[i];
+      t[i] = (uint32_t)(cur / 1000000000u);
+      rem = cur % 1000000000u;
+    }
+    chunks[nchunks++] = (uint32_t)rem;
+  }
+  if (nchunks == 0)
+    return idris2_formatUInt64(buf, 0);
+
+  size_t l = idris2_formatUInt64(buf, chunks[nchunks - 1]);
+  for (int c = nchunks - 1; c-- > 0;) {
+    uint32_t v = chunks[c];
+    for (int k = 8; k >= 0; k--) {
+      buf[l + k] = (char)('0' + v % 10);
+      v /= 10;
+    }
+    l += 9;
+  }
+  buf[l] = '\0';
+  return l;
+}
+
+static void wideFromWords(uint32_t *r, const uint64_t *w, int n) {
+  for (int i = 0; i < n; i += 2) {
+    r[i] = (uint32_t)w[i / 2];
+    r[i + 1] = (uint32_t)(w[i / 2] >> 32);
+  }
+}
+
+static uint64_t wideWord(const uint32_t *a, int64_t i, int n) {
+  if (i < 0 || 2 * i >= n)
+    return 0;
+  return (uint64_t)a[2 * i] | ((uint64_t)a[2 * i + 1] << 32);
+}
+
+static void wideLoad(uint32_t *r, const uint8_t *p, int n) {
+  for (int i = 0; i < n; i++, p += 4)
+    r[i] = (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) |
+           ((uint32_t)p[3] << 24);
+}
+
+static void wideStore(uint8_t *p, const uint32_t *a, int n) {
+  for (int i = 0; i < n; i++, p += 4) {
+    p[0] = (uint8_t)a[i];
+    p[1] = (uint8_t)(a[i] >> 8);
+    p[2] = (uint8_t)(a[i] >> 16);
+    p[3] = (uint8_t)(a[i] >> 24);
+  }
+}
+
+/* Construction and ic0 buffers */
+
+Value *idris2_mkBits128(uint64_t hi, uint64_t lo) {
+  Value_Bits128 *retVal = newBits128();
+  uint64_t w[2] = {lo, hi};
+  wideFromWords(retVal->d, w, IDRIS2_BITS128_DIGITS);
+  return (Value *)retVal;
+}
+
+Value *idris2_mkBits256(uint64_t w3, uint64_t w2, uint64_t w1, uint64_t w0) {
+  Value_Bits256 *retVal = newBits256();
+  uint64_t w[4] = {w0, w1, w2, w3};
+  wideFromWords(retVal->d, w, IDRIS2_BITS256_DIGITS);
+  return (Value *)retVal;
+}
+
+uint64_t idris2_word_Bits128(Value *x, int64_t i) {
+  return wideWord(DIGITS128(x), i, IDRIS2_BITS128_DIGITS);
+}
+
+uint64_t idris2_word_Bits256(Value *x, int64_t i) {
+  return wideWord(DIGITS256(x), i, IDRIS2_BITS256_DIGITS);
+}
+
+Value *idris2_load_Bits128(const void *src) {
+  Value_Bits128 *retVal = newBits128();
+  wideLoad(retVal->d, src, IDRIS2_BITS128_DIGITS);
+  return (Value *)retVal;
+}
+
+Value *idris2_load_Bits256(const void *src) {
+  Value_Bits256 *retVal = newBits256();
+  wideLoad(retVal->d, src, IDRIS2_BITS256_DIGITS);
+  return (Value *)retVal;
+}
+
+void idris2_store_Bits128(Value *x, void *dst) {
+  wideStore(dst, DIGITS128(x), IDRIS2_BITS128_DIGITS);
+}
+
+void idris2_store_Bits256(Value *x, void *dst) {
+  wideStore(dst, DIGITS256(x), IDRIS2_BITS256_DIGITS);
+}
+
+/* Primitives, stamped out for both widths */
+
+#define WIDE_BINOP(name, op, bits)                                             \
+  Value *idris2_##name##_Bits##bits(Value *x, Value *y) {                      \
+    Value_Bits##bits *retVal = newBits##bits();                                \
+    op(retVal->d, DIGITS##bits(x), DIGITS##bits(y),                            \
+       IDRIS2_BITS##bits##_DIGITS);                                            \
+    return (Value *)retVal;                                                    \
+  }
+
+#define WIDE_SHIFT(name, op, bits)                                             \
+  Value *idris2_##name##_Bits##bits(Value *x, int64_t n) {                     \
+    Value_Bits##bits *retVal = newBits##bits();                                \
+    op(retVal->d, DIGITS##bits(x), n < 0 ? 0 : n,                              \
+       IDRIS2_BITS##bits##_DIGITS);                                            \
+    return (Value *)retVal;                                                    \
+  }
+
+#define WIDE_PRIMITIVES(bits)                                                  \
+  WIDE_BINOP(add, wideAdd, bits)                                               \
+  WIDE_BINOP(sub, wideSub, bits)                                               \
+  WIDE_BINOP(mul, wideMul, bits)                                               \
+  WIDE_BINOP(div, wideDiv, bits)                                               \
+  WIDE_BINOP(mod, wideMod, bits)                                               \
+  WIDE_BINOP(and, wideAnd, bits)                                               \
+  WIDE_BINOP(or, wideOr, bits)                                                 \
+  WIDE_BINOP(xor, wideXor, bits)                                               \
+  WIDE_SHIFT(shiftl, wideShiftl, bits)                                         \
+  WIDE_SHIFT(shiftr, wideShiftr, bits)                                         \
+                                                                               \
+  int64_t idris2_cmp_Bits##bits(Value *x, Value *y) {                          \
+    return wideCmp(DIGITS##bits(x), DIGITS##bits(y),                           \
+                   IDRIS2_BITS##bits##_DIGITS);                                \
+  }                                                                            \
+                                                                               \
+  Value *idris2_cast_Bits##bits##_to_string(Value *x) {                        \
+    char buf[80];                                                              \
+    size_t l = wideFormat(buf, DIGITS##bits(x), IDRIS2_BITS##bits##_DIGITS);   \
+    Value_String *retVal = idris2_mkEmptyStringUninit(l + 1);                  \
+    memcpy(retVal->str, buf, l);                                               \
+    return (Value *)retVal;                                                    \
+  }
+
+WIDE_PRIMITIVES(128)
+WIDE_PRIMITIVES(256)
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "cBackend.h"
+
+/*
+ * Bits128 / Bits256: fixed-width naturals for cycles and token amounts.
+ *
+ * Arithmetic wraps modulo 2^128 / 2^256 like the other BitsN types, and
+ * division by zero traps like Bits64 division does on wasm. Values cross the
+ * FFI as `Value *` (external Idris types, see WasmBuilder.Runtime.WideInt).
+ * Word / byte order is little-endian, matching the ic0 *128 buffers.
+ */
+
+Value *idris2_mkBits128(uint64_t hi, uint64_t lo);
+Value *idris2_mkBits256(uint64_t w3, uint64_t w2, uint64_t w1, uint64_t w0);
+// 64-bit word `i` (0 = least significant); 0 when out of range
+uint64_t idris2_word_Bits128(Value *x, int64_t i);
+uint64_t idris2_word_Bits256(Value *x, int64_t i);
+
+// ic0 buffers: 16 / 32 little-endian bytes at `src` / `dst`
+Value *idris2_load_Bits128(const void *src);
+Value *idris2_load_Bits256(const void *src);
+void idris2_store_Bits128(Value *x, void *dst);
+void idris2_store_Bits256(Value *x, void *dst);
+
+Value *idris2_add_Bits128(Value *x, Value *y);
+Value *idris2_sub_Bits128(Value *x, Value *y);
+Value *idris2_mul_Bits128(Value *x, Value *y);
+Value *idris2_div_Bits128(Value *x, Value *y);
+Value *idris2_mod_Bits128(Value *x, Value *y);
+Value *idris2_and_Bits128(Value *x, Value *y);
+Value *idris2_or_Bits128(Value *x, Value *y);
+Value *idris2_xor_Bits128(Value *x, Value *y);
+Value *idris2_shiftl_Bits128(Value *x, int64_t n);
+Value *idris2_shiftr_Bits128(Value *x, int64_t n);
+// -1, 0 or 1
+int64_t idris2_cmp_Bits128(Value *x, Value *y);
+Value *idris2_cast_Bits128_to_string(Value *x);
+
+Value *idris2_add_Bits256(Value *x, Value *y);
+Value *idris2_sub_Bits256(Value *x, Value *y);
+Value *idris2_mul_Bits256(Value *x, Value *y);
+Value *idris2_div_Bits256(Value *x, Value *y);
+Value *idris2_mod_Bits256(Value *x, Value *y);
+Value *idris2_and_Bits256(Value *x, Value *y);
+Value *idris2_or_Bits256(Value *x, Value *y);
+Value *idris2_xor_Bits256(Value *x, Value *y);
+Value *idris2_shiftl_Bits256(Value *x, int64_t n);
+Value *idris2_shiftr_Bits256(Value *x, int64_t n);
+int64_t idris2_cmp_Bits256(Value *x, Value *y);
+Value *idris2_cast_Bits256_to_string(Value *x);
@@ -0,0 +1,22 @@
+/*
+ * Minimal assertions for the host tests: a failed check is reported with its
+ * location and the test carries on, exiting non-zero at the end.
+ */
+#pragma once
+
+#include <stdio.h>
+
+static int checkFailures = 0;
+
+#define CHECK(cond)                                                            \
+  do {                                                                         \
+    if (!(cond)) {                                                             \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+      checkFailures++;                                                         \
+    }                                                                          \
+  } while (0)
+
+static int checkDone(const char *name) {
+  printf("%s: %s\n", name, checkFailures ? "FAILED" : "ok");
+  return checkFailures != 0;
+}
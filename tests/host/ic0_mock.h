@@ -0,0 +1,78 @@
+/*
+ * The ic0 system calls the stable memory code imports (ic_stable.c,
+ * ic_stkv.c, ic_stable_structs.c), served from a heap array standing in for
+ * stable memory. Tests include the sources they exercise after this header,
+ * so they can also drop the sources' heap state to simulate an upgrade.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MOCK_WASM_PAGE 65536u
+#define MOCK_MAX_PAGES 8192u  /* 512 MiB, unless a test lowers mockMaxPages */
+
+static uint8_t* mockStable = NULL;
+static uint64_t mockPages = 0;
+static uint64_t mockMaxPages = MOCK_MAX_PAGES;
+static uint64_t mockCalls = 0;
+
+static void mockCheck(uint64_t offset, uint64_t size) {
+    if (offset + size < offset || offset + size > mockPages * MOCK_WASM_PAGE) {
+        fprintf(stderr, "stable access out of bounds: %llu + %llu\n",
+                (unsigned long long)offset, (unsigned long long)size);
+        abort();
+    }
+}
+
+uint64_t ic0_stable64_size_impl(void) {
+    return mockPages;
+}
+
+uint64_t ic0_stable64_grow_impl(uint64_t pages) {
+    if (pages > mockMaxPages - mockPages) {
+        return UINT64_MAX;
+    }
+    uint64_t old = mockPages;
+    mockStable = realloc(mockStable, (old + pages) * MOCK_WASM_PAGE);
+    if (mockStable == NULL) {
+        abort();
+    }
+    memset(mockStable + old * MOCK_WASM_PAGE, 0, pages * MOCK_WASM_PAGE);
+    mockPages = old + pages;
+    return old;
+}
+
+void ic0_stable64_read_impl(uint64_t dst, uint64_t offset, uint64_t size) {
+    mockCheck(offset, size);
+    mockCalls++;
+    memcpy((void*)(uintptr_t)dst, mockStable + offset, size);
+}
+
+void ic0_stable64_write_impl(uint64_t offset, uint64_t src, uint64_t size) {
+    mockCheck(offset, size);
+    mockCalls++;
+    memcpy(mockStable + offset, (const void*)(uintptr_t)src, size);
+}
+
+/* The message is a Wasm address, which a 64-bit host cannot follow */
+void ic0_trap(int32_t src, int32_t size) {
+    (void)src;
+    (void)size;
+    fprintf(stderr, "ic0.trap\n");
+    abort();
+}
+
+uint64_t ic0_performance_counter(int32_t type) {
+    (void)type;
+    return mockCalls;
+}
+
+/* Throw stable memory away, as for a fresh canister */
+static void mockStableErase(void) {
+    free(mockStable);
+    mockStable = NULL;
+    mockPages = 0;
+}
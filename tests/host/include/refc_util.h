@@ -0,0 +1,19 @@
+/*
+ * refc_util.h for the host tests
+ *
+ * The RefC runtime takes this header from the Idris2 installation (it is not
+ * part of support/refc); the tests only need its check macro.
+ */
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define IDRIS2_REFC_VERIFY(cond, ...)                                          \
+  do {                                                                         \
+    if (!(cond)) {                                                             \
+      fprintf(stderr, __VA_ARGS__);                                            \
+      fputc('\n', stderr);                                                     \
+      abort();                                                                 \
+    }                                                                          \
+  } while (0)
@@ -0,0 +1,53 @@
+#!/bin/bash
+# Host tests for the C support code: build each test natively against the
+# vendored sources and run it.
+#
+#   tests/host/run.sh                 # all tests
+#   tests/host/run.sh test_arrays     # one test
+#   SANITIZE=1 tests/host/run.sh      # with AddressSanitizer / UBSan
+#
+# Needs a C compiler and GMP headers/library (the RefC runtime's Integer
+# uses the mpz API; the canister build gets it from mini-gmp instead).
+#
+# The stable memory tests include the ic0 sources they exercise after
+# ic0_mock.h, which serves the ic0 stable memory calls from the heap.
+set -e
+
+SCRIPT_DIR="$(cd "$(dirname "$0")" && pwd)"
+PROJECT_DIR="$(dirname "$(dirname "$SCRIPT_DIR")")"
+REFC="$PROJECT_DIR/support/refc"
+IC0="$PROJECT_DIR/support/ic0"
+BUILD_DIR="${BUILD_DIR:-${TMPDIR:-/tmp}/idris2-wasm-host-tests}"
+CC="${CC:-cc}"
+
+# -Wno-attributes: the ic0 sources' Wasm import attributes
+CFLAGS="-std=c11 -D_POSIX_C_SOURCE=200809L -O1 -g -Wall -Wno-unused-function -Wno-attributes"
+if [ -n "$SANITIZE" ]; then
+    CFLAGS="$CFLAGS -fsanitize=address,undefined -fno-sanitize-recover=undefined"
+    export ASAN_OPTIONS="${ASAN_OPTIONS:-detect_leaks=0}"
+fi
+INCLUDES="-I$SCRIPT_DIR -I$SCRIPT_DIR/include -I$REFC -I$IC0"
+
+# Sources each test is linked with
+sources() {
+    case "$1" in
+        test_arrays) echo "$REFC"/*.c ;;
+        test_stkv) echo "$REFC/buffer.c $REFC/simdOps.c" ;;
+        test_stable_structs) echo "$IC0/ic_stable_structs.c $REFC/buffer.c $REFC/simdOps.c" ;;
+    esac
+}
+libs() {
+    case "$1" in
+        test_arrays) echo "-lgmp -lm" ;;
+    esac
+}
+
+TESTS="${*:-test_arrays test_bytes test_stable test_stkv test_stable_structs}"
+mkdir -p "$BUILD_DIR"
+failed=0
+for t in $TESTS; do
+    # shellcheck disable=SC2046
+    $CC $CFLAGS $INCLUDES "$SCRIPT_DIR/$t.c" $(sources "$t") -o "$BUILD_DIR/$t" $(libs "$t")
+    "$BUILD_DIR/$t" || failed=1
+done
+exit $failed
@@ -0,0 +1,43 @@
+/*
+ * Helpers shared by the tests that include ic_stkv.c (after ic0_mock.h and
+ * the sources): a random stream, an upgrade that drops the store's heap
+ * state, and packing of the length-prefixed lists the entry points take.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+static uint32_t seed = 2024;
+
+static uint32_t rnd(void) {
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+}
+
+/* An upgrade keeps stable memory and loses the heap */
+static void upgrade(void) {
+    ic_stable_flush();
+    ic_stable_cache_limit(-1);
+    size_known = 0;
+    stkv_initialized = 0;
+    idx_reset(0);
+}
+
+static Buffer* newList(void) {
+    return newBufferWithCapacity(0);
+}
+
+static void pack32(Buffer* b, uint32_t v) {
+    reserveBuffer(b, 4);
+    memcpy(b->data + b->size, &v, 4);
+    b->size += 4;
+}
+
+static void packBytes(Buffer* b, const void* p, uint32_t n) {
+    reserveBuffer(b, (int)n);
+    if (n > 0) memcpy(b->data + b->size, p, n);
+    b->size += (int)n;
+}
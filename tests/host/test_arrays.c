@@ -0,0 +1,92 @@
+/*
+ * DynArray updates (support/refc/arrays.c): a uniquely referenced array is
+ * updated in place, a shared one or one a slice borrows is copied and left
+ * as it was.
+ */
+#include "arrays.h"
+#include "check.h"
+
+static int64_t at(Value *a, int64_t i) {
+  Value *v = idris2_arrayIndex(a, i);
+  int64_t x = idris2_vp_to_Int64(v);
+  idris2_removeReference(v);
+  return x;
+}
+
+// The linear use WasmBuilder.Runtime.Array makes: the old array is dropped
+static Value *pushLinear(Value *a, int64_t x) {
+  Value *v = idris2_mkInt64(x);
+  Value *r = idris2_arrayPush(a, v);
+  idris2_removeReference(v);
+  idris2_removeReference(a);
+  return r;
+}
+
+static Value *setLinear(Value *a, int64_t i, int64_t x) {
+  Value *v = idris2_mkInt64(x);
+  Value *r = idris2_arraySet(a, i, v);
+  idris2_removeReference(v);
+  idris2_removeReference(a);
+  return r;
+}
+
+static void linearUpdatesInPlace(void) {
+  Value *a = idris2_arrayEmpty(0);
+  Value *first = a;
+  int moves = 0;
+  for (int64_t i = 0; i < 1000; i++) {
+    Value **storage = ((Value_Array *)a)->arr;
+    a = pushLinear(a, i);
+    CHECK(a == first);
+    moves += ((Value_Array *)a)->arr != storage;
+  }
+  CHECK(idris2_arrayLength(a) == 1000);
+  CHECK(moves <= 10); // capacity doubles: 8, 16, ..., 1024
+  for (int64_t i = 0; i < 1000; i += 7) {
+    a = setLinear(a, i, -i);
+    CHECK(a == first);
+  }
+  for (int64_t i = 0; i < 1000; i++)
+    CHECK(at(a, i) == (i % 7 == 0 ? -i : i));
+  idris2_removeReference(a);
+}
+
+static void sharedArraysAreCopied(void) {
+  Value *a = idris2_arrayEmpty(4);
+  for (int64_t i = 0; i < 20; i++)
+    a = pushLinear(a, i);
+  Value *other = idris2_newReference(a);
+
+  Value *v = idris2_mkInt64(99);
+  Value *b = idris2_arraySet(a, 3, v);
+  CHECK(b != a && at(b, 3) == 99 && at(a, 3) == 3);
+  Value *c = idris2_arrayPush(a, v);
+  CHECK(c != a && idris2_arrayLength(c) == 21 && idris2_arrayLength(a) == 20);
+  idris2_removeReference(b);
+  idris2_removeReference(c);
+  idris2_removeReference(other);
+
+  // a slice borrows the storage: its base is no longer updated in place
+  Value *s = idris2_arraySlice(a, 5, 10);
+  b = idris2_arraySet(a, 6, v);
+  CHECK(b != a && at(s, 1) == 6 && at(a, 6) == 6);
+  idris2_removeReference(b);
+  c = idris2_arrayPush(s, v);
+  CHECK(c != s && idris2_arrayLength(c) == 11 && at(c, 10) == 99);
+  CHECK(idris2_arrayLength(s) == 10 && at(a, 15) == 15);
+  idris2_removeReference(c);
+
+  // once the slice holds the only reference, it is updated in place
+  idris2_removeReference(a);
+  b = idris2_arraySet(s, 0, v);
+  CHECK(b == s && at(s, 0) == 99);
+  idris2_removeReference(b);
+  idris2_removeReference(s);
+  idris2_removeReference(v);
+}
+
+int main(void) {
+  linearUpdatesInPlace();
+  sharedArraysAreCopied();
+  return checkDone("test_arrays");
+}
@@ -0,0 +1,48 @@
+/*
+ * Bridge byte buffers (support/ic0/ic_bytes.h): payloads up to the message
+ * limit keep their terminator, and pinned storage never moves or goes away.
+ */
+#include "ic_bytes.h"
+#include "check.h"
+
+static void assignUpToTheLimit(void) {
+    ic_bytes b = {0};
+    CHECK(*ic_bytes_cstr(&b) == 0);
+
+    uint8_t* src = malloc(IC_BYTES_MAX + 1);
+    memset(src, 'x', IC_BYTES_MAX + 1);
+    CHECK(ic_bytes_assign(&b, src, IC_BYTES_MAX) == 0 && !b.overflow);
+    CHECK(b.len == IC_BYTES_MAX && b.data[IC_BYTES_MAX] == 0);
+    CHECK(ic_bytes_cstr(&b)[IC_BYTES_MAX - 1] == 'x');
+    CHECK(ic_bytes_assign(&b, src, IC_BYTES_MAX + 1) == -1 && b.overflow);
+    CHECK(b.len == IC_BYTES_MAX);
+
+    ic_bytes_clear(&b);
+    CHECK(ic_bytes_set_len(&b, IC_BYTES_MAX) == 0 && b.data[0] == 0);
+    CHECK(ic_bytes_cstr(&b)[IC_BYTES_MAX] == 0);
+    CHECK(ic_bytes_assign(&b, "", 0) == 0 && *ic_bytes_cstr(&b) == 0);
+    ic_bytes_reset(&b, 0);
+    CHECK(b.data == NULL && *ic_bytes_cstr(&b) == 0);
+    free(src);
+}
+
+static void pinnedStorageStays(void) {
+    ic_bytes b = {0};
+    ic_bytes_put(&b, 10, 1);
+    CHECK(ic_bytes_pin(&b) == 0 && b.cap == IC_BYTES_MAX);
+    uint8_t* view = b.data;
+    view[IC_BYTES_MAX - 1] = 7;
+
+    ic_bytes_reset(&b, 64);
+    CHECK(b.data == view && b.cap == IC_BYTES_MAX && b.len == 0);
+    CHECK(ic_bytes_set_len(&b, IC_BYTES_MAX) == 0 && b.data == view);
+    CHECK(ic_bytes_reserve(&b, IC_BYTES_MAX + 1) == -1 && b.data == view);
+    CHECK(ic_bytes_pin(&b) == 0 && b.data == view && b.hi == b.cap);
+    free(b.data);
+}
+
+int main(void) {
+    assignUpToTheLimit();
+    pinnedStorageStays();
+    return checkDone("test_bytes");
+}
@@ -0,0 +1,119 @@
+/*
+ * Stable memory page cache (support/ic0/ic_stable.c): cached reads and
+ * writes, evictions and direct transfers agree with a plain copy of stable
+ * memory, raw ic0 access stays coherent, and growth runs ahead of need.
+ */
+#include "ic0_mock.h"
+#include "ic_stable.c"
+#include "check.h"
+
+#define SIZE (4u << 20)
+
+static uint32_t seed = 12345;
+
+static uint32_t rnd(void) {
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+}
+
+/* An upgrade keeps stable memory and loses the heap */
+static void upgrade(void) {
+    ic_stable_flush();
+    ic_stable_cache_limit(-1);
+    size_known = 0;
+}
+
+/* Mostly small transfers, some across pages, a few past the cache */
+static uint32_t transferSize(void) {
+    uint32_t r = rnd() % 10;
+    if (r < 7) return 1 + rnd() % 64;
+    if (r < 9) return 100 + rnd() % 5000;
+    return IC_STABLE_DIRECT + rnd() % (3 * IC_STABLE_DIRECT);
+}
+
+static void cachedAccessMatchesStable(void) {
+    uint8_t* shadow = calloc(SIZE, 1);
+    uint8_t* buf = malloc(SIZE);
+    CHECK(ic_stable_reserve(SIZE) == 0 && ic_stable_capacity >= SIZE);
+
+    int32_t limits[] = {8, 0, 64, -1};
+    for (int round = 0; round < 4; round++) {
+        ic_stable_cache_limit(limits[round]);
+        for (int op = 0; op < 20000; op++) {
+            uint32_t n = transferSize();
+            uint32_t off = rnd() % (SIZE - n);
+            if (rnd() % 2) {
+                for (uint32_t i = 0; i < n; i++) buf[i] = (uint8_t)rnd();
+                ic_stable_write(off, buf, n);
+                memcpy(shadow + off, buf, n);
+            } else {
+                ic_stable_read(off, buf, n);
+                CHECK(memcmp(buf, shadow + off, n) == 0);
+            }
+            if (op % 5000 == 4999) {
+                ic_stable_flush();
+                CHECK(ic_stable_cache_stat(5) == 0);
+                CHECK(memcmp(mockStable, shadow, SIZE) == 0);
+            }
+        }
+        CHECK(ic_stable_cache_stat(4) <= (limits[round] < 0 ? IC_STABLE_PAGES : limits[round]));
+    }
+    CHECK(ic_stable_cache_stat(0) > 0 && ic_stable_cache_stat(2) > 0);
+
+    upgrade();
+    ic_stable_read(0, buf, SIZE);
+    CHECK(memcmp(buf, shadow, SIZE) == 0);
+    free(shadow);
+    free(buf);
+}
+
+/* What ic0_stubs.c does around a raw ic0.stable64_read / write */
+static void rawAccessIsCoherent(void) {
+    uint8_t a[100], b[100];
+    memset(a, 0xA5, sizeof a);
+    ic_stable_write(5000, a, sizeof a);
+    CHECK(mockStable[5000] != 0xA5);  /* still only in the cache */
+    ic_stable_sync(4096, 8192);
+    ic0_stable64_read_impl((uint64_t)(uintptr_t)b, 5000, sizeof b);
+    CHECK(memcmp(a, b, sizeof b) == 0);
+
+    memset(a, 0x3C, sizeof a);
+    ic0_stable64_write_impl(5050, (uint64_t)(uintptr_t)a, sizeof a);
+    ic_stable_patch(5050, a, sizeof a);
+    ic_stable_read(5000, b, sizeof b);
+    CHECK(b[0] == 0xA5 && b[49] == 0xA5 && b[50] == 0x3C && b[99] == 0x3C);
+    upgrade();
+}
+
+static void growthRunsAhead(void) {
+    mockStableErase();
+    upgrade();
+    CHECK(ic_stable_pages() == 0);
+    CHECK(ic_stable_ensure(1) == 0 && mockPages == IC_STABLE_GROW_MIN);
+    uint64_t grown = ic_stable_cache_stat(7);
+    for (uint64_t end = 1; end < 64ull << 20; end += 100000) {
+        CHECK(ic_stable_ensure(end) == 0);
+    }
+    CHECK(ic_stable_capacity >= 64ull << 20 && ic_stable_capacity == mockPages * MOCK_WASM_PAGE);
+    CHECK(ic_stable_cache_stat(7) - grown < 20);
+
+    /* Exactly to need when a chunk would not fit */
+    uint64_t pages = mockPages;
+    mockMaxPages = pages + 10;
+    CHECK(ic_stable_reserve(ic_stable_capacity + 1) == 0 && mockPages == pages + 1);
+    CHECK(ic_stable_reserve((pages + 10) * MOCK_WASM_PAGE) == 0 && mockPages == pages + 10);
+    CHECK(ic_stable_reserve((pages + 10) * MOCK_WASM_PAGE + 1) == -1);
+    CHECK(ic_stable_capacity == mockPages * MOCK_WASM_PAGE);
+    mockMaxPages = MOCK_MAX_PAGES;
+    mockStableErase();
+    upgrade();
+}
+
+int main(void) {
+    cachedAccessMatchesStable();
+    rawAccessIsCoherent();
+    growthRunsAhead();
+    return checkDone("test_stable");
+}
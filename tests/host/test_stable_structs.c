@@ -0,0 +1,327 @@
+/*
+ * Stable vectors, hash maps and logs (support/ic0/ic_stable_structs.c)
+ * against reference data, across upgrades, with the stkv store they borrow
+ * extents from compacting and clearing around them.
+ */
+#include "ic0_mock.h"
+#include "ic_stable.c"
+#include "ic_stkv.c"
+#include "ic_stable_structs.h"
+#include "check.h"
+#include "stable_test.h"
+
+#define VEC_LEN 140000  /* 8-byte elements: past the first 1 MiB chunk */
+#define WIDE 1000       /* bytes per element of the wide vector */
+#define WIDE_LEN 2500
+#define MAP_KEYS 20000
+#define LOG_LEN 1500
+
+/* ic_ffi_bridge.c's; only the structures benchmark calls it */
+int64_t ic_stable_read_i64(int64_t offset) {
+    uint8_t b[8];
+    ic_stable_read((uint64_t)offset, b, 8);
+    return (int64_t)ld64(b);
+}
+
+static Buffer* name(const char* s) {
+    Buffer* b = newList();
+    packBytes(b, s, (uint32_t)strlen(s));
+    return b;
+}
+
+/* stkv traffic in the same heap */
+static void kvNoise(int ops) {
+    for (int i = 0; i < ops; i++) {
+        char key[32];
+        uint8_t val[300];
+        int klen = snprintf(key, sizeof key, "noise%u", rnd() % 5000);
+        uint32_t vlen = rnd() % sizeof val;
+        memset(val, i, vlen);
+        if (rnd() % 4 == 0) {
+            stkv_delete((int64_t)(intptr_t)key, klen);
+        } else {
+            stkv_put((int64_t)(intptr_t)key, klen, (int64_t)(intptr_t)val, vlen);
+        }
+    }
+}
+
+/* =============================================================================
+ * Reference data
+ * ============================================================================= */
+
+static int64_t vecValue(int64_t i) {
+    return i * 3 + 1;
+}
+
+static uint8_t wideByte(int64_t i, int j) {
+    return (uint8_t)(i + j);
+}
+
+static int64_t mapKey[MAP_KEYS], mapVal[MAP_KEYS];
+static int mapHas[MAP_KEYS];
+
+static uint32_t logLen[LOG_LEN], logSeed[LOG_LEN];
+
+static void logBytes(uint8_t* p, uint32_t i, uint32_t n) {
+    for (uint32_t j = 0; j < n; j++) p[j] = (uint8_t)(logSeed[i] + j * 7);
+}
+
+typedef struct {
+    int64_t vec, wide, map, log;
+} handles;
+
+static void verify(handles h) {
+    CHECK(stvec_len(h.vec) == VEC_LEN);
+    for (int64_t i = 0; i < VEC_LEN; i += 1 + rnd() % 50) {
+        CHECK(stvec_get_i64(h.vec, i) == vecValue(i));
+    }
+    Buffer* out = newList();
+    CHECK(stvec_get(h.vec, 131000, 200, out) == 200 && out->size == 8 * 200);
+    for (int64_t i = 0; i < 200; i++) {
+        CHECK((int64_t)ld64((uint8_t*)out->data + 8 * i) == vecValue(131000 + i));
+    }
+    freeBuffer(out);
+
+    out = newList();
+    int64_t wide = stvec_len(h.wide);
+    CHECK(stvec_get(h.wide, 0, wide + 5, out) == wide && out->size == wide * WIDE);
+    int bad = 0;
+    for (int64_t i = 0; i < wide; i++) {
+        for (int j = 0; j < WIDE; j++) bad += (uint8_t)out->data[i * WIDE + j] != wideByte(i, j);
+    }
+    CHECK(bad == 0);
+    freeBuffer(out);
+
+    int64_t count = 0;
+    for (int i = 0; i < MAP_KEYS; i++) {
+        int64_t v = stmap_get_i64(h.map, mapKey[i], -7);
+        count += mapHas[i];
+        CHECK(mapHas[i] ? v == mapVal[i] : v == -7);
+    }
+    CHECK(stmap_len(h.map) == count);
+
+    CHECK(stlog_len(h.log) == LOG_LEN);
+    for (int64_t i = 0; i < LOG_LEN;) {
+        out = newList();
+        int64_t want = 1 + rnd() % 400;
+        int64_t r = stlog_read(h.log, i, want, out);
+        CHECK(r >= 1 && r <= want);
+        if (r < 1) break;
+        int pos = 0;
+        for (int64_t e = 0; e < r; e++) {
+            uint32_t len = ld32((uint8_t*)out->data + pos);
+            CHECK(len == logLen[i + e]);
+            uint8_t* expect = malloc(len + 1);
+            logBytes(expect, (uint32_t)(i + e), len);
+            CHECK(memcmp(out->data + pos + 4, expect, len) == 0);
+            free(expect);
+            pos += 4 + (int)len;
+        }
+        CHECK(pos == out->size);
+        freeBuffer(out);
+        i += r;
+    }
+}
+
+/* =============================================================================
+ * Building the structures
+ * ============================================================================= */
+
+static void fillVectors(handles h) {
+    for (int64_t i = 0; i < VEC_LEN; i++) {
+        CHECK(stvec_push_i64(h.vec, vecValue(i)) == i);
+        if (i % 20000 == 0) kvNoise(200);
+    }
+    CHECK(stvec_set_i64(h.vec, VEC_LEN, 0) == -1 && stvec_get_i64(h.vec, VEC_LEN) == 0);
+
+    Buffer* items = newList();
+    for (int i = 0; i < WIDE_LEN; i++) {
+        uint8_t e[WIDE];
+        for (int j = 0; j < WIDE; j++) e[j] = wideByte(i, j);
+        packBytes(items, e, WIDE);
+    }
+    CHECK(stvec_push(h.wide, items) == 0);
+    items->size = WIDE - 1;
+    CHECK(stvec_push(h.wide, items) == -1);  /* not whole elements */
+
+    /* A range across a chunk boundary (1048 elements per 1 MiB chunk) */
+    Buffer* range = newList();
+    for (int i = 1040; i < 1060; i++) {
+        uint8_t e[WIDE];
+        for (int j = 0; j < WIDE; j++) e[j] = wideByte(i, j);
+        packBytes(range, e, WIDE);
+    }
+    CHECK(stvec_set(h.wide, 1040, range) == 20);
+    CHECK(stvec_set(h.wide, WIDE_LEN - 10, range) == -1);  /* past the end */
+    freeBuffer(range);
+    freeBuffer(items);
+}
+
+static void fillMap(handles h) {
+    for (int i = 0; i < MAP_KEYS; i++) {
+        mapKey[i] = (int64_t)(((uint64_t)rnd() << 32) | rnd());
+        mapVal[i] = rnd();
+        mapHas[i] = 1;
+        CHECK(stmap_put_i64(h.map, mapKey[i], mapVal[i]) == 0);
+        if (i % 5000 == 0) kvNoise(100);
+    }
+    for (int i = 0; i < MAP_KEYS; i += 3) {
+        mapVal[i] = -mapVal[i];
+        CHECK(stmap_put_i64(h.map, mapKey[i], mapVal[i]) == 0);
+    }
+
+    Buffer* keys = newList();
+    for (int i = 0; i < MAP_KEYS; i += 2) {
+        packBytes(keys, &mapKey[i], 8);
+        mapHas[i] = 0;
+    }
+    CHECK(stmap_delete(h.map, keys) == MAP_KEYS / 2 && stmap_delete(h.map, keys) == 0);
+    freeBuffer(keys);
+
+    keys = newList();
+    Buffer* out = newList();
+    int64_t found = 0;
+    for (int i = 0; i < MAP_KEYS; i += 7) {
+        packBytes(keys, &mapKey[i], 8);
+        found += mapHas[i];
+    }
+    CHECK(stmap_get(h.map, keys, out) == found);
+    for (int i = 0; i < MAP_KEYS; i += 7) {
+        const uint8_t* r = (const uint8_t*)out->data + 9 * (i / 7);
+        CHECK(r[0] == mapHas[i] && (!mapHas[i] || (int64_t)ld64(r + 1) == mapVal[i]));
+    }
+    freeBuffer(keys);
+    freeBuffer(out);
+}
+
+/* Keys and values of odd sizes; of repeated keys in one list the last wins */
+static void oddSizedMap(void) {
+    int64_t m = stmap_new(20, 3);
+    Buffer* entries = newList();
+    for (int i = 0; i < 5000; i++) {
+        uint8_t k[20] = {0};
+        uint8_t v[3] = {(uint8_t)i, (uint8_t)(i >> 8), 7};
+        snprintf((char*)k, sizeof k, "key%d", i % 3000);
+        packBytes(entries, k, 20);
+        packBytes(entries, v, 3);
+    }
+    CHECK(stmap_put(m, entries) == 5000 && stmap_len(m) == 3000);
+    entries->size = 5;
+    CHECK(stmap_put(m, entries) == -1);
+    freeBuffer(entries);
+
+    Buffer* keys = newList();
+    Buffer* out = newList();
+    for (int i = 0; i < 3100; i++) {
+        uint8_t k[20] = {0};
+        snprintf((char*)k, sizeof k, "key%d", i);
+        packBytes(keys, k, 20);
+    }
+    CHECK(stmap_get(m, keys, out) == 3000);
+    for (int i = 0; i < 3100; i++) {
+        const uint8_t* r = (const uint8_t*)out->data + 4 * i;
+        int last = i + 3000 < 5000 ? i + 3000 : i;
+        if (i < 3000) {
+            CHECK(r[0] == 1 && r[1] == (uint8_t)last && r[2] == (uint8_t)(last >> 8) && r[3] == 7);
+        } else {
+            CHECK(r[0] == 0);
+        }
+    }
+    freeBuffer(keys);
+    freeBuffer(out);
+    CHECK(stds_drop(m) == 0);
+}
+
+static void fillLog(handles h) {
+    uint32_t n = 0;
+    while (n < LOG_LEN) {
+        Buffer* entries = newList();
+        uint32_t first = n;
+        for (int k = 1 + rnd() % 50; k > 0 && n < LOG_LEN; k--, n++) {
+            uint32_t len = rnd() % 300 == 0 ? 1000000 + rnd() % 1500000 : rnd() % 300;
+            logLen[n] = len;
+            logSeed[n] = rnd();
+            pack32(entries, len);
+            reserveBuffer(entries, (int)len);
+            logBytes((uint8_t*)entries->data + entries->size, n, len);
+            entries->size += (int)len;
+        }
+        CHECK(stlog_append(h.log, entries) == first);
+        freeBuffer(entries);
+        if (rnd() % 5 == 0) kvNoise(50);
+    }
+    Buffer* torn = newList();
+    pack32(torn, 10);
+    packBytes(torn, "abc", 3);
+    CHECK(stlog_append(h.log, torn) == -1 && stlog_len(h.log) == LOG_LEN);
+    freeBuffer(torn);
+}
+
+/* =============================================================================
+ * Tests
+ * ============================================================================= */
+
+static void badHandles(void) {
+    CHECK(stvec_len(12345) == -1 && stmap_len(0) == -1 && stlog_len(26 * 65536) == -1);
+    CHECK(stvec_new(0) == 0 && stvec_new(65537) == 0 && stmap_new(0, 1) == 0);
+}
+
+static void structuresSurviveUpgrades(void) {
+    handles h = {stvec_new(8), stvec_new(WIDE), stmap_new(8, 8), stlog_new()};
+    CHECK(h.vec != 0 && h.wide != 0 && h.map != 0 && h.log != 0);
+    CHECK(stvec_len(h.map) == -1 && stmap_len(h.vec) == -1 && stlog_len(h.vec) == -1);
+    fillVectors(h);
+    fillMap(h);
+    oddSizedMap();
+    fillLog(h);
+    verify(h);
+
+    Buffer* nv = name("vec");
+    Buffer* nw = name("wide");
+    Buffer* nm = name("map");
+    Buffer* nl = name("log");
+    CHECK(stds_root_get(nv) == 0);
+    CHECK(stds_root_set(nv, h.vec) == 0 && stds_root_set(nw, h.wide) == 0 &&
+          stds_root_set(nm, h.map) == 0 && stds_root_set(nl, h.log) == 0);
+    upgrade();
+    handles back = {stds_root_get(nv), stds_root_get(nw), stds_root_get(nm), stds_root_get(nl)};
+    CHECK(back.vec == h.vec && back.wide == h.wide && back.map == h.map && back.log == h.log);
+    verify(h);
+
+    /* Compaction and clearing the store leave the structures alone */
+    for (int i = 0; i < 100; i++) {
+        kvNoise(100);
+        stkv_compact(0);
+    }
+    verify(h);
+    stkv_clear();
+    CHECK(stkv_count_entries() == 0 && stds_root_get(nv) == 0);
+    kvNoise(2000);
+    verify(h);
+    upgrade();
+    verify(h);
+
+    /* Truncating frees whole chunks; dropping frees everything */
+    uint64_t freed = st.free_extents;
+    CHECK(stvec_truncate(h.vec, 1000) == 0 && stvec_len(h.vec) == 1000);
+    CHECK(st.free_extents > freed && stvec_get_i64(h.vec, 999) == vecValue(999));
+    CHECK(stvec_push_i64(h.vec, 77) == 1000 && stvec_get_i64(h.vec, 1000) == 77);
+    CHECK(stds_drop(h.map) == 0 && stmap_len(h.map) == -1 && stds_drop(h.map) == -1);
+    CHECK(stds_drop(h.log) == 0 && stds_drop(h.wide) == 0);
+    stkv_clear();
+    CHECK(stvec_get_i64(h.vec, 1000) == 77);
+    CHECK(stds_drop(h.vec) == 0);
+    stkv_clear();
+    CHECK(st.next_extent == st.heap_start);
+
+    freeBuffer(nv);
+    freeBuffer(nw);
+    freeBuffer(nm);
+    freeBuffer(nl);
+}
+
+int main(void) {
+    badHandles();
+    structuresSurviveUpgrades();
+    return checkDone("test_stable_structs");
+}
@@ -0,0 +1,679 @@
+/*
+ * Stable KV store (support/ic0/ic_stkv.c) against a reference map: single
+ * and batched puts, gets and deletes, range and prefix scans, compaction
+ * and atomic batches, with upgrades in between, and the migration of a
+ * format 1 image.
+ */
+#include "ic0_mock.h"
+#include "ic_stable.c"
+#include "ic_stkv.c"
+#include "check.h"
+#include "stable_test.h"
+
+#define KEYS 3000  /* key ids in use; ids past it are never stored */
+
+/* =============================================================================
+ * Keys, values and packed lists
+ * ============================================================================= */
+
+static uint8_t keyBuf[2048];
+static uint8_t valBuf[6u << 20];  /* room for the largest value stored */
+
+/* Key `id`: "a/".."d/", the id, then filler; every 37th is past the
+ * inline part of a node cell */
+static uint32_t makeKey(uint32_t id, uint8_t* out) {
+    uint32_t len = id % 37 == 0 ? 1100 + id % 500 : 6 + id % 20;
+    out[0] = (uint8_t)('a' + id % 4);
+    out[1] = '/';
+    out[2] = (uint8_t)(id >> 24);
+    out[3] = (uint8_t)(id >> 16);
+    out[4] = (uint8_t)(id >> 8);
+    out[5] = (uint8_t)id;
+    for (uint32_t i = 6; i < len; i++) out[i] = (uint8_t)(id * 31 + i);
+    return len;
+}
+
+/* Mostly small values, now and then one spanning several extents */
+static uint32_t makeValue(uint8_t* out) {
+    uint32_t len = rnd() % 150 == 0 ? 70000 + rnd() % 100000 : rnd() % 200;
+    for (uint32_t i = 0; i < len; i++) out[i] = (uint8_t)rnd();
+    return len;
+}
+
+static Buffer* bytesBuffer(const void* p, uint32_t n) {
+    Buffer* b = newList();
+    packBytes(b, p, n);
+    return b;
+}
+
+/* =============================================================================
+ * Reference map: entries in key order
+ * ============================================================================= */
+
+typedef struct {
+    uint8_t* key;
+    uint8_t* val;
+    uint32_t klen;
+    uint32_t vlen;
+} entry;
+
+typedef struct {
+    entry* e;
+    size_t n;
+    size_t cap;
+} refmap;
+
+static int refCmp(const uint8_t* a, uint32_t alen, const uint8_t* b, uint32_t blen) {
+    int c = memcmp(a, b, alen < blen ? alen : blen);
+    if (c != 0) return c;
+    return alen < blen ? -1 : alen > blen;
+}
+
+static uint8_t* dup(const void* p, uint32_t n) {
+    uint8_t* d = malloc(n + 1);
+    memcpy(d, p, n);
+    return d;
+}
+
+/* Index of the key, or of where it would go */
+static size_t refFind(const refmap* m, const uint8_t* k, uint32_t klen, int* found) {
+    size_t lo = 0, hi = m->n;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        int c = refCmp(m->e[mid].key, m->e[mid].klen, k, klen);
+        if (c == 0) {
+            *found = 1;
+            return mid;
+        }
+        if (c < 0) lo = mid + 1; else hi = mid;
+    }
+    *found = 0;
+    return lo;
+}
+
+static const entry* refGet(const refmap* m, const uint8_t* k, uint32_t klen) {
+    int found;
+    size_t i = refFind(m, k, klen, &found);
+    return found ? &m->e[i] : NULL;
+}
+
+static void refPut(refmap* m, const uint8_t* k, uint32_t klen, const uint8_t* v, uint32_t vlen) {
+    int found;
+    size_t i = refFind(m, k, klen, &found);
+    if (found) {
+        free(m->e[i].val);
+    } else {
+        if (m->n == m->cap) {
+            m->cap = m->cap ? 2 * m->cap : 256;
+            m->e = realloc(m->e, m->cap * sizeof(entry));
+        }
+        memmove(&m->e[i + 1], &m->e[i], (m->n - i) * sizeof(entry));
+        m->n++;
+        m->e[i].key = dup(k, klen);
+        m->e[i].klen = klen;
+    }
+    m->e[i].val = dup(v, vlen);
+    m->e[i].vlen = vlen;
+}
+
+static void refDelete(refmap* m, const uint8_t* k, uint32_t klen) {
+    int found;
+    size_t i = refFind(m, k, klen, &found);
+    if (!found) return;
+    free(m->e[i].key);
+    free(m->e[i].val);
+    memmove(&m->e[i], &m->e[i + 1], (m->n - i - 1) * sizeof(entry));
+    m->n--;
+}
+
+static void refFree(refmap* m) {
+    for (size_t i = 0; i < m->n; i++) {
+        free(m->e[i].key);
+        free(m->e[i].val);
+    }
+    free(m->e);
+    memset(m, 0, sizeof *m);
+}
+
+static void refCopy(refmap* dst, const refmap* src) {
+    refFree(dst);
+    for (size_t i = 0; i < src->n; i++) {
+        const entry* e = &src->e[i];
+        refPut(dst, e->key, e->klen, e->val, e->vlen);
+    }
+}
+
+/* =============================================================================
+ * Checks
+ * ============================================================================= */
+
+static int64_t get(const uint8_t* k, uint32_t klen, uint8_t* out, int64_t max) {
+    return stkv_get((int64_t)(intptr_t)k, klen, (int64_t)(intptr_t)out, max);
+}
+
+static void verifyAll(const refmap* m) {
+    for (size_t i = 0; i < m->n; i++) {
+        const entry* e = &m->e[i];
+        int64_t n = get(e->key, e->klen, valBuf, sizeof valBuf);
+        CHECK(n == e->vlen && memcmp(valBuf, e->val, e->vlen) == 0);
+    }
+    for (uint32_t id = KEYS; id < KEYS + 50; id++) {
+        uint32_t klen = makeKey(id, keyBuf);
+        CHECK(get(keyBuf, klen, valBuf, sizeof valBuf) == -1);
+    }
+    CHECK(stkv_count_entries() == (int64_t)m->n && stkv_stat(0) == (int64_t)m->n);
+}
+
+/* Whether entry `e` belongs to a scan from `from` (past it with `after`)
+ * below `to` (none if empty) of keys starting with `prefix` (if any) */
+static int inScan(const entry* e, Buffer* from, int after, Buffer* to, Buffer* prefix) {
+    int c = refCmp(e->key, e->klen, (uint8_t*)from->data, (uint32_t)from->size);
+    if (c < 0 || (c == 0 && after)) return 0;
+    if (to->size > 0 && refCmp(e->key, e->klen, (uint8_t*)to->data, (uint32_t)to->size) >= 0) {
+        return 0;
+    }
+    if (prefix != NULL && (e->klen < (uint32_t)prefix->size ||
+                           memcmp(e->key, prefix->data, (size_t)prefix->size) != 0)) {
+        return 0;
+    }
+    return 1;
+}
+
+/* Page through a scan, checking every entry against the reference */
+static void scanCheck(const refmap* m, Buffer* prefix, Buffer* from, Buffer* to, int64_t limit) {
+    size_t next = 0;
+    while (next < m->n && !inScan(&m->e[next], from, 0, to, prefix)) next++;
+    Buffer* cursor = bytesBuffer(from->data, (uint32_t)from->size);
+    int after = 0;
+    for (;;) {
+        Buffer* out = newList();
+        int64_t r = prefix != NULL ? stkv_scan_prefix(prefix, cursor, after, limit, out)
+                                   : stkv_scan(cursor, after, to, limit, out);
+        CHECK(r >= 0);
+        int64_t count = r & 0xFFFFFFFF;
+        CHECK(limit <= 0 || count <= limit);
+        const uint8_t* p = (const uint8_t*)out->data;
+        const uint8_t* end = p + out->size;
+        for (int64_t i = 0; i < count && p + 8 <= end; i++) {
+            uint32_t klen = ld32(p);
+            uint32_t vlen = ld32(p + 4);
+            CHECK(next < m->n && inScan(&m->e[next], from, 0, to, prefix));
+            if (next < m->n) {
+                const entry* e = &m->e[next];
+                CHECK(klen == e->klen && vlen == e->vlen && memcmp(p + 8, e->key, klen) == 0 &&
+                      memcmp(p + 8 + klen, e->val, vlen) == 0);
+            }
+            next++;
+            if (i == count - 1) {
+                cursor->size = 0;
+                packBytes(cursor, p + 8, klen);
+            }
+            p += 8 + klen + vlen;
+        }
+        CHECK(p == end);
+        freeBuffer(out);
+        if (!(r & STKV_SCAN_MORE)) break;
+        CHECK(count > 0);
+        after = 1;
+    }
+    CHECK(next == m->n || !inScan(&m->e[next], from, 0, to, prefix));
+    freeBuffer(cursor);
+}
+
+static void verifyScans(const refmap* m) {
+    Buffer* empty = newList();
+    scanCheck(m, NULL, empty, empty, 0);
+    scanCheck(m, NULL, empty, empty, 1 + rnd() % 300);
+    if (m->n > 2) {
+        const entry* lo = &m->e[rnd() % (m->n / 2)];
+        const entry* hi = &m->e[m->n / 2 + rnd() % (m->n / 2)];
+        Buffer* from = bytesBuffer(lo->key, lo->klen);
+        Buffer* to = bytesBuffer(hi->key, hi->klen);
+        scanCheck(m, NULL, from, to, 1 + rnd() % 100);
+        scanCheck(m, NULL, to, from, 0);  /* empty range */
+        freeBuffer(from);
+        freeBuffer(to);
+    }
+    for (uint8_t group = 'a'; group <= 'e'; group++) {
+        uint8_t p[3] = {group, '/', 0};
+        Buffer* prefix = bytesBuffer(p, 2 + (group == 'b'));
+        scanCheck(m, prefix, empty, empty, 1 + rnd() % 200);
+        if (m->n > 0) {
+            const entry* e = &m->e[rnd() % m->n];
+            Buffer* from = bytesBuffer(e->key, e->klen);
+            scanCheck(m, prefix, from, empty, 0);
+            freeBuffer(from);
+        }
+        freeBuffer(prefix);
+    }
+    freeBuffer(empty);
+}
+
+/* =============================================================================
+ * Workloads
+ * ============================================================================= */
+
+static void putManyCheck(refmap* m) {
+    Buffer* list = newList();
+    uint32_t n = 1 + rnd() % 40;
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t klen = makeKey(rnd() % KEYS, keyBuf);
+        uint32_t vlen = makeValue(valBuf);
+        pack32(list, klen);
+        pack32(list, vlen);
+        packBytes(list, keyBuf, klen);
+        packBytes(list, valBuf, vlen);
+        refPut(m, keyBuf, klen, valBuf, vlen);  /* of repeated keys the last wins */
+    }
+    CHECK(stkv_put_many(list) == n);
+    freeBuffer(list);
+}
+
+static void getManyCheck(const refmap* m) {
+    Buffer* keys = newList();
+    uint32_t n = 1 + rnd() % 60;
+    uint32_t* ids = malloc(n * sizeof *ids);
+    int64_t found = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        ids[i] = rnd() % (KEYS + 100);
+        uint32_t klen = makeKey(ids[i], keyBuf);
+        pack32(keys, klen);
+        packBytes(keys, keyBuf, klen);
+        found += refGet(m, keyBuf, klen) != NULL;
+    }
+    Buffer* out = newList();
+    packBytes(out, "xyz", 3);  /* results are appended */
+    CHECK(stkv_get_many(keys, out) == found);
+    const uint8_t* p = (const uint8_t*)out->data + 3;
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t klen = makeKey(ids[i], keyBuf);
+        const entry* e = refGet(m, keyBuf, klen);
+        uint32_t vlen = ld32(p);
+        if (e == NULL) {
+            CHECK(vlen == 0xFFFFFFFFu);
+            p += 4;
+        } else {
+            CHECK(vlen == e->vlen && memcmp(p + 4, e->val, vlen) == 0);
+            p += 4 + vlen;
+        }
+    }
+    CHECK(p == (const uint8_t*)out->data + out->size && memcmp(out->data, "xyz", 3) == 0);
+    free(ids);
+    freeBuffer(keys);
+    freeBuffer(out);
+}
+
+static void randomOps(refmap* m, int ops) {
+    for (int op = 0; op < ops; op++) {
+        uint32_t r = rnd() % 10;
+        uint32_t klen = makeKey(rnd() % KEYS, keyBuf);
+        if (r < 4) {
+            uint32_t vlen = makeValue(valBuf);
+            CHECK(stkv_put((int64_t)(intptr_t)keyBuf, klen, (int64_t)(intptr_t)valBuf, vlen) == 0);
+            refPut(m, keyBuf, klen, valBuf, vlen);
+        } else if (r < 6) {
+            CHECK(stkv_delete((int64_t)(intptr_t)keyBuf, klen) == 0);
+            refDelete(m, keyBuf, klen);
+        } else if (r == 6) {
+            putManyCheck(m);
+        } else if (r == 7) {
+            getManyCheck(m);
+        } else if (r == 8) {
+            const entry* e = refGet(m, keyBuf, klen);
+            uint8_t small[4];
+            int64_t n = get(keyBuf, klen, small, sizeof small);
+            CHECK(e == NULL ? n == -1 : n == e->vlen);
+            if (e != NULL) CHECK(memcmp(small, e->val, e->vlen < 4 ? e->vlen : 4) == 0);
+        } else if (rnd() % 20 == 0) {
+            upgrade();
+        } else {
+            stkv_compact(1 + rnd() % (1u << 20));
+        }
+    }
+}
+
+static void emptyStore(void) {
+    Buffer* empty = newList();
+    Buffer* out = newList();
+    CHECK(stkv_count_entries() == 0 && get((const uint8_t*)"k", 1, valBuf, 8) == -1);
+    CHECK(stkv_get_many(empty, out) == 0 && out->size == 0);
+    CHECK(stkv_put_many(empty) == 0);
+    CHECK(stkv_scan(empty, 0, empty, 0, out) == 0 && out->size == 0);
+    CHECK(stkv_scan_prefix(empty, empty, 0, 0, out) == 0);
+    CHECK(stkv_batch_commit() == -1 && stkv_batch_pending() == -1);
+    CHECK(stkv_recover() == 0 && stkv_compact(0) == 0);
+    freeBuffer(empty);
+    freeBuffer(out);
+}
+
+static void storeMatchesReference(refmap* m) {
+    for (int round = 0; round < 6; round++) {
+        randomOps(m, 1500);
+        verifyAll(m);
+        verifyScans(m);
+        upgrade();
+        verifyAll(m);
+    }
+    while (stkv_compact(1u << 30) != 0) {}
+    verifyAll(m);
+    CHECK(stkv_stat(1) > 0 && stkv_stat(5) >= stkv_stat(2) + stkv_stat(3));
+}
+
+/* Stage random operations into `staged`; how many */
+static int64_t stage(refmap* staged, int ops) {
+    int64_t n = 0;
+    for (int op = 0; op < ops; op++) {
+        uint32_t klen = makeKey(rnd() % KEYS, keyBuf);
+        uint32_t r = rnd() % 4;
+        if (r == 0) {
+            CHECK(stkv_batch_delete((int64_t)(intptr_t)keyBuf, klen) == 0);
+            refDelete(staged, keyBuf, klen);
+        } else if (r == 1) {
+            Buffer* keys = newList();
+            pack32(keys, klen);
+            packBytes(keys, keyBuf, klen);
+            CHECK(stkv_batch_delete_many(keys) == 1);
+            refDelete(staged, keyBuf, klen);
+            freeBuffer(keys);
+        } else if (r == 2) {
+            uint32_t vlen = makeValue(valBuf);
+            CHECK(stkv_batch_put((int64_t)(intptr_t)keyBuf, klen,
+                                 (int64_t)(intptr_t)valBuf, vlen) == 0);
+            refPut(staged, keyBuf, klen, valBuf, vlen);
+        } else {
+            Buffer* list = newList();
+            uint32_t vlen = makeValue(valBuf);
+            pack32(list, klen);
+            pack32(list, vlen);
+            packBytes(list, keyBuf, klen);
+            packBytes(list, valBuf, vlen);
+            CHECK(stkv_batch_put_many(list) == 1);
+            refPut(staged, keyBuf, klen, valBuf, vlen);
+            freeBuffer(list);
+        }
+        n++;
+    }
+    return n;
+}
+
+/* Flip a byte of the last record in the batch log, as a torn write would */
+static void damageLastRecord(void) {
+    ic_stable_flush();
+    uint64_t run = wal_get(st.wal, WAL_TAIL);
+    uint64_t used = wal_get(run, WAL_USED);
+    uint64_t last = WAL_RUN_HEADER;
+    for (uint64_t pos = WAL_RUN_HEADER; pos < used;) {
+        uint8_t h[WAL_REC_HEADER];
+        sm_read(run + pos, h, WAL_REC_HEADER);
+        last = pos;
+        pos += WAL_REC_HEADER + (uint64_t)ld32(h + 8) + ld32(h + 12);
+    }
+    mockStable[run + last + WAL_REC_HEADER] ^= 0x40;
+}
+
+static void batchesAreAtomic(refmap* m) {
+    refmap staged = {0};
+    for (int round = 0; round < 6; round++) {
+        refCopy(&staged, m);
+        CHECK(stkv_batch_begin() == 0 && stkv_batch_begin() == -1);
+        int64_t total = 0;
+        for (int msg = 0; msg < 3; msg++) {
+            total += stage(&staged, 100 + rnd() % 300);
+            CHECK(stkv_batch_pending() == total);
+            verifyAll(m);  /* staged operations stay invisible */
+            if (msg == 1 && round % 2 == 0) {
+                upgrade();
+                CHECK(stkv_recover() == 0 && stkv_batch_pending() == total);
+            }
+        }
+        switch (round % 3) {
+            case 0:
+                CHECK(stkv_batch_commit() == total);
+                refCopy(m, &staged);
+                break;
+            case 1:
+                stkv_batch_abort();
+                break;
+            case 2: {
+                /* the damaged last record goes, the rest commits */
+                uint32_t klen = makeKey(KEYS + 60 + round, keyBuf);
+                CHECK(stkv_batch_put((int64_t)(intptr_t)keyBuf, klen,
+                                     (int64_t)(intptr_t)"v", 1) == 0);
+                damageLastRecord();
+                upgrade();
+                CHECK(stkv_recover() == 0 && stkv_batch_pending() == total);
+                CHECK(stkv_batch_commit() == total);
+                refCopy(m, &staged);
+                break;
+            }
+        }
+        CHECK(stkv_batch_pending() == -1);
+        verifyAll(m);
+        upgrade();
+        verifyAll(m);
+    }
+    refFree(&staged);
+
+    /* Past the record limit */
+    CHECK(stkv_batch_begin() == 0);
+    Buffer* list = newList();
+    for (uint32_t i = 0; i < STKV_BATCH_MAX_RECORDS; i++) {
+        uint32_t klen = makeKey(KEYS + 100 + i, keyBuf);
+        pack32(list, klen);
+        pack32(list, 0);
+        packBytes(list, keyBuf, klen);
+    }
+    CHECK(stkv_batch_put_many(list) == STKV_BATCH_MAX_RECORDS);
+    CHECK(stkv_batch_delete((int64_t)(intptr_t)keyBuf, 1) == -1);
+    CHECK(stkv_batch_pending() == STKV_BATCH_MAX_RECORDS);
+    stkv_batch_abort();
+    freeBuffer(list);
+
+    /* Past the byte limit; a list that does not fit is staged not at all */
+    CHECK(stkv_batch_begin() == 0);
+    uint32_t big = 5u << 20;
+    uint8_t* value = calloc(big, 1);
+    CHECK(stkv_batch_put((int64_t)(intptr_t)"big", 3, (int64_t)(intptr_t)value, big) == 0);
+    list = newList();
+    pack32(list, 1);
+    pack32(list, 0);
+    packBytes(list, "x", 1);
+    pack32(list, 4);
+    pack32(list, big);
+    packBytes(list, "big2", 4);
+    packBytes(list, value, big);
+    CHECK(stkv_batch_put_many(list) == -1 && stkv_batch_pending() == 1);
+    CHECK(stkv_batch_commit() == 1);
+    refPut(m, (const uint8_t*)"big", 3, value, big);
+    verifyAll(m);
+    free(value);
+    freeBuffer(list);
+}
+
+/* A format 1 image: [key_len, key, val_len, val] records from offset 12,
+ * later ones replacing earlier ones, the count at 4 and the end at 8 */
+static void migrationFromFormat1(void) {
+    upgrade();
+    mockStableErase();
+    size_known = 0;
+    refmap m = {0};
+    ic0_stable64_grow_impl(4);
+    memcpy(mockStable, "STKV", 4);
+    uint32_t end = 12, count = 0;
+    for (uint32_t i = 0; i < 600; i++) {
+        uint32_t id = i < 500 ? i * 5 : (i - 500) * 3;
+        uint32_t klen = makeKey(id, keyBuf);
+        uint32_t vlen = rnd() % 300;
+        for (uint32_t j = 0; j < vlen; j++) valBuf[j] = (uint8_t)rnd();
+        memcpy(mockStable + end, &klen, 4);
+        memcpy(mockStable + end + 4, keyBuf, klen);
+        memcpy(mockStable + end + 4 + klen, &vlen, 4);
+        memcpy(mockStable + end + 8 + klen, valBuf, vlen);
+        end += 8 + klen + vlen;
+        count++;
+        refPut(&m, keyBuf, klen, valBuf, vlen);
+    }
+    memcpy(mockStable + 4, &count, 4);
+    memcpy(mockStable + 8, &end, 4);
+
+    verifyAll(&m);
+    verifyScans(&m);
+    ic_stable_flush();
+    CHECK(memcmp(mockStable, stkv_magic, 4) == 0 && ld32(mockStable + 4) == STKV_FORMAT);
+    upgrade();
+    verifyAll(&m);
+    randomOps(&m, 500);
+    upgrade();
+    verifyAll(&m);
+    refFree(&m);
+}
+
+/* A key whose separators are as long as the key: past the inline part of
+ * a cell, so that a leaf split needs overflow nodes too */
+static uint32_t longKey(uint8_t* out) {
+    uint32_t id = rnd();
+    memset(out, 'k', 1496);
+    memcpy(out + 1496, &id, 4);
+    return 1500;
+}
+
+/* Nodes kept from the store while stable memory cannot grow */
+static uint64_t* heldNodes = NULL;
+static size_t heldCount = 0, heldCap = 0;
+
+/* Stop stable memory growing and take every node there is but `spare` */
+static void holdNodes(uint32_t spare) {
+    stkv_enter();  /* the store's state, if an upgrade dropped it */
+    mockMaxPages = mockPages;
+    for (uint64_t off; (off = alloc_node()) != 0; heldNodes[heldCount++] = off) {
+        if (heldCount == heldCap) {
+            heldCap = heldCap ? 2 * heldCap : 1024;
+            heldNodes = realloc(heldNodes, heldCap * sizeof *heldNodes);
+        }
+    }
+    for (; spare > 0 && heldCount > 0; spare--) free_node(heldNodes[--heldCount]);
+}
+
+static void releaseNodes(void) {
+    mockMaxPages = MOCK_MAX_PAGES;
+    while (heldCount > 0) free_node(heldNodes[--heldCount]);
+}
+
+/* A fresh store of long keys a few levels deep, growing stable memory only
+ * as far as it needs, with lookups walking the tree */
+static void longKeyStore(refmap* m) {
+    upgrade();
+    mockStableErase();
+    size_known = 0;
+    stkv_index_limit(0);
+    ic_stable_grow_policy(1, 1);
+    for (int i = 0; i < 300; i++) {
+        uint32_t klen = longKey(keyBuf);
+        CHECK(stkv_put((int64_t)(intptr_t)keyBuf, klen, (int64_t)(intptr_t)"v", 1) == 0);
+        refPut(m, keyBuf, klen, (const uint8_t*)"v", 1);
+    }
+    CHECK(st.height >= 3);
+}
+
+static void endLongKeyStore(refmap* m) {
+    verifyAll(m);
+    stkv_index_limit(-1);
+    ic_stable_grow_policy(IC_STABLE_GROW_MIN, IC_STABLE_GROW_MAX);
+    refFree(m);
+}
+
+/* Puts with only `spare` more nodes to be had, for every `spare` a split
+ * may need: a put that fails leaves the tree as it was, so every put that
+ * succeeded is still there */
+static void outOfNodes(void) {
+    refmap m = {0};
+    longKeyStore(&m);
+    int failed = 0;
+    for (int trial = 0; trial < 600; trial++) {
+        holdNodes((uint32_t)trial % (st.height + 4));
+        uint32_t klen = longKey(keyBuf);
+        uint32_t vlen = rnd() % 100;
+        for (uint32_t j = 0; j < vlen; j++) valBuf[j] = (uint8_t)rnd();
+        if (stkv_put((int64_t)(intptr_t)keyBuf, klen, (int64_t)(intptr_t)valBuf, vlen) == 0) {
+            refPut(&m, keyBuf, klen, valBuf, vlen);
+        } else {
+            failed++;
+        }
+        releaseNodes();
+
+        /* and one that can take what it needs */
+        klen = longKey(keyBuf);
+        CHECK(stkv_put((int64_t)(intptr_t)keyBuf, klen, (int64_t)(intptr_t)"w", 1) == 0);
+        refPut(&m, keyBuf, klen, (const uint8_t*)"w", 1);
+        if (trial % 100 == 99) {
+            verifyAll(&m);
+            upgrade();
+        }
+    }
+    CHECK(failed > 0);
+    endLongKeyStore(&m);
+}
+
+/* A put_many that runs out stores the entries before the failing key, in
+ * key order, and none from it on */
+static void putManyOutOfNodes(void) {
+    refmap m = {0};
+    longKeyStore(&m);
+    int failed = 0;
+    for (int trial = 0; trial < 200; trial++) {
+        refmap list = {0};
+        Buffer* entries = newList();
+        for (int i = 0; i < 10; i++) {
+            uint32_t klen = longKey(keyBuf);
+            uint32_t vlen = rnd() % 100;
+            for (uint32_t j = 0; j < vlen; j++) valBuf[j] = (uint8_t)rnd();
+            pack32(entries, klen);
+            pack32(entries, vlen);
+            packBytes(entries, keyBuf, klen);
+            packBytes(entries, valBuf, vlen);
+            refPut(&list, keyBuf, klen, valBuf, vlen);
+        }
+        holdNodes((uint32_t)trial % (2 * st.height + 4));
+        int64_t r = stkv_put_many(entries);
+        releaseNodes();
+        CHECK(r == 10 || r == -1);
+        failed += r == -1;
+
+        size_t stored = 0;
+        while (stored < list.n &&
+               get(list.e[stored].key, list.e[stored].klen, valBuf, sizeof valBuf) >= 0) {
+            stored++;
+        }
+        CHECK(r == -1 || stored == list.n);
+        for (size_t i = 0; i < list.n; i++) {
+            const entry* e = &list.e[i];
+            if (i < stored) refPut(&m, e->key, e->klen, e->val, e->vlen);
+            else CHECK(get(e->key, e->klen, valBuf, sizeof valBuf) == -1);
+        }
+        refFree(&list);
+        freeBuffer(entries);
+
+        uint32_t klen = longKey(keyBuf);
+        CHECK(stkv_put((int64_t)(intptr_t)keyBuf, klen, (int64_t)(intptr_t)"w", 1) == 0);
+        refPut(&m, keyBuf, klen, (const uint8_t*)"w", 1);
+        if (trial % 50 == 49) {
+            verifyAll(&m);
+            upgrade();
+        }
+    }
+    CHECK(failed > 0);
+    endLongKeyStore(&m);
+}
+
+int main(void) {
+    refmap m = {0};
+    emptyStore();
+    storeMatchesReference(&m);
+    batchesAreAtomic(&m);
+    verifyScans(&m);
+    refFree(&m);
+    migrationFromFormat1();
+    outOfNodes();
+    putManyOutOfNodes();
+    return checkDone("test_stkv");
+}